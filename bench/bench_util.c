@@ -0,0 +1,168 @@
+/*
+ * bench_util.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include "bench_util.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+
+/****************************************************************************
+ * Defines
+****************************************************************************/
+#define TSC_CALIBRATION_NS  50000000     // 50 ms
+
+
+/****************************************************************************
+ * Clock state
+****************************************************************************/
+static bench_clock_t g_clock = BENCH_CLOCK_MONOTONIC;
+static double g_tsc_ns_per_tick = 0.0;
+
+
+/****************************************************************************
+ * Static Function Prototypes
+****************************************************************************/
+static uint64_t monotonic_ns(void);
+static int compare_u64(const void *a, const void *b);
+
+
+/****************************************************************************
+ * Static Function Implementations
+****************************************************************************/
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+
+/****************************************************************************
+ * Function Implementations
+****************************************************************************/
+
+/**
+ * @brief Select the clock used by bench_now_ns, calibrates the TSC if needed
+ *
+ * @param clock Clock source
+ * @return 0 when successful, -1 if the clock is not available
+ */
+int bench_clock_init(bench_clock_t clock) {
+
+    if(clock == BENCH_CLOCK_MONOTONIC) {
+        g_clock = clock;
+        return 0;
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    uint64_t t0 = monotonic_ns();
+    uint64_t c0 = __rdtsc();
+    while(monotonic_ns() - t0 < TSC_CALIBRATION_NS) {
+        // Spin, sleeping would let the core clock down on non-invariant TSCs
+    }
+    uint64_t t1 = monotonic_ns();
+    uint64_t c1 = __rdtsc();
+
+    g_tsc_ns_per_tick = (double) (t1 - t0) / (double) (c1 - c0);
+    g_clock = BENCH_CLOCK_TSC;
+    return 0;
+#else
+    printf("TSC clock not available on this architecture\n");
+    return -1;
+#endif
+}
+
+
+/**
+ * @brief Current time of the selected clock in ns
+ */
+uint64_t bench_now_ns(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    if(g_clock == BENCH_CLOCK_TSC) {
+        return (uint64_t) ((double) __rdtsc() * g_tsc_ns_per_tick);
+    }
+#endif
+    return monotonic_ns();
+}
+
+
+/**
+ * @brief Compute statistics over samples, sorts the samples in place
+ *
+ * @param samples Measurements in ns
+ * @param n Number of samples
+ * @param stats Output
+ */
+void bench_compute_stats(uint64_t *samples, size_t n, bench_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->n = n;
+
+    if(n == 0) {
+        return;
+    }
+
+    qsort(samples, n, sizeof(uint64_t), compare_u64);
+
+    double sum = 0.0;
+    for(size_t i = 0; i < n; i++) {
+        sum += (double) samples[i];
+    }
+
+    stats->min = (double) samples[0];
+    stats->max = (double) samples[n - 1];
+    stats->mean = sum / (double) n;
+    stats->median = (n % 2) ? (double) samples[n / 2] : ((double) samples[n / 2 - 1] + (double) samples[n / 2]) / 2.0;
+    stats->p95 = (double) samples[(size_t) ceil(0.95 * (double) n) - 1];  // Nearest rank
+
+    double var = 0.0;
+    for(size_t i = 0; i < n; i++) {
+        double d = (double) samples[i] - stats->mean;
+        var += d * d;
+    }
+    stats->stddev = n > 1 ? sqrt(var / (double) (n - 1)) : 0.0;
+}
+
+
+/**
+ * @brief Parse a comma separated list of unsigned integers, e.g. "1,2,4"
+ *
+ * @param str Input string
+ * @param values Output array
+ * @param max Capacity of values
+ * @return Number of values parsed
+ */
+size_t bench_parse_list(const char *str, uint64_t *values, size_t max) {
+    size_t n = 0;
+    const char *p = str;
+
+    while(*p != '\0' && n < max) {
+        char *end = NULL;
+        values[n++] = strtoull(p, &end, 10);
+        if(end == p) {
+            return n - 1;
+        }
+        p = (*end == ',') ? end + 1 : end;
+    }
+
+    return n;
+}
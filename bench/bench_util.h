@@ -0,0 +1,80 @@
+/*
+ * bench_util.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+typedef enum {
+    BENCH_CLOCK_MONOTONIC,      // CLOCK_MONOTONIC_RAW, not affected by NTP slewing
+    BENCH_CLOCK_TSC             // rdtsc, calibrated against CLOCK_MONOTONIC_RAW
+} bench_clock_t;
+
+// Summary of repeated measurements, all in ns
+typedef struct bench_stats {
+    size_t n;
+    double min;
+    double max;
+    double mean;
+    double median;
+    double p95;
+    double stddev;
+} bench_stats_t;
+
+
+/****************************************************************************
+ * Function Prototypes
+****************************************************************************/
+
+/**
+ * @brief Select the clock used by bench_now_ns, calibrates the TSC if needed
+ *
+ * @param clock Clock source
+ * @return 0 when successful, -1 if the clock is not available
+ */
+int bench_clock_init(bench_clock_t clock);
+
+
+/**
+ * @brief Current time of the selected clock in ns
+ */
+uint64_t bench_now_ns(void);
+
+
+/**
+ * @brief Compute statistics over samples, sorts the samples in place
+ *
+ * @param samples Measurements in ns
+ * @param n Number of samples
+ * @param stats Output
+ */
+void bench_compute_stats(uint64_t *samples, size_t n, bench_stats_t *stats);
+
+
+/**
+ * @brief Parse a comma separated list of unsigned integers, e.g. "1,2,4"
+ *
+ * @param str Input string
+ * @param values Output array
+ * @param max Capacity of values
+ * @return Number of values parsed
+ */
+size_t bench_parse_list(const char *str, uint64_t *values, size_t max);
+
+
+#endif // BENCH_UTIL_H
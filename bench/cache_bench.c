@@ -0,0 +1,260 @@
+/*
+ * cache_bench.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+// Startup time with the on-disk compilation cache. Each startup is a fresh
+// process that initialises the engine and loads every partition, as after a
+// deploy: without the cache, with an empty cache (cold) and with the cache
+// the cold start filled (warm). Partitions load generated modules that take
+// long enough to compile for the difference to show.
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#define _GNU_SOURCE
+#include "../src/wasm_api.h"
+#include "bench_util.h"
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+
+/****************************************************************************
+ * Defines
+****************************************************************************/
+#define BENCH_PARTITIONS    8
+#define BENCH_FUNCTIONS     1000            // Functions per generated module
+#define BENCH_REPEAT        3
+#define BENCH_PATH_MAX      512
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+typedef enum {
+    PHASE_NO_CACHE = 0,
+    PHASE_COLD,
+    PHASE_WARM,
+    PHASE_COUNT
+} bench_phase_t;
+
+// Written by the startup process through a pipe
+typedef struct bench_startup {
+    int rc;
+    uint64_t startup_ns;
+    wasm_cache_stats_t cache;
+} bench_startup_t;
+
+
+/****************************************************************************
+ * Static Function Prototypes
+****************************************************************************/
+static int write_module(const char *path, int seed, int functions);
+static int run_startup(const char *root, const char *cache_dir, int partitions, bench_startup_t *result);
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw);
+
+
+/****************************************************************************
+ * Main
+****************************************************************************/
+
+int main(int argc, char **argv) {
+    static const char *phase_names[PHASE_COUNT] = { "no-cache", "cold", "warm" };
+    int partitions = BENCH_PARTITIONS;
+    int functions = BENCH_FUNCTIONS;
+    int repeat = BENCH_REPEAT;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--partitions") == 0 && i + 1 < argc) {
+            partitions = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--functions") == 0 && i + 1 < argc) {
+            functions = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+        } else {
+            printf("Usage: %s [--partitions %d] [--functions %d] [--repeat %d]\n",
+                   argv[0], BENCH_PARTITIONS, BENCH_FUNCTIONS, BENCH_REPEAT);
+            return 1;
+        }
+    }
+
+    if(partitions <= 0 || partitions > NUM_MAX_PARTITIONS || functions <= 0 || repeat <= 0) {
+        printf("Invalid arguments\n");
+        return 1;
+    }
+
+    bench_clock_init(BENCH_CLOCK_MONOTONIC);
+
+    char root[] = "/tmp/cache_bench.XXXXXX";
+    if(mkdtemp(root) == NULL) {
+        printf("Cannot create a scratch directory\n");
+        return 1;
+    }
+
+    // Distinct modules, so no partition hits the entry of another
+    int rc = 0;
+    for(int id = 0; id < partitions && rc == 0; id++) {
+        char path[BENCH_PATH_MAX];
+        snprintf(path, sizeof(path), "%s/p%d.wasm", root, id);
+        rc = write_module(path, id, functions);
+    }
+
+    uint64_t *samples[PHASE_COUNT];
+    for(int phase = 0; phase < PHASE_COUNT; phase++) {
+        samples[phase] = calloc((size_t) repeat, sizeof(uint64_t));
+        if(!samples[phase]) {
+            rc = 1;
+        }
+    }
+
+    bench_startup_t last[PHASE_COUNT];
+    memset(last, 0, sizeof(last));
+
+    // Every repetition starts from an empty cache directory
+    for(int run = 0; run < repeat && rc == 0; run++) {
+        char cache_dir[BENCH_PATH_MAX];
+        snprintf(cache_dir, sizeof(cache_dir), "%s/cache%d", root, run);
+
+        for(int phase = 0; phase < PHASE_COUNT && rc == 0; phase++) {
+            rc = run_startup(root, phase == PHASE_NO_CACHE ? NULL : cache_dir, partitions, &last[phase]);
+            samples[phase][run] = last[phase].startup_ns;
+        }
+    }
+
+    if(rc == 0) {
+        printf("%d partitions, %d functions per module, %d runs\n", partitions, functions, repeat);
+        printf("%10s %12s %12s %8s %8s %10s %12s\n", "startup", "median_ms", "p95_ms", "hits", "misses", "entries", "cache_KiB");
+
+        for(int phase = 0; phase < PHASE_COUNT; phase++) {
+            bench_stats_t stats;
+            bench_compute_stats(samples[phase], (size_t) repeat, &stats);
+            printf("%10s %12.2f %12.2f %8lu %8lu %10lu %12lu\n", phase_names[phase], stats.median / 1e6, stats.p95 / 1e6,
+                   last[phase].cache.hits, last[phase].cache.misses, last[phase].cache.entries, last[phase].cache.bytes / 1024);
+        }
+    } else {
+        printf("Startup failed\n");
+    }
+
+    for(int phase = 0; phase < PHASE_COUNT; phase++) {
+        free(samples[phase]);
+    }
+    nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+
+    return rc;
+}
+
+
+/****************************************************************************
+ * Static Function Implementations
+****************************************************************************/
+
+/**
+ * @brief Generate a module with many small functions, the seed makes its
+ *        bytes and therefore its cache key unique
+ *
+ * @return 0 when successful, else 1
+ */
+static int write_module(const char *path, int seed, int functions) {
+    size_t cap = (size_t) functions * 256 + 256;
+    size_t len = 0;
+    char *wat = malloc(cap);
+    if(!wat) {
+        return 1;
+    }
+
+    len += snprintf(wat + len, cap - len, "(module (memory 1)\n");
+    for(int f = 0; f < functions; f++) {
+        len += snprintf(wat + len, cap - len,
+                        "(func $f%d (param $x i32) (result i32)"
+                        " (local.set $x (i32.add (i32.mul (local.get $x) (i32.const %d))"
+                        " (i32.load (i32.and (local.get $x) (i32.const 1020)))))"
+                        " (i32.xor (local.get $x) (i32.const %d)))\n", f, seed + 3, f);
+    }
+    len += snprintf(wat + len, cap - len,
+                    "(func (export \"main\") (param i32) (result i32) (call $f0 (local.get 0))))\n");
+
+    wasm_byte_vec_t wasm;
+    wasmtime_error_t *error = wasmtime_wat2wasm(wat, len, &wasm);
+    free(wat);
+    if(error != NULL) {
+        wasmtime_error_delete(error);
+        printf("Failed to generate module\n");
+        return 1;
+    }
+
+    FILE *file = fopen(path, "wb");
+    size_t written = file ? fwrite(wasm.data, 1, wasm.size, file) : 0;
+    int rc = (file && fclose(file) == 0 && written == wasm.size) ? 0 : 1;
+    wasm_byte_vec_delete(&wasm);
+
+    return rc;
+}
+
+
+/**
+ * @brief Start up in a fresh process: init and load every partition
+ *
+ * @param cache_dir Cache directory, NULL without the cache
+ * @return 0 when successful, else 1
+ */
+static int run_startup(const char *root, const char *cache_dir, int partitions, bench_startup_t *result) {
+    int fds[2];
+    if(pipe(fds) != 0) {
+        return 1;
+    }
+
+    pid_t pid = fork();
+    if(pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return 1;
+    }
+
+    if(pid == 0) {
+        bench_startup_t startup = { 0 };
+        wasm_api_init_opts_t init = { 0 };
+        init.quiet = true;
+        init.cache_dir = cache_dir;
+
+        uint64_t start = bench_now_ns();
+        startup.rc = wasm_api_init_with_opts(&init) == WASM_API_OK ? 0 : 1;
+        for(int id = 0; id < partitions && startup.rc == 0; id++) {
+            char path[BENCH_PATH_MAX];
+            snprintf(path, sizeof(path), "%s/p%d.wasm", root, id);
+            startup.rc = wasm_api_load_partition(id, path) == WASM_API_OK ? 0 : 1;
+        }
+        startup.startup_ns = bench_now_ns() - start;
+
+        wasm_api_stats_t stats;
+        wasm_api_get_stats(&stats);
+        startup.cache = stats.cache;
+        wasm_api_cleanup();
+
+        ssize_t n = write(fds[1], &startup, sizeof(startup));
+        _exit(n == (ssize_t) sizeof(startup) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    ssize_t n = read(fds[0], result, sizeof(*result));
+    close(fds[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+
+    return (n == (ssize_t) sizeof(*result) && WIFEXITED(status) && WEXITSTATUS(status) == 0 && result->rc == 0) ? 0 : 1;
+}
+
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void) st;
+    (void) flag;
+    (void) ftw;
+    return remove(path);
+}
@@ -0,0 +1,199 @@
+/*
+ * channel_bench.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+// Channel throughput: a producer partition fills shared-memory slots, a
+// consumer partition reads every byte back, both on one scheduler thread.
+// Switches only happen when one side parks on a full or empty ring.
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include "../src/wasm_api.h"
+#include "bench_util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/****************************************************************************
+ * Defines
+****************************************************************************/
+#define BENCH_WARMUP        1
+#define BENCH_REPEAT        5
+#define BENCH_MEGABYTES     256             // Payload moved per run
+#define BENCH_SLOTS         64
+#define BENCH_MAX_SIZES     16
+#define PRODUCER            0
+#define CONSUMER            1
+
+
+/****************************************************************************
+ * Static Function Prototypes
+****************************************************************************/
+static int measure(uint32_t slot_size, uint32_t slots, uint64_t megabytes, int repeat,
+                   bench_stats_t *stats, wasm_channel_stats_t *channel);
+static int run_pair(void);
+
+
+/****************************************************************************
+ * Main
+****************************************************************************/
+
+int main(int argc, char **argv) {
+    uint64_t sizes[BENCH_MAX_SIZES] = { 256, 4096, 65536 };
+    size_t nsizes = 3;
+    uint64_t slots = BENCH_SLOTS;
+    uint64_t megabytes = BENCH_MEGABYTES;
+    int repeat = BENCH_REPEAT;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) {
+            nsizes = bench_parse_list(argv[++i], sizes, BENCH_MAX_SIZES);
+        } else if(strcmp(argv[i], "--slots") == 0 && i + 1 < argc) {
+            slots = strtoull(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--mb") == 0 && i + 1 < argc) {
+            megabytes = strtoull(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+        } else {
+            printf("Usage: %s [--sizes 256,4096,65536] [--slots %d] [--mb %d] [--repeat %d]\n",
+                   argv[0], BENCH_SLOTS, BENCH_MEGABYTES, BENCH_REPEAT);
+            return 1;
+        }
+    }
+
+    if(nsizes == 0 || slots == 0 || megabytes == 0 || repeat <= 0) {
+        printf("Invalid arguments\n");
+        return 1;
+    }
+
+    bench_clock_init(BENCH_CLOCK_MONOTONIC);
+
+    printf("%10s %8s %12s %12s %12s %10s\n", "slot_size", "slots", "median_ms", "MB/s", "msgs/s", "parks/run");
+
+    for(size_t s = 0; s < nsizes; s++) {
+        bench_stats_t stats;
+        wasm_channel_stats_t channel;
+        uint32_t slot_size = (uint32_t) sizes[s];
+
+        if(measure(slot_size, (uint32_t) slots, megabytes, repeat, &stats, &channel) != 0) {
+            printf("Channel benchmark failed for slot size %u\n", slot_size);
+            return 1;
+        }
+
+        uint64_t payload = slot_size - CHANNEL_PAYLOAD;
+        uint64_t messages = (megabytes << 20) / payload;
+        double seconds = stats.median / 1e9;
+        printf("%10u %8lu %12.2f %12.1f %12.0f %10.1f\n", slot_size, slots, stats.median / 1e6,
+               (double) (messages * payload) / (1 << 20) / seconds, messages / seconds,
+               (double) channel.waits / (BENCH_WARMUP + repeat));
+    }
+
+    return 0;
+}
+
+
+/****************************************************************************
+ * Static Function Implementations
+****************************************************************************/
+
+/**
+ * @brief Run both partitions until each returned, parked ones are skipped
+ *
+ * @return 0 when successful, else 1
+ */
+static int run_pair(void) {
+    bool done[2] = { false, false };
+
+    while(!done[PRODUCER] || !done[CONSUMER]) {
+        wasm_api_poll_completions();
+
+        for(int id = PRODUCER; id <= CONSUMER; id++) {
+            if(done[id] || !wasm_api_partition_runnable(id)) {
+                continue;
+            }
+
+            wasm_api_result_t status = wasm_api_run_partition(id, "main");
+            if(status == PARTITION_DONE) {
+                done[id] = true;
+            } else if(status != PARTITION_YIELDED && status != PARTITION_BLOCKED) {
+                return 1;
+            }
+        }
+    }
+
+    // A negative result is a corrupted message
+    return get_wasm_partition(CONSUMER)->results[0].of.i32 < 0;
+}
+
+
+/**
+ * @brief Runtime statistics of moving megabytes through one channel
+ *
+ * @return 0 when successful, else 1
+ */
+static int measure(uint32_t slot_size, uint32_t slots, uint64_t megabytes, int repeat,
+                   bench_stats_t *stats, wasm_channel_stats_t *channel) {
+    const char *channels[] = { "bulk" };
+    wasm_api_load_opts_t load = { .channels = channels, .nchannels = 1 };
+    wasm_api_init_opts_t opts = { .quiet = true, .no_fuel = true };
+    int channel_id;
+
+    if(slot_size <= CHANNEL_PAYLOAD) {
+        return 1;
+    }
+
+    // Channels belong to an engine, each configuration gets its own
+    if(wasm_api_init_with_opts(&opts) != WASM_API_OK) {
+        return 1;
+    }
+
+    if(wasm_api_create_channel("bulk", slot_size, slots, &channel_id) != WASM_API_OK
+       || wasm_api_load_partition_with_opts(PRODUCER, "wasm/channel_tx.wasm", &load) != WASM_API_OK
+       || wasm_api_load_partition_with_opts(CONSUMER, "wasm/channel_rx.wasm", &load) != WASM_API_OK) {
+        wasm_api_cleanup();
+        return 1;
+    }
+
+    wasmtime_val_t arg = { .kind = WASMTIME_I32, .of.i32 = (int32_t) ((megabytes << 20) / (slot_size - CHANNEL_PAYLOAD)) };
+    wasm_api_set_args(PRODUCER, &arg, 1);
+    wasm_api_set_args(CONSUMER, &arg, 1);
+
+    uint64_t *samples = calloc((size_t) repeat, sizeof(uint64_t));
+    if(!samples) {
+        wasm_api_cleanup();
+        return 1;
+    }
+
+    // Statistics are process wide
+    wasm_api_stats_t before;
+    wasm_api_get_stats(&before);
+
+    int rc = 0;
+    for(int run = 0; run < BENCH_WARMUP + repeat && rc == 0; run++) {
+        uint64_t start = bench_now_ns();
+        rc = run_pair();
+        uint64_t end = bench_now_ns();
+
+        if(run >= BENCH_WARMUP) {
+            samples[run - BENCH_WARMUP] = end - start;
+        }
+    }
+
+    if(rc == 0) {
+        wasm_api_stats_t api_stats;
+        wasm_api_get_stats(&api_stats);
+        channel->waits = api_stats.channels.waits - before.channels.waits;
+        channel->wakeups = api_stats.channels.wakeups - before.channels.wakeups;
+        bench_compute_stats(samples, (size_t) repeat, stats);
+    }
+
+    free(samples);
+    wasm_api_cleanup();
+
+    return rc;
+}
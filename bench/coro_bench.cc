@@ -0,0 +1,191 @@
+/*
+ * coro_bench.cc
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+// Coroutine front end at scale: every partition runs a task that awaits a
+// chain of fib calls, all tasks share one Executor. Reports the cost of a
+// resume and the heap allocations made while the tasks are running.
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include "../src/wasm_coro.hh"
+extern "C" {
+#include "bench_util.h"
+}
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+
+/****************************************************************************
+ * Defines
+****************************************************************************/
+#define BENCH_FUEL          (1ull << 60)
+#define BENCH_PARTITIONS    1000
+#define BENCH_CALLS         10              // Awaited calls per partition
+#define BENCH_INTERVAL      1000            // Fuel per slice
+#define FIB_DEPTH           15
+
+
+using wasm_coro::Executor;
+using wasm_coro::FramePool;
+using wasm_coro::Task;
+
+
+/****************************************************************************
+ * Allocation counter
+****************************************************************************/
+static uint64_t g_allocations = 0;
+
+void *operator new(std::size_t size) {
+    g_allocations++;
+    void *memory = std::malloc(size ? size : 1);
+    if(memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void *memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+
+/****************************************************************************
+ * Static Function Prototypes
+****************************************************************************/
+static Task<int32_t> fib(Executor &executor, int partition_id);
+static Task<void> partition_main(Executor &executor, int partition_id, int calls, int64_t *sum);
+
+
+/****************************************************************************
+ * Main
+****************************************************************************/
+
+int main(int argc, char **argv) {
+    int partitions = BENCH_PARTITIONS;
+    int calls = BENCH_CALLS;
+    uint64_t interval = BENCH_INTERVAL;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--partitions") == 0 && i + 1 < argc) {
+            partitions = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--calls") == 0 && i + 1 < argc) {
+            calls = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+            interval = strtoull(argv[++i], NULL, 10);
+        } else {
+            printf("Usage: %s [--partitions %d] [--calls %d] [--interval %d]\n",
+                   argv[0], BENCH_PARTITIONS, BENCH_CALLS, BENCH_INTERVAL);
+            return 1;
+        }
+    }
+
+    if(partitions <= 0 || partitions > NUM_MAX_PARTITIONS || calls <= 0 || interval == 0) {
+        printf("Partition count must be between 1 and %d, calls and interval above 0\n", NUM_MAX_PARTITIONS);
+        return 1;
+    }
+
+    bench_clock_init(BENCH_CLOCK_MONOTONIC);
+
+    // Pooled stacks, thousands of concurrent futures would otherwise mmap one each
+    wasm_api_init_opts_t opts = {};
+    opts.quiet = true;
+    opts.stack_pool_size = (size_t) partitions;
+    if(wasm_api_init_with_opts(&opts) != WASM_API_OK) {
+        return 1;
+    }
+
+    wasmtime_val_t arg = {};
+    arg.kind = WASMTIME_I32;
+    arg.of.i32 = FIB_DEPTH;
+
+    for(int id = 0; id < partitions; id++) {
+        if(wasm_api_load_partition(id, "wasm/fib.wasm") != WASM_API_OK) {
+            wasm_api_cleanup();
+            return 1;
+        }
+        wasm_api_set_args(id, &arg, 1);
+        wasm_api_set_yield_interval(id, interval);
+    }
+
+    int rc = 0;
+    {
+        Executor executor;
+        int64_t sum = 0;
+
+        // Warm up the frame pool, the second run must not allocate frames
+        for(int run = 0; run < 2 && rc == 0; run++) {
+            for(int id = 0; id < partitions; id++) {
+                executor.spawn(partition_main(executor, id, calls, &sum));
+            }
+
+            uint64_t allocations = g_allocations;
+            uint64_t resumes = executor.resumes();
+            uint64_t start = bench_now_ns();
+            executor.run();
+            uint64_t end = bench_now_ns();
+
+            // fib(15) is 610
+            int64_t expected = (int64_t) partitions * calls * 610;
+            if(sum != expected) {
+                printf("Wrong sum %ld, expected %ld\n", sum, expected);
+                rc = 1;
+            }
+            sum = 0;
+
+            resumes = executor.resumes() - resumes;
+            printf("%s: %d partitions x %d calls in %.2f ms, %lu resumes, %.1f ns/resume, "
+                   "%lu allocations while running, %zu frame slabs\n",
+                   run == 0 ? "cold" : "warm", partitions, calls, (end - start) / 1e6, resumes,
+                   (double) (end - start) / resumes, g_allocations - allocations, FramePool::slabs());
+        }
+    }
+
+    wasm_api_cleanup();
+    return rc;
+}
+
+
+/****************************************************************************
+ * Static Function Implementations
+****************************************************************************/
+
+/**
+ * @brief One call of the partition's fib, -1 when it failed
+ */
+static Task<int32_t> fib(Executor &executor, int partition_id) {
+    wasm_api_inject_fuel(partition_id, BENCH_FUEL, true);
+
+    wasm_api_result_t status = co_await executor.call(partition_id, "main");
+    if(status != PARTITION_DONE) {
+        co_return -1;
+    }
+
+    co_return get_wasm_partition(partition_id)->results[0].of.i32;
+}
+
+
+/**
+ * @brief Partition code path composed of awaited calls
+ */
+static Task<void> partition_main(Executor &executor, int partition_id, int calls, int64_t *sum) {
+
+    for(int i = 0; i < calls; i++) {
+        int32_t result = co_await fib(executor, partition_id);
+        if(result < 0) {
+            printf("Partition %d failed\n", partition_id);
+            co_return;
+        }
+        *sum += result;
+    }
+}
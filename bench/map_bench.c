@@ -0,0 +1,222 @@
+/*
+ * map_bench.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+// Throughput of wasm_api_map over a sweep of worker counts, against the same
+// elements called one at a time through wasm_api_run_partition. Speedup is
+// relative to one worker, it can only grow up to the number of online CPUs.
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include "../src/wasm_api.h"
+#include "bench_util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+/****************************************************************************
+ * Defines
+****************************************************************************/
+#define BENCH_FUEL          (1ull << 60)
+#define BENCH_WARMUP        1
+#define BENCH_REPEAT        5
+#define BENCH_ELEMENTS      100000
+#define BENCH_ARG           10
+#define BENCH_MAX_WORKERS   16
+#define PARTITION           0
+
+
+/****************************************************************************
+ * Static Function Prototypes
+****************************************************************************/
+static int run_serial(const wasmtime_val_t *inputs, wasmtime_val_t *outputs, size_t n);
+static int check_outputs(const wasmtime_val_t *outputs, size_t n, int32_t expected);
+
+
+/****************************************************************************
+ * Main
+****************************************************************************/
+
+int main(int argc, char **argv) {
+    uint64_t workers[BENCH_MAX_WORKERS] = { 1, 2, 4, 8 };
+    size_t nworkers = 4;
+    uint64_t n = BENCH_ELEMENTS;
+    uint64_t batch = MAP_BATCH;
+    int32_t arg = BENCH_ARG;
+    int repeat = BENCH_REPEAT;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            nworkers = bench_parse_list(argv[++i], workers, BENCH_MAX_WORKERS);
+        } else if(strcmp(argv[i], "--elements") == 0 && i + 1 < argc) {
+            n = strtoull(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch = strtoull(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--arg") == 0 && i + 1 < argc) {
+            arg = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+        } else {
+            printf("Usage: %s [--workers 1,2,4,8] [--elements %d] [--batch %d] [--arg %d] [--repeat %d]\n",
+                   argv[0], BENCH_ELEMENTS, MAP_BATCH, BENCH_ARG, BENCH_REPEAT);
+            return 1;
+        }
+    }
+
+    if(nworkers == 0 || n == 0 || batch == 0 || arg < 0 || arg > 30 || repeat <= 0) {
+        printf("Invalid arguments\n");
+        return 1;
+    }
+
+    bench_clock_init(BENCH_CLOCK_MONOTONIC);
+
+    wasm_api_init_opts_t init = { 0 };
+    init.quiet = true;
+    if(wasm_api_init_with_opts(&init) != WASM_API_OK) {
+        return 1;
+    }
+
+    wasmtime_val_t *inputs = calloc(n, sizeof(wasmtime_val_t));
+    wasmtime_val_t *outputs = calloc(n, sizeof(wasmtime_val_t));
+    uint64_t *samples = calloc((size_t) repeat, sizeof(uint64_t));
+    if(!inputs || !outputs || !samples) {
+        free(inputs);
+        free(outputs);
+        free(samples);
+        wasm_api_cleanup();
+        return 1;
+    }
+
+    for(size_t i = 0; i < n; i++) {
+        inputs[i].kind = WASMTIME_I32;
+        inputs[i].of.i32 = arg;
+    }
+
+    // fib(arg) iteratively, every element must return it
+    int32_t expected = 0;
+    for(int32_t a = 0, b = 1, k = 0; k <= arg; k++) {
+        expected = a;
+        int32_t next = a + b;
+        a = b;
+        b = next;
+    }
+
+    printf("%zu elements of fib(%d), %ld online CPUs\n", (size_t) n, arg, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%10s %12s %14s %10s\n", "workers", "median_ms", "elements/s", "speedup");
+
+    int rc = 0;
+    bench_stats_t stats;
+
+    // One partition, one call at a time
+    if(wasm_api_load_partition(PARTITION, "wasm/fib.wasm") != WASM_API_OK) {
+        rc = 1;
+    }
+    for(int run = 0; run < BENCH_WARMUP + repeat && rc == 0; run++) {
+        uint64_t start = bench_now_ns();
+        rc = run_serial(inputs, outputs, n);
+        uint64_t end = bench_now_ns();
+
+        if(run >= BENCH_WARMUP) {
+            samples[run - BENCH_WARMUP] = end - start;
+        }
+    }
+    if(rc == 0 && check_outputs(outputs, n, expected) == 0) {
+        bench_compute_stats(samples, (size_t) repeat, &stats);
+        printf("%10s %12.2f %14.0f %10s\n", "serial", stats.median / 1e6, n / (stats.median / 1e9), "-");
+    } else {
+        printf("Serial run failed\n");
+        rc = 1;
+    }
+
+    double base = 0.0;
+    for(size_t w = 0; w < nworkers && rc == 0; w++) {
+        wasm_map_opts_t opts = { 0 };
+        opts.workers = workers[w];
+        opts.batch = batch;
+        opts.fuel = BENCH_FUEL;
+
+        for(int run = 0; run < BENCH_WARMUP + repeat && rc == 0; run++) {
+            memset(outputs, 0, n * sizeof(wasmtime_val_t));
+
+            uint64_t start = bench_now_ns();
+            rc = wasm_api_map("wasm/fib.wasm", "main", inputs, outputs, n, &opts) == WASM_API_OK ? 0 : 1;
+            uint64_t end = bench_now_ns();
+
+            if(run >= BENCH_WARMUP) {
+                samples[run - BENCH_WARMUP] = end - start;
+            }
+        }
+
+        if(rc != 0 || check_outputs(outputs, n, expected) != 0) {
+            printf("Map with %lu workers failed\n", workers[w]);
+            rc = 1;
+            break;
+        }
+
+        bench_compute_stats(samples, (size_t) repeat, &stats);
+        double rate = n / (stats.median / 1e9);
+        if(w == 0) {
+            base = rate;
+        }
+        printf("%10lu %12.2f %14.0f %9.2fx\n", workers[w], stats.median / 1e6, rate, rate / base);
+    }
+
+    wasm_api_stats_t api_stats;
+    wasm_api_get_stats(&api_stats);
+    printf("%lu maps, %lu elements in %lu batches, %lu failed\n", api_stats.map.maps, api_stats.map.elements,
+           api_stats.map.batches, api_stats.map.failed);
+
+    free(inputs);
+    free(outputs);
+    free(samples);
+    wasm_api_cleanup();
+    return rc;
+}
+
+
+/****************************************************************************
+ * Static Function Implementations
+****************************************************************************/
+
+/**
+ * @brief Call every element on one partition, without fuel yields
+ *
+ * @return 0 when successful, else 1
+ */
+static int run_serial(const wasmtime_val_t *inputs, wasmtime_val_t *outputs, size_t n) {
+    wasm_partition_t *partition = get_wasm_partition(PARTITION);
+
+    wasm_api_inject_fuel(PARTITION, BENCH_FUEL, false);
+
+    for(size_t i = 0; i < n; i++) {
+        wasm_api_set_args(PARTITION, &inputs[i], 1);
+        if(wasm_api_run_partition(PARTITION, "main") != PARTITION_DONE) {
+            return 1;
+        }
+        outputs[i] = partition->results[0];
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Verify every output against the expected fib value
+ *
+ * @return 0 when all match, else 1
+ */
+static int check_outputs(const wasmtime_val_t *outputs, size_t n, int32_t expected) {
+    for(size_t i = 0; i < n; i++) {
+        if(outputs[i].kind != WASMTIME_I32 || outputs[i].of.i32 != expected) {
+            printf("Element %zu: %d, expected %d\n", i, outputs[i].of.i32, expected);
+            return 1;
+        }
+    }
+    return 0;
+}
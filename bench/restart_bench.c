@@ -0,0 +1,225 @@
+/*
+ * restart_bench.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+// Cost of recovering a trapped partition. wasm_api_restart_partition reuses
+// the compiled module and instance_pre, unload and load compiles again. The
+// scheduler run restarts trapping partitions with RESTART_IMMEDIATE next to a
+// healthy one and reports how many slices the healthy one still gets.
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include "../src/wasm_api.h"
+#include "../src/wasm_sched.h"
+#include "bench_util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/****************************************************************************
+ * Defines
+****************************************************************************/
+#define BENCH_MODULE        "wasm/fault.wasm"
+#define BENCH_HEALTHY       "wasm/loop.wasm"
+#define BENCH_RESTARTS      1000
+#define BENCH_PARTITIONS    8
+#define BENCH_COUNT         100             // Iterations before the guest traps
+#define BENCH_SCHED_MS      200             // Scheduler time per policy
+
+
+/****************************************************************************
+ * Static Function Prototypes
+****************************************************************************/
+static int run_trap(int partition_id);
+static uint64_t healthy_fuel(int partition_id);
+static int run_sched(wasm_sched_restart_mode_t mode, int partitions, int healthy, const wasmtime_val_t *arg);
+static void print_stats(const char *name, uint64_t *samples, size_t n);
+
+
+/****************************************************************************
+ * Main
+****************************************************************************/
+
+int main(int argc, char **argv) {
+    int restarts = BENCH_RESTARTS;
+    int partitions = BENCH_PARTITIONS;
+    int count = BENCH_COUNT;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--restarts") == 0 && i + 1 < argc) {
+            restarts = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--partitions") == 0 && i + 1 < argc) {
+            partitions = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+            count = atoi(argv[++i]);
+        } else {
+            printf("Usage: %s [--restarts %d] [--partitions %d] [--count %d]\n",
+                   argv[0], BENCH_RESTARTS, BENCH_PARTITIONS, BENCH_COUNT);
+            return 1;
+        }
+    }
+
+    if(restarts <= 0 || count <= 0 || partitions <= 0 || partitions >= NUM_MAX_PARTITIONS) {
+        printf("Invalid arguments\n");
+        return 1;
+    }
+
+    bench_clock_init(BENCH_CLOCK_MONOTONIC);
+
+    wasm_api_init_opts_t init = { 0 };
+    init.quiet = true;
+    if(wasm_api_init_with_opts(&init) != WASM_API_OK) {
+        return 1;
+    }
+
+    uint64_t *samples = calloc((size_t) restarts, sizeof(uint64_t));
+    wasmtime_val_t arg = { .kind = WASMTIME_I32, .of.i32 = count };
+    int rc = samples == NULL;
+
+    // Restart from the instance_pre
+    if(rc == 0 && wasm_api_load_partition(0, BENCH_MODULE) == WASM_API_OK && wasm_api_set_args(0, &arg, 1) == WASM_API_OK
+       && wasm_api_inject_fuel(0, FUEL_AMOUNT, true) == WASM_API_OK) {
+        for(int r = 0; r < restarts && rc == 0; r++) {
+            rc = run_trap(0);
+            uint64_t t0 = bench_now_ns();
+            rc |= wasm_api_restart_partition(0) != WASM_API_OK;
+            samples[r] = bench_now_ns() - t0;
+        }
+        wasm_api_unload_partition(0);
+    } else {
+        rc = 1;
+    }
+
+    if(rc == 0) {
+        printf("%d restarts, trap after %d iterations\n", restarts, count);
+        printf("%-14s %10s %10s %10s %10s\n", "recovery", "mean_us", "median_us", "p95_us", "max_us");
+        print_stats("restart", samples, (size_t) restarts);
+    }
+
+    // Unload and load, the module is compiled again
+    rc = rc || wasm_api_load_partition(0, BENCH_MODULE) != WASM_API_OK;
+    for(int r = 0; r < restarts && rc == 0; r++) {
+        uint64_t t0 = bench_now_ns();
+        rc = wasm_api_unload_partition(0) != WASM_API_OK || wasm_api_load_partition(0, BENCH_MODULE) != WASM_API_OK
+             || wasm_api_inject_fuel(0, FUEL_AMOUNT, true) != WASM_API_OK;
+        samples[r] = bench_now_ns() - t0;
+    }
+    wasm_api_unload_partition(0);
+    if(rc == 0) {
+        print_stats("unload+load", samples, (size_t) restarts);
+    }
+
+    // Trapping partitions restarted by the scheduler next to a healthy one
+    wasmtime_val_t healthy_arg = { .kind = WASMTIME_I32, .of.i32 = INT32_MAX };
+
+    rc = rc || wasm_sched_init(NULL, NULL) != 0;
+    rc = rc || wasm_api_load_partition(partitions, BENCH_HEALTHY) != WASM_API_OK;
+    rc = rc || wasm_api_set_args(partitions, &healthy_arg, 1) != WASM_API_OK;
+    rc = rc || wasm_api_inject_fuel(partitions, UINT64_MAX / 2, true) != WASM_API_OK;
+    rc = rc || wasm_sched_add(partitions, "main") != 0;
+
+    if(rc == 0) {
+        printf("\n%d trapping partitions next to a healthy one, %d ms each\n", partitions, BENCH_SCHED_MS);
+        printf("%-14s %14s %10s %10s %10s\n", "policy", "healthy_slices", "restarts", "mean_us", "max_us");
+    }
+    for(int mode = -1; mode <= RESTART_BACKOFF && rc == 0; mode++) {
+        rc = run_sched((wasm_sched_restart_mode_t) mode, mode < 0 ? 0 : partitions, partitions, &arg);
+    }
+
+    wasm_sched_shutdown();
+    wasm_api_cleanup();
+    free(samples);
+
+    if(rc != 0) {
+        printf("Benchmark failed\n");
+    }
+    return rc;
+}
+
+
+/****************************************************************************
+ * Static Function Implementations
+****************************************************************************/
+
+/**
+ * @brief Run the partition's call until it traps
+ *
+ * @return 0 when it trapped, else 1
+ */
+static int run_trap(int partition_id) {
+    wasm_api_result_t status;
+
+    while((status = wasm_api_run_partition(partition_id, "main")) == PARTITION_YIELDED) {
+    }
+
+    return status == PARTITION_ERROR ? 0 : 1;
+}
+
+
+static uint64_t healthy_fuel(int partition_id) {
+    uint64_t fuel = 0;
+    wasmtime_error_t *error = wasmtime_context_get_fuel(get_wasm_partition(partition_id)->context, &fuel);
+    if(error != NULL) {
+        wasmtime_error_delete(error);
+    }
+    return fuel;
+}
+
+
+/**
+ * @brief Schedule trapping partitions under a restart policy next to the
+ *        healthy one for BENCH_SCHED_MS
+ *
+ * @param partitions Trapping partitions, 0 for the healthy one alone
+ * @param healthy Partition id of the healthy one, already scheduled
+ * @return 0 when successful, else 1
+ */
+static int run_sched(wasm_sched_restart_mode_t mode, int partitions, int healthy, const wasmtime_val_t *arg) {
+    static const char *names[] = { "alone", "never", "immediate", "backoff" };
+    wasm_sched_restart_t policy = { .mode = mode };
+    wasm_sched_stats_t before;
+    wasm_sched_stats_t after;
+    int rc = 0;
+
+    for(int id = 0; id < partitions && rc == 0; id++) {
+        rc = wasm_api_load_partition(id, BENCH_MODULE) != WASM_API_OK || wasm_api_set_args(id, arg, 1) != WASM_API_OK
+             || wasm_api_inject_fuel(id, FUEL_AMOUNT, true) != WASM_API_OK
+             || wasm_sched_set_restart(id, &policy) != 0 || wasm_sched_add(id, "main") != 0;
+    }
+
+    wasm_sched_stats(&before);
+    uint64_t fuel = healthy_fuel(healthy);
+    uint64_t start = bench_now_ns();
+    wasm_sched_budget_t budget = { .time_ns = BENCH_SCHED_MS * 1000000ull, .fuel = 0 };
+    while(rc == 0 && bench_now_ns() - start < budget.time_ns) {
+        wasm_sched_step(&budget);
+    }
+    uint64_t slices = (fuel - healthy_fuel(healthy)) / YIELD_AFTER;
+    wasm_sched_stats(&after);
+
+    for(int id = 0; id < partitions; id++) {
+        wasm_sched_remove(id);
+        wasm_api_unload_partition(id);
+    }
+
+    uint64_t restarts = after.restarts - before.restarts;
+    if(rc == 0) {
+        printf("%-14s %14lu %10lu %10.1f %10.1f\n", names[mode + 1], slices, restarts,
+               restarts ? (after.restart_ns - before.restart_ns) / 1e3 / restarts : 0.0, after.restart_max_ns / 1e3);
+    }
+
+    return rc;
+}
+
+
+static void print_stats(const char *name, uint64_t *samples, size_t n) {
+    bench_stats_t stats;
+    bench_compute_stats(samples, n, &stats);
+    printf("%-14s %10.1f %10.1f %10.1f %10.1f\n", name, stats.mean / 1e3, stats.median / 1e3,
+           stats.p95 / 1e3, stats.max / 1e3);
+}
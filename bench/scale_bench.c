@@ -0,0 +1,266 @@
+/*
+ * scale_bench.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+// Loads thousands of partitions of one module under each memory budget and
+// reports what they cost the process: load time, resident memory, address
+// space and mapped regions against vm.max_map_count. Every budget runs in a
+// fresh process. Built with NUM_MAX_PARTITIONS raised to SCALE_PARTITIONS.
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include "../src/wasm_api.h"
+#include "bench_util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+
+/****************************************************************************
+ * Defines
+****************************************************************************/
+#define BENCH_MODULE        "wasm/main.wasm"
+#define BENCH_MAX_BUDGETS   4
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+// Written by the loading process through a pipe
+typedef struct bench_scale {
+    int loaded;                     // Partitions loaded before the first failure
+    double load_ms;
+    double load_p50_us;
+    double load_p95_us;
+    uint64_t rss_kib;               // Growth over the process before init
+    uint64_t vm_kib;
+    uint64_t maps;
+} bench_scale_t;
+
+
+/****************************************************************************
+ * Static Function Prototypes
+****************************************************************************/
+static int parse_budgets(const char *str, wasm_memory_budget_t *budgets);
+static const char *budget_name(wasm_memory_budget_t budget);
+static uint64_t proc_status_kib(const char *field);
+static uint64_t proc_lines(const char *path);
+static int run_scale(wasm_memory_budget_t budget, const char *module, int partitions, bench_scale_t *result);
+
+
+/****************************************************************************
+ * Main
+****************************************************************************/
+
+int main(int argc, char **argv) {
+    wasm_memory_budget_t budgets[BENCH_MAX_BUDGETS] = { MEMORY_BUDGET_DEFAULT, MEMORY_BUDGET_MANY_SMALL, MEMORY_BUDGET_FEW_LARGE };
+    int nbudgets = 3;
+    int partitions = NUM_MAX_PARTITIONS;
+    const char *module = BENCH_MODULE;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--partitions") == 0 && i + 1 < argc) {
+            partitions = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--budget") == 0 && i + 1 < argc) {
+            nbudgets = parse_budgets(argv[++i], budgets);
+        } else if(strcmp(argv[i], "--module") == 0 && i + 1 < argc) {
+            module = argv[++i];
+        } else {
+            printf("Usage: %s [--partitions %d] [--budget default,small,large] [--module %s]\n",
+                   argv[0], NUM_MAX_PARTITIONS, BENCH_MODULE);
+            return 1;
+        }
+    }
+
+    if(partitions <= 0 || partitions > NUM_MAX_PARTITIONS || nbudgets <= 0) {
+        printf("Invalid arguments, at most %d partitions\n", NUM_MAX_PARTITIONS);
+        return 1;
+    }
+
+    bench_clock_init(BENCH_CLOCK_MONOTONIC);
+
+    FILE *file = fopen("/proc/sys/vm/max_map_count", "r");
+    unsigned long max_map_count = 0;
+    if(file) {
+        if(fscanf(file, "%lu", &max_map_count) != 1) {
+            max_map_count = 0;
+        }
+        fclose(file);
+    }
+
+    printf("%d partitions of %s, vm.max_map_count %lu\n", partitions, module, max_map_count);
+    printf("%12s %8s %10s %12s %12s %10s %10s %10s\n",
+           "budget", "loaded", "load_ms", "load_p50_us", "load_p95_us", "rss_MiB", "vm_GiB", "maps");
+
+    int rc = 0;
+    for(int b = 0; b < nbudgets; b++) {
+        bench_scale_t scale;
+        if(run_scale(budgets[b], module, partitions, &scale) != 0) {
+            printf("%12s failed\n", budget_name(budgets[b]));
+            rc = 1;
+            continue;
+        }
+
+        printf("%12s %8d %10.1f %12.1f %12.1f %10.1f %10.1f %10lu\n", budget_name(budgets[b]), scale.loaded,
+               scale.load_ms, scale.load_p50_us, scale.load_p95_us, scale.rss_kib / 1024.0,
+               scale.vm_kib / (1024.0 * 1024.0), scale.maps);
+        if(scale.loaded < partitions) {
+            rc = 1;
+        }
+    }
+
+    return rc;
+}
+
+
+/****************************************************************************
+ * Static Function Implementations
+****************************************************************************/
+
+static int parse_budgets(const char *str, wasm_memory_budget_t *budgets) {
+    char buf[128];
+    int n = 0;
+
+    snprintf(buf, sizeof(buf), "%s", str);
+    for(char *tok = strtok(buf, ","); tok != NULL && n < BENCH_MAX_BUDGETS; tok = strtok(NULL, ",")) {
+        if(strcmp(tok, "default") == 0) {
+            budgets[n++] = MEMORY_BUDGET_DEFAULT;
+        } else if(strcmp(tok, "small") == 0) {
+            budgets[n++] = MEMORY_BUDGET_MANY_SMALL;
+        } else if(strcmp(tok, "large") == 0) {
+            budgets[n++] = MEMORY_BUDGET_FEW_LARGE;
+        } else {
+            return 0;
+        }
+    }
+
+    return n;
+}
+
+
+static const char *budget_name(wasm_memory_budget_t budget) {
+    switch(budget) {
+        case MEMORY_BUDGET_MANY_SMALL:  return "small";
+        case MEMORY_BUDGET_FEW_LARGE:   return "large";
+        case MEMORY_BUDGET_CUSTOM:      return "custom";
+        default:                        return "default";
+    }
+}
+
+
+/**
+ * @brief A "<field>: <n> kB" line of /proc/self/status
+ */
+static uint64_t proc_status_kib(const char *field) {
+    char line[256];
+    size_t len = strlen(field);
+    uint64_t kib = 0;
+
+    FILE *file = fopen("/proc/self/status", "r");
+    if(!file) {
+        return 0;
+    }
+    while(fgets(line, sizeof(line), file)) {
+        if(strncmp(line, field, len) == 0 && line[len] == ':') {
+            kib = strtoull(line + len + 1, NULL, 10);
+            break;
+        }
+    }
+    fclose(file);
+
+    return kib;
+}
+
+
+static uint64_t proc_lines(const char *path) {
+    uint64_t lines = 0;
+    int c;
+
+    FILE *file = fopen(path, "r");
+    if(!file) {
+        return 0;
+    }
+    while((c = fgetc(file)) != EOF) {
+        lines += c == '\n';
+    }
+    fclose(file);
+
+    return lines;
+}
+
+
+/**
+ * @brief Load partitions in a fresh process until all are loaded or one fails
+ *
+ * @return 0 when the process reported, else 1
+ */
+static int run_scale(wasm_memory_budget_t budget, const char *module, int partitions, bench_scale_t *result) {
+    int fds[2];
+    if(pipe(fds) != 0) {
+        return 1;
+    }
+
+    pid_t pid = fork();
+    if(pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return 1;
+    }
+
+    if(pid == 0) {
+        bench_scale_t scale = { 0 };
+        uint64_t *samples = calloc((size_t) partitions, sizeof(uint64_t));
+        uint64_t rss_before = proc_status_kib("VmRSS");
+
+        wasm_api_init_opts_t init = { 0 };
+        init.quiet = true;
+        init.memory_budget = budget;
+
+        if(samples != NULL && wasm_api_init_with_opts(&init) == WASM_API_OK) {
+            uint64_t start = bench_now_ns();
+            for(int id = 0; id < partitions; id++) {
+                uint64_t t0 = bench_now_ns();
+                if(wasm_api_load_partition(id, module) != WASM_API_OK) {
+                    break;
+                }
+                samples[id] = bench_now_ns() - t0;
+                scale.loaded++;
+            }
+            scale.load_ms = (bench_now_ns() - start) / 1e6;
+
+            // Before cleanup, the partitions are still mapped
+            uint64_t rss = proc_status_kib("VmRSS");
+            scale.rss_kib = rss > rss_before ? rss - rss_before : 0;
+            scale.vm_kib = proc_status_kib("VmSize");
+            scale.maps = proc_lines("/proc/self/maps");
+
+            if(scale.loaded > 0) {
+                bench_stats_t stats;
+                bench_compute_stats(samples, (size_t) scale.loaded, &stats);
+                scale.load_p50_us = stats.median / 1e3;
+                scale.load_p95_us = stats.p95 / 1e3;
+            }
+            wasm_api_cleanup();
+        }
+        free(samples);
+
+        ssize_t n = write(fds[1], &scale, sizeof(scale));
+        _exit(n == (ssize_t) sizeof(scale) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    ssize_t n = read(fds[0], result, sizeof(*result));
+    close(fds[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+
+    return (n == (ssize_t) sizeof(*result) && WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 0 : 1;
+}
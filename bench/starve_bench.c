@@ -0,0 +1,187 @@
+/*
+ * starve_bench.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+// Cost and effect of suspending on fuel exhaustion. A suspending partition
+// reads its fuel after every slice, the first run compares the slice cost
+// with trapping partitions. The scheduler run gives a long job a budget per
+// period far below what it needs: trapping, it is lost in its first period,
+// suspending, it waits starved for each refill and completes
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include "../src/wasm_api.h"
+#include "../src/wasm_sched.h"
+#include "bench_util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+/****************************************************************************
+ * Defines
+****************************************************************************/
+#define BENCH_MODULE        "wasm/loop.wasm"
+#define BENCH_COUNT         2000000         // Loop iterations of the job, about 8 fuel each
+#define BENCH_BUDGET        500000          // Fuel per period
+#define BENCH_PERIOD_US     1000
+#define BENCH_SLICE_COUNT   20000000        // Loop iterations of the slice cost run
+
+
+/****************************************************************************
+ * Static Function Prototypes
+****************************************************************************/
+static int run_slices(bool suspend);
+static int run_sched(bool suspend, int count, uint64_t budget, uint64_t period_ns);
+static void on_exit_cb(int partition_id, wasm_api_result_t status, void *env);
+
+
+/****************************************************************************
+ * Bench state
+****************************************************************************/
+static wasm_api_result_t g_exit_status = WASM_API_ERR;
+
+
+/****************************************************************************
+ * Main
+****************************************************************************/
+
+int main(int argc, char **argv) {
+    int count = BENCH_COUNT;
+    uint64_t budget = BENCH_BUDGET;
+    uint64_t period_us = BENCH_PERIOD_US;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+            count = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--budget") == 0 && i + 1 < argc) {
+            budget = strtoull(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--period-us") == 0 && i + 1 < argc) {
+            period_us = strtoull(argv[++i], NULL, 10);
+        } else {
+            printf("Usage: %s [--count %d] [--budget %d] [--period-us %d]\n",
+                   argv[0], BENCH_COUNT, BENCH_BUDGET, BENCH_PERIOD_US);
+            return 1;
+        }
+    }
+
+    if(count <= 0 || budget == 0 || period_us == 0) {
+        printf("Invalid arguments\n");
+        return 1;
+    }
+
+    bench_clock_init(BENCH_CLOCK_MONOTONIC);
+
+    wasm_api_init_opts_t init = { 0 };
+    init.quiet = true;
+    if(wasm_api_init_with_opts(&init) != WASM_API_OK) {
+        return 1;
+    }
+
+    printf("%-10s %10s %12s\n", "mode", "slices", "ns_per_slice");
+    int rc = run_slices(false) || run_slices(true);
+
+    rc = rc || wasm_sched_init(on_exit_cb, NULL) != 0;
+    if(rc == 0) {
+        printf("\n%d iterations, %lu fuel every %lu us\n", count, budget, period_us);
+        printf("%-10s %10s %10s %10s\n", "mode", "status", "refills", "wall_ms");
+    }
+    rc = rc || run_sched(false, count, budget, period_us * 1000);
+    rc = rc || run_sched(true, count, budget, period_us * 1000);
+
+    wasm_sched_shutdown();
+    wasm_api_cleanup();
+
+    if(rc != 0) {
+        printf("Benchmark failed\n");
+    }
+    return rc;
+}
+
+
+/****************************************************************************
+ * Static Function Implementations
+****************************************************************************/
+
+/**
+ * @brief Run the loop to completion in YIELD_AFTER slices
+ *
+ * @param suspend Suspend on fuel exhaustion, else trap
+ * @return 0 when successful, else 1
+ */
+static int run_slices(bool suspend) {
+    wasmtime_val_t arg = { .kind = WASMTIME_I32, .of.i32 = BENCH_SLICE_COUNT };
+    wasm_api_result_t status;
+    uint64_t slices = 0;
+
+    if(wasm_api_load_partition(0, BENCH_MODULE) != WASM_API_OK || wasm_api_set_args(0, &arg, 1) != WASM_API_OK
+       || wasm_api_set_fuel_suspend(0, suspend) != WASM_API_OK
+       || wasm_api_inject_fuel(0, UINT64_MAX / 2, true) != WASM_API_OK) {
+        return 1;
+    }
+
+    uint64_t start = bench_now_ns();
+    while((status = wasm_api_run_partition(0, "main")) == PARTITION_YIELDED) {
+        slices++;
+    }
+    uint64_t ns = bench_now_ns() - start;
+    wasm_api_unload_partition(0);
+
+    printf("%-10s %10lu %12.1f\n", suspend ? "suspend" : "trap", slices, slices ? (double) ns / slices : 0.0);
+    return status == PARTITION_DONE ? 0 : 1;
+}
+
+
+/**
+ * @brief Schedule the job with a fuel budget per period until it leaves
+ *
+ * @return 0 when the job left the run queue, else 1
+ */
+static int run_sched(bool suspend, int count, uint64_t budget, uint64_t period_ns) {
+    wasmtime_val_t arg = { .kind = WASMTIME_I32, .of.i32 = count };
+    wasm_sched_stats_t before;
+    wasm_sched_stats_t after;
+
+    if(wasm_api_load_partition(0, BENCH_MODULE) != WASM_API_OK || wasm_api_set_args(0, &arg, 1) != WASM_API_OK
+       || wasm_api_set_fuel_suspend(0, suspend) != WASM_API_OK
+       || wasm_api_inject_fuel(0, budget, true) != WASM_API_OK) {
+        return 1;
+    }
+
+    wasm_sched_stats(&before);
+    uint64_t start = bench_now_ns();
+    int rc = wasm_sched_set_fuel_period(0, budget, period_ns) != 0 || wasm_sched_add(0, "main") != 0;
+
+    // Sleeps out the periods like an event loop on wasm_sched_timeout_ms
+    while(rc == 0 && wasm_sched_active() > 0) {
+        int timeout = wasm_sched_timeout_ms();
+        if(timeout > 0) {
+            struct timespec ts = { .tv_sec = timeout / 1000, .tv_nsec = (timeout % 1000) * 1000000L };
+            nanosleep(&ts, NULL);
+        }
+        wasm_sched_step(NULL);
+    }
+    uint64_t ns = bench_now_ns() - start;
+    wasm_sched_stats(&after);
+
+    wasm_sched_set_fuel_period(0, 0, 0);
+    wasm_api_unload_partition(0);
+
+    if(rc == 0) {
+        printf("%-10s %10s %10lu %10.1f\n", suspend ? "suspend" : "trap",
+               g_exit_status == PARTITION_DONE ? "done" : "trapped", after.refills - before.refills, ns / 1e6);
+    }
+    return rc;
+}
+
+
+static void on_exit_cb(int partition_id, wasm_api_result_t status, void *env) {
+    (void) partition_id;
+    (void) env;
+    g_exit_status = status;
+}
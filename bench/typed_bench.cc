@@ -0,0 +1,226 @@
+/*
+ * typed_bench.cc
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+// Per-call cost of TypedFunc against the generic path, a call by name
+// through wasm_api_run_partition. The engine has async support, which rules
+// out the checked wasmtime_func_call, so the sync typed call is compared
+// with the generic async path as well. A short fib keeps the guest work
+// small against the call overhead.
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include "../src/wasm_typed.hh"
+extern "C" {
+#include "bench_util.h"
+}
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+/****************************************************************************
+ * Defines
+****************************************************************************/
+#define BENCH_FUEL          (1ull << 60)
+#define BENCH_WARMUP        1
+#define BENCH_REPEAT        5
+#define BENCH_CALLS         100000
+#define BENCH_ARG           1
+#define PARTITION           0
+
+
+using wasm_typed::TypedFunc;
+using Fib = TypedFunc<int32_t(int32_t)>;
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+typedef enum {
+    PATH_ASYNC_GENERIC,         // wasm_api_set_args + wasm_api_run_partition by name
+    PATH_ASYNC_TYPED,           // TypedFunc::start + wasm_api_run_partition
+    PATH_SYNC_TYPED,            // TypedFunc::call
+    PATH_COUNT
+} call_path_t;
+
+static const char *const g_path_names[PATH_COUNT] = {
+    "async generic", "async typed", "sync typed"
+};
+
+
+/****************************************************************************
+ * Static Function Prototypes
+****************************************************************************/
+static int run_calls(call_path_t path, const Fib &fib, int32_t arg, int calls, int64_t *sum);
+
+
+/****************************************************************************
+ * Main
+****************************************************************************/
+
+int main(int argc, char **argv) {
+    int calls = BENCH_CALLS;
+    int repeat = BENCH_REPEAT;
+    int32_t arg = BENCH_ARG;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--calls") == 0 && i + 1 < argc) {
+            calls = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--arg") == 0 && i + 1 < argc) {
+            arg = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+        } else {
+            printf("Usage: %s [--calls %d] [--arg %d] [--repeat %d]\n",
+                   argv[0], BENCH_CALLS, BENCH_ARG, BENCH_REPEAT);
+            return 1;
+        }
+    }
+
+    if(calls <= 0 || repeat <= 0 || arg < 0) {
+        printf("Invalid arguments\n");
+        return 1;
+    }
+
+    bench_clock_init(BENCH_CLOCK_MONOTONIC);
+
+    wasm_api_init_opts_t opts = {};
+    opts.quiet = true;
+    if(wasm_api_init_with_opts(&opts) != WASM_API_OK) {
+        return 1;
+    }
+
+    if(wasm_api_load_partition(PARTITION, "wasm/fib.wasm") != WASM_API_OK) {
+        wasm_api_cleanup();
+        return 1;
+    }
+
+    std::optional<Fib> fib = Fib::bind(PARTITION, "main");
+    if(!fib) {
+        wasm_api_cleanup();
+        return 1;
+    }
+
+    uint64_t *samples = (uint64_t *) calloc((size_t) repeat, sizeof(uint64_t));
+    if(!samples) {
+        wasm_api_cleanup();
+        return 1;
+    }
+
+    printf("%14s %12s %12s %10s\n", "path", "median_ms", "ns/call", "vs_generic");
+
+    int rc = 0;
+    int64_t expected = 0;
+    double generic_ns = 0.0;
+    for(int path = 0; path < PATH_COUNT && rc == 0; path++) {
+        int64_t sum = 0;
+        bench_stats_t stats;
+
+        // Async paths may yield, sync paths run without a yield interval
+        wasm_api_inject_fuel(PARTITION, BENCH_FUEL, path == PATH_ASYNC_GENERIC || path == PATH_ASYNC_TYPED);
+
+        for(int run = 0; run < BENCH_WARMUP + repeat && rc == 0; run++) {
+            uint64_t start = bench_now_ns();
+            rc = run_calls((call_path_t) path, *fib, arg, calls, &sum);
+            uint64_t end = bench_now_ns();
+
+            if(run >= BENCH_WARMUP) {
+                samples[run - BENCH_WARMUP] = end - start;
+            }
+        }
+
+        if(rc != 0) {
+            printf("%s failed\n", g_path_names[path]);
+            break;
+        }
+
+        // Every path computes the same sum
+        if(path == PATH_ASYNC_GENERIC) {
+            expected = sum;
+        } else if(sum != expected) {
+            printf("%s: wrong sum %ld, expected %ld\n", g_path_names[path], sum, expected);
+            rc = 1;
+            break;
+        }
+
+        bench_compute_stats(samples, (size_t) repeat, &stats);
+        double per_call = stats.median / calls;
+        if(path == PATH_ASYNC_GENERIC) {
+            generic_ns = per_call;
+        }
+
+        printf("%14s %12.2f %12.1f %+9.1f%%\n", g_path_names[path], stats.median / 1e6, per_call,
+               100.0 * (per_call - generic_ns) / generic_ns);
+    }
+
+    free(samples);
+    wasm_api_cleanup();
+    return rc;
+}
+
+
+/****************************************************************************
+ * Static Function Implementations
+****************************************************************************/
+
+/**
+ * @brief Call fib(arg) calls times through one path, adds the results to sum
+ *
+ * @return 0 when successful, else 1
+ */
+static int run_calls(call_path_t path, const Fib &fib, int32_t arg, int calls, int64_t *sum) {
+    wasm_partition_t *partition = get_wasm_partition(PARTITION);
+    wasmtime_val_t val = {};
+    val.kind = WASMTIME_I32;
+    val.of.i32 = arg;
+
+    for(int i = 0; i < calls; i++) {
+        wasm_api_result_t status = PARTITION_YIELDED;
+
+        switch(path) {
+        case PATH_ASYNC_GENERIC:
+            wasm_api_set_args(PARTITION, &val, 1);
+            while(status == PARTITION_YIELDED) {
+                status = wasm_api_run_partition(PARTITION, "main");
+            }
+            if(status != PARTITION_DONE) {
+                return 1;
+            }
+            *sum += partition->results[0].of.i32;
+            break;
+
+        case PATH_ASYNC_TYPED:
+            if(fib.start(arg) != WASM_API_OK) {
+                return 1;
+            }
+            while(status == PARTITION_YIELDED) {
+                status = wasm_api_run_partition(PARTITION, NULL);
+            }
+            if(status != PARTITION_DONE) {
+                return 1;
+            }
+            *sum += fib.result();
+            break;
+
+        case PATH_SYNC_TYPED: {
+            auto result = fib.call(arg);
+            if(!result) {
+                return 1;
+            }
+            *sum += result.unwrap();
+            break;
+        }
+
+        default:
+            return 1;
+        }
+    }
+
+    return 0;
+}
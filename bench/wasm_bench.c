@@ -0,0 +1,404 @@
+/*
+ * wasm_bench.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+// Benchmark harness: runs workloads to completion through the fuel scheduler
+// for every combination of workload argument, yield interval and partition count.
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include "../src/wasm_api.h"
+#include "bench_util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/****************************************************************************
+ * Defines
+****************************************************************************/
+#define BENCH_FUEL          (1ull << 60)    // Workloads must never run out
+#define BENCH_MAX_LIST      32
+#define BENCH_WARMUP        3
+#define BENCH_REPEAT        10
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+typedef struct bench_workload {
+    const char *name;
+    const char *wasm_file;
+    uint64_t default_arg;       // fib depth, loop count, memory passes
+} bench_workload_t;
+
+typedef enum {
+    FORMAT_TABLE,
+    FORMAT_CSV,
+    FORMAT_JSON
+} bench_format_t;
+
+typedef struct bench_result {
+    const char *workload;
+    uint64_t arg;
+    uint64_t yield_interval;
+    uint64_t partitions;
+    uint64_t slices;            // Slices of one repetition, over all partitions
+    bench_stats_t stats;
+} bench_result_t;
+
+
+/****************************************************************************
+ * Workloads
+****************************************************************************/
+static const bench_workload_t g_workloads[] = {
+    { "fib",    "wasm/fib.wasm",    20 },
+    { "loop",   "wasm/loop.wasm",   1000000 },
+    { "memory", "wasm/memory.wasm", 4 },
+};
+
+
+/****************************************************************************
+ * Static Function Prototypes
+****************************************************************************/
+static const bench_workload_t *find_workload(const char *name);
+static int run_config(const bench_workload_t *workload, uint64_t arg, uint64_t yield_interval, uint64_t partitions,
+                      int warmup, int repeat, bench_result_t *result);
+static int run_to_completion(int partitions, uint64_t *slices);
+static void print_result(FILE *out, bench_format_t format, const bench_result_t *result, bool first);
+static void usage(const char *prog);
+
+
+/****************************************************************************
+ * Main
+****************************************************************************/
+
+int main(int argc, char **argv) {
+    const char *workload_list = "fib,loop,memory";
+    const char *arg_list = NULL;
+    const char *yield_list = "1000";
+    const char *partition_list = "1,2";
+    const char *out_file = NULL;
+    int warmup = BENCH_WARMUP;
+    int repeat = BENCH_REPEAT;
+    size_t stack_pool = 0;
+    wasm_memory_page_mode_t memory_pages = MEMORY_PAGES_DEFAULT;
+    bool numa_bind = false;
+    const char *record_file = NULL;
+    bench_format_t format = FORMAT_TABLE;
+    bench_clock_t clock = BENCH_CLOCK_MONOTONIC;
+
+    for(int i = 1; i < argc; i++) {
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if(strcmp(argv[i], "--help") == 0 || value == NULL) {
+            usage(argv[0]);
+            return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+
+        if(strcmp(argv[i], "--workload") == 0) {
+            workload_list = value;
+        } else if(strcmp(argv[i], "--arg") == 0) {
+            arg_list = value;
+        } else if(strcmp(argv[i], "--yield") == 0) {
+            yield_list = value;
+        } else if(strcmp(argv[i], "--partitions") == 0) {
+            partition_list = value;
+        } else if(strcmp(argv[i], "--warmup") == 0) {
+            warmup = atoi(value);
+        } else if(strcmp(argv[i], "--repeat") == 0) {
+            repeat = atoi(value);
+        } else if(strcmp(argv[i], "--out") == 0) {
+            out_file = value;
+        } else if(strcmp(argv[i], "--format") == 0) {
+            format = strcmp(value, "csv") == 0 ? FORMAT_CSV : strcmp(value, "json") == 0 ? FORMAT_JSON : FORMAT_TABLE;
+        } else if(strcmp(argv[i], "--stack-pool") == 0) {
+            stack_pool = (size_t) atol(value);
+        } else if(strcmp(argv[i], "--hugepages") == 0) {
+            memory_pages = strcmp(value, "explicit") == 0 ? MEMORY_PAGES_EXPLICIT
+                         : strcmp(value, "thp") == 0 ? MEMORY_PAGES_TRANSPARENT : MEMORY_PAGES_DEFAULT;
+        } else if(strcmp(argv[i], "--numa-bind") == 0) {
+            numa_bind = strcmp(value, "on") == 0;
+        } else if(strcmp(argv[i], "--clock") == 0) {
+            clock = strcmp(value, "tsc") == 0 ? BENCH_CLOCK_TSC : BENCH_CLOCK_MONOTONIC;
+        } else if(strcmp(argv[i], "--record") == 0) {
+            record_file = value;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+
+    if(repeat <= 0 || warmup < 0) {
+        printf("Invalid repeat/warmup count\n");
+        return 1;
+    }
+
+    uint64_t args[BENCH_MAX_LIST];
+    uint64_t yields[BENCH_MAX_LIST];
+    uint64_t partitions[BENCH_MAX_LIST];
+    size_t nargs = arg_list ? bench_parse_list(arg_list, args, BENCH_MAX_LIST) : 0;
+    size_t nyields = bench_parse_list(yield_list, yields, BENCH_MAX_LIST);
+    size_t npartitions = bench_parse_list(partition_list, partitions, BENCH_MAX_LIST);
+
+    for(size_t p = 0; p < npartitions; p++) {
+        if(partitions[p] == 0 || partitions[p] > NUM_MAX_PARTITIONS) {
+            printf("Partition count must be between 1 and %d\n", NUM_MAX_PARTITIONS);
+            return 1;
+        }
+    }
+
+    if(bench_clock_init(clock) != 0) {
+        return 1;
+    }
+
+    FILE *out = stdout;
+    if(out_file != NULL) {
+        out = fopen(out_file, "w");
+        if(!out) {
+            printf("> Error opening output file: %s\n", out_file);
+            return 1;
+        }
+    }
+
+    wasm_api_init_opts_t opts = {
+        .quiet = true,
+        .stack_pool_size = stack_pool,
+        .memory_pages = memory_pages,
+        .memory_numa_bind = numa_bind,
+        .record_file = record_file
+    };
+    if(wasm_api_init_with_opts(&opts) != WASM_API_OK) {
+        return 1;
+    }
+
+    char *workloads = strdup(workload_list);
+    bool first = true;
+    int rc = 0;
+
+    if(format == FORMAT_JSON) {
+        fprintf(out, "[\n");
+    }
+
+    for(char *name = strtok(workloads, ","); name != NULL && rc == 0; name = strtok(NULL, ",")) {
+        const bench_workload_t *workload = find_workload(name);
+        if(workload == NULL) {
+            printf("Unknown workload '%s'\n", name);
+            rc = 1;
+            break;
+        }
+
+        size_t n = nargs ? nargs : 1;
+        for(size_t a = 0; a < n && rc == 0; a++) {
+            uint64_t arg = nargs ? args[a] : workload->default_arg;
+
+            for(size_t y = 0; y < nyields && rc == 0; y++) {
+                for(size_t p = 0; p < npartitions && rc == 0; p++) {
+                    bench_result_t result;
+                    rc = run_config(workload, arg, yields[y], partitions[p], warmup, repeat, &result);
+                    if(rc == 0) {
+                        print_result(out, format, &result, first);
+                        first = false;
+                        fflush(out);
+                    }
+                }
+            }
+        }
+    }
+
+    if(format == FORMAT_JSON) {
+        fprintf(out, "\n]\n");
+    }
+
+    wasm_api_stats_t stats;
+    wasm_api_get_stats(&stats);
+    if(stack_pool > 0) {
+        printf("stack pool: %zu stacks, high water %zu stacks / %zu KiB, exhausted %lu\n",
+               stats.stack_pool.stacks_total, stats.stack_pool.stacks_high_water,
+               stats.stack_pool.stack_bytes_high_water / 1024, stats.stack_pool.stack_exhausted);
+    }
+    if(memory_pages != MEMORY_PAGES_DEFAULT || numa_bind) {
+        printf("memories: %lu created, %lu reused, %lu explicit hugepage fallbacks, %lu NUMA bind errors\n",
+               stats.memory.memories_created, stats.memory.reservations_reused,
+               stats.memory.hugetlb_fallbacks, stats.memory.numa_bind_errors);
+    }
+    if(record_file != NULL) {
+        printf("replay log: %lu slices, %lu host results, %lu KiB\n",
+               stats.replay.slices, stats.replay.host_results, stats.replay.bytes / 1024);
+    }
+
+    free(workloads);
+    wasm_api_cleanup();
+
+    if(out != stdout) {
+        fclose(out);
+    }
+
+    return rc;
+}
+
+
+/****************************************************************************
+ * Static Function Implementations
+****************************************************************************/
+
+static const bench_workload_t *find_workload(const char *name) {
+    for(size_t i = 0; i < sizeof(g_workloads) / sizeof(g_workloads[0]); i++) {
+        if(strcmp(g_workloads[i].name, name) == 0) {
+            return &g_workloads[i];
+        }
+    }
+    return NULL;
+}
+
+
+/**
+ * @brief Loads the partitions, runs warm-up and measured repetitions
+ *
+ * @return 0 when successful, else 1
+ */
+static int run_config(const bench_workload_t *workload, uint64_t arg, uint64_t yield_interval, uint64_t partitions,
+                      int warmup, int repeat, bench_result_t *result) {
+
+    wasmtime_val_t call_arg = { .kind = WASMTIME_I32, .of.i32 = (int32_t) arg };
+    int rc = 0;
+
+    for(int id = 0; id < (int) partitions; id++) {
+        if(wasm_api_load_partition(id, workload->wasm_file) != WASM_API_OK
+           || wasm_api_set_args(id, &call_arg, 1) != WASM_API_OK
+           || wasm_api_set_yield_interval(id, yield_interval) != WASM_API_OK) {
+            rc = 1;
+            break;
+        }
+    }
+
+    uint64_t *samples = calloc((size_t) repeat, sizeof(uint64_t));
+    uint64_t slices = 0;
+
+    for(int run = 0; run < warmup + repeat && rc == 0 && samples; run++) {
+        for(int id = 0; id < (int) partitions; id++) {
+            wasm_api_inject_fuel(id, BENCH_FUEL, true);
+        }
+
+        uint64_t start = bench_now_ns();
+        rc = run_to_completion((int) partitions, &slices);
+        uint64_t end = bench_now_ns();
+
+        if(run >= warmup) {
+            samples[run - warmup] = end - start;
+        }
+    }
+
+    if(rc == 0 && samples) {
+        result->workload = workload->name;
+        result->arg = arg;
+        result->yield_interval = yield_interval;
+        result->partitions = partitions;
+        result->slices = slices;
+        bench_compute_stats(samples, (size_t) repeat, &result->stats);
+    }
+
+    free(samples);
+
+    for(int id = 0; id < (int) partitions; id++) {
+        wasm_api_unload_partition(id);
+    }
+
+    return (rc == 0 && samples) ? 0 : 1;
+}
+
+
+/**
+ * @brief Round robin until every partition finished one call. A yield is not
+ *        a failure, only PARTITION_ERROR and WASM_API_ERR are
+ *
+ * @return 0 when successful, else 1
+ */
+static int run_to_completion(int partitions, uint64_t *slices) {
+    bool done[NUM_MAX_PARTITIONS] = { false };
+    int remaining = partitions;
+    uint64_t count = 0;
+
+    while(remaining > 0) {
+        for(int id = 0; id < partitions; id++) {
+            if(done[id]) {
+                continue;
+            }
+
+            wasm_api_result_t status = wasm_api_run_partition(id, "main");
+            count++;
+
+            if(status == PARTITION_DONE) {
+                done[id] = true;
+                remaining--;
+            } else if(status != PARTITION_YIELDED) {
+                printf("Partition %d failed with status %d\n", id, status);
+                return 1;
+            }
+        }
+    }
+
+    *slices = count;
+    return 0;
+}
+
+
+static void print_result(FILE *out, bench_format_t format, const bench_result_t *result, bool first) {
+    const bench_stats_t *s = &result->stats;
+
+    switch(format) {
+        case FORMAT_CSV:
+            if(first) {
+                fprintf(out, "workload,arg,yield_interval,partitions,repeat,slices,min_ns,median_ns,mean_ns,p95_ns,max_ns,stddev_ns\n");
+            }
+            fprintf(out, "%s,%lu,%lu,%lu,%zu,%lu,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f\n",
+                    result->workload, result->arg, result->yield_interval, result->partitions, s->n, result->slices,
+                    s->min, s->median, s->mean, s->p95, s->max, s->stddev);
+        break;
+
+        case FORMAT_JSON:
+            fprintf(out, "%s  {\"workload\":\"%s\",\"arg\":%lu,\"yield_interval\":%lu,\"partitions\":%lu,\"repeat\":%zu,"
+                         "\"slices\":%lu,\"min_ns\":%.0f,\"median_ns\":%.0f,\"mean_ns\":%.0f,\"p95_ns\":%.0f,"
+                         "\"max_ns\":%.0f,\"stddev_ns\":%.0f}",
+                    first ? "" : ",\n", result->workload, result->arg, result->yield_interval, result->partitions, s->n,
+                    result->slices, s->min, s->median, s->mean, s->p95, s->max, s->stddev);
+        break;
+
+        case FORMAT_TABLE:
+        default:
+            if(first) {
+                fprintf(out, "%-8s %10s %10s %5s %10s %12s %12s %12s %12s %10s\n",
+                        "workload", "arg", "yield", "parts", "slices", "min_us", "median_us", "mean_us", "p95_us", "stddev_%");
+            }
+            fprintf(out, "%-8s %10lu %10lu %5lu %10lu %12.1f %12.1f %12.1f %12.1f %10.2f\n",
+                    result->workload, result->arg, result->yield_interval, result->partitions, result->slices,
+                    s->min / 1000.0, s->median / 1000.0, s->mean / 1000.0, s->p95 / 1000.0,
+                    s->mean > 0 ? 100.0 * s->stddev / s->mean : 0.0);
+        break;
+    }
+}
+
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options]\n"
+           "  --workload <list>     fib,loop,memory (default: all)\n"
+           "  --arg <list>          fib depth / loop count / memory passes (default per workload)\n"
+           "  --yield <list>        fuel per slice (default: 1000)\n"
+           "  --partitions <list>   concurrent partitions (default: 1,2)\n"
+           "  --warmup <n>          unmeasured repetitions (default: %d)\n"
+           "  --repeat <n>          measured repetitions (default: %d)\n"
+           "  --stack-pool <n>      preallocated async stacks (default: 0, Wasmtime allocates)\n"
+           "  --hugepages <mode>    linear memory pages: default, thp, explicit\n"
+           "  --numa-bind <on|off>  bind linear memories to the local NUMA node (default: off)\n"
+           "  --clock <mono|tsc>    time source (default: mono)\n"
+           "  --record <file>       record a replay log while measuring\n"
+           "  --format <table|csv|json>\n"
+           "  --out <file>          write results to file instead of stdout\n",
+           prog, BENCH_WARMUP, BENCH_REPEAT);
+}
@@ -0,0 +1,232 @@
+/*
+ * yield_bench.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+// Context-switch microbenchmark: cost of one fuel yield/resume round-trip
+// through wasmtime_call_future_poll, swept over the yield interval.
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include "../src/wasm_api.h"
+#include "bench_util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/****************************************************************************
+ * Defines
+****************************************************************************/
+#define BENCH_FUEL          (1ull << 60)
+#define BENCH_WARMUP        3
+#define BENCH_REPEAT        20
+#define FIB_DEPTH           25
+#define INTERVAL_MIN        100
+#define INTERVAL_MAX        10000000
+#define INTERVAL_STEPS      6               // 10^2 .. 10^7
+#define AFFORDABLE_PCT      5.0             // Yield overhead considered affordable
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+typedef enum {
+    MODE_NO_FUEL,               // Engine without fuel metering
+    MODE_FUEL,                  // Fuel metering, never yields
+    MODE_YIELD                  // Fuel metering, yields every interval
+} run_mode_t;
+
+typedef struct yield_workload {
+    const char *wasm_file;
+    bool has_arg;
+} yield_workload_t;
+
+
+/****************************************************************************
+ * Workloads
+****************************************************************************/
+static const yield_workload_t g_workloads[] = {
+    { "wasm/fib.wasm",  true },
+    { "wasm/main.wasm", false },
+};
+
+
+/****************************************************************************
+ * Static Function Prototypes
+****************************************************************************/
+static int measure(const yield_workload_t *workload, run_mode_t mode, uint64_t interval, int repeat,
+                   double *median_ns, uint64_t *yields);
+
+
+/****************************************************************************
+ * Main
+****************************************************************************/
+
+int main(int argc, char **argv) {
+    int repeat = BENCH_REPEAT;
+
+    if(argc > 1) {
+        repeat = atoi(argv[1]);
+        if(repeat <= 0) {
+            printf("Usage: %s [repeat]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    bench_clock_init(BENCH_CLOCK_MONOTONIC);
+
+    for(size_t w = 0; w < sizeof(g_workloads) / sizeof(g_workloads[0]); w++) {
+        const yield_workload_t *workload = &g_workloads[w];
+        double no_fuel_ns = 0.0;
+        double fuel_ns = 0.0;
+        uint64_t yields = 0;
+
+        // The engine decides whether code is metered, so each mode gets its own
+        wasm_api_init_opts_t opts = { .quiet = true, .no_fuel = true };
+        if(wasm_api_init_with_opts(&opts) != WASM_API_OK
+           || measure(workload, MODE_NO_FUEL, 0, repeat, &no_fuel_ns, &yields) != 0) {
+            return 1;
+        }
+        wasm_api_cleanup();
+
+        opts.no_fuel = false;
+        if(wasm_api_init_with_opts(&opts) != WASM_API_OK
+           || measure(workload, MODE_FUEL, 0, repeat, &fuel_ns, &yields) != 0) {
+            return 1;
+        }
+
+        if(workload->has_arg) {
+            printf("\n%s (fib %d)\n", workload->wasm_file, FIB_DEPTH);
+        } else {
+            printf("\n%s\n", workload->wasm_file);
+        }
+        printf("  no fuel:           %12.1f us\n", no_fuel_ns / 1000.0);
+        printf("  fuel, no yield:    %12.1f us  (metering overhead %+.1f%%)\n",
+               fuel_ns / 1000.0, 100.0 * (fuel_ns - no_fuel_ns) / no_fuel_ns);
+        printf("  %10s %10s %14s %14s %12s\n", "interval", "yields", "runtime_us", "per_yield_ns", "vs_no_fuel");
+
+        uint64_t intervals[INTERVAL_STEPS];
+        double xs[INTERVAL_STEPS];
+        double ys[INTERVAL_STEPS];
+        int n = 0;
+
+        for(uint64_t interval = INTERVAL_MIN; interval <= INTERVAL_MAX && n < INTERVAL_STEPS; interval *= 10) {
+            double yield_ns = 0.0;
+            if(measure(workload, MODE_YIELD, interval, repeat, &yield_ns, &yields) != 0) {
+                return 1;
+            }
+            intervals[n] = interval;
+            xs[n] = (double) yields;
+            ys[n] = yield_ns;
+            n++;
+        }
+
+        // Least-squares fit runtime = base + yields * cost, less sensitive to
+        // noise than differences against a single no-yield run
+        double mx = 0.0, my = 0.0, sxx = 0.0, sxy = 0.0;
+        for(int i = 0; i < n; i++) {
+            mx += xs[i] / n;
+            my += ys[i] / n;
+        }
+        for(int i = 0; i < n; i++) {
+            sxx += (xs[i] - mx) * (xs[i] - mx);
+            sxy += (xs[i] - mx) * (ys[i] - my);
+        }
+        double cost = sxx > 0 ? sxy / sxx : 0.0;
+        double base = my - cost * mx;
+        uint64_t affordable = 0;
+
+        for(int i = 0; i < n; i++) {
+            double per_yield = xs[i] > 0 ? (ys[i] - base) / xs[i] : 0.0;
+            printf("  %10lu %10.0f %14.1f %14.1f %+11.1f%%\n",
+                   intervals[i], xs[i], ys[i] / 1000.0, per_yield, 100.0 * (ys[i] - no_fuel_ns) / no_fuel_ns);
+
+            if(affordable == 0 && 100.0 * xs[i] * cost / base < AFFORDABLE_PCT) {
+                affordable = intervals[i];
+            }
+        }
+
+        printf("  per-yield cost (least squares): %.1f ns\n", cost);
+        if(affordable) {
+            printf("  smallest interval with < %.0f%% yield overhead: %lu\n", AFFORDABLE_PCT, affordable);
+        }
+
+        wasm_api_cleanup();
+    }
+
+    return 0;
+}
+
+
+/****************************************************************************
+ * Static Function Implementations
+****************************************************************************/
+
+/**
+ * @brief Median runtime of one call to completion and the yields it took
+ *
+ * @return 0 when successful, else 1
+ */
+static int measure(const yield_workload_t *workload, run_mode_t mode, uint64_t interval, int repeat,
+                   double *median_ns, uint64_t *yields) {
+
+    if(wasm_api_load_partition(0, workload->wasm_file) != WASM_API_OK) {
+        return 1;
+    }
+
+    if(workload->has_arg) {
+        wasmtime_val_t arg = { .kind = WASMTIME_I32, .of.i32 = FIB_DEPTH };
+        wasm_api_set_args(0, &arg, 1);
+    }
+
+    if(mode == MODE_YIELD) {
+        wasm_api_set_yield_interval(0, interval);
+    }
+
+    uint64_t *samples = calloc((size_t) repeat, sizeof(uint64_t));
+    if(!samples) {
+        wasm_api_unload_partition(0);
+        return 1;
+    }
+
+    int rc = 0;
+    for(int run = 0; run < BENCH_WARMUP + repeat && rc == 0; run++) {
+        if(mode != MODE_NO_FUEL) {
+            wasm_api_inject_fuel(0, BENCH_FUEL, mode == MODE_YIELD);
+        }
+
+        uint64_t polls = 0;
+        wasm_api_result_t status;
+
+        uint64_t start = bench_now_ns();
+        do {
+            status = wasm_api_run_partition(0, "main");
+            polls++;
+        } while(status == PARTITION_YIELDED);
+        uint64_t end = bench_now_ns();
+
+        if(status != PARTITION_DONE) {
+            printf("%s failed with status %d\n", workload->wasm_file, status);
+            rc = 1;
+        }
+
+        if(run >= BENCH_WARMUP) {
+            samples[run - BENCH_WARMUP] = end - start;
+        }
+        *yields = polls - 1;
+    }
+
+    bench_stats_t stats;
+    bench_compute_stats(samples, (size_t) repeat, &stats);
+    *median_ns = stats.median;
+
+    free(samples);
+    wasm_api_unload_partition(0);
+
+    return rc;
+}
@@ -1,24 +1,125 @@
 
 
 #include "src/wasm_api.h"
+#include "src/wasm_sched.h"
+#include "src/wasm_trace.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <time.h>
-#include <sys/time.h>
 #include <unistd.h>
+#include <sys/epoll.h>
+
+#define SCHED_STEP_NS   (10 * 1000 * 1000)  // Wasm time between event loop iterations
 
-// Benchmark related functions
-static uint64_t getTimeUs();
-static uint64_t runPartitionBenchmark_I(int partition_id, const char* func_name);
 static void sched_cycle();
-static void printInfo(int partition_id, int run);
+static void sched_exit(int partition_id, wasm_api_result_t status, void *env);
+static void stop_handler(int signum);
+static void host_sleep_ms(void *env, const wasmtime_val_t *params, size_t nparams, wasmtime_val_t *results, size_t nresults);
+
+// Set on SIGINT/SIGTERM, sched_cycle returns so cleanup writes traces and profiles
+static volatile sig_atomic_t g_stop = 0;
 
 
 int main(int argc, char** argv) {
 
-    int benchmark_mode = (argc > 1 && strcmp(argv[1], "--benchmark") == 0);
+    wasm_api_init_opts_t opts = {0};
+    wasm_sched_restart_t restart = {0};
+    uint32_t profile_every = 0;
+    uint64_t fuel_period_ms = 0;
+
+#ifdef SCHED_PROFILING
+    // Profiling variant (make profile), see README
+    opts.jit_profiler = WASMTIME_PROFILING_STRATEGY_JITDUMP;
+    opts.debug_info = true;
+#endif
+
+    // --trace <file>: record scheduler activity, flushed on SIGUSR1 or exit
+    // --guest-profile <N>: sample guest stacks every Nth fuel yield, written on exit
+    // --jit-profiler <jitdump|perfmap|vtune|none>: expose JIT code to perf/VTune
+    // --sched-cpus <list>, --housekeeping-cpus <list>, --fifo <prio>, --mlock: steady slice timing
+    // --record <file>, --replay <file>: record the interleaving and host results, or replay them
+    // --tiered: start on quickly compiled code, recompile hot modules optimized in the background
+    // --cache <dir>: keep compiled modules on disk, restarts skip compiling unchanged ones
+    // --restart <never|immediate|backoff>: restart trapped partitions, at most 10 times a minute
+    // --fuel-period <ms>: FUEL_AMOUNT per period, partitions out of fuel wait starved for the next one
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--debug-info") == 0) {
+            opts.debug_info = true;
+        }
+        if(strcmp(argv[i], "--mlock") == 0) {
+            opts.lock_memory = true;
+        }
+        if(strcmp(argv[i], "--tiered") == 0) {
+            opts.tiered = true;
+        }
+        if(i == argc - 1) {
+            break;
+        }
+        if(strcmp(argv[i], "--trace") == 0) {
+            if(wasm_trace_init(argv[i + 1], 0) != 0) return 1;
+            printf("Tracing to %s, send SIGUSR1 to flush\n", argv[i + 1]);
+        }
+        if(strcmp(argv[i], "--guest-profile") == 0) {
+            profile_every = (uint32_t) strtoul(argv[i + 1], NULL, 10);
+            opts.guest_profiling = true;
+        }
+        if(strcmp(argv[i], "--jit-profiler") == 0) {
+            const char *strategy = argv[i + 1];
+            if(strcmp(strategy, "jitdump") == 0) {
+                opts.jit_profiler = WASMTIME_PROFILING_STRATEGY_JITDUMP;
+            } else if(strcmp(strategy, "perfmap") == 0) {
+                opts.jit_profiler = WASMTIME_PROFILING_STRATEGY_PERFMAP;
+            } else if(strcmp(strategy, "vtune") == 0) {
+                opts.jit_profiler = WASMTIME_PROFILING_STRATEGY_VTUNE;
+            } else {
+                opts.jit_profiler = WASMTIME_PROFILING_STRATEGY_NONE;
+            }
+        }
+        if(strcmp(argv[i], "--sched-cpus") == 0) {
+            opts.sched_cpus = argv[i + 1];
+        }
+        if(strcmp(argv[i], "--housekeeping-cpus") == 0) {
+            opts.housekeeping_cpus = argv[i + 1];
+        }
+        if(strcmp(argv[i], "--fifo") == 0) {
+            opts.sched_fifo_priority = atoi(argv[i + 1]);
+        }
+        if(strcmp(argv[i], "--record") == 0) {
+            opts.record_file = argv[i + 1];
+        }
+        if(strcmp(argv[i], "--replay") == 0) {
+            opts.replay_file = argv[i + 1];
+        }
+        if(strcmp(argv[i], "--cache") == 0) {
+            opts.cache_dir = argv[i + 1];
+        }
+        if(strcmp(argv[i], "--restart") == 0) {
+            const char *mode = argv[i + 1];
+            restart.mode = strcmp(mode, "immediate") == 0 ? RESTART_IMMEDIATE
+                         : strcmp(mode, "backoff") == 0 ? RESTART_BACKOFF : RESTART_NEVER;
+            restart.max_restarts = 10;
+        }
+        if(strcmp(argv[i], "--fuel-period") == 0) {
+            fuel_period_ms = strtoull(argv[i + 1], NULL, 10);
+        }
+    }
+
+    signal(SIGINT, stop_handler);
+    signal(SIGTERM, stop_handler);
 
-    if(wasm_api_init() != WASM_API_OK) return 1;
+    // host.open/read/write/close on the scheduler thread's io_uring, files below the working directory
+    opts.host_io = true;
+    opts.host_io_root = ".";
+
+    if(wasm_api_init_with_opts(&opts) != WASM_API_OK) return 1;
+
+    // host.sleep_ms(i32) -> i32, runs on the completion queue while the guest is suspended
+    wasm_valkind_t sleep_params[] = { WASM_I32 };
+    wasm_valkind_t sleep_results[] = { WASM_I32 };
+    if(wasm_api_define_async_func("host", "sleep_ms", sleep_params, 1, sleep_results, 1, host_sleep_ms, NULL) != WASM_API_OK) return 1;
 
     if(wasm_api_load_partition(0, "wasm/fib.wasm") != WASM_API_OK) return WASM_API_ERR;
 
@@ -28,95 +129,131 @@ int main(int argc, char** argv) {
 
     if(wasm_api_inject_fuel(1, FUEL_AMOUNT, true) != WASM_API_OK) return WASM_API_ERR;
 
-    sched_cycle();
-
-    // if(benchmark_mode) {
-    //     printf("Running in benchmark mode\n");
-
-    //     uint64_t total_time[2] = {0, 0};
+    if(wasm_api_load_partition(2, "wasm/sleep.wasm") != WASM_API_OK) return WASM_API_ERR;
 
-    //     for(int run = 0; run < NUM_RUNS; run++) {
-    //         printf("\n##################### Run %d: #####################\n", run + 1);
-    //         uint64_t t0 = runPartitionBenchmark_I(0, "main");
-    //         uint64_t t1 = runPartitionBenchmark_I(1, "main");
+    if(wasm_api_inject_fuel(2, FUEL_AMOUNT, true) != WASM_API_OK) return WASM_API_ERR;
 
-    //         printInfo(0, run);            
-    //         printInfo(1, run);
+    if(wasm_api_load_partition(3, "wasm/io.wasm") != WASM_API_OK) return WASM_API_ERR;
 
-    //         total_time[0] += t0;
-    //         total_time[1] += t1;
+    if(wasm_api_inject_fuel(3, FUEL_AMOUNT, true) != WASM_API_OK) return WASM_API_ERR;
 
-    //     }
+    // Partition 4 feeds partition 5 through the queuing port "pipe"
+    int pipe_port;
+    if(wasm_api_create_queuing_port("pipe", 64, 16, 4, 5, &pipe_port) != WASM_API_OK) return WASM_API_ERR;
 
-    //     printf("\nAverage time Partition 0: %lu µs\n", total_time[0] / NUM_RUNS);
-    //     printf("Average time Partition 1: %lu µs\n", total_time[1] / NUM_RUNS);
+    if(wasm_api_load_partition(4, "wasm/producer.wasm") != WASM_API_OK) return WASM_API_ERR;
 
-    // }else {
-    //     if(runPartitionBenchmark_I(0, "main") == (uint64_t) WASM_API_ERR) return 1;
-    //     if(runPartitionBenchmark_I(1, "main") == (uint64_t) WASM_API_ERR) return 1;
-    // }
+    if(wasm_api_inject_fuel(4, FUEL_AMOUNT, true) != WASM_API_OK) return WASM_API_ERR;
 
-    wasm_api_cleanup();
+    if(wasm_api_load_partition(5, "wasm/consumer.wasm") != WASM_API_OK) return WASM_API_ERR;
 
-    return 0;
-}
+    if(wasm_api_inject_fuel(5, FUEL_AMOUNT, true) != WASM_API_OK) return WASM_API_ERR;
 
+    if(opts.guest_profiling) {
+        if(wasm_api_profile_partition(0, profile_every, "profile_0.json") != WASM_API_OK) return WASM_API_ERR;
+        if(wasm_api_profile_partition(1, profile_every, "profile_1.json") != WASM_API_OK) return WASM_API_ERR;
+    }
 
-static uint64_t getTimeUs(){
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return ((uint64_t)tv.tv_sec * 1000000 + tv.tv_usec);
-}
+    if(wasm_sched_init(sched_exit, NULL) != 0) return WASM_API_ERR;
 
-static uint64_t runPartitionBenchmark_I(int partition_id, const char* func_name) {
-    uint64_t start = getTimeUs();
+    for(int id = 0; id <= 5; id++) {
+        if(wasm_sched_set_restart(id, &restart) != 0) return WASM_API_ERR;
+        if(fuel_period_ms > 0) {
+            if(wasm_api_set_fuel_suspend(id, true) != WASM_API_OK) return WASM_API_ERR;
+            if(wasm_sched_set_fuel_period(id, FUEL_AMOUNT, fuel_period_ms * 1000000ull) != 0) return WASM_API_ERR;
+        }
+        if(wasm_sched_add(id, "main") != 0) return WASM_API_ERR;
+    }
 
-    if(wasm_api_run_partition(partition_id, func_name) != WASM_API_OK) return 0; 
+    // Everything is compiled and prefaulted, from here on only slices run on the scheduler CPUs
+    if(wasm_api_rt_enter() != WASM_API_OK) return WASM_API_ERR;
 
-    uint64_t end = getTimeUs();
-    uint64_t duration = end - start;
+    sched_cycle();
 
-    printf("Partition %d ran '%s' in %lu µs\n", partition_id, func_name, duration);
+    wasm_sched_shutdown();
+    wasm_api_cleanup();
 
-    return duration;
+    return 0;
 }
 
+
+// Event loop over the scheduler's readiness fd, other fds of the process
+// (sockets, timers) would be added to the same epoll set
 static void sched_cycle() {
-    int num_partition = 0;
+    wasm_sched_budget_t budget = { .time_ns = SCHED_STEP_NS, .fuel = 0 };
+    struct epoll_event event = { .events = EPOLLIN, .data.fd = wasm_sched_fd() };
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if(epoll_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wasm_sched_fd(), &event) != 0) {
+        printf("Failed to set up epoll\n");
+        if(epoll_fd >= 0) {
+            close(epoll_fd);
+        }
+        return;
+    }
 
-    while(1) {
-        int current_partition = num_partition;
-        printf("<<<<<<<<<<<<<<<<<<<< Partition %u >>>>>>>>>>>>>>>>>>>>\n", current_partition);
-        wasm_api_result_t status = wasm_api_run_partition(current_partition, "main");
+    while(!g_stop && wasm_sched_active() > 0) {
+        struct epoll_event ready;
+
+        // Blocks while every partition waits for a host call, a restart backoff or a refill
+        int n = epoll_wait(epoll_fd, &ready, 1, wasm_sched_timeout_ms());
+        if(n < 0) {
+            if(errno != EINTR) {
+                printf("epoll_wait failed: %s\n", strerror(errno));
+                break;
+            }
+            continue;
+        }
 
-        switch (status) {
-            case PARTITION_DONE:
-                printf("Partition %d finished execution\n", current_partition);
-            break;
+        if(n == 0 || ready.data.fd == wasm_sched_fd()) {
+            wasm_sched_step(&budget);
+        }
+        wasm_trace_poll();
+    }
 
-            case PARTITION_YIELDED:
-                num_partition = (num_partition + 1) % NUM_MAX_PARTITIONS;
-                printf("Partition %d yielded, executing Partition %d next\n", current_partition, num_partition);
-            break;
+    close(epoll_fd);
+}
 
-            case PARTITION_ERROR:
-                printf("Partition %d encountered an error\n", current_partition);
-            break;
 
-            default:
-                printf("Unknown status from Partition %d\n", current_partition);
-            break;
-        }
-        sleep(1);
+static void sched_exit(int partition_id, wasm_api_result_t status, void *env) {
+    char msg[FAULT_MESSAGE_MAX];
+    char trace[FAULT_MESSAGE_MAX];
+    (void) env;
+
+    switch (status) {
+        case PARTITION_DONE:
+            printf("Partition %d finished execution\n", partition_id);
+        break;
+
+        // The fault is only formatted here, on demand
+        case PARTITION_ERROR:
+        case PARTITION_LIMIT:
+            wasm_api_fault_message(partition_id, msg, sizeof(msg));
+            wasm_api_fault_backtrace(partition_id, trace, sizeof(trace));
+            printf("Partition %d %s: %s\n%s", partition_id,
+                   status == PARTITION_LIMIT ? "hit a resource limit" : "encountered an error", msg, trace);
+        break;
+
+        default:
+            printf("Unknown status from Partition %d\n", partition_id);
+        break;
     }
 }
 
 
-static void printInfo(int partition_id, int run) {
-    uint64_t fuel_remaining = 0;
-    wasmtime_context_get_fuel(get_wasm_partition(partition_id)->context, &fuel_remaining);
-    printf("<<<<<<<<<<<<<<<<<<<< Partition %u >>>>>>>>>>>>>>>>>>>>\n", 0);
-    printf("Fuel remaining: %lu\n", fuel_remaining);
-    printf("Fuel used (total): %lu\n", (FUEL_AMOUNT - fuel_remaining));
-    printf("Fuel used (this run): %lu\n", (FUEL_AMOUNT - fuel_remaining)/(run + 1));
-}
\ No newline at end of file
+static void stop_handler(int signum) {
+    (void) signum;
+    g_stop = 1;
+}
+
+
+// Timer host work, blocks a completion queue worker instead of the scheduler
+static void host_sleep_ms(void *env, const wasmtime_val_t *params, size_t nparams, wasmtime_val_t *results, size_t nresults) {
+    (void) env;
+    (void) nparams;
+    (void) nresults;
+
+    int32_t ms = params[0].of.i32;
+    struct timespec ts = { .tv_sec = ms / 1000, .tv_nsec = (long) (ms % 1000) * 1000000 };
+    results[0].of.i32 = nanosleep(&ts, NULL);
+}
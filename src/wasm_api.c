@@ -11,37 +11,135 @@
  * Includes
 ****************************************************************************/
 #include "wasm_api.h"
+#include "wasm_channel.h"
+#include "wasm_host.h"
+#include "wasm_port.h"
+#include "wasm_trace.h"
+#include "wasm_uring.h"
 #include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
 #include <time.h>
+#include <sys/stat.h>
 #include <sys/time.h>
+#include <unistd.h>
 
 
 /****************************************************************************
  * Defines
 ****************************************************************************/
+#define EPOCH_DEADLINE_NEVER    (1ull << 62)   // Nothing increments the engine epoch
 
+// Progress output, silenced by the quiet init option
+#define LOG_INFO(...) do { if(!g_opts.quiet) printf(__VA_ARGS__); } while(0)
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+// Written by the compile thread until done is set, then owned by the scheduler thread
+struct partition_reload {
+    pthread_t thread;
+    char *wasm_file;
+    wasmtime_linker_t *linker;          // The partition's, only read here
+    wasm_engine_t *engine;              // The partition's, new code stays on its tier
+    wasmtime_module_t *module;
+    wasmtime_instance_pre_t *instance_pre;
+    bool limited;                       // The partition has limits, the new module's needs are read
+    wasm_module_needs_t needs;
+    wasmtime_error_t *error;
+    _Atomic bool done;
+};
+
+// Identified by engine and file, a changed file compiles anew
+struct shared_module {
+    wasm_engine_t *engine;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    wasmtime_module_t *module;          // Reference of its own, partitions hold clones
+    size_t users;
+    struct shared_module *next;
+};
+
+// Module of the last map, kept while its file is unchanged
+typedef struct map_cache {
+    shared_module_t *shared;
+    wasmtime_module_t *module;
+    wasmtime_instance_pre_t *instance_pre;
+} map_cache_t;
 
 /****************************************************************************
  * Wasm/Wasmtime related instances
 ****************************************************************************/
 wasm_engine_t *g_engine;
 wasm_config_t *g_config;
+wasm_engine_t *g_baseline_engine;      // Tiered only, compiles new partitions quickly
+wasm_api_init_opts_t g_opts;
 
 /****************************************************************************
  * Wasm Partition Array
 ****************************************************************************/
 wasm_partition_t *g_partitions[NUM_MAX_PARTITIONS] = {NULL};
+static size_t g_reloads_pending = 0;
+static uint64_t g_reloads = 0;
+static uint64_t g_reload_failures = 0;
+static uint64_t g_store_generations = 0;
+static shared_module_t *g_shared_modules = NULL;
+static uint64_t g_modules_shared = 0;
+static map_cache_t g_map_cache = { 0 };
+static wasm_fault_t g_faults[NUM_MAX_PARTITIONS];   // Last fault per partition id, outlives a failed load
 
 /****************************************************************************
  * Static Function Prototypes
 ****************************************************************************/
-static wasm_api_result_t catch_err(err_type_t errType, const char* msgPrint, wasmtime_error_t* err, wasm_trap_t* trap);
-static wasm_api_result_t print_fuel_usage(int partition_id);
+static wasm_api_result_t fault_record(int partition_id, wasm_fault_site_t site, wasmtime_error_t *error, wasm_trap_t *trap);
+static wasm_api_result_t fault_report(int partition_id, wasm_fault_site_t site, wasmtime_error_t *error, wasm_trap_t *trap);
 static wasm_api_result_t partition_id_valid(int partition_id);
+static int config_common(wasm_config_t *config);
+static wasm_api_result_t init_undo(void);
+static wasmtime_error_t *profile_epoch_callback(wasmtime_context_t *context, void *data, uint64_t *epoch_deadline_delta, wasmtime_update_deadline_kind_t *update_kind);
+static void profile_finish(wasm_partition_t *partition);
+static uint64_t thread_cpu_ns(void);
+static void partition_map_write(const wasm_partition_t *partition);
+static uint64_t partition_fuel(const wasm_partition_t *partition);
+static uint64_t partition_budget(const wasm_partition_t *partition);
+static wasmtime_error_t *partition_fuel_set(const wasm_partition_t *partition, wasmtime_context_t *context, uint64_t budget);
+static bool partition_has_limits(const wasm_partition_t *partition);
+static wasmtime_error_t *partition_check_needs(const wasm_partition_t *partition, const wasm_module_needs_t *needs);
+static wasm_api_result_t module_needs_scan(wasm_partition_t *partition, const wasm_byte_vec_t *wasm_data, const char *wasm_file);
+static wasm_api_result_t start_call(wasm_partition_t *partition);
+static wasmtime_store_t *partition_store_new(wasm_partition_t *partition);
+static wasm_api_result_t read_wasm_file(const char *wasm_file, wasm_byte_vec_t *data, struct stat *st);
+static shared_module_t *module_find(wasm_engine_t *engine, const struct stat *st);
+static wasm_api_result_t module_share(wasm_engine_t *engine, const wasm_byte_vec_t *wasm_data, const struct stat *st,
+                                      int partition_id, wasmtime_module_t **module, shared_module_t **shared);
+static void module_unshare(shared_module_t *shared);
+static wasm_api_result_t module_acquire(wasm_partition_t *partition, const wasm_byte_vec_t *wasm_data, const struct stat *st);
+static void module_release(wasm_partition_t *partition);
+static void map_cache_clear(void);
+static wasm_api_result_t partition_instantiate(int partition_id, wasmtime_instance_pre_t *instance_pre,
+                                               const wasm_module_needs_t *needs,
+                                               wasmtime_context_t *context, wasmtime_instance_t *instance);
+static bool hook_type(const wasm_functype_t *functype, wasm_valkind_t param, size_t nparams, wasm_valkind_t result);
+static bool hook_get(wasmtime_context_t *context, wasmtime_instance_t *instance, const char *name,
+                     wasm_valkind_t param, size_t nparams, wasm_valkind_t result, wasmtime_func_t *func);
+static bool hook_exported(const wasmtime_module_t *module, const char *name,
+                          wasm_valkind_t param, size_t nparams, wasm_valkind_t result);
+static wasm_api_result_t hook_call(int partition_id, wasmtime_context_t *context, const wasmtime_func_t *func,
+                                   const wasmtime_val_t *params, size_t nparams, wasmtime_val_t *result);
+static uint8_t *instance_memory(wasmtime_context_t *context, wasmtime_instance_t *instance, size_t *size);
+static void *reload_compile(void *arg);
+static void reload_free(partition_reload_t *reload);
+static void reload_try(wasm_partition_t *partition);
+static wasm_api_result_t reload_drop_fault(wasm_partition_t *partition, const char *reason);
+static wasm_api_result_t reload_swap(wasm_partition_t *partition);
+static void partition_tier_up(wasm_partition_t *partition);
 
 
 /****************************************************************************
@@ -49,388 +147,2387 @@ static wasm_api_result_t partition_id_valid(int partition_id);
 ****************************************************************************/
 
 /**
- * @brief Catches errors or traps and prints a custom message 
+ * @brief Record an error or trap as the partition's fault, without
+ *        formatting it. Takes ownership of both
+ *
+ * @param partition_id Partition identifier
+ * @param site Where it was raised
+ * @param error Error or NULL
+ * @param trap Trap or NULL
+ * @return WASM_API_ERR
+ */
+static wasm_api_result_t fault_record(int partition_id, wasm_fault_site_t site, wasmtime_error_t *error, wasm_trap_t *trap) {
+    if(error == NULL && trap == NULL) {
+        return WASM_API_ERR;
+    }
+
+    wasm_fault_record(&g_faults[partition_id], partition_id, site, error, trap);
+    return WASM_API_ERR;
+}
+
+
+/**
+ * @brief Record a fault and print its message, for loads, reloads and fuel
+ *        that fail outside the slice path
  *
- * @param errType Either ERR or TRAP for identification
- * @param msgPrint String to be printed when error/trap is caught
- * @param err Error or NULL if its a trap
- * @param trap Trap or NULL if its an error
  * @return WASM_API_ERR
  */
-static wasm_api_result_t catch_err(err_type_t errType, const char* msgPrint, wasmtime_error_t* err, wasm_trap_t* trap) {
+static wasm_api_result_t fault_report(int partition_id, wasm_fault_site_t site, wasmtime_error_t *error, wasm_trap_t *trap) {
+    char msg[FAULT_MESSAGE_MAX];
 
-    if((errType != ERR && errType != TRAP) || (errType == ERR && err == NULL) || (errType == TRAP && trap == NULL)) {
+    if(error == NULL && trap == NULL) {
         return WASM_API_ERR;
     }
 
-    wasm_byte_vec_t msg;
+    fault_record(partition_id, site, error, trap);
+    wasm_fault_message(&g_faults[partition_id], msg, sizeof(msg));
+    fprintf(stderr, "Partition %d: %s\n", partition_id, msg);
+    return WASM_API_ERR;
+}
+
 
-    switch(errType) {
-        case ERR:
-                wasmtime_error_message(err, &msg);
-                fprintf(stderr, "%s: %.*s\n", msgPrint, (int)msg.size, msg.data);
-                wasm_byte_vec_delete(&msg);
-                wasmtime_error_delete(err);
-                return WASM_API_ERR;
-        break;
+static wasm_api_result_t partition_id_valid(int partition_id) {
+    if(partition_id < 0 || partition_id >= NUM_MAX_PARTITIONS){
+        printf("Invalid partition Id %d\n", partition_id);
+        return WASM_API_ERR;
+    }else {
+        return WASM_API_OK;
+    }
+}
 
-        case TRAP:
-                wasm_trap_message(trap, &msg);
-                fprintf(stderr, "%s: %.*s\n", msgPrint, (int)msg.size, msg.data);
-                wasm_byte_vec_delete(&msg);
-                wasm_trap_delete(trap);
-                return WASM_API_ERR;
-        break;
 
-        default:
-            return WASM_API_ERR;
+/**
+ * @brief Engine settings shared by both tiers, creators are attached separately
+ *
+ * @return 0 when successful, -1 when the cache configuration failed
+ */
+static int config_common(wasm_config_t *config) {
+
+    // Enable fuel consumption
+    wasmtime_config_consume_fuel_set(config, !g_opts.no_fuel);
+
+    // Async Support
+    wasmtime_config_async_support_set(config, true);
+
+    // Shared memories back the channels between partitions
+    wasmtime_config_wasm_threads_set(config, true);
+
+    // Guest profiling samples from the epoch deadline callback, which runs on the guest's stack
+    if(g_opts.guest_profiling) {
+        wasmtime_config_epoch_interruption_set(config, true);
+    }
+
+    // Let perf/VTune see JIT code instead of anonymous memory
+    if(g_opts.jit_profiler != WASMTIME_PROFILING_STRATEGY_NONE) {
+        wasmtime_config_profiler_set(config, g_opts.jit_profiler);
+    }
+
+    if(g_opts.debug_info) {
+        wasmtime_config_debug_info_set(config, true);
+    }
+
+    // Address space per memory, thousands of 4 GiB reservations exhaust it
+    if(g_opts.memory_budget != MEMORY_BUDGET_DEFAULT) {
+        wasmtime_config_memory_reservation_set(config, g_opts.memory_reservation);
+        wasmtime_config_memory_guard_size_set(config, g_opts.memory_guard_size);
+        wasmtime_config_memory_reservation_for_growth_set(config, g_opts.memory_reservation_for_growth);
+    }
+
+    // Pooled stacks set their size when the pool is attached
+    if(g_opts.stack_pool_size == 0 && g_opts.async_stack_size > 0) {
+        wasmtime_config_async_stack_size_set(config, g_opts.async_stack_size);
+    }
+
+    // Keys include the compiler settings, both tiers share one directory
+    if(g_opts.cache_dir != NULL && wasm_cache_attach(config) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Release what a failed wasm_api_init_with_opts set up, so it can be
+ *        called again. Tracing started before the init is kept
+ *
+ * @return WASM_API_ERR
+ */
+static wasm_api_result_t init_undo(void) {
+    wasm_replay_close();
+    wasm_uring_shutdown();
+    wasm_host_shutdown();
+
+    wasm_tier_destroy();
+    if(g_baseline_engine) {
+        wasm_engine_delete(g_baseline_engine);
+        g_baseline_engine = NULL;
+    }
+    if(g_engine) {
+        wasm_engine_delete(g_engine);
+        g_engine = NULL;
     }
 
+    wasm_stack_pool_destroy();
+    wasm_memory_destroy();
+    wasm_rt_destroy();
+    wasm_cache_destroy();
+
+    return WASM_API_ERR;
 }
 
+
 /**
- * @brief Prints fuel remaining and fuel used  
+ * @brief Epoch deadline callback, runs on the guest's stack so the sample
+ *        sees the Wasm frames. Sampling from the host after a yield would
+ *        capture an empty stack
  *
- * @return WASM_API_OK
+ * @return NULL to continue execution
  */
-static wasm_api_result_t print_fuel_usage(int partition_id) {
-    uint64_t fuel_remaining = 0;
+static wasmtime_error_t *profile_epoch_callback(wasmtime_context_t *context, void *data, uint64_t *epoch_deadline_delta, wasmtime_update_deadline_kind_t *update_kind) {
+    (void) context;
+    wasm_partition_t *partition = data;
+
+    if(partition->profile_pending && partition->profiler != NULL) {
+        wasmtime_guestprofiler_sample(partition->profiler, partition->store, partition->profile_cpu_ns);
+        partition->profile_cpu_ns = 0;
+        partition->profile_pending = false;
+    }
+
+    *epoch_deadline_delta = EPOCH_DEADLINE_NEVER;
+    *update_kind = WASMTIME_UPDATE_DEADLINE_CONTINUE;
+
+    return NULL;
+}
+
+
+/**
+ * @brief Writes the profile of a partition and frees the profiler
+ */
+static void profile_finish(wasm_partition_t *partition) {
+    if(partition->profiler == NULL) {
+        return;
+    }
+
+    wasm_byte_vec_t out;
+    wasmtime_error_t *error = wasmtime_guestprofiler_finish(partition->profiler, &out);
+    partition->profiler = NULL;
+
+    if(error != NULL) {
+        fault_report(partition->partition_id, FAULT_SITE_PROFILE, error, NULL);
+    } else {
+        FILE *file = fopen(partition->profile_file, "w");
+        if(file) {
+            fwrite(out.data, 1, out.size, file);
+            fclose(file);
+            LOG_INFO("> Guest profile of partition %d written to %s\n", partition->partition_id, partition->profile_file);
+        } else {
+            printf("> Error opening profile file: %s\n", partition->profile_file);
+        }
+        wasm_byte_vec_delete(&out);
+    }
+
+    free(partition->profile_file);
+    partition->profile_file = NULL;
+}
+
+
+/**
+ * @brief CPU time of the calling thread in ns
+ */
+static uint64_t thread_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+
+/**
+ * @brief Appends the partition's JIT code range to PARTITION_MAP_FMT, so
+ *        samples from perf can be attributed to partitions by address
+ */
+static void partition_map_write(const wasm_partition_t *partition) {
+    char path[64];
+    snprintf(path, sizeof(path), PARTITION_MAP_FMT, (int) getpid());
+
+    FILE *file = fopen(path, "a");
+    if(!file) {
+        printf("> Error opening partition map: %s\n", path);
+        return;
+    }
+
+    void *start = NULL;
+    void *end = NULL;
+    wasmtime_module_image_range(partition->module, &start, &end);
+
+    // <start> <end> <partition_id> <wasm_file>
+    fprintf(file, "%lx %lx %d %s\n", (unsigned long) start, (unsigned long) end, partition->partition_id, partition->wasm_file);
+    fclose(file);
+}
+
+
+/**
+ * @brief Fuel left in the partition's store, 0 if fuel is disabled
+ */
+static uint64_t partition_fuel(const wasm_partition_t *partition) {
+    uint64_t fuel = 0;
+    wasmtime_error_t *error = wasmtime_context_get_fuel(partition->context, &fuel);
+    if(error != NULL) {
+        wasmtime_error_delete(error);
+        return 0;
+    }
+    return fuel;
+}
+
+
+/**
+ * @brief Fuel budget left, without the FUEL_SLACK of suspending partitions
+ */
+static uint64_t partition_budget(const wasm_partition_t *partition) {
+    uint64_t fuel = partition_fuel(partition);
+    if(!partition->fuel_suspend) {
+        return fuel;
+    }
+    return fuel > FUEL_SLACK ? fuel - FUEL_SLACK : 0;
+}
+
+
+/**
+ * @brief Set the yield interval and fuel of a store for a budget. Suspending
+ *        partitions get FUEL_SLACK on top and no slice longer than the
+ *        budget, so the guest yields where the budget ends instead of trapping
+ *
+ * @param partition Partition, its yield settings are used
+ * @param context Store context, the partition's or a replacement
+ * @param budget Fuel the guest may consume
+ * @return NULL when successful, else the error of Wasmtime
+ */
+static wasmtime_error_t *partition_fuel_set(const wasm_partition_t *partition, wasmtime_context_t *context, uint64_t budget) {
+    uint64_t interval = partition->fuel_yield ? partition->yield_interval : 0;
+
+    // Interval first, set_fuel splits the fuel into slices of the current interval
+    if(!partition->fuel_suspend) {
+        wasmtime_context_fuel_async_yield_interval(context, interval);
+        return wasmtime_context_set_fuel(context, budget);
+    }
+
+    if(budget > UINT64_MAX - FUEL_SLACK) {
+        budget = UINT64_MAX - FUEL_SLACK;
+    }
+    if(interval == 0 || budget < interval) {
+        interval = budget;
+    }
+
+    // A spent budget yields at the first check, the guest stays starved
+    wasmtime_context_fuel_async_yield_interval(context, interval ? interval : 1);
+    return wasmtime_context_set_fuel(context, budget + FUEL_SLACK);
+}
+
+
+/**
+ * @brief True when the partition was loaded with any resource limit
+ */
+static bool partition_has_limits(const wasm_partition_t *partition) {
+    const wasm_api_load_opts_t *opts = &partition->load_opts;
+    return opts->memory_size > 0 || opts->table_elements > 0 || opts->instances > 0
+        || opts->tables > 0 || opts->memories > 0;
+}
+
+
+/**
+ * @brief Error naming the first limit the module exceeds at instantiation,
+ *        NULL when it fits. Checked before instantiating, Wasmtime's limiter
+ *        only answers with an error text
+ */
+static wasmtime_error_t *partition_check_needs(const wasm_partition_t *partition, const wasm_module_needs_t *needs) {
+    const wasm_api_load_opts_t *opts = &partition->load_opts;
+    char msg[128];
+
+    if(opts->memories > 0 && needs->memories > (uint64_t) opts->memories) {
+        snprintf(msg, sizeof(msg), "module defines %u memories, the limit is %ld", needs->memories, (long) opts->memories);
+    } else if(opts->tables > 0 && needs->tables > (uint64_t) opts->tables) {
+        snprintf(msg, sizeof(msg), "module defines %u tables, the limit is %ld", needs->tables, (long) opts->tables);
+    } else if(opts->memory_size > 0 && needs->memory_bytes > (uint64_t) opts->memory_size) {
+        snprintf(msg, sizeof(msg), "memory minimum of %lu bytes exceeds the limit of %ld",
+                 (unsigned long) needs->memory_bytes, (long) opts->memory_size);
+    } else if(opts->table_elements > 0 && needs->table_elements > (uint64_t) opts->table_elements) {
+        snprintf(msg, sizeof(msg), "table minimum of %lu elements exceeds the limit of %ld",
+                 (unsigned long) needs->table_elements, (long) opts->table_elements);
+    } else {
+        return NULL;
+    }
+
+    return wasmtime_error_new(msg);
+}
+
+
+/**
+ * @brief Create the call future for exported_func with the partition's params
+ */
+static wasm_api_result_t start_call(wasm_partition_t *partition) {
+
+    // Trap, error and params are written/read by the future, so they
+    // live in the partition until the future is deleted
+    partition->call_trap = NULL;
+    partition->call_error = NULL;
+    partition->memory_limit.hit = false;
+
+    partition->future = wasmtime_func_call_async(
+        partition->context, &partition->exported_func,
+        partition->params, partition->nparams,
+        partition->results, partition->nresults,
+        &partition->call_trap, &partition->call_error
+    );
+
+    if(partition->future == NULL) {
+        if(partition->call_error != NULL) {
+            fault_record(partition->partition_id, FAULT_SITE_CALL, partition->call_error, NULL);
+        }else if(partition->call_trap != NULL) {
+            fault_record(partition->partition_id, FAULT_SITE_CALL, NULL, partition->call_trap);
+        }
+        partition->call_error = NULL;
+        partition->call_trap = NULL;
+
+        return WASM_API_ERR;
+    }
+
+    return WASM_API_OK;
+}
+
+
+/**
+ * @brief New store of a partition with its limits and profiling callback.
+ *        Store data is the partition, async host functions find their caller
+ *        through it
+ */
+static wasmtime_store_t *partition_store_new(wasm_partition_t *partition) {
+    wasmtime_store_t *store = wasmtime_store_new(partition->engine, partition, NULL);
+    if(!store) {
+        printf("Failed to create Wasmtime store\n");
+        return NULL;
+    }
+
+    // Caps on what the guest can allocate, negative leaves a limit unset.
+    // Wasmtime asks the limiter before the memory creator and reports no
+    // denial, so with memory_limits the creator takes memory_size instead to
+    // tell PARTITION_LIMIT apart
+    if(partition_has_limits(partition)) {
+        const wasm_api_load_opts_t *limits = &partition->load_opts;
+        wasmtime_store_limiter(store, limits->memory_size > 0 && !g_opts.memory_limits ? limits->memory_size : -1,
+                               limits->table_elements > 0 ? limits->table_elements : -1,
+                               limits->instances > 0 ? limits->instances : -1,
+                               limits->tables > 0 ? limits->tables : -1,
+                               limits->memories > 0 ? limits->memories : -1);
+    }
+
+    if(g_opts.guest_profiling) {
+        wasmtime_context_set_epoch_deadline(wasmtime_store_context(store), EPOCH_DEADLINE_NEVER);
+        wasmtime_store_epoch_deadline_callback(store, profile_epoch_callback, partition, NULL);
+    }
+
+    return store;
+}
+
+
+/**
+ * @brief Read a .wasm file into a byte vector, deleted by the caller. st,
+ *        when given, identifies the file the bytes were read from
+ */
+static wasm_api_result_t read_wasm_file(const char *wasm_file, wasm_byte_vec_t *data, struct stat *st) {
+
+    // Open Wasm file
+    FILE *file = fopen(wasm_file, "rb");
+    if(!file) {
+        printf("> Error loading file: %s\n", wasm_file);
+        return WASM_API_ERR;
+    }
+
+    if(st != NULL && fstat(fileno(file), st) != 0) {
+        printf("> Error reading file: %s\n", wasm_file);
+        fclose(file);
+        return WASM_API_ERR;
+    }
+
+    // Move file pointer to end for fle size
+    fseek(file, 0, SEEK_END);
+    size_t file_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    // Allocating byte vector with previously determined size
+    wasm_byte_vec_new_uninitialized(data, file_size);
+
+    // Reads file content into data and closes file
+    size_t read = fread(data->data, 1, file_size, file);
+    fclose(file);
+    if(read != file_size) {
+        printf("Failed to read full wasm file\n");
+        wasm_byte_vec_delete(data);
+        return WASM_API_ERR;
+    }
+
+    return WASM_API_OK;
+}
+
+
+/**
+ * @brief Tables and memories the partition's module defines, checked
+ *        against its limits before every instantiation. Scans the bytes the
+ *        module was compiled from
+ *
+ * @return WASM_API_OK, when successful, else WASM_API_ERR
+ */
+static wasm_api_result_t module_needs_scan(wasm_partition_t *partition, const wasm_byte_vec_t *wasm_data, const char *wasm_file) {
+    if(wasm_limits_scan((const uint8_t*) wasm_data->data, wasm_data->size, &partition->needs) != 0) {
+        printf("Partition %d: cannot read the tables and memories of %s\n", partition->partition_id, wasm_file);
+        return WASM_API_ERR;
+    }
+
+    return WASM_API_OK;
+}
+
+
+/**
+ * @brief Shared module of an unchanged file on the engine, NULL when there
+ *        is none
+ */
+static shared_module_t *module_find(wasm_engine_t *engine, const struct stat *st) {
+    for(shared_module_t *shared = g_shared_modules; shared != NULL; shared = shared->next) {
+        if(shared->engine == engine && shared->dev == st->st_dev && shared->ino == st->st_ino
+           && shared->size == st->st_size && shared->mtime.tv_sec == st->st_mtim.tv_sec
+           && shared->mtime.tv_nsec == st->st_mtim.tv_nsec) {
+            return shared;
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ * @brief Module of a file, shared with other users of the same unchanged
+ *        file on the same engine. Compiled code is mapped once instead of
+ *        per user
+ *
+ * @param engine Engine to compile with
+ * @param wasm_data Module bytes, compiled unless shared
+ * @param st File the bytes were read from, NULL leaves the module unshared
+ * @param partition_id Partition the fault is reported for, -1 for none
+ * @param module Output, a clone owned by the caller
+ * @param shared Output, the share to drop with module_unshare(), NULL when
+ *        the file is not identified
+ * @return WASM_API_OK, when successful, else WASM_API_ERR
+ */
+static wasm_api_result_t module_share(wasm_engine_t *engine, const wasm_byte_vec_t *wasm_data, const struct stat *st,
+                                      int partition_id, wasmtime_module_t **module, shared_module_t **shared) {
+    *shared = st != NULL ? module_find(engine, st) : NULL;
+    if(*shared != NULL) {
+        *module = wasmtime_module_clone((*shared)->module);
+        (*shared)->users++;
+        g_modules_shared++;
+        return WASM_API_OK;
+    }
+
+    // Pass bytes to Wasmtime for compilation
+    wasmtime_error_t* error = wasmtime_module_new(engine, (const uint8_t*) wasm_data->data, wasm_data->size, module);
+
+    if(error != NULL) {
+        if(partition_id >= 0) {
+            return fault_report(partition_id, FAULT_SITE_COMPILE, error, NULL);
+        }
+        wasm_byte_vec_t msg;
+        wasmtime_error_message(error, &msg);
+        printf("Failed to compile wasm module: %.*s\n", (int) msg.size, msg.data);
+        wasm_byte_vec_delete(&msg);
+        wasmtime_error_delete(error);
+        return WASM_API_ERR;
+    }
+    wasm_cache_count_compile();
+
+    *shared = st != NULL ? calloc(1, sizeof(shared_module_t)) : NULL;
+    if(*shared != NULL) {
+        (*shared)->engine = engine;
+        (*shared)->dev = st->st_dev;
+        (*shared)->ino = st->st_ino;
+        (*shared)->size = st->st_size;
+        (*shared)->mtime = st->st_mtim;
+        (*shared)->module = wasmtime_module_clone(*module);
+        (*shared)->users = 1;
+        (*shared)->next = g_shared_modules;
+        g_shared_modules = *shared;
+    }
 
-    wasmtime_context_get_fuel(g_partitions[partition_id]->context, &fuel_remaining);
-    printf("<<<<<<<<<<<<<<<<<<<< Partition %u >>>>>>>>>>>>>>>>>>>>\n", partition_id);
-    printf("Fuel remaining: %lu\n", fuel_remaining);
-    printf("Fuel used: %lu\n", (FUEL_AMOUNT - fuel_remaining));
-        
     return WASM_API_OK;
 }
 
 
-/**
- * @brief Bounds check for partition Id, for array bounds, so max is NUM_MAX_PARTITIONS - 1
- *
- * @return WASM_API_OK, else WASM_API_ERR
- */
-static wasm_api_result_t partition_id_valid(int partition_id) {
-    if(partition_id < 0 || partition_id > NUM_MAX_PARTITIONS){
-        printf("Invalid partition Id %d\n", partition_id);
+/**
+ * @brief Drop a share of a module, the last user frees it
+ */
+static void module_unshare(shared_module_t *shared) {
+    if(shared == NULL || --shared->users > 0) {
+        return;
+    }
+
+    for(shared_module_t **it = &g_shared_modules; *it != NULL; it = &(*it)->next) {
+        if(*it == shared) {
+            *it = shared->next;
+            break;
+        }
+    }
+    wasmtime_module_delete(shared->module);
+    free(shared);
+}
+
+
+/**
+ * @brief Module of a partition, shared with partitions that loaded the same
+ *        unchanged file on the same engine
+ *
+ * @return WASM_API_OK, when successful, else WASM_API_ERR
+ */
+static wasm_api_result_t module_acquire(wasm_partition_t *partition, const wasm_byte_vec_t *wasm_data, const struct stat *st) {
+    return module_share(partition->engine, wasm_data, st, partition->partition_id, &partition->module, &partition->shared);
+}
+
+
+/**
+ * @brief Drop the partition's share of its module
+ */
+static void module_release(wasm_partition_t *partition) {
+    module_unshare(partition->shared);
+    partition->shared = NULL;
+}
+
+
+/**
+ * @brief Drop the module kept for the next map of the same file
+ */
+static void map_cache_clear(void) {
+    if(g_map_cache.instance_pre != NULL) {
+        wasmtime_instance_pre_delete(g_map_cache.instance_pre);
+    }
+    if(g_map_cache.module != NULL) {
+        wasmtime_module_delete(g_map_cache.module);
+    }
+    module_unshare(g_map_cache.shared);
+    memset(&g_map_cache, 0, sizeof(g_map_cache));
+}
+
+
+/**
+ * @brief Instantiate into a store, polling the async instantiation to the end.
+ *        The module's needs are checked against the partition's limits first,
+ *        memories created on the way get the partition's memory limit
+ *
+ * @return WASM_API_OK, when successful, PARTITION_LIMIT when instantiation
+ *         exceeds a limit, else WASM_API_ERR
+ */
+static wasm_api_result_t partition_instantiate(int partition_id, wasmtime_instance_pre_t *instance_pre,
+                                               const wasm_module_needs_t *needs,
+                                               wasmtime_context_t *context, wasmtime_instance_t *instance) {
+    wasm_partition_t *partition = g_partitions[partition_id];
+    wasmtime_error_t *error = partition_check_needs(partition, needs);
+    wasm_trap_t *trap = NULL;
+
+    if(error != NULL) {
+        fault_report(partition_id, FAULT_SITE_INSTANTIATE, error, NULL);
+        g_faults[partition_id].info.limit = true;
+        return PARTITION_LIMIT;
+    }
+
+    bool traced = wasm_trace_enabled();
+    if(traced) {
+        wasm_trace_record(TRACE_INSTANTIATE_BEGIN, partition_id, 0, 0);
+    }
+
+    partition->memory_limit.hit = false;
+    wasm_memory_limit_enter(&partition->memory_limit);
+
+    wasmtime_call_future_t *future = wasmtime_instance_pre_instantiate_async(instance_pre, context, instance, &trap, &error);
+    if (error || !future) {
+        wasm_memory_limit_enter(NULL);
+        if(traced) {
+            wasm_trace_record(TRACE_INSTANTIATE_END, partition_id, PARTITION_ERROR, 0);
+        }
+        return fault_report(partition_id, FAULT_SITE_INSTANTIATE, error, NULL);
+    }
+
+    while(!wasmtime_call_future_poll(future)) {
+        LOG_INFO("instantiation yielded...\n");
+    }
+
+    wasmtime_call_future_delete(future);
+    wasm_memory_limit_enter(NULL);
+
+    if(traced) {
+        wasm_trace_record(TRACE_INSTANTIATE_END, partition_id, (error || trap) ? PARTITION_ERROR : WASM_API_OK, 0);
+    }
+
+    if(error != NULL) {
+        bool limit = partition->memory_limit.hit;
+        fault_report(partition_id, FAULT_SITE_INSTANTIATE, error, NULL);
+        g_faults[partition_id].info.limit = limit;
+        return limit ? PARTITION_LIMIT : WASM_API_ERR;
+    }
+    if(trap != NULL) {
+        if(traced) {
+            wasm_trace_record(TRACE_TRAP, partition_id, PARTITION_ERROR, 0);
+        }
+        return fault_report(partition_id, FAULT_SITE_INSTANTIATE, NULL, trap);
+    }
+
+    return WASM_API_OK;
+}
+
+
+/**
+ * @brief Whether a hook has at most one param and one result of the given kinds
+ */
+static bool hook_type(const wasm_functype_t *functype, wasm_valkind_t param, size_t nparams, wasm_valkind_t result) {
+    const wasm_valtype_vec_t *params = wasm_functype_params(functype);
+    const wasm_valtype_vec_t *results = wasm_functype_results(functype);
+
+    return params->size == nparams && (nparams == 0 || wasm_valtype_kind(params->data[0]) == param)
+           && results->size == 1 && wasm_valtype_kind(results->data[0]) == result;
+}
+
+
+/**
+ * @brief Look up an exported function with at most one param and one result
+ *        of the given kinds
+ *
+ * @return True when exported with this type
+ */
+static bool hook_get(wasmtime_context_t *context, wasmtime_instance_t *instance, const char *name,
+                     wasm_valkind_t param, size_t nparams, wasm_valkind_t result, wasmtime_func_t *func) {
+    wasmtime_extern_t ext;
+
+    if(!wasmtime_instance_export_get(context, instance, name, strlen(name), &ext)) {
+        return false;
+    }
+    if(ext.kind != WASMTIME_EXTERN_FUNC) {
+        wasmtime_extern_delete(&ext);
+        return false;
+    }
+
+    wasm_functype_t *functype = wasmtime_func_type(context, &ext.of.func);
+    bool ok = hook_type(functype, param, nparams, result);
+    wasm_functype_delete(functype);
+
+    if(!ok) {
+        printf("Export '%s' has the wrong type, ignored\n", name);
+        return false;
+    }
+
+    *func = ext.of.func;
+    return true;
+}
+
+
+/**
+ * @brief Whether a compiled module exports a hook of this type, before it
+ *        is instantiated
+ */
+static bool hook_exported(const wasmtime_module_t *module, const char *name,
+                          wasm_valkind_t param, size_t nparams, wasm_valkind_t result) {
+    wasm_exporttype_vec_t exports;
+    bool ok = false;
+
+    wasmtime_module_exports(module, &exports);
+
+    for(size_t e = 0; e < exports.size; e++) {
+        const wasm_name_t *export_name = wasm_exporttype_name(exports.data[e]);
+        if(export_name->size != strlen(name) || memcmp(export_name->data, name, export_name->size) != 0) {
+            continue;
+        }
+        const wasm_functype_t *functype = wasm_externtype_as_functype_const(wasm_exporttype_type(exports.data[e]));
+        ok = functype != NULL && hook_type(functype, param, nparams, result);
+        break;
+    }
+
+    wasm_exporttype_vec_delete(&exports);
+    return ok;
+}
+
+
+/**
+ * @brief Run a hook to completion on the calling thread, slices of the
+ *        store's yield interval are polled back to back. Hooks run between
+ *        slices of other partitions, so one that blocks in a host call is
+ *        abandoned instead of waited for. Host calls completing inline and
+ *        io_uring requests already reaped still return to the hook
+ */
+static wasm_api_result_t hook_call(int partition_id, wasmtime_context_t *context, const wasmtime_func_t *func,
+                                   const wasmtime_val_t *params, size_t nparams, wasmtime_val_t *result) {
+    wasm_partition_t *partition = g_partitions[partition_id];
+    wasm_trap_t *trap = NULL;
+    wasmtime_error_t *error = NULL;
+
+    wasmtime_call_future_t *future = wasmtime_func_call_async(context, func, params, nparams, result, 1, &trap, &error);
+    if(future != NULL) {
+        bool done = wasmtime_call_future_poll(future);
+        while(!done) {
+            if(partition->pending_call != NULL && !wasm_host_call_done(partition->pending_call)) {
+                wasm_uring_poll();
+                if(!wasm_host_call_done(partition->pending_call)) {
+                    break;
+                }
+            }
+            done = wasmtime_call_future_poll(future);
+        }
+
+        // Parked port calls and in-flight I/O target the store's linear memory
+        if(!done) {
+            wasm_port_detach(partition_id);
+            wasm_channel_detach(partition_id);
+            wasm_uring_cancel(partition_id);
+            partition->pending_call = NULL;
+            partition->blocked = false;
+        }
+        wasmtime_call_future_delete(future);
+
+        if(!done) {
+            printf("Partition %d: %s hook blocked in a host call\n", partition_id,
+                   context == partition->context ? RELOAD_SAVE : RELOAD_RESTORE);
+            return WASM_API_ERR;
+        }
+    }
+
+    if(error != NULL) {
+        return fault_report(partition_id, FAULT_SITE_RELOAD, error, NULL);
+    }
+    if(trap != NULL) {
+        return fault_report(partition_id, FAULT_SITE_RELOAD, NULL, trap);
+    }
+
+    return future != NULL ? WASM_API_OK : WASM_API_ERR;
+}
+
+
+/**
+ * @brief Exported linear memory of an instance, NULL when it has none
+ */
+static uint8_t *instance_memory(wasmtime_context_t *context, wasmtime_instance_t *instance, size_t *size) {
+    wasmtime_extern_t item;
+
+    *size = 0;
+    if(!wasmtime_instance_export_get(context, instance, "memory", 6, &item)) {
+        return NULL;
+    }
+    if(item.kind != WASMTIME_EXTERN_MEMORY) {
+        wasmtime_extern_delete(&item);
+        return NULL;
+    }
+
+    *size = wasmtime_memory_data_size(context, &item.of.memory);
+    uint8_t *data = wasmtime_memory_data(context, &item.of.memory);
+    wasmtime_extern_delete(&item);
+
+    return data;
+}
+
+
+/**
+ * @brief Compile thread of a reload, runs on the housekeeping CPUs. The
+ *        partition's linker is only read, nothing else uses it after the load
+ */
+static void *reload_compile(void *arg) {
+    partition_reload_t *reload = arg;
+    wasm_byte_vec_t wasm_data;
+
+    if(read_wasm_file(reload->wasm_file, &wasm_data, NULL) != WASM_API_OK) {
+        reload->error = wasmtime_error_new("cannot read module");
+    } else {
+        reload->error = wasmtime_module_new(reload->engine, (const uint8_t*) wasm_data.data, wasm_data.size, &reload->module);
+        if(reload->error == NULL) {
+            wasm_cache_count_compile();
+        }
+        if(reload->error == NULL && reload->limited
+           && wasm_limits_scan((const uint8_t*) wasm_data.data, wasm_data.size, &reload->needs) != 0) {
+            reload->error = wasmtime_error_new("cannot read the tables and memories of the module");
+        }
+        wasm_byte_vec_delete(&wasm_data);
+    }
+
+    // Import checks against host functions and channels happen here as well
+    if(reload->error == NULL) {
+        reload->error = wasmtime_linker_instantiate_pre(reload->linker, reload->module, &reload->instance_pre);
+    }
+
+    atomic_store_explicit(&reload->done, true, memory_order_release);
+    return NULL;
+}
+
+
+/**
+ * @brief Join the compile thread and free what the swap did not take over
+ */
+static void reload_free(partition_reload_t *reload) {
+    pthread_join(reload->thread, NULL);
+
+    if(reload->error) {
+        wasmtime_error_delete(reload->error);
+    }
+    if(reload->instance_pre) {
+        wasmtime_instance_pre_delete(reload->instance_pre);
+    }
+    if(reload->module) {
+        wasmtime_module_delete(reload->module);
+    }
+
+    free(reload->wasm_file);
+    free(reload);
+    g_reloads_pending--;
+}
+
+
+/**
+ * @brief Swap in a compiled reload at this scheduling boundary. Waits while a
+ *        call is in flight, unless the old code can save its state, the new
+ *        code can restore it and the partition is not inside a host call
+ */
+static void reload_try(wasm_partition_t *partition) {
+    partition_reload_t *reload = partition->reload;
+    wasmtime_func_t save;
+
+    if(reload == NULL || !atomic_load_explicit(&reload->done, memory_order_acquire)) {
+        return;
+    }
+
+    if(reload->error != NULL) {
+        fault_report(partition->partition_id, FAULT_SITE_RELOAD, reload->error, NULL);
+        reload->error = NULL;
+        g_reload_failures++;
+    } else if(partition->future != NULL
+              && (partition->pending_call != NULL
+                  || !hook_get(partition->context, &partition->instance, RELOAD_SAVE, WASM_I32, 0, WASM_I64, &save)
+                  || !hook_exported(reload->module, RELOAD_RESTORE, WASM_I32, 1, WASM_I32))) {
+        return;
+    } else if(reload_swap(partition) == WASM_API_OK) {
+        LOG_INFO("Partition %d reloaded from %s\n", partition->partition_id, partition->wasm_file);
+        g_reloads++;
+    } else {
+        printf("Reload of partition %d failed, keeping the old code\n", partition->partition_id);
+        g_reload_failures++;
+    }
+
+    partition->reload = NULL;
+    reload_free(reload);
+}
+
+
+/**
+ * @brief A hook failed after the reload dropped the call in flight. Recorded
+ *        as the partition's fault, the next run returns PARTITION_ERROR
+ *
+ * @return WASM_API_ERR
+ */
+static wasm_api_result_t reload_drop_fault(wasm_partition_t *partition, const char *reason) {
+    char msg[FAULT_MESSAGE_MAX];
+
+    snprintf(msg, sizeof(msg), "call in flight dropped by the reload, %s", reason);
+    partition->call_dropped = true;
+    return fault_report(partition->partition_id, FAULT_SITE_RELOAD, wasmtime_error_new(msg), NULL);
+}
+
+
+/**
+ * @brief Replace the partition's module, store and instance by the reload's.
+ *        The new code is instantiated, and its restore hook checked, before
+ *        the call in flight is dropped, a module that fails there leaves the
+ *        call running. State saved by RELOAD_SAVE is handed to RELOAD_RESTORE.
+ *        The save hook needs the store to itself, so it runs after the drop.
+ *        When a hook fails the old code stays and the lost call is reported
+ *        as the partition's fault
+ */
+static wasm_api_result_t reload_swap(wasm_partition_t *partition) {
+    partition_reload_t *reload = partition->reload;
+    wasmtime_func_t save;
+    wasmtime_func_t restore;
+    wasmtime_val_t result;
+    uint8_t *state = NULL;
+    uint32_t state_len = 0;
+
+    wasmtime_store_t *store = partition_store_new(partition);
+    if(!store) {
+        return WASM_API_ERR;
+    }
+    wasmtime_context_t *context = wasmtime_store_context(store);
+
+    // Fuel and slicing carry over, hooks run on the partition's fuel
+    if(!g_opts.no_fuel) {
+        wasmtime_error_t *error = partition_fuel_set(partition, context, partition_budget(partition));
+        if(error != NULL) {
+            fault_report(partition->partition_id, FAULT_SITE_RELOAD, error, NULL);
+            wasmtime_store_delete(store);
+            return WASM_API_ERR;
+        }
+    }
+
+    wasmtime_instance_t instance;
+    if(partition_instantiate(partition->partition_id, reload->instance_pre, &reload->needs, context, &instance) != WASM_API_OK) {
+        wasmtime_store_delete(store);
+        return WASM_API_ERR;
+    }
+
+    // The state of a call in flight must have somewhere to go
+    bool dropped = partition->future != NULL;
+    if(dropped && !hook_get(context, &instance, RELOAD_RESTORE, WASM_I32, 1, WASM_I32, &restore)) {
+        wasmtime_store_delete(store);
+        return WASM_API_ERR;
+    }
+
+    // The new code runs. The old call is dropped, its stack is lost but
+    // memory stays for the save hook, which needs the store to itself
+    if(dropped) {
+        wasmtime_call_future_delete(partition->future);
+        partition->future = NULL;
+    }
+
+    if(hook_get(partition->context, &partition->instance, RELOAD_SAVE, WASM_I32, 0, WASM_I64, &save)) {
+        if(hook_call(partition->partition_id, partition->context, &save, NULL, 0, &result) != WASM_API_OK) {
+            wasmtime_store_delete(store);
+            return dropped ? reload_drop_fault(partition, "the save hook failed") : WASM_API_ERR;
+        }
+
+        // Memory after the hook, it may have grown or moved
+        size_t memory_size;
+        uint8_t *memory = instance_memory(partition->context, &partition->instance, &memory_size);
+        uint32_t ptr = (uint32_t) ((uint64_t) result.of.i64 >> 32);
+        state_len = (uint32_t) result.of.i64;
+        if(memory == NULL || (uint64_t) ptr + state_len > memory_size || !(state = malloc(state_len ? state_len : 1))) {
+            printf("Partition %d: saved state out of bounds\n", partition->partition_id);
+            wasmtime_store_delete(store);
+            return dropped ? reload_drop_fault(partition, "the saved state is out of bounds") : WASM_API_ERR;
+        }
+        memcpy(state, memory + ptr, state_len);
+    }
+
+    if(state != NULL && hook_get(context, &instance, RELOAD_RESTORE, WASM_I32, 1, WASM_I32, &restore)) {
+        wasmtime_val_t len = { .kind = WASMTIME_I32, .of.i32 = (int32_t) state_len };
+        size_t memory_size;
+
+        if(hook_call(partition->partition_id, context, &restore, &len, 1, &result) != WASM_API_OK) {
+            wasmtime_store_delete(store);
+            free(state);
+            return dropped ? reload_drop_fault(partition, "the restore hook failed") : WASM_API_ERR;
+        }
+
+        // Memory after the hook, it may have grown
+        uint8_t *memory = instance_memory(context, &instance, &memory_size);
+        uint32_t ptr = (uint32_t) result.of.i32;
+        if(memory == NULL || (uint64_t) ptr + state_len > memory_size) {
+            printf("Partition %d: restore buffer out of bounds\n", partition->partition_id);
+            wasmtime_store_delete(store);
+            free(state);
+            return dropped ? reload_drop_fault(partition, "the restore buffer is out of bounds") : WASM_API_ERR;
+        }
+        memcpy(memory + ptr, state, state_len);
+    }
+    free(state);
+
+    // Point of no return, the profile belongs to the old code
+    profile_finish(partition);
+
+    if(partition->call_trap) {
+        wasm_trap_delete(partition->call_trap);
+        partition->call_trap = NULL;
+    }
+    if(partition->call_error) {
+        wasmtime_error_delete(partition->call_error);
+        partition->call_error = NULL;
+    }
+    wasmtime_instance_pre_delete(partition->instance_pre);
+    wasmtime_module_delete(partition->module);
+    module_release(partition);
+    wasmtime_store_delete(partition->store);
+
+    partition->store = store;
+    partition->context = context;
+    partition->instance = instance;
+    partition->store_generation = ++g_store_generations;
+    partition->module = reload->module;
+    partition->instance_pre = reload->instance_pre;
+    partition->needs = reload->needs;
+    reload->module = NULL;
+    reload->instance_pre = NULL;
+
+    free(partition->wasm_file);
+    partition->wasm_file = reload->wasm_file;
+    reload->wasm_file = NULL;
+
+    // The tier entry counts and recompiles the old code, the new code stays on this engine
+    partition->tier = -1;
+
+    if(g_opts.jit_profiler != WASMTIME_PROFILING_STRATEGY_NONE) {
+        partition_map_write(partition);
+    }
+
+    return WASM_API_OK;
+}
+
+
+/**
+ * @brief Move a partition loaded on baseline code onto its module's optimized
+ *        code, once the module tiered up. Runs before a restart, which would
+ *        otherwise instantiate the baseline instance_pre again. The linker
+ *        belongs to an engine, so the optimized code gets its own. When
+ *        anything fails the partition stays on baseline code
+ */
+static void partition_tier_up(wasm_partition_t *partition) {
+    wasmtime_module_t *optimized = wasm_tier_optimized(partition->tier);
+    wasmtime_instance_pre_t *instance_pre = NULL;
+
+    if(optimized == NULL) {
+        return;
+    }
+
+    wasmtime_linker_t *linker = wasmtime_linker_new(g_engine);
+    wasmtime_error_t *error = wasm_host_link(linker);
+    if(error == NULL) {
+        error = wasmtime_linker_instantiate_pre(linker, optimized, &instance_pre);
+    }
+    if(error != NULL) {
+        wasmtime_error_delete(error);
+        wasmtime_linker_delete(linker);
+        wasmtime_module_delete(optimized);
+        printf("Partition %d stays on baseline code\n", partition->partition_id);
+        return;
+    }
+
+    wasmtime_instance_pre_delete(partition->instance_pre);
+    wasmtime_linker_delete(partition->linker);
+    wasmtime_module_delete(partition->module);
+    module_release(partition);
+
+    partition->instance_pre = instance_pre;
+    partition->linker = linker;
+    partition->module = optimized;
+    partition->engine = g_engine;
+
+    if(g_opts.jit_profiler != WASMTIME_PROFILING_STRATEGY_NONE) {
+        partition_map_write(partition);
+    }
+}
+
+
+/****************************************************************************
+ * Function Implementations
+****************************************************************************/
+
+wasm_partition_t *get_wasm_partition(int partition_id) {
+    if(partition_id_valid(partition_id) != WASM_API_OK) {
+        return NULL;
+    }
+    return g_partitions[partition_id];
+}
+
+
+/**
+ * @brief Initialize the Wasm engine and context globally 
+ *
+ * @return WASM_API_OK, when successful, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_init(void) {
+    return wasm_api_init_with_opts(NULL);
+}
+
+
+/**
+ * @brief Initialize the Wasm engine with options
+ *
+ * @param opts Engine options, NULL for defaults
+ * @return WASM_API_OK, when successful, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_init_with_opts(const wasm_api_init_opts_t *opts) {
+
+    if(opts != NULL) {
+        g_opts = *opts;
+    } else {
+        memset(&g_opts, 0, sizeof(g_opts));
+    }
+
+    // Checked before anything is set up
+    if(g_opts.record_file != NULL && g_opts.replay_file != NULL) {
+        printf("Cannot record and replay at the same time\n");
+        return WASM_API_ERR;
+    }
+
+    // Before anything compiles or starts threads, they inherit the housekeeping CPUs
+    if(wasm_rt_init(g_opts.sched_cpus, g_opts.housekeeping_cpus, g_opts.sched_fifo_priority) != 0) {
+        return WASM_API_ERR;
+    }
+
+    if(g_opts.memory_budget != MEMORY_BUDGET_DEFAULT
+       && wasm_memory_budget_preset(g_opts.memory_budget, &g_opts.memory_reservation, &g_opts.memory_guard_size,
+                                    &g_opts.memory_reservation_for_growth) != 0) {
+        printf("Unknown memory budget %d\n", g_opts.memory_budget);
+        return init_undo();
+    }
+
+    // Locked stacks need a pool, Wasmtime's own stacks are mapped per call
+    if(g_opts.lock_memory && g_opts.stack_pool_size == 0) {
+        g_opts.stack_pool_size = NUM_MAX_PARTITIONS;
+    }
+    
+    // Compiled modules from disk, restarts after a deploy skip recompiling unchanged ones
+    if(g_opts.cache_dir != NULL && wasm_cache_init(g_opts.cache_dir, g_opts.cache_size_limit, g_opts.cache_file_limit,
+                                                   g_opts.cache_cleanup_secs, g_opts.cache_cleanup_percent) != 0) {
+        return init_undo();
+    }
+
+    // Config to enable fuel usage
+    g_config = wasm_config_new();
+    if(config_common(g_config) != 0) {
+        wasm_config_delete(g_config);
+        g_config = NULL;
+        return init_undo();
+    }
+
+    // Fiber stacks from a preallocated, guard-paged pool instead of an mmap per call
+    if(g_opts.stack_pool_size > 0) {
+        if(wasm_stack_pool_init(g_config, g_opts.stack_pool_size, g_opts.async_stack_size, g_opts.stack_hugepages,
+                                g_opts.lock_memory) != 0) {
+            printf("Failed to create async stack pool\n");
+            wasm_config_delete(g_config);
+            g_config = NULL;
+            return init_undo();
+        }
+    }
+
+    // Linear memories from our own mappings, with hugepages, NUMA placement and locking
+    bool memory_creator = g_opts.memory_pages != MEMORY_PAGES_DEFAULT || g_opts.memory_numa_bind || g_opts.lock_memory
+                          || g_opts.memory_limits;
+    if(memory_creator) {
+        if(wasm_memory_init(g_config, g_opts.memory_pages, g_opts.memory_numa_bind, g_opts.lock_memory,
+                            g_opts.memory_budget != MEMORY_BUDGET_DEFAULT ? g_opts.memory_reservation_for_growth : 0) != 0) {
+            printf("Failed to create memory creator\n");
+            wasm_config_delete(g_config);
+            g_config = NULL;
+            return init_undo();
+        }
+    }
+
+    // Baseline tier: same settings, stacks and memories, unoptimized code
+    wasm_config_t *baseline_config = NULL;
+    if(g_opts.tiered) {
+        wasmtime_config_cranelift_opt_level_set(g_config, WASMTIME_OPT_LEVEL_SPEED);
+
+        baseline_config = wasm_config_new();
+        if(config_common(baseline_config) != 0) {
+            wasm_config_delete(baseline_config);
+            wasm_config_delete(g_config);
+            g_config = NULL;
+            return init_undo();
+        }
+        wasmtime_config_cranelift_opt_level_set(baseline_config, WASMTIME_OPT_LEVEL_NONE);
+        if(g_opts.stack_pool_size > 0) {
+            wasm_stack_pool_attach(baseline_config);
+        }
+        if(memory_creator) {
+            wasm_memory_attach(baseline_config);
+        }
+    }
+
+    // Engine creation
+    g_engine = wasm_engine_new_with_config(g_config);
+    if(!g_engine) {
+        printf("Failed to create Wasmtime engine\n");
+        if(baseline_config) {
+            wasm_config_delete(baseline_config);
+        }
+        return init_undo();
+    }
+
+    // Optimized tier is g_engine, recompiles run on housekeeping threads
+    if(baseline_config) {
+        g_baseline_engine = wasm_engine_new_with_config(baseline_config);
+        if(!g_baseline_engine || wasm_tier_init(g_engine, g_opts.tier_up_slices) != 0) {
+            printf("Failed to create the baseline engine\n");
+            return init_undo();
+        }
+    }
+
+    if(g_opts.host_io && wasm_uring_init(g_opts.host_io_root) != 0) {
+        printf("Failed to define the host I/O module\n");
+        return init_undo();
+    }
+
+    if(g_opts.record_file != NULL && wasm_replay_record(g_opts.record_file) != 0) {
+        return init_undo();
+    }
+    if(g_opts.replay_file != NULL && wasm_replay_open(g_opts.replay_file) != 0) {
+        return init_undo();
+    }
+
+    return WASM_API_OK;    
+}
+
+
+/**
+ * @brief Load Wasm module from file and instantiate it
+ *
+ * @param wasm_file Wasm module to be read
+ * @param partition_id Partition identifier
+ * @return WASM_API_OK, when successful, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_load_partition(int partition_id, const char* wasm_file) {
+    return wasm_api_load_partition_with_opts(partition_id, wasm_file, NULL);
+}
+
+
+/**
+ * @brief Load Wasm module from file and instantiate it with resource limits.
+ *        Growing past a limit fails inside the guest, a call that traps
+ *        after its memory limit denied a grow reports PARTITION_LIMIT
+ *        instead of PARTITION_ERROR
+ *
+ * @param partition_id Partition identifier
+ * @param wasm_file Wasm module to be read
+ * @param opts Partition options, NULL for no limits
+ * @return WASM_API_OK, when successful, PARTITION_LIMIT when instantiation
+ *         exceeds a limit, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_load_partition_with_opts(int partition_id, const char* wasm_file, const wasm_api_load_opts_t *opts) {
+
+    /* Create Wasm partition struct */
+
+    // partition_id checks
+    if(partition_id_valid(partition_id) != WASM_API_OK) {
+        return WASM_API_ERR;
+    }
+
+    // Check if already loaded
+    if(g_partitions[partition_id] != NULL) {
+        printf("Partition %d already loaded\n", partition_id);
+        return WASM_API_ERR;
+    }
+
+    // Allocate Mem for a partition
+    wasm_partition_t *partition = calloc(1, sizeof(wasm_partition_t));
+    if(!partition) {
+        printf("Memory allocation failed!\n");
+        return WASM_API_ERR;
+    }
+
+    // Store in global array 
+    g_partitions[partition_id] = partition;
+    wasm_fault_clear(&g_faults[partition_id]);
+
+    partition->partition_id = partition_id;
+    partition->yield_interval = YIELD_AFTER;
+    if(opts != NULL) {
+        partition->load_opts = *opts;
+    }
+
+    // The store limiter enforces memory_size, unless the memory creator
+    // does to record a denied grow
+    if(partition->load_opts.memory_size > 0 && g_opts.memory_limits) {
+        partition->memory_limit.max_size = (uint64_t) partition->load_opts.memory_size;
+    }
+
+    // Compiled, scanned for limits and tiered from the same bytes
+    wasm_byte_vec_t wasm_data;
+    struct stat st;
+    if(read_wasm_file(wasm_file, &wasm_data, &st) != WASM_API_OK) {
+        wasm_api_unload_partition(partition_id);
+        return WASM_API_ERR;
+    }
+
+    // Tiered: optimized code once the module ran hot, else the baseline engine.
+    // Shared memories of channels belong to the optimized engine
+    wasmtime_module_t *optimized = NULL;
+    partition->engine = g_engine;
+    partition->tier = -1;
+    if(g_baseline_engine != NULL && partition->load_opts.nchannels == 0) {
+        partition->tier = wasm_tier_lookup(wasm_file, &st, (const uint8_t*) wasm_data.data, wasm_data.size, &optimized);
+        if(optimized == NULL) {
+            partition->engine = g_baseline_engine;
+        }
+    }
+
+    /* Compile .wasm content, unless another partition did */
+
+    wasm_api_result_t loaded = WASM_API_OK;
+    if(optimized != NULL) {
+        partition->module = optimized;
+    } else {
+        loaded = module_acquire(partition, &wasm_data, &st);
+    }
+    if(loaded == WASM_API_OK && partition_has_limits(partition)) {
+        loaded = module_needs_scan(partition, &wasm_data, wasm_file);
+    }
+    wasm_byte_vec_delete(&wasm_data);
+    if(loaded != WASM_API_OK) {
+        wasm_api_unload_partition(partition_id);
+        return WASM_API_ERR;
+    }
+
+    // Create Wasm related instances and assign
+    partition->store = partition_store_new(partition);
+    if(!partition->store) {
+        wasm_api_unload_partition(partition_id);
+        return WASM_API_ERR;
+    }
+    
+    partition->context = wasmtime_store_context(partition->store);
+    partition->instantiated = false;
+
+    partition->wasm_file = strdup(wasm_file);
+
+    partition->linker = wasmtime_linker_new(partition->engine);
+
+    wasmtime_error_t *link_error = wasm_host_link(partition->linker);
+    if(link_error != NULL) {
+        wasm_api_unload_partition(partition_id);
+        return fault_report(partition_id, FAULT_SITE_LINK, link_error, NULL);
+    }
+
+    for(size_t i = 0; i < partition->load_opts.nchannels; i++) {
+        link_error = wasm_channel_link(partition->linker, partition->context, partition->load_opts.channels[i]);
+        if(link_error != NULL) {
+            wasm_api_unload_partition(partition_id);
+            return fault_report(partition_id, FAULT_SITE_LINK, link_error, NULL);
+        }
+    }
+
+    if(g_opts.jit_profiler != WASMTIME_PROFILING_STRATEGY_NONE) {
+        partition_map_write(partition);
+    }
+
+    // Create Async instance, pre instance required for wasmtime_instance_pre_instantiate_async
+    wasmtime_error_t *error = wasmtime_linker_instantiate_pre(partition->linker, partition->module, &partition->instance_pre);
+    if(error != NULL) {
+        wasm_api_unload_partition(partition_id);
+        return fault_report(partition_id, FAULT_SITE_INSTANTIATE, error, NULL);
+    }
+
+    /* Instantiate module */
+
+    wasm_api_result_t instantiated = partition_instantiate(partition_id, partition->instance_pre, &partition->needs,
+                                                           partition->context, &partition->instance);
+    if(instantiated != WASM_API_OK) {
+        wasm_api_unload_partition(partition_id);
+        return instantiated;
+    }
+
+    // Finalise partition attributes
+    partition->future = NULL;
+    partition->instantiated = true;
+    partition->store_generation = ++g_store_generations;
+
+
+    return WASM_API_OK;
+}
+
+
+/**
+ * @brief Unload a partition and free its resources, the id can be loaded again
+ *
+ * @param partition_id Partition identifier
+ * @return WASM_API_OK, when successful, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_unload_partition(int partition_id) {
+
+    // partition_id checks
+    if(partition_id_valid(partition_id) != WASM_API_OK) {
+        return WASM_API_ERR;
+    }
+
+    wasm_partition_t *partition = g_partitions[partition_id];
+    if(partition == NULL) {
+        return WASM_API_ERR;
+    }
+
+    profile_finish(partition);
+
+    // The compile thread reads the linker
+    if(partition->reload != NULL) {
+        reload_free(partition->reload);
+        partition->reload = NULL;
+    }
+
+    // Parked port calls and in-flight I/O target the partition's linear memory
+    wasm_port_detach(partition_id);
+    wasm_channel_detach(partition_id);
+    wasm_uring_cancel(partition_id);
+    wasm_uring_detach(partition_id);
+
+    // The future borrows the store, so it goes first
+    if(partition->future) {
+        wasmtime_call_future_delete(partition->future);
+    }
+    if(partition->call_trap) {
+        wasm_trap_delete(partition->call_trap);
+    }
+    if(partition->call_error) {
+        wasmtime_error_delete(partition->call_error);
+    }
+    if(partition->instance_pre) {
+        wasmtime_instance_pre_delete(partition->instance_pre);
+    }
+    if(partition->linker) {
+        wasmtime_linker_delete(partition->linker);
+    }
+    if(partition->module) {
+        wasmtime_module_delete(partition->module);
+    }
+    module_release(partition);
+    if(partition->store) {
+        wasmtime_store_delete(partition->store);
+    }
+
+    free(partition->wasm_file);
+    free(partition);
+    g_partitions[partition_id] = NULL;
+
+    return WASM_API_OK;
+}
+
+
+/**
+ * @brief Replace a partition's code without stopping other partitions. The
+ *        module is compiled on a housekeeping thread, the swap happens on the
+ *        scheduler thread once the current call has finished. When the old
+ *        code exports RELOAD_SAVE the swap does not wait: the call in flight
+ *        is dropped at the next slice boundary and the saved bytes are handed
+ *        to RELOAD_RESTORE of the new code. Fuel, yield interval and
+ *        arguments carry over, linear memory starts afresh
+ *
+ * @param partition_id Partition identifier
+ * @param wasm_file Wasm module with the same imports
+ * @return WASM_API_OK when the compilation started, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_reload_partition(int partition_id, const char *wasm_file) {
+
+    // partition_id checks
+    if(partition_id_valid(partition_id) != WASM_API_OK) {
+        return WASM_API_ERR;
+    }
+
+    wasm_partition_t *partition = g_partitions[partition_id];
+    if(partition == NULL || !partition->instantiated) {
+        printf("Partition %d not loaded\n", partition_id);
+        return WASM_API_ERR;
+    }
+
+    if(partition->reload != NULL) {
+        printf("Partition %d is already being reloaded\n", partition_id);
+        return WASM_API_ERR;
+    }
+
+    partition_reload_t *reload = calloc(1, sizeof(partition_reload_t));
+    if(!reload || !(reload->wasm_file = strdup(wasm_file))) {
+        free(reload);
+        printf("Memory allocation failed!\n");
+        return WASM_API_ERR;
+    }
+    reload->linker = partition->linker;
+    reload->engine = partition->engine;
+    reload->limited = partition_has_limits(partition);
+    atomic_init(&reload->done, false);
+
+    // Off the scheduler thread, on the housekeeping CPUs when they are set
+    if(pthread_create(&reload->thread, wasm_rt_housekeeping_attr(), reload_compile, reload) != 0) {
+        printf("Failed to start the compile thread of partition %d\n", partition_id);
+        free(reload->wasm_file);
+        free(reload);
+        return WASM_API_ERR;
+    }
+
+    partition->reload = reload;
+    g_reloads_pending++;
+
+    return WASM_API_OK;
+}
+
+
+/**
+ * @brief Whether a reload of the partition has not been swapped in yet
+ *
+ * @param partition_id Partition identifier
+ */
+bool wasm_api_reload_pending(int partition_id) {
+    wasm_partition_t *partition = get_wasm_partition(partition_id);
+    return partition != NULL && partition->reload != NULL;
+}
+
+
+/**
+ * @brief Start a partition afresh on its compiled code, after a trap or to
+ *        drop a call in flight. The new store is instantiated from the
+ *        partition's instance_pre, nothing is compiled or linked. Fuel is
+ *        refilled to the last injected amount, the yield interval and the
+ *        arguments carry over, linear memory starts afresh. The last fault
+ *        is kept
+ *
+ * @param partition_id Partition identifier
+ * @return WASM_API_OK when successful, PARTITION_LIMIT when instantiation
+ *         exceeds a limit, else WASM_API_ERR and the old store stays
+ */
+wasm_api_result_t wasm_api_restart_partition(int partition_id) {
+
+    // partition_id checks
+    if(partition_id_valid(partition_id) != WASM_API_OK) {
+        return WASM_API_ERR;
+    }
+
+    wasm_partition_t *partition = g_partitions[partition_id];
+    if(partition == NULL || partition->instance_pre == NULL) {
+        printf("Partition %d not loaded\n", partition_id);
+        return WASM_API_ERR;
+    }
+
+    // The compile thread of a reload reads the linker
+    if(partition->tier >= 0 && partition->engine == g_baseline_engine && partition->reload == NULL) {
+        partition_tier_up(partition);
+    }
+
+    wasmtime_store_t *store = partition_store_new(partition);
+    if(!store) {
+        return WASM_API_ERR;
+    }
+    wasmtime_context_t *context = wasmtime_store_context(store);
+
+    // The budget starts over like the call
+    if(!g_opts.no_fuel) {
+        wasmtime_error_t *error = partition_fuel_set(partition, context, partition->fuel_injected);
+        if(error != NULL) {
+            wasmtime_store_delete(store);
+            return fault_report(partition_id, FAULT_SITE_FUEL, error, NULL);
+        }
+    }
+
+    wasmtime_instance_t instance;
+    wasm_api_result_t instantiated = partition_instantiate(partition_id, partition->instance_pre, &partition->needs, context, &instance);
+    if(instantiated != WASM_API_OK) {
+        wasmtime_store_delete(store);
+        return instantiated;
+    }
+
+    // Parked port calls and in-flight I/O target the old linear memory
+    wasm_port_detach(partition_id);
+    wasm_channel_detach(partition_id);
+    wasm_uring_cancel(partition_id);
+    wasm_uring_detach(partition_id);
+
+    // The future borrows the old store, so it goes first
+    if(partition->future != NULL) {
+        wasmtime_call_future_delete(partition->future);
+        partition->future = NULL;
+    }
+    if(partition->call_trap) {
+        wasm_trap_delete(partition->call_trap);
+        partition->call_trap = NULL;
+    }
+    if(partition->call_error) {
+        wasmtime_error_delete(partition->call_error);
+        partition->call_error = NULL;
+    }
+    wasmtime_store_delete(partition->store);
+
+    partition->store = store;
+    partition->context = context;
+    partition->instance = instance;
+    partition->store_generation = ++g_store_generations;
+    partition->instantiated = true;
+    partition->pending_call = NULL;
+    partition->blocked = false;
+    partition->starved = partition->fuel_suspend && partition->fuel_injected == 0;
+    partition->call_dropped = false;
+
+    return WASM_API_OK;
+}
+
+
+/**
+ * @brief Set the arguments for the next call of the partition's function.
+ *        Without arguments a single i32 DEFAULT_ARG is passed if expected
+ *
+ * @param partition_id Partition identifier
+ * @param args Arguments, copied
+ * @param nargs Number of arguments, at most MAX_FUNC_VALUES
+ * @return WASM_API_OK, when successful, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_set_args(int partition_id, const wasmtime_val_t *args, size_t nargs) {
+
+    // partition_id checks
+    if(partition_id_valid(partition_id) != WASM_API_OK || g_partitions[partition_id] == NULL) {
+        return WASM_API_ERR;
+    }
+
+    if(nargs > MAX_FUNC_VALUES) {
+        printf("Too many arguments: %zu, max %d\n", nargs, MAX_FUNC_VALUES);
+        return WASM_API_ERR;
+    }
+
+    wasm_partition_t *partition = g_partitions[partition_id];
+
+    memcpy(partition->args, args, nargs * sizeof(wasmtime_val_t));
+    partition->nargs = nargs;
+
+    return WASM_API_OK;
+}
+
+
+/**
+ * @brief Set the fuel consumed per slice before the partition yields, applies
+ *        at the next wasm_api_inject_fuel
+ *
+ * @param partition_id Partition identifier
+ * @param interval Fuel per slice, 0 for YIELD_AFTER
+ * @return WASM_API_OK, when successful, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_set_yield_interval(int partition_id, uint64_t interval) {
+
+    // partition_id checks
+    if(partition_id_valid(partition_id) != WASM_API_OK || g_partitions[partition_id] == NULL) {
+        return WASM_API_ERR;
+    }
+
+    g_partitions[partition_id]->yield_interval = interval ? interval : YIELD_AFTER;
+
+    return WASM_API_OK;
+}
+
+
+/**
+ * @brief Turn fuel yields off for a synchronous call, which has no future to
+ *        suspend, and back on afterwards. Resuming applies the yield interval
+ *        to the fuel left, a suspending partition's next slice again ends at
+ *        its budget
+ *
+ * @param partition_id Partition identifier
+ * @param paused True before the synchronous call, false after it
+ * @return WASM_API_OK, when successful, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_pause_fuel_yield(int partition_id, bool paused) {
+
+    // partition_id checks
+    if(partition_id_valid(partition_id) != WASM_API_OK || g_partitions[partition_id] == NULL) {
+        return WASM_API_ERR;
+    }
+
+    wasm_partition_t *partition = g_partitions[partition_id];
+    if(g_opts.no_fuel || !partition->fuel_yield) {
+        return WASM_API_OK;
+    }
+
+    if(paused) {
+        wasmtime_context_fuel_async_yield_interval(partition->context, 0);
+        return WASM_API_OK;
+    }
+
+    wasmtime_error_t *error = partition_fuel_set(partition, partition->context, partition_budget(partition));
+    if(error != NULL) {
+        return fault_report(partition_id, FAULT_SITE_FUEL, error, NULL);
+    }
+
+    return WASM_API_OK;
+}
+
+
+/**
+ * @brief Park the partition as PARTITION_STARVED when its fuel runs out
+ *        instead of trapping, applies at the next wasm_api_inject_fuel. The
+ *        store holds FUEL_SLACK more than the budget and the last slice is
+ *        shortened to what is left, so the guest yields at its budget
+ *
+ * @param partition_id Partition identifier
+ * @param suspend True to suspend, false traps once the fuel is gone
+ * @return WASM_API_OK, when successful, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_set_fuel_suspend(int partition_id, bool suspend) {
+
+    // partition_id checks
+    if(partition_id_valid(partition_id) != WASM_API_OK || g_partitions[partition_id] == NULL) {
+        return WASM_API_ERR;
+    }
+
+    if(g_opts.no_fuel) {
+        printf("Fuel metering is disabled, partition %d cannot starve\n", partition_id);
+        return WASM_API_ERR;
+    }
+
+    g_partitions[partition_id]->fuel_suspend = suspend;
+
+    return WASM_API_OK;
+}
+
+
+/**
+ * @brief Inject fuel to the partition. A starved partition gets a new
+ *        budget and becomes runnable with its call intact
+ *
+ * @param partition_id Partition identifier
+ * @param fuel_amount Amount of fuel for the partition
+ * @param yield True when yielding should be activated
+ * @return WASM_API_OK, when successful, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_inject_fuel(int partition_id, uint64_t fuel_amount, bool yield) {
+
+    // partition_id checks
+    if(partition_id_valid(partition_id) != WASM_API_OK) {
+        return WASM_API_ERR;
+    }
+
+    wasm_partition_t *partition = g_partitions[partition_id];
+    if(partition == NULL) {
+        printf("Partition %d not loaded\n", partition_id);
+        return WASM_API_ERR;
+    }
+
+    LOG_INFO("Injecting %lu units of fuel...\n", fuel_amount);
+
+    partition->fuel_yield = yield;
+    if(yield) {
+        LOG_INFO("Yielding set for partition %d\n", partition_id);
+    } else {
+        LOG_INFO("No yielding set for partition %d\n", partition_id);
+    }
+
+    wasmtime_error_t* error = partition_fuel_set(partition, partition->context, fuel_amount);
+    if(error != NULL) {
+        return fault_report(partition_id, FAULT_SITE_FUEL, error, NULL);
+    }
+    partition->fuel_injected = fuel_amount;
+    partition->starved = partition->fuel_suspend && fuel_amount == 0;
+
+    return WASM_API_OK;    
+}
+
+ 
+/**
+ * @brief Run partition for a fuel slice
+ *
+ * @param partition_id Partition identifier
+ * @return WASM_API_OK, when successful, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_run_partition(int partition_id, const char* func_name) {
+
+    // partition_id checks
+    if(partition_id_valid(partition_id) != WASM_API_OK) {
+        return WASM_API_ERR;
+    }
+
+    wasm_partition_t *partition = g_partitions[partition_id];
+
+    if(partition == NULL || !partition->instantiated) {
+        printf("Module not instantiated\n");
+        return WASM_API_ERR;
+    }
+
+    // Code swaps happen between slices, never inside one
+    if(partition->reload != NULL) {
+        reload_try(partition);
+    }
+
+    // The call stays in flight until wasm_api_inject_fuel
+    if(partition->starved) {
+        return PARTITION_STARVED;
+    }
+
+    // Reported once, the run after starts the call again
+    if(partition->call_dropped) {
+        partition->call_dropped = false;
+        return PARTITION_ERROR;
+    }
+
+    // First time call, skips function export in runs after that
+    if(partition->future == NULL) {    
+        /* Look up exported function */
+
+        // Looks up export by func_name in the current instance, result stored in ext
+        wasmtime_extern_t ext;
+        bool ok = wasmtime_instance_export_get(partition->context, &partition->instance, func_name, strlen(func_name), &ext);
+
+        // Export exist and it's a function
+        if(!ok || ext.kind != WASMTIME_EXTERN_FUNC) {
+            printf("Function '%s' not found or not a function\n", func_name);
+            return WASM_API_ERR;
+        }
+
+        partition->exported_func = ext.of.func;
+
+        /* Prepare params and results from the function type */
+
+        wasm_functype_t *functype = wasmtime_func_type(partition->context, &partition->exported_func);
+        const wasm_valtype_vec_t *param_types = wasm_functype_params(functype);
+        partition->nparams = param_types->size;
+        partition->nresults = wasm_functype_results(functype)->size;
+
+        bool args_ok = partition->nparams <= MAX_FUNC_VALUES && partition->nresults <= MAX_FUNC_VALUES;
+        if(args_ok && partition->nargs == 0) {
+            // No arguments set, keep the fib(DEFAULT_ARG) behaviour for i32 params
+            for(size_t i = 0; i < partition->nparams; i++) {
+                args_ok = args_ok && wasm_valtype_kind(param_types->data[i]) == WASM_I32;
+                partition->params[i].kind = WASMTIME_I32;
+                partition->params[i].of.i32 = DEFAULT_ARG;
+            }
+        } else if(args_ok) {
+            args_ok = partition->nargs == partition->nparams;
+            memcpy(partition->params, partition->args, partition->nargs * sizeof(wasmtime_val_t));
+        }
+
+        wasm_functype_delete(functype);
+
+        if(!args_ok) {
+            printf("Function '%s' expects %zu params, %zu args set\n", func_name, partition->nparams, partition->nargs);
+            return WASM_API_ERR;
+        }
+
+        /* Call function */
+
+        if(start_call(partition) != WASM_API_OK) {
+            return WASM_API_ERR;
+        }
+
+    }
+
+    // Nothing to do until the host call completes
+    if(partition->blocked && !wasm_host_call_done(partition->pending_call)) {
+        if(wasm_replay_mode() == REPLAY_REPLAY) {
+            wasm_replay_diverged(partition_id, "partition is blocked");
+        }
+        return PARTITION_BLOCKED;
+    }
+
+    // Sample at the first epoch check after every Nth fuel yield
+    uint64_t cpu_before = 0;
+    if(partition->profiler != NULL) {
+        if(partition->profile_yields > 0 && partition->profile_yields % partition->profile_every == 0) {
+            partition->profile_pending = true;
+            wasmtime_context_set_epoch_deadline(partition->context, 0);
+        }
+        cpu_before = thread_cpu_ns();
+    }
+
+    // One check per slice, tracing is not switched within it
+    bool traced = wasm_trace_enabled();
+    uint64_t fuel_before = 0;
+    if(traced) {
+        fuel_before = partition_fuel(partition);
+        wasm_trace_record(TRACE_SLICE_BEGIN, partition_id, 0, 0);
+    }
+
+    // wasmtime_call_future_poll returns false when yielded
+    bool done = wasmtime_call_future_poll(partition->future);
+
+    if(partition->profiler != NULL) {
+        partition->profile_cpu_ns += thread_cpu_ns() - cpu_before;
+        if(!done) {
+            partition->profile_yields++;
+        }
+    }
+
+    wasm_api_result_t status = PARTITION_YIELDED;
+    if(done) {
+        status = (partition->call_trap != NULL || partition->call_error != NULL) ? PARTITION_ERROR : PARTITION_DONE;
+        if(status == PARTITION_ERROR && partition->memory_limit.hit) {
+            status = PARTITION_LIMIT;
+        }
+    } else if(partition->pending_call != NULL && !wasm_host_call_done(partition->pending_call)) {
+        partition->blocked = true;
+        status = PARTITION_BLOCKED;
+    }
+
+    // Park once the budget is spent, else keep the next slice within it
+    if(!done && partition->fuel_suspend) {
+        uint64_t budget = partition_budget(partition);
+        if(budget == 0) {
+            partition->starved = true;
+            status = status == PARTITION_YIELDED ? PARTITION_STARVED : status;
+        } else if(partition->fuel_yield && budget < partition->yield_interval) {
+            wasmtime_error_t *error = partition_fuel_set(partition, partition->context, budget);
+            if(error != NULL) {
+                fault_report(partition_id, FAULT_SITE_FUEL, error, NULL);
+            }
+        }
+    }
+
+    if(traced) {
+        wasm_trace_record(TRACE_SLICE_END, partition_id, status, fuel_before - partition_fuel(partition));
+        if(status == PARTITION_ERROR || status == PARTITION_LIMIT) {
+            wasm_trace_record(TRACE_TRAP, partition_id, status, 0);
+        }
+    }
+
+    if(wasm_replay_mode() != REPLAY_OFF) {
+        wasm_replay_slice(partition_id, status, partition_fuel(partition));
+    }
+
+    if(partition->tier >= 0) {
+        wasm_tier_count(partition->tier);
+    }
+
+    if(!done) {
+        LOG_INFO("Partition %d %s\n", partition_id, status == PARTITION_BLOCKED ? "blocked"
+                 : status == PARTITION_STARVED ? "starved" : "yielded");
+        return status;
+    }
+
+    wasmtime_call_future_delete(partition->future);
+    partition->future = NULL;
+
+    // Kept for wasm_api_get_fault, the text is only produced when asked for
+    if(partition->call_error != NULL || partition->call_trap != NULL) {
+        fault_record(partition_id, FAULT_SITE_RUN, partition->call_error, partition->call_trap);
+        g_faults[partition_id].info.limit = status == PARTITION_LIMIT;
+        partition->call_error = NULL;
+        partition->call_trap = NULL;
+        return status;
+    }
+
+    if(partition->nresults > 0 && partition->results[0].kind == WASMTIME_I32) {
+        LOG_INFO("Partition %d returned %d\n", partition_id, partition->results[0].of.i32);
+    }
+    LOG_INFO("Partition %d completed\n", partition_id);
+    return PARTITION_DONE;
+    
+}
+
+
+/**
+ * @brief Start a call of a function the caller resolved and type checked
+ *        once, skips the export lookup and signature check of
+ *        wasm_api_run_partition. Run it with wasm_api_run_partition, whose
+ *        func_name is ignored while the call is in flight
+ *
+ * @param partition_id Partition identifier
+ * @param func Function of the partition's instance
+ * @param params Params matching the function type, copied
+ * @param nparams Number of params
+ * @param nresults Number of results of the function type
+ * @return WASM_API_OK, when successful, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_start_call(int partition_id, const wasmtime_func_t *func,
+                                      const wasmtime_val_t *params, size_t nparams, size_t nresults) {
+
+    // partition_id checks
+    if(partition_id_valid(partition_id) != WASM_API_OK) {
+        return WASM_API_ERR;
+    }
+
+    wasm_partition_t *partition = g_partitions[partition_id];
+
+    if(partition == NULL || !partition->instantiated) {
+        printf("Module not instantiated\n");
+        return WASM_API_ERR;
+    }
+
+    if(partition->future != NULL) {
+        printf("Partition %d already has a call in flight\n", partition_id);
         return WASM_API_ERR;
-    }else {
-        return WASM_API_OK;
     }
-}
 
+    if(nparams > MAX_FUNC_VALUES || nresults > MAX_FUNC_VALUES) {
+        printf("Partition %d: at most %d params and results\n", partition_id, MAX_FUNC_VALUES);
+        return WASM_API_ERR;
+    }
 
-/****************************************************************************
- * Function Implementations
-****************************************************************************/
+    partition->exported_func = *func;
+    partition->nparams = nparams;
+    partition->nresults = nresults;
+    memcpy(partition->params, params, nparams * sizeof(wasmtime_val_t));
 
-wasm_partition_t *get_wasm_partition(int partition_id) {
-    partition_id_valid(partition_id);
-    return g_partitions[partition_id];
+    return start_call(partition);
 }
 
 
-/**
- * @brief Initialize the Wasm engine and context globally 
+/** // TODO: Probably obsolete
+ * @brief Check if fuel remaining
  *
+ * @param partition_id Partition identifier
  * @return WASM_API_OK, when successful, else WASM_API_ERR
  */
-wasm_api_result_t wasm_api_init(void) {
-    
-    // Config to enable fuel usage
-    g_config = wasm_config_new();
+wasm_api_result_t wasm_api_fuel_remaining(int partition_id) {
 
-    // Enable fuel consumption
-    wasmtime_config_consume_fuel_set(g_config, true);
+    // partition_id checks
+    if(partition_id_valid(partition_id) != WASM_API_OK) {
+        return WASM_API_ERR;
+    }
 
-    // Async Support
-    wasmtime_config_async_support_set(g_config, true);
+    wasm_partition_t *partition = g_partitions[partition_id];
 
-    // Engine creation
-    g_engine = wasm_engine_new_with_config(g_config);
-    if(!g_engine) {
-        printf("Failed to create Wasmtime engine\n");
-        return WASM_API_ERR;
+    uint64_t fuel_remaining = 0;
+
+    wasmtime_error_t* error = wasmtime_context_get_fuel(partition->context, &fuel_remaining);
+
+    if(error != NULL) {
+        return fault_report(partition_id, FAULT_SITE_FUEL, error, NULL);
     }
 
+    printf("Partition %d: ", partition_id);
+    printf("Fuel remaining %ld\n", fuel_remaining);
+
     return WASM_API_OK;    
 }
 
 
 /**
- * @brief Load Wasm module from file and instantiate it
+ * @brief Enable the guest sampling profiler for a partition. A guest stack
+ *        sample is taken at every Nth fuel yield, so samples are weighted by
+ *        instruction count. The Firefox profiler JSON is written on cleanup
  *
- * @param wasm_file Wasm module to be read
  * @param partition_id Partition identifier
+ * @param sample_every Sample every Nth fuel yield, 0 for PROFILE_EVERY
+ * @param out_file Output file, open with https://profiler.firefox.com
  * @return WASM_API_OK, when successful, else WASM_API_ERR
  */
-wasm_api_result_t wasm_api_load_partition(int partition_id, const char* wasm_file) {
-
-    /* Create Wasm partition struct */
+wasm_api_result_t wasm_api_profile_partition(int partition_id, uint32_t sample_every, const char *out_file) {
 
     // partition_id checks
     if(partition_id_valid(partition_id) != WASM_API_OK) {
         return WASM_API_ERR;
     }
 
-    // Check if already loaded
-    if(g_partitions[partition_id] != NULL) {
-        printf("Partition %d already loaded\n", partition_id);
-        return WASM_API_ERR;
-    }
+    wasm_partition_t *partition = g_partitions[partition_id];
 
-    // Allocate Mem for a partition
-    wasm_partition_t *partition = malloc(sizeof(wasm_partition_t));
-    if(!partition) {
-        printf("Memory allocation failed!\n");
+    if(partition == NULL || !partition->instantiated) {
+        printf("Module not instantiated\n");
         return WASM_API_ERR;
     }
 
-    // Store in global array 
-    g_partitions[partition_id] = partition;
-
-    partition->partition_id = partition_id;
-
-    // Create Wasm related instances and assign
-    partition->store = wasmtime_store_new(g_engine, NULL, NULL);
-    if(!partition->store) {
-        printf("Failed to create Wasmtime store\n");
+    if(!g_opts.guest_profiling) {
+        printf("Guest profiling not enabled in wasm_api_init_with_opts\n");
         return WASM_API_ERR;
     }
-    
-    partition->context = wasmtime_store_context(partition->store);
-
-    partition->linker = wasmtime_linker_new(g_engine);
-
-    g_partitions[partition_id]->module = NULL;
-    g_partitions[partition_id]->instantiated = false;
-
-    /* Read .wasm content */
 
-    // Open Wasm file
-    FILE *file = fopen(wasm_file, "rb");
-    if(!file) {
-        printf("> Error loading file: %s\n", wasm_file);
+    if(partition->profiler != NULL) {
+        printf("Partition %d already profiled\n", partition_id);
         return WASM_API_ERR;
     }
 
-    // Move file pointer to end for fle size
-    fseek(file, 0, SEEK_END);
-    size_t file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
-
-    // Allocating byte vector with previously determined size
-    wasm_byte_vec_t wasm_data;
-    wasm_byte_vec_new_uninitialized(&wasm_data, file_size);
-
-    // Reads file content into wasm_data.data and closes file
-    size_t read = fread(wasm_data.data, 1, file_size, file);
-    fclose(file);
-    if(read != file_size) {
-        printf("Failed to read full wasm file\n");
-        wasm_byte_vec_delete(&wasm_data);
-        free(partition);
+    partition->profile_file = strdup(out_file);
+    if(!partition->profile_file) {
+        printf("Memory allocation failed!\n");
         return WASM_API_ERR;
     }
 
-    /* Compile Wasm Module */ 
+    // Name the module after its file so frames can be told apart across partitions
+    wasm_name_t module_name;
+    wasm_name_new(&module_name, strlen(partition->wasm_file), partition->wasm_file);
 
-    // Pass bytes to Wasmtime for compilation
-    wasmtime_error_t* error = wasmtime_module_new(g_engine, (const uint8_t*) wasm_data.data, wasm_data.size, &partition->module);
-    wasm_byte_vec_delete(&wasm_data);
+    wasmtime_guestprofiler_modules_t modules = {
+        .name = &module_name,
+        .mod = partition->module
+    };
 
-    if(error != NULL) {
-        free(partition);
-        return catch_err(ERR, "Failed to compile wasm module", error, NULL);
-    }
+    partition->profile_every = sample_every ? sample_every : PROFILE_EVERY;
+    partition->profile_yields = 0;
+    partition->profile_cpu_ns = 0;
+    partition->profile_pending = false;
+    partition->profiler = wasmtime_guestprofiler_new(&module_name, 0, &modules, 1);
 
-    // Create Async instance, pre instance required for wasmtime_instance_pre_instantiate_async
-    wasmtime_instance_pre_t *instance_pre = NULL;
-    error = wasmtime_linker_instantiate_pre(partition->linker, partition->module, &instance_pre);
-    if(error != NULL) {
-        return catch_err(ERR, "Error preaparing async instantiation", error, NULL);
-    }
+    wasm_name_delete(&module_name);
 
-    /* Instantiate module */
-    
-    // Instantiate
-    wasm_trap_t* trap = NULL;
-    wasmtime_call_future_t *future = wasmtime_instance_pre_instantiate_async(instance_pre, partition->context, &partition->instance, &trap, &error);
-    if (error || !future) {
-        return catch_err(ERR, "Error during async instantiation\n", error, NULL);
+    if(partition->profiler == NULL) {
+        printf("Failed to create guest profiler for partition %d\n", partition_id);
+        free(partition->profile_file);
+        partition->profile_file = NULL;
+        return WASM_API_ERR;
     }
 
+    LOG_INFO("Profiling partition %d every %u fuel yields\n", partition_id, partition->profile_every);
 
-    while(!wasmtime_call_future_poll(future)) {
-        printf("instantiation yielded...\n");
-    }
+    return WASM_API_OK;
+}
 
-    wasmtime_call_future_delete(future);
 
-    // Finalise partition attributes
-    partition->future = NULL;
-    partition->instantiated = true;
-    g_partitions[partition_id] = partition;
-    
+/**
+ * @brief Register an async host function for partitions loaded afterwards.
+ *        The calling guest is suspended while the work runs on a worker of
+ *        the completion queue, wasm_api_run_partition returns
+ *        PARTITION_BLOCKED meanwhile
+ *
+ * @param module Import module name
+ * @param name Import name
+ * @param params Parameter kinds, numeric only
+ * @param nparams Number of parameters
+ * @param results Result kinds, numeric only
+ * @param nresults Number of results
+ * @param work Host work, may block
+ * @param env Passed to work
+ * @return WASM_API_OK, when successful, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_define_async_func(const char *module, const char *name,
+                                             const wasm_valkind_t *params, size_t nparams,
+                                             const wasm_valkind_t *results, size_t nresults,
+                                             wasm_host_work_t work, void *env) {
+
+    if(wasm_host_define(module, name, params, nparams, results, nresults, work, env, g_opts.host_workers) != 0) {
+        return WASM_API_ERR;
+    }
 
     return WASM_API_OK;
 }
 
 
 /**
- * @brief Inject fuel to the partition
+ * @brief Create a queuing port from one partition to another, see
+ *        wasm_port.h for the guest imports. Ports must be created before
+ *        the partitions using them are loaded
  *
- * @param partition_id Partition identifier
- * @param fuel_amount Amount of fuel for the partition
- * @param yield True when yielding should be activated
+ * @param name Port name, guests look it up with port.id
+ * @param max_message Largest message in bytes
+ * @param depth Messages in flight
+ * @param source Sending partition
+ * @param destination Receiving partition, parked while the port is empty
+ * @param port_id Output, id of the port
  * @return WASM_API_OK, when successful, else WASM_API_ERR
  */
-wasm_api_result_t wasm_api_inject_fuel(int partition_id, uint64_t fuel_amount, bool yield) {
+wasm_api_result_t wasm_api_create_queuing_port(const char *name, uint32_t max_message, uint32_t depth,
+                                               int source, int destination, int *port_id) {
 
-    // partition_id checks
-    if(partition_id_valid(partition_id) != WASM_API_OK) {
+    int id = wasm_port_create_queuing(name, max_message, depth, source, destination);
+    if(id < 0) {
         return WASM_API_ERR;
     }
 
-    wasm_partition_t *partition = g_partitions[partition_id];
-
-    printf("Injecting %lu units of fuel...\n", fuel_amount);
+    *port_id = id;
+    return WASM_API_OK;
+}
 
-    wasmtime_error_t* error = wasmtime_context_set_fuel(partition->context, fuel_amount);
 
-    catch_err(ERR, "Error injecting fuel", error, NULL);
+/**
+ * @brief Create a sampling port holding the latest message of a partition
+ *
+ * @param name Port name, guests look it up with port.id
+ * @param max_message Largest message in bytes
+ * @param source Writing partition
+ * @param port_id Output, id of the port
+ * @return WASM_API_OK, when successful, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_create_sampling_port(const char *name, uint32_t max_message, int source, int *port_id) {
 
-    // Async Yield
-    if(yield) {
-        printf("Yielding set for partition %d\n", partition_id);
-        wasmtime_context_fuel_async_yield_interval(partition->context, YIELD_AFTER);
-    } else {
-        printf("No yielding set for partition %d\n", partition_id);
-        wasmtime_context_fuel_async_yield_interval(partition->context, 0);
+    int id = wasm_port_create_sampling(name, max_message, source);
+    if(id < 0) {
+        return WASM_API_ERR;
     }
 
-    return WASM_API_OK;    
+    *port_id = id;
+    return WASM_API_OK;
 }
 
- 
+
 /**
- * @brief Run partition for a fuel slice
+ * @brief Create a channel between partitions, a shared memory holding a ring
+ *        of fixed size slots, see wasm_channel.h for its layout and the guest
+ *        imports. Partitions import it through wasm_api_load_opts_t.channels
  *
- * @param partition_id Partition identifier
+ * @param name Channel name
+ * @param slot_size Bytes per slot including CHANNEL_PAYLOAD, multiple of 8
+ * @param slots Slot count
+ * @param channel_id Output, id of the channel
  * @return WASM_API_OK, when successful, else WASM_API_ERR
  */
-wasm_api_result_t wasm_api_run_partition(int partition_id, const char* func_name) {
+wasm_api_result_t wasm_api_create_channel(const char *name, uint32_t slot_size, uint32_t slots, int *channel_id) {
 
-    // partition_id checks
-    if(partition_id_valid(partition_id) != WASM_API_OK) {
+    int id = wasm_channel_create(g_engine, name, slot_size, slots);
+    if(id < 0) {
         return WASM_API_ERR;
     }
 
-    wasm_partition_t *partition = g_partitions[partition_id];
-    
-    int32_t fib = 10;
-    wasmtime_val_t params[1];
-    // wasmtime_val_t results[1]; // TODO: Expect only one result
-    if (partition->results == NULL) {
-        partition->results = malloc(sizeof(wasmtime_val_t));  // Or handle allocation elsewhere
-        if (!partition->results) {
-            fprintf(stderr, "Failed to allocate results buffer\n");
+    *channel_id = id;
+    return WASM_API_OK;
+}
+
+
+/**
+ * @brief Call one export over n inputs in parallel, see wasm_map.h. Each
+ *        worker thread instantiates the module once and takes batches of
+ *        elements, fuel is enforced per element or per batch. The module
+ *        comes from the shared module cache, and the last map's
+ *        instance_pre is kept while its file is unchanged
+ *
+ * @param wasm_file Module, must not import host functions or channels
+ * @param func_name Export with numeric params and results
+ * @param inputs n * nparams values
+ * @param outputs n * nresults values
+ * @param n Number of elements
+ * @param opts Options, may be NULL
+ * @return WASM_API_OK when every element completed, PARTITION_ERROR when some
+ *         trapped or ran out of fuel, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_map(const char *wasm_file, const char *func_name, const wasmtime_val_t *inputs,
+                               wasmtime_val_t *outputs, size_t n, const wasm_map_opts_t *opts) {
+    struct stat st;
+
+    bool cached = g_map_cache.shared != NULL && stat(wasm_file, &st) == 0
+                  && module_find(g_engine, &st) == g_map_cache.shared;
+    if(!cached) {
+        wasm_byte_vec_t wasm_data;
+        map_cache_clear();
+        if(read_wasm_file(wasm_file, &wasm_data, &st) != WASM_API_OK) {
+            return WASM_API_ERR;
+        }
+        wasm_api_result_t shared = module_share(g_engine, &wasm_data, &st, -1, &g_map_cache.module, &g_map_cache.shared);
+        wasm_byte_vec_delete(&wasm_data);
+        if(shared != WASM_API_OK) {
+            return WASM_API_ERR;
+        }
+        g_map_cache.instance_pre = wasm_map_prepare(g_engine, g_map_cache.module);
+        if(g_map_cache.instance_pre == NULL) {
+            map_cache_clear();
             return WASM_API_ERR;
         }
     }
 
-    if(!partition->instantiated) {
-        printf("Module not instantiated\n");
+    long failed = wasm_map_run(g_engine, !g_opts.no_fuel, g_map_cache.module, g_map_cache.instance_pre,
+                               func_name, inputs, outputs, n, opts);
+
+    // A file that cannot be identified is compiled again next time
+    if(g_map_cache.shared == NULL) {
+        map_cache_clear();
+    }
+    if(failed < 0) {
         return WASM_API_ERR;
     }
 
-    // First time call, skips function export in runs after that
-    if(partition->future == NULL) {    
-        /* Look up exported function */
+    return failed == 0 ? WASM_API_OK : PARTITION_ERROR;
+}
 
-        // Looks up export by func_name in the current instance, result stored in ext
-        wasmtime_extern_t ext;
-        bool ok = wasmtime_instance_export_get(partition->context, &partition->instance, func_name, strlen(func_name), &ext);
 
-        // Export exist and it's a function
-        if(!ok || ext.kind != WASMTIME_EXTERN_FUNC) {
-            printf("Function '%s' not found or not a function\n", func_name);
-            return WASM_API_ERR;
+/**
+ * @brief Collect completed host calls, their partitions become runnable.
+ *        Called by the scheduler between slices
+ *
+ * @return Number of partitions made runnable
+ */
+size_t wasm_api_poll_completions(void) {
+    wasm_uring_poll();
+
+    // Idle partitions are swapped here, running ones before their next slice
+    for(int id = 0; g_reloads_pending > 0 && id < NUM_MAX_PARTITIONS; id++) {
+        if(g_partitions[id] != NULL && g_partitions[id]->reload != NULL && g_partitions[id]->future == NULL) {
+            reload_try(g_partitions[id]);
         }
+    }
 
-        partition->exported_func = ext.of.func;
+    return wasm_host_poll();
+}
 
-        /* Call function */
 
-        wasm_trap_t* trap = NULL;
-        wasmtime_error_t *error = NULL;
+/**
+ * @brief Last fault of a partition id: kind, site, trap code and faulting
+ *        function. Kept until the id is loaded again or faults again,
+ *        including the fault of a failed load
+ *
+ * @param partition_id Partition identifier
+ * @param info Output
+ * @return WASM_API_OK when the id has a fault, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_get_fault(int partition_id, wasm_fault_info_t *info) {
 
-        params[0].kind = WASMTIME_I32;
-        params[0].of.i32 = fib;
+    if(partition_id_valid(partition_id) != WASM_API_OK || info == NULL) {
+        return WASM_API_ERR;
+    }
 
-        partition->future = wasmtime_func_call_async(
-            partition->context, &partition->exported_func,
-            params, 1,
-            partition->results, 1,
-            &trap, &error
-        );
+    wasm_fault_t *fault = &g_faults[partition_id];
+    wasm_fault_resolve(fault);
+    *info = fault->info;
 
-        if(error != NULL || trap != NULL) {
-            if(error != NULL) {
-                catch_err(ERR, "Error calling function", error, NULL);
-            }else if(trap != NULL) {
-                catch_err(TRAP, "Trap while calling function", NULL, trap);
-            }
+    return fault->info.kind != FAULT_NONE ? WASM_API_OK : WASM_API_ERR;
+}
 
-            return WASM_API_ERR;
-        }
 
-    }
+/**
+ * @brief Message of the last fault of a partition id, "<site>: <message>"
+ *
+ * @param partition_id Partition identifier
+ * @param buf Output, NUL terminated, truncated to size
+ * @param size Size of buf
+ * @return Length of the full message, 0 without a fault
+ */
+size_t wasm_api_fault_message(int partition_id, char *buf, size_t size) {
 
-    // wasmtime_call_future_poll returns false when yielded
-    if(wasmtime_call_future_poll(partition->future)) {
-        if(partition->results[0].kind == WASMTIME_I32) {
-            printf("Fibonacci(%d) =  %d\n", 10, partition->results[0].of.i32);
-        }
-        printf("Partition %d completed\n", partition_id);
-        wasmtime_call_future_delete(partition->future);
-        partition->future = NULL;
-        return PARTITION_DONE;
-    }else {
-        printf("Partition %d yielded\n", partition_id);
-        return PARTITION_YIELDED;
+    if(partition_id_valid(partition_id) != WASM_API_OK) {
+        return 0;
     }
-    
+
+    return wasm_fault_message(&g_faults[partition_id], buf, size);
 }
 
 
-/** // TODO: Probably obsolete
- * @brief Check if fuel remaining
+/**
+ * @brief Wasm backtrace of the last fault of a partition id, one frame per
+ *        line, innermost first. Function names need the module's name section
  *
  * @param partition_id Partition identifier
- * @return WASM_API_OK, when successful, else WASM_API_ERR
+ * @param buf Output, NUL terminated, truncated to size
+ * @param size Size of buf
+ * @return Length of the full backtrace, 0 without a fault or Wasm frames
  */
-wasm_api_result_t wasm_api_fuel_remaining(int partition_id) {
+size_t wasm_api_fault_backtrace(int partition_id, char *buf, size_t size) {
 
-    // partition_id checks
     if(partition_id_valid(partition_id) != WASM_API_OK) {
-        return WASM_API_ERR;
+        return 0;
     }
 
-    wasm_partition_t *partition = g_partitions[partition_id];
+    return wasm_fault_backtrace(&g_faults[partition_id], buf, size);
+}
 
-    uint64_t fuel_remaining = 0;
 
-    wasmtime_error_t* error = wasmtime_context_get_fuel(partition->context, &fuel_remaining);
+/**
+ * @brief Whether a partition can make progress, false while it is blocked in
+ *        an async host function, starved or not loaded
+ *
+ * @param partition_id Partition identifier
+ */
+bool wasm_api_partition_runnable(int partition_id) {
+    wasm_partition_t *partition = get_wasm_partition(partition_id);
+    return partition != NULL && partition->instantiated && !partition->blocked && !partition->starved;
+}
 
-    if(error != NULL) {
-        return catch_err(ERR, "Error querying fuel remaining", error, NULL);
+
+/**
+ * @brief Whether a partition spent its fuel budget and waits for
+ *        wasm_api_inject_fuel, see wasm_api_set_fuel_suspend
+ *
+ * @param partition_id Partition identifier
+ */
+bool wasm_api_partition_starved(int partition_id) {
+    wasm_partition_t *partition = get_wasm_partition(partition_id);
+    return partition != NULL && partition->starved;
+}
+
+
+/**
+ * @brief Move the calling thread onto the scheduler CPUs and into SCHED_FIFO
+ *        as set in wasm_api_init_opts_t. Call on the scheduler thread after
+ *        loading, later compilations should stay on housekeeping threads
+ *
+ * @return WASM_API_OK, when successful, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_rt_enter(void) {
+
+    if(wasm_rt_enter() != 0) {
+        return WASM_API_ERR;
     }
 
-    printf("Partition %d: ", partition_id);
-    printf("Fuel remaining %ld\n", fuel_remaining);
+    return WASM_API_OK;
+}
 
-    return WASM_API_OK;    
+
+/**
+ * @brief Snapshot of runtime statistics
+ *
+ * @param stats Output
+ */
+void wasm_api_get_stats(wasm_api_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+    wasm_stack_pool_stats(&stats->stack_pool);
+    wasm_memory_stats(&stats->memory);
+    wasm_uring_stats(&stats->uring);
+    wasm_port_stats(&stats->ports);
+    wasm_channel_stats(&stats->channels);
+    wasm_map_stats(&stats->map);
+    wasm_replay_stats(&stats->replay);
+    wasm_tier_stats(&stats->tier);
+    wasm_cache_stats(&stats->cache);
+    stats->reloads = g_reloads;
+    stats->reload_failures = g_reload_failures;
+    stats->modules_shared = g_modules_shared;
 }
 
 
@@ -442,13 +2539,25 @@ wasm_api_result_t wasm_api_fuel_remaining(int partition_id) {
 void wasm_api_cleanup(void) {
     for (int i = 0; i < NUM_MAX_PARTITIONS; i++) {
         if (g_partitions[i]) {
-            if (g_partitions[i]->instantiated) {
-                wasmtime_module_delete(g_partitions[i]->module);
-                wasmtime_store_delete(g_partitions[i]->store);
-            }
-            free(g_partitions[i]);
-            g_partitions[i] = NULL;
+            wasm_api_unload_partition(i);
         }
+        wasm_fault_clear(&g_faults[i]);
+        g_faults[i].info.count = 0;
+    }
+
+    map_cache_clear();
+
+    // Workers finish queued host work, nobody waits for it anymore
+    wasm_uring_shutdown();
+    wasm_host_shutdown();
+    wasm_port_destroy();
+    wasm_channel_destroy();
+
+    // Recompiles in flight finish before their engine goes
+    wasm_tier_destroy();
+    if (g_baseline_engine) {
+        wasm_engine_delete(g_baseline_engine);
+        g_baseline_engine = NULL;
     }
 
     if (g_engine) {
@@ -456,5 +2565,14 @@ void wasm_api_cleanup(void) {
         g_engine = NULL;
     }
 
-    printf("\nWasm API cleaned up!\n");
+    // Stacks and memories are only returned once the stores and engine are gone
+    wasm_stack_pool_destroy();
+    wasm_memory_destroy();
+    wasm_rt_destroy();
+    wasm_cache_destroy();
+
+    wasm_trace_shutdown();
+    wasm_replay_close();
+
+    LOG_INFO("\nWasm API cleaned up!\n");
 }
@@ -15,34 +15,156 @@
 #include <stdint.h>
 #include <wasm.h>
 #include <wasmtime.h>
+#include "wasm_cache.h"
+#include "wasm_channel.h"
+#include "wasm_fault.h"
+#include "wasm_host.h"
+#include "wasm_limits.h"
+#include "wasm_map.h"
+#include "wasm_memory.h"
+#include "wasm_port.h"
+#include "wasm_replay.h"
+#include "wasm_rt.h"
+#include "wasm_stack_pool.h"
+#include "wasm_tier.h"
+#include "wasm_uring.h"
 
 
 /****************************************************************************
  * Defines
 ****************************************************************************/
-#define NUM_MAX_PARTITIONS 2
+#ifndef NUM_MAX_PARTITIONS
+#define NUM_MAX_PARTITIONS 64
+#endif
 #define FUEL_AMOUNT     10000000
 #define YIELD_AFTER     1000
+#define FUEL_SLACK      10000             // Fuel past the budget of suspending partitions, absorbs the overrun of the last slice
 #define NUM_RUNS        100               
+#define MAX_FUNC_VALUES 8                 // Max params/results of a partition's entry function
+#define DEFAULT_ARG     10                // i32 argument when none was set, fib(10)
+#define PROFILE_EVERY   10                // Default: sample every 10th fuel yield
+#define WASM_PAGE_SIZE  65536             // Bytes per Wasm page
+#define PARTITION_MAP_FMT "/tmp/sched-%d.partitions"  // Code ranges per partition, %d is the pid
+#define RELOAD_SAVE     "reload_save"     // Optional export of the old code, () -> i64 (ptr << 32 | len)
+#define RELOAD_RESTORE  "reload_restore"  // Optional export of the new code, (i32 len) -> i32 ptr
 
 
 /****************************************************************************
  * Structs
 ****************************************************************************/
 
+// Partition options, see wasm_api_load_partition_with_opts. 0 leaves a limit unset
+typedef struct wasm_api_load_opts {
+    int64_t memory_size;                // Bytes per linear memory
+    int64_t table_elements;             // Elements per table
+    int64_t instances;
+    int64_t tables;
+    int64_t memories;
+    const char *const *channels;        // Channels imported as channel.<name>, read during the load only
+    size_t nchannels;
+} wasm_api_load_opts_t;
+
+// Background compilation of wasm_api_reload_partition
+typedef struct partition_reload partition_reload_t;
+
+// Compiled module shared by partitions loading the same file
+typedef struct shared_module shared_module_t;
+
 typedef struct wasm_partition {
     wasmtime_module_t *module;
     wasmtime_instance_t instance;
     wasmtime_context_t *context;
     wasmtime_store_t *store;
+    uint64_t store_generation;          // New for every store a partition id gets, handles into the store check it
     wasmtime_linker_t *linker;
+    wasmtime_instance_pre_t *instance_pre;
     wasmtime_call_future_t *future;
     int partition_id;
     bool instantiated;
-    wasmtime_val_t *results;
+    wasmtime_val_t results[MAX_FUNC_VALUES];
+    size_t nresults;
     wasmtime_func_t exported_func;
+    wasmtime_val_t args[MAX_FUNC_VALUES];   // Set by wasm_api_set_args, used for the next call
+    size_t nargs;
+    wasmtime_val_t params[MAX_FUNC_VALUES]; // Must outlive the future
+    size_t nparams;
+    uint64_t yield_interval;            // Fuel per slice, YIELD_AFTER by default
+    bool fuel_yield;                    // Fuel was injected with yielding
+    wasm_trap_t *call_trap;             // Written by the future on completion
+    wasmtime_error_t *call_error;       // Written by the future on completion
+    char *wasm_file;
+    wasmtime_guestprofiler_t *profiler; // NULL when not profiling
+    char *profile_file;
+    uint32_t profile_every;             // Sample every Nth fuel yield
+    uint64_t profile_yields;
+    uint64_t profile_cpu_ns;            // CPU time since the last sample
+    bool profile_pending;               // Sample at the next epoch check
+    wasm_api_load_opts_t load_opts;     // Resource limits the store was created with
+    wasm_module_needs_t needs;          // Tables and memories the module defines, read when loaded with limits
+    wasm_memory_limit_t memory_limit;   // memory_size, the memory creator records a denied grow
+    wasm_host_call_t *pending_call;     // Async host call the guest is suspended in
+    bool blocked;                       // Waiting for pending_call, not runnable
+    partition_reload_t *reload;         // Pending code swap, NULL when none
+    shared_module_t *shared;            // Share of module, NULL when the partition owns it alone
+    wasm_engine_t *engine;              // Engine the module was compiled by, baseline or optimized
+    int tier;                           // Tier entry counting its slices, -1 when not tiered
+    uint64_t fuel_injected;             // Last wasm_api_inject_fuel amount, a restart refills to it
+    bool fuel_suspend;                  // Park as PARTITION_STARVED when the fuel runs out instead of trapping
+    bool starved;                       // Fuel budget spent with the call in flight, not runnable
+    bool call_dropped;                  // A failed reload dropped the call, the next run returns PARTITION_ERROR
 } wasm_partition_t;
 
+// Engine options, see wasm_api_init_with_opts
+typedef struct wasm_api_init_opts {
+    bool guest_profiling;               // Required for wasm_api_profile_partition
+    wasmtime_profiling_strategy_t jit_profiler;  // perf jitdump/perfmap or VTune, NONE by default
+    bool debug_info;                    // DWARF for JIT code, resolves Wasm source lines in perf
+    bool quiet;                         // No per-slice logging, errors are still printed
+    bool no_fuel;                       // Disable fuel metering, baseline for benchmarks only
+    size_t stack_pool_size;             // Preallocated async stacks, 0 lets Wasmtime mmap per call
+    size_t async_stack_size;            // Bytes per async stack, 0 for STACK_POOL_DEFAULT_SIZE
+    bool stack_hugepages;               // Back pooled stacks with transparent hugepages
+    wasm_memory_page_mode_t memory_pages;   // Page size of linear memories, non-default enables the memory creator
+    bool memory_numa_bind;              // Bind linear memories to the NUMA node of the instantiating thread
+    bool memory_limits;                 // memory_size enforced by the memory creator, a trap after a denied grow is PARTITION_LIMIT
+    wasm_memory_budget_t memory_budget; // Address space per linear memory, presets fill the three below
+    uint64_t memory_reservation;        // MEMORY_BUDGET_CUSTOM: bytes reserved per memory, 0 for the exact size
+    uint64_t memory_guard_size;         // MEMORY_BUDGET_CUSTOM: guard bytes after each memory
+    uint64_t memory_reservation_for_growth; // MEMORY_BUDGET_CUSTOM: headroom of memories that move when they grow
+    size_t host_workers;                // Completion queue workers for async host functions, 0 for HOST_WORKERS
+    bool host_io;                       // Define host.open/read/write/close on a per-thread io_uring
+    const char *host_io_root;           // Directory host.open resolves paths beneath, NULL refuses opens
+    const char *sched_cpus;             // CPU list the scheduler thread is pinned to by wasm_api_rt_enter, "2-3"
+    const char *housekeeping_cpus;      // CPU list for compilation and worker threads, includes the calling thread
+    int sched_fifo_priority;            // SCHED_FIFO priority set by wasm_api_rt_enter, 0 for SCHED_OTHER
+    bool lock_memory;                   // Prefault and mlock linear memories and pooled stacks, pools stacks
+    const char *record_file;            // Record slices and external host results to this log
+    const char *replay_file;            // Replay a recorded log, the same partitions must be loaded
+    bool tiered;                        // Load on quickly compiled code, recompile hot modules optimized
+    uint64_t tier_up_slices;            // Slices before a module is recompiled, 0 for TIER_UP_SLICES
+    const char *cache_dir;              // On-disk cache of compiled modules, NULL disables it
+    uint64_t cache_size_limit;          // Soft limit of the cache in bytes, 0 for Wasmtime's default
+    uint64_t cache_file_limit;          // Soft limit of cached modules, 0 for Wasmtime's default
+    uint32_t cache_cleanup_secs;        // Seconds between cleanups enforcing the limits, 0 for Wasmtime's default
+    uint32_t cache_cleanup_percent;     // Cleanups shrink the cache to this percent of the limits, 0 for Wasmtime's default
+} wasm_api_init_opts_t;
+
+// Runtime statistics, see wasm_api_get_stats
+typedef struct wasm_api_stats {
+    wasm_stack_pool_stats_t stack_pool;
+    wasm_memory_stats_t memory;
+    wasm_uring_stats_t uring;
+    wasm_port_stats_t ports;
+    wasm_channel_stats_t channels;
+    wasm_map_stats_t map;
+    wasm_replay_stats_t replay;
+    wasm_tier_stats_t tier;
+    wasm_cache_stats_t cache;
+    uint64_t reloads;                   // Code swaps by wasm_api_reload_partition
+    uint64_t reload_failures;           // Reloads that kept the old code
+    uint64_t modules_shared;            // Loads that reused the compiled module of another partition
+} wasm_api_stats_t;
+
 // Error codes
 typedef enum {
     WASM_API_NO_FUEL,
@@ -50,14 +172,12 @@ typedef enum {
     WASM_API_OK,  
     PARTITION_DONE,
     PARTITION_YIELDED,
-    PARTITION_ERROR
+    PARTITION_ERROR,
+    PARTITION_LIMIT,            // Trapped or failed to instantiate at a resource limit
+    PARTITION_BLOCKED,          // Suspended in an async host function, run others
+    PARTITION_STARVED           // Fuel budget spent, the call resumes after wasm_api_inject_fuel
 } wasm_api_result_t;
 
-typedef enum {
-    ERR,
-    TRAP
-} err_type_t;
-
 /****************************************************************************
  * Function Prototypes
 ****************************************************************************/
@@ -70,6 +190,15 @@ typedef enum {
 wasm_api_result_t wasm_api_init(void);
 
 
+/**
+ * @brief Initialize the Wasm engine with options
+ *
+ * @param opts Engine options, NULL for defaults
+ * @return WASM_API_OK, when successful, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_init_with_opts(const wasm_api_init_opts_t *opts);
+
+
 /**
  * @brief Load Wasm module from file and instantiate it
  *
@@ -81,7 +210,121 @@ wasm_api_result_t wasm_api_load_partition(int partition_id, const char* wasm_fil
 
 
 /**
- * @brief Inject fuel to the partition
+ * @brief Load Wasm module from file and instantiate it with resource limits.
+ *        Growing past a limit fails inside the guest, a call that traps
+ *        after its memory limit denied a grow reports PARTITION_LIMIT
+ *        instead of PARTITION_ERROR
+ *
+ * @param partition_id Partition identifier
+ * @param wasm_file Wasm module to be read
+ * @param opts Partition options, NULL for no limits
+ * @return WASM_API_OK, when successful, PARTITION_LIMIT when instantiation
+ *         exceeds a limit, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_load_partition_with_opts(int partition_id, const char* wasm_file, const wasm_api_load_opts_t *opts);
+
+
+/**
+ * @brief Unload a partition and free its resources, the id can be loaded again
+ *
+ * @param partition_id Partition identifier
+ * @return WASM_API_OK, when successful, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_unload_partition(int partition_id);
+
+
+/**
+ * @brief Replace a partition's code without stopping other partitions. The
+ *        module is compiled on a housekeeping thread, the swap happens on the
+ *        scheduler thread once the current call has finished. When the old
+ *        code exports RELOAD_SAVE and the new code RELOAD_RESTORE the swap
+ *        does not wait: the call in flight is dropped at the next slice
+ *        boundary and the saved bytes are handed to RELOAD_RESTORE. A hook
+ *        failing after that is the partition's fault. Fuel, yield interval
+ *        and arguments carry over, linear memory starts afresh
+ *
+ * @param partition_id Partition identifier
+ * @param wasm_file Wasm module with the same imports
+ * @return WASM_API_OK when the compilation started, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_reload_partition(int partition_id, const char *wasm_file);
+
+
+/**
+ * @brief Whether a reload of the partition has not been swapped in yet
+ *
+ * @param partition_id Partition identifier
+ */
+bool wasm_api_reload_pending(int partition_id);
+
+
+/**
+ * @brief Start a partition afresh on its compiled code, after a trap or to
+ *        drop a call in flight. The new store is instantiated from the
+ *        partition's instance_pre, nothing is compiled or linked. Fuel is
+ *        refilled to the last injected amount, the yield interval and the
+ *        arguments carry over, linear memory starts afresh. The last fault
+ *        is kept
+ *
+ * @param partition_id Partition identifier
+ * @return WASM_API_OK when successful, PARTITION_LIMIT when instantiation
+ *         exceeds a limit, else WASM_API_ERR and the old store stays
+ */
+wasm_api_result_t wasm_api_restart_partition(int partition_id);
+
+
+/**
+ * @brief Set the arguments for the next call of the partition's function.
+ *        Without arguments a single i32 DEFAULT_ARG is passed if expected
+ *
+ * @param partition_id Partition identifier
+ * @param args Arguments, copied
+ * @param nargs Number of arguments, at most MAX_FUNC_VALUES
+ * @return WASM_API_OK, when successful, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_set_args(int partition_id, const wasmtime_val_t *args, size_t nargs);
+
+
+/**
+ * @brief Set the fuel consumed per slice before the partition yields, applies
+ *        at the next wasm_api_inject_fuel
+ *
+ * @param partition_id Partition identifier
+ * @param interval Fuel per slice, 0 for YIELD_AFTER
+ * @return WASM_API_OK, when successful, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_set_yield_interval(int partition_id, uint64_t interval);
+
+
+/**
+ * @brief Turn fuel yields off for a synchronous call, which has no future to
+ *        suspend, and back on afterwards. Resuming applies the yield interval
+ *        to the fuel left, a suspending partition's next slice again ends at
+ *        its budget
+ *
+ * @param partition_id Partition identifier
+ * @param paused True before the synchronous call, false after it
+ * @return WASM_API_OK, when successful, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_pause_fuel_yield(int partition_id, bool paused);
+
+
+/**
+ * @brief Park the partition as PARTITION_STARVED when its fuel runs out
+ *        instead of trapping, applies at the next wasm_api_inject_fuel. The
+ *        store holds FUEL_SLACK more than the budget and the last slice is
+ *        shortened to what is left, so the guest yields at its budget
+ *
+ * @param partition_id Partition identifier
+ * @param suspend True to suspend, false traps once the fuel is gone
+ * @return WASM_API_OK, when successful, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_set_fuel_suspend(int partition_id, bool suspend);
+
+
+/**
+ * @brief Inject fuel to the partition. A starved partition gets a new
+ *        budget and becomes runnable with its call intact
  *
  * @param partition_id Partition identifier
  * @param fuel_amount Amount of fuel for the partition
@@ -100,6 +343,23 @@ wasm_api_result_t wasm_api_inject_fuel(int partition_id, uint64_t fuel_amount, b
 wasm_api_result_t wasm_api_run_partition(int partition_id, const char* func_name);
 
 
+/**
+ * @brief Start a call of a function the caller resolved and type checked
+ *        once, skips the export lookup and signature check of
+ *        wasm_api_run_partition. Run it with wasm_api_run_partition, whose
+ *        func_name is ignored while the call is in flight
+ *
+ * @param partition_id Partition identifier
+ * @param func Function of the partition's instance
+ * @param params Params matching the function type, copied
+ * @param nparams Number of params
+ * @param nresults Number of results of the function type
+ * @return WASM_API_OK, when successful, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_start_call(int partition_id, const wasmtime_func_t *func,
+                                      const wasmtime_val_t *params, size_t nparams, size_t nresults);
+
+
 /**
  * @brief Check if fuel remaining
  *
@@ -109,6 +369,182 @@ wasm_api_result_t wasm_api_run_partition(int partition_id, const char* func_name
 wasm_api_result_t wasm_api_fuel_remaining(int partition_id);
 
 
+/**
+ * @brief Enable the guest sampling profiler for a partition. A guest stack
+ *        sample is taken at every Nth fuel yield, so samples are weighted by
+ *        instruction count. The Firefox profiler JSON is written on cleanup
+ *
+ * @param partition_id Partition identifier
+ * @param sample_every Sample every Nth fuel yield, 0 for PROFILE_EVERY
+ * @param out_file Output file, open with https://profiler.firefox.com
+ * @return WASM_API_OK, when successful, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_profile_partition(int partition_id, uint32_t sample_every, const char *out_file);
+
+
+/**
+ * @brief Register an async host function for partitions loaded afterwards.
+ *        The calling guest is suspended while the work runs on a worker of
+ *        the completion queue, wasm_api_run_partition returns
+ *        PARTITION_BLOCKED meanwhile
+ *
+ * @param module Import module name
+ * @param name Import name
+ * @param params Parameter kinds, numeric only
+ * @param nparams Number of parameters
+ * @param results Result kinds, numeric only
+ * @param nresults Number of results
+ * @param work Host work, may block
+ * @param env Passed to work
+ * @return WASM_API_OK, when successful, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_define_async_func(const char *module, const char *name,
+                                             const wasm_valkind_t *params, size_t nparams,
+                                             const wasm_valkind_t *results, size_t nresults,
+                                             wasm_host_work_t work, void *env);
+
+
+/**
+ * @brief Create a queuing port from one partition to another, see
+ *        wasm_port.h for the guest imports. Ports must be created before
+ *        the partitions using them are loaded
+ *
+ * @param name Port name, guests look it up with port.id
+ * @param max_message Largest message in bytes
+ * @param depth Messages in flight
+ * @param source Sending partition
+ * @param destination Receiving partition, parked while the port is empty
+ * @param port_id Output, id of the port
+ * @return WASM_API_OK, when successful, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_create_queuing_port(const char *name, uint32_t max_message, uint32_t depth,
+                                               int source, int destination, int *port_id);
+
+
+/**
+ * @brief Create a sampling port holding the latest message of a partition
+ *
+ * @param name Port name, guests look it up with port.id
+ * @param max_message Largest message in bytes
+ * @param source Writing partition
+ * @param port_id Output, id of the port
+ * @return WASM_API_OK, when successful, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_create_sampling_port(const char *name, uint32_t max_message, int source, int *port_id);
+
+
+/**
+ * @brief Create a channel between partitions, a shared memory holding a ring
+ *        of fixed size slots, see wasm_channel.h for its layout and the guest
+ *        imports. Partitions import it through wasm_api_load_opts_t.channels
+ *
+ * @param name Channel name
+ * @param slot_size Bytes per slot including CHANNEL_PAYLOAD, multiple of 8
+ * @param slots Slot count
+ * @param channel_id Output, id of the channel
+ * @return WASM_API_OK, when successful, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_create_channel(const char *name, uint32_t slot_size, uint32_t slots, int *channel_id);
+
+
+/**
+ * @brief Call one export over n inputs in parallel, see wasm_map.h. Each
+ *        worker thread instantiates the module once and takes batches of
+ *        elements, fuel is enforced per element or per batch
+ *
+ * @param wasm_file Module, must not import host functions or channels
+ * @param func_name Export with numeric params and results
+ * @param inputs n * nparams values
+ * @param outputs n * nresults values
+ * @param n Number of elements
+ * @param opts Options, may be NULL
+ * @return WASM_API_OK when every element completed, PARTITION_ERROR when some
+ *         trapped or ran out of fuel, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_map(const char *wasm_file, const char *func_name, const wasmtime_val_t *inputs,
+                               wasmtime_val_t *outputs, size_t n, const wasm_map_opts_t *opts);
+
+
+/**
+ * @brief Collect completed host calls, their partitions become runnable.
+ *        Called by the scheduler between slices
+ *
+ * @return Number of partitions made runnable
+ */
+size_t wasm_api_poll_completions(void);
+
+
+/**
+ * @brief Last fault of a partition id: kind, site, trap code and faulting
+ *        function. Kept until the id is loaded again or faults again,
+ *        including the fault of a failed load
+ *
+ * @param partition_id Partition identifier
+ * @param info Output
+ * @return WASM_API_OK when the id has a fault, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_get_fault(int partition_id, wasm_fault_info_t *info);
+
+
+/**
+ * @brief Message of the last fault of a partition id, "<site>: <message>"
+ *
+ * @param partition_id Partition identifier
+ * @param buf Output, NUL terminated, truncated to size
+ * @param size Size of buf
+ * @return Length of the full message, 0 without a fault
+ */
+size_t wasm_api_fault_message(int partition_id, char *buf, size_t size);
+
+
+/**
+ * @brief Wasm backtrace of the last fault of a partition id, one frame per
+ *        line, innermost first. Function names need the module's name section
+ *
+ * @param partition_id Partition identifier
+ * @param buf Output, NUL terminated, truncated to size
+ * @param size Size of buf
+ * @return Length of the full backtrace, 0 without a fault or Wasm frames
+ */
+size_t wasm_api_fault_backtrace(int partition_id, char *buf, size_t size);
+
+
+/**
+ * @brief Whether a partition can make progress, false while it is blocked in
+ *        an async host function, starved or not loaded
+ *
+ * @param partition_id Partition identifier
+ */
+bool wasm_api_partition_runnable(int partition_id);
+
+
+/**
+ * @brief Whether a partition spent its fuel budget and waits for
+ *        wasm_api_inject_fuel, see wasm_api_set_fuel_suspend
+ *
+ * @param partition_id Partition identifier
+ */
+bool wasm_api_partition_starved(int partition_id);
+
+
+/**
+ * @brief Move the calling thread onto the scheduler CPUs and into SCHED_FIFO
+ *        as set in wasm_api_init_opts_t. Call on the scheduler thread after
+ *        loading, later compilations should stay on housekeeping threads
+ *
+ * @return WASM_API_OK, when successful, else WASM_API_ERR
+ */
+wasm_api_result_t wasm_api_rt_enter(void);
+
+
+/**
+ * @brief Snapshot of runtime statistics
+ *
+ * @param stats Output
+ */
+void wasm_api_get_stats(wasm_api_stats_t *stats);
+
+
 /**
  * @brief Cleanup resources
  *
@@ -0,0 +1,286 @@
+/*
+ * wasm_cache.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+// https://docs.wasmtime.dev/cli-cache.html
+
+// Wasmtime looks every compiled module up in the cache by a hash of its bytes
+// and the compiler settings, and writes a file on a miss. It keeps no counters
+// the C API could read, so misses are the entries the directory gained
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include "wasm_cache.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+typedef struct wasm_cache {
+    char dir[CACHE_PATH_MAX];       // Absolute, Wasmtime rejects relative directories
+    uint64_t size_limit;
+    uint64_t file_limit;
+    uint32_t cleanup_secs;
+    uint32_t cleanup_percent;
+    uint64_t entries_at_init;
+    _Atomic uint64_t compiles;
+} wasm_cache_t;
+
+
+/****************************************************************************
+ * Cache state
+****************************************************************************/
+static wasm_cache_t *g_cache = NULL;
+
+
+/****************************************************************************
+ * Static Function Prototypes
+****************************************************************************/
+static void cache_walk(int dir_fd, uint64_t *entries, uint64_t *bytes);
+static void cache_count(uint64_t *entries, uint64_t *bytes);
+static int cache_write_config(int fd);
+
+
+/****************************************************************************
+ * Static Function Implementations
+****************************************************************************/
+
+/**
+ * @brief Count module files below a directory. Usage statistics and files
+ *        still being written are not entries
+ */
+static void cache_walk(int dir_fd, uint64_t *entries, uint64_t *bytes) {
+    DIR *dir = fdopendir(dir_fd);
+    if(!dir) {
+        close(dir_fd);
+        return;
+    }
+
+    struct dirent *entry;
+    while((entry = readdir(dir)) != NULL) {
+        const char *name = entry->d_name;
+        size_t len = strlen(name);
+        struct stat st;
+
+        if(name[0] == '.' || strstr(name, ".wip") != NULL
+           || (len > 6 && strcmp(name + len - 6, ".stats") == 0)) {
+            continue;
+        }
+        if(fstatat(dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            continue;
+        }
+
+        if(S_ISDIR(st.st_mode)) {
+            int child = openat(dirfd(dir), name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if(child >= 0) {
+                cache_walk(child, entries, bytes);
+            }
+        } else if(S_ISREG(st.st_mode)) {
+            (*entries)++;
+            *bytes += (uint64_t) st.st_size;
+        }
+    }
+
+    closedir(dir);
+}
+
+
+static void cache_count(uint64_t *entries, uint64_t *bytes) {
+    char path[CACHE_PATH_MAX + sizeof(CACHE_MODULES_DIR) + 1];
+
+    *entries = 0;
+    *bytes = 0;
+
+    snprintf(path, sizeof(path), "%s/%s", g_cache->dir, CACHE_MODULES_DIR);
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(fd >= 0) {
+        cache_walk(fd, entries, bytes);
+    }
+}
+
+
+/**
+ * @brief Write the TOML configuration Wasmtime loads, unset limits are left
+ *        out so its defaults apply
+ */
+static int cache_write_config(int fd) {
+    FILE *file = fdopen(fd, "w");
+    if(!file) {
+        close(fd);
+        return -1;
+    }
+
+    // Literal string, the directory has no quote in it
+    fprintf(file, "[cache]\ndirectory = '%s'\n", g_cache->dir);
+    if(g_cache->size_limit > 0) {
+        fprintf(file, "files-total-size-soft-limit = \"%llu\"\n", (unsigned long long) g_cache->size_limit);
+    }
+    if(g_cache->file_limit > 0) {
+        fprintf(file, "file-count-soft-limit = \"%llu\"\n", (unsigned long long) g_cache->file_limit);
+    }
+    if(g_cache->cleanup_secs > 0) {
+        fprintf(file, "cleanup-interval = \"%us\"\n", g_cache->cleanup_secs);
+    }
+    if(g_cache->cleanup_percent > 0) {
+        fprintf(file, "files-total-size-limit-percent-if-deleting = \"%u%%\"\n", g_cache->cleanup_percent);
+        fprintf(file, "file-count-limit-percent-if-deleting = \"%u%%\"\n", g_cache->cleanup_percent);
+    }
+
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+
+/****************************************************************************
+ * Function Implementations
+****************************************************************************/
+
+/**
+ * @brief Enable the on-disk cache of compiled modules. The directory is
+ *        created when missing, limits of 0 keep Wasmtime's defaults
+ *
+ * @param dir Cache directory, shared by engines and processes
+ * @param size_limit Soft limit of the cache size in bytes
+ * @param file_limit Soft limit of the number of cached modules
+ * @param cleanup_secs Seconds between cleanups that enforce the limits
+ * @param cleanup_percent Cleanup deletes the oldest entries down to this percent of the limits
+ * @return 0 when successful, else -1
+ */
+int wasm_cache_init(const char *dir, uint64_t size_limit, uint64_t file_limit,
+                    uint32_t cleanup_secs, uint32_t cleanup_percent) {
+
+    if(g_cache != NULL || dir == NULL || cleanup_percent > 100) {
+        printf("Cannot initialise the compilation cache\n");
+        return -1;
+    }
+
+    if(mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        printf("Cannot create cache directory %s: %s\n", dir, strerror(errno));
+        return -1;
+    }
+
+    g_cache = calloc(1, sizeof(wasm_cache_t));
+    if(!g_cache) {
+        printf("Memory allocation failed!\n");
+        return -1;
+    }
+
+    char resolved[PATH_MAX];
+    if(realpath(dir, resolved) == NULL || strlen(resolved) >= sizeof(g_cache->dir)
+       || strpbrk(resolved, "'\n") != NULL) {
+        printf("Unusable cache directory %s\n", dir);
+        free(g_cache);
+        g_cache = NULL;
+        return -1;
+    }
+
+    strcpy(g_cache->dir, resolved);
+    g_cache->size_limit = size_limit;
+    g_cache->file_limit = file_limit;
+    g_cache->cleanup_secs = cleanup_secs;
+    g_cache->cleanup_percent = cleanup_percent;
+    atomic_init(&g_cache->compiles, 0);
+
+    uint64_t bytes;
+    cache_count(&g_cache->entries_at_init, &bytes);
+
+    return 0;
+}
+
+
+/**
+ * @brief Load the cache configuration into a config, modules its engine
+ *        compiles are looked up and stored in the cache
+ *
+ * @param config Config the cache is enabled on
+ * @return 0 when successful, -1 without a cache or when Wasmtime rejects it
+ */
+int wasm_cache_attach(wasm_config_t *config) {
+    char path[CACHE_PATH_MAX + 32];
+
+    if(g_cache == NULL) {
+        return -1;
+    }
+
+    // Wasmtime only loads the configuration from a file, it is parsed right away
+    snprintf(path, sizeof(path), "%s/.config.toml.XXXXXX", g_cache->dir);
+    int fd = mkstemp(path);
+    if(fd < 0 || cache_write_config(fd) != 0) {
+        printf("Cannot write cache configuration: %s\n", strerror(errno));
+        if(fd >= 0) {
+            unlink(path);
+        }
+        return -1;
+    }
+
+    wasmtime_error_t *error = wasmtime_config_cache_config_load(config, path);
+    unlink(path);
+
+    if(error != NULL) {
+        wasm_name_t message;
+        wasmtime_error_message(error, &message);
+        printf("Cache configuration rejected: %.*s\n", (int) message.size, message.data);
+        wasm_byte_vec_delete(&message);
+        wasmtime_error_delete(error);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Count a module compiled by an engine with the cache attached. Any
+ *        thread
+ */
+void wasm_cache_count_compile(void) {
+    if(g_cache != NULL) {
+        atomic_fetch_add_explicit(&g_cache->compiles, 1, memory_order_relaxed);
+    }
+}
+
+
+/**
+ * @brief Cache statistics, zeroed when the cache is off. Misses are the
+ *        entries the directory gained since init, which other processes
+ *        sharing it and cleanups skew
+ *
+ * @param stats Output
+ */
+void wasm_cache_stats(wasm_cache_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+
+    if(g_cache == NULL) {
+        return;
+    }
+
+    cache_count(&stats->entries, &stats->bytes);
+    stats->compiles = atomic_load_explicit(&g_cache->compiles, memory_order_relaxed);
+
+    uint64_t added = stats->entries > g_cache->entries_at_init ? stats->entries - g_cache->entries_at_init : 0;
+    stats->misses = added < stats->compiles ? added : stats->compiles;
+    stats->hits = stats->compiles - stats->misses;
+}
+
+
+/**
+ * @brief Disable the cache, entries stay on disk for the next start
+ */
+void wasm_cache_destroy(void) {
+    free(g_cache);
+    g_cache = NULL;
+}
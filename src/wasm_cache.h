@@ -0,0 +1,93 @@
+/*
+ * wasm_cache.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+#ifndef WASM_CACHE_H
+#define WASM_CACHE_H
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wasm.h>
+#include <wasmtime.h>
+
+
+/****************************************************************************
+ * Defines
+****************************************************************************/
+#define CACHE_PATH_MAX      4096
+#define CACHE_MODULES_DIR   "modules"       // Wasmtime keeps one file per compiled module below it
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+typedef struct wasm_cache_stats {
+    uint64_t compiles;              // Modules compiled while the cache was on
+    uint64_t hits;                  // Compiles served from the cache
+    uint64_t misses;                // Compiles that added an entry to the cache
+    uint64_t entries;               // Modules in the cache directory
+    uint64_t bytes;                 // Their size on disk
+} wasm_cache_stats_t;
+
+
+/****************************************************************************
+ * Function Prototypes
+****************************************************************************/
+
+/**
+ * @brief Enable the on-disk cache of compiled modules. The directory is
+ *        created when missing, limits of 0 keep Wasmtime's defaults
+ *
+ * @param dir Cache directory, shared by engines and processes
+ * @param size_limit Soft limit of the cache size in bytes
+ * @param file_limit Soft limit of the number of cached modules
+ * @param cleanup_secs Seconds between cleanups that enforce the limits
+ * @param cleanup_percent Cleanup deletes the oldest entries down to this percent of the limits
+ * @return 0 when successful, else -1
+ */
+int wasm_cache_init(const char *dir, uint64_t size_limit, uint64_t file_limit,
+                    uint32_t cleanup_secs, uint32_t cleanup_percent);
+
+
+/**
+ * @brief Load the cache configuration into a config, modules its engine
+ *        compiles are looked up and stored in the cache
+ *
+ * @param config Config the cache is enabled on
+ * @return 0 when successful, -1 without a cache or when Wasmtime rejects it
+ */
+int wasm_cache_attach(wasm_config_t *config);
+
+
+/**
+ * @brief Count a module compiled by an engine with the cache attached. Any
+ *        thread
+ */
+void wasm_cache_count_compile(void);
+
+
+/**
+ * @brief Cache statistics, zeroed when the cache is off. Misses are the
+ *        entries the directory gained since init, which other processes
+ *        sharing it and cleanups skew
+ *
+ * @param stats Output
+ */
+void wasm_cache_stats(wasm_cache_stats_t *stats);
+
+
+/**
+ * @brief Disable the cache, entries stay on disk for the next start
+ */
+void wasm_cache_destroy(void);
+
+
+#endif // WASM_CACHE_H
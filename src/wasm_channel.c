@@ -0,0 +1,392 @@
+/*
+ * wasm_channel.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+// https://docs.wasmtime.dev/api/wasmtime/struct.SharedMemory.html
+// Partitions move data through the shared memory with plain wasm atomics,
+// the host is only involved to park and wake a partition that cannot proceed
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include "wasm_channel.h"
+#include "wasm_api.h"
+#include "wasm_host.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+typedef enum {
+    CHANNEL_OP_ID,
+    CHANNEL_OP_WAIT,
+    CHANNEL_OP_NOTIFY
+} channel_op_t;
+
+typedef struct channel_waiter {
+    wasm_host_call_t *call;
+    int partition_id;
+} channel_waiter_t;
+
+typedef struct channel {
+    char name[CHANNEL_MAX_NAME];
+    wasmtime_sharedmemory_t *memory;
+    uint8_t *data;
+    _Atomic(channel_waiter_t *) waiters[CHANNEL_MAX_WAITERS];
+} channel_t;
+
+
+/****************************************************************************
+ * Channel state
+****************************************************************************/
+static channel_t *g_channels[CHANNEL_MAX_CHANNELS];
+static int g_channel_count = 0;
+static bool g_channel_registered = false;
+
+static _Atomic uint64_t g_channel_waits = 0;
+static _Atomic uint64_t g_channel_wakeups = 0;
+
+
+/****************************************************************************
+ * Static Function Prototypes
+****************************************************************************/
+static int channel_register(void);
+static uint32_t *channel_field(channel_t *channel, uint32_t offset);
+static void channel_complete(channel_waiter_t *waiter, int32_t result);
+static int channel_wait(channel_t *channel, int partition_id, uint32_t offset, uint32_t expected,
+                        wasm_host_call_t *call, int32_t *result);
+static int32_t channel_notify(channel_t *channel);
+static int channel_submit(void *env, wasmtime_caller_t *caller, const wasmtime_val_t *params, size_t nparams,
+                          wasm_host_call_t *call);
+
+
+/****************************************************************************
+ * Static Function Implementations
+****************************************************************************/
+
+/**
+ * @brief Define the channel host module on first use
+ */
+static int channel_register(void) {
+    const wasm_valkind_t i32x3[] = { WASM_I32, WASM_I32, WASM_I32 };
+    const wasm_valkind_t result[] = { WASM_I32 };
+
+    if(g_channel_registered) {
+        return 0;
+    }
+
+    if(wasm_host_define_submit("channel", "id", i32x3, 2, result, 1, channel_submit, (void *) (uintptr_t) CHANNEL_OP_ID) != 0
+       || wasm_host_define_submit("channel", "wait", i32x3, 3, result, 1, channel_submit, (void *) (uintptr_t) CHANNEL_OP_WAIT) != 0
+       || wasm_host_define_submit("channel", "notify", i32x3, 1, result, 1, channel_submit, (void *) (uintptr_t) CHANNEL_OP_NOTIFY) != 0) {
+        return -1;
+    }
+
+    g_channel_registered = true;
+    return 0;
+}
+
+
+static uint32_t *channel_field(channel_t *channel, uint32_t offset) {
+    return (uint32_t *) (channel->data + offset);
+}
+
+
+static void channel_complete(channel_waiter_t *waiter, int32_t result) {
+    wasm_host_call_results(waiter->call)[0].of.i32 = result;
+    wasm_host_complete(waiter->call);
+    free(waiter);
+}
+
+
+/**
+ * @brief Park the partition while the header field still holds expected.
+ *        Publishing the waiter, raising CHANNEL_WAITING and re-reading the
+ *        field pairs with the guest's store followed by its CHANNEL_WAITING
+ *        load, one of both sides sees the other
+ *
+ * @return 1 when completed inline with result, 0 when parked
+ */
+static int channel_wait(channel_t *channel, int partition_id, uint32_t offset, uint32_t expected,
+                        wasm_host_call_t *call, int32_t *result) {
+
+    *result = 1;
+    if(__atomic_load_n(channel_field(channel, offset), __ATOMIC_SEQ_CST) != expected) {
+        return 1;
+    }
+
+    channel_waiter_t *waiter = malloc(sizeof(channel_waiter_t));
+    if(!waiter) {
+        *result = -ENOMEM;
+        return 1;
+    }
+    waiter->call = call;
+    waiter->partition_id = partition_id;
+
+    size_t slot = 0;
+    for(; slot < CHANNEL_MAX_WAITERS; slot++) {
+        channel_waiter_t *empty = NULL;
+        if(atomic_compare_exchange_strong(&channel->waiters[slot], &empty, waiter)) {
+            break;
+        }
+    }
+    if(slot == CHANNEL_MAX_WAITERS) {
+        free(waiter);
+        *result = -EBUSY;
+        return 1;
+    }
+
+    __atomic_store_n(channel_field(channel, CHANNEL_WAITING), 1, __ATOMIC_SEQ_CST);
+    atomic_fetch_add_explicit(&g_channel_waits, 1, memory_order_relaxed);
+
+    if(__atomic_load_n(channel_field(channel, offset), __ATOMIC_SEQ_CST) != expected) {
+        channel_waiter_t *self = waiter;
+        if(atomic_compare_exchange_strong(&channel->waiters[slot], &self, NULL)) {
+            free(waiter);
+            return 1;
+        }
+        // A notify took the waiter and completes it
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Wake every partition parked on the channel
+ *
+ * @return Partitions woken
+ */
+static int32_t channel_notify(channel_t *channel) {
+    int32_t woken = 0;
+
+    __atomic_store_n(channel_field(channel, CHANNEL_WAITING), 0, __ATOMIC_SEQ_CST);
+
+    for(size_t slot = 0; slot < CHANNEL_MAX_WAITERS; slot++) {
+        channel_waiter_t *waiter = atomic_exchange(&channel->waiters[slot], NULL);
+        if(waiter != NULL) {
+            channel_complete(waiter, 0);
+            woken++;
+        }
+    }
+
+    atomic_fetch_add_explicit(&g_channel_wakeups, (uint64_t) woken, memory_order_relaxed);
+    return woken;
+}
+
+
+/**
+ * @brief Submit callback of all channel functions, env is the operation.
+ *        Completes inline unless the partition has to be parked
+ */
+static int channel_submit(void *env, wasmtime_caller_t *caller, const wasmtime_val_t *params, size_t nparams,
+                          wasm_host_call_t *call) {
+    channel_op_t op = (channel_op_t) (uintptr_t) env;
+    wasm_partition_t *partition = wasmtime_context_get_data(wasmtime_caller_context(caller));
+    wasmtime_val_t *result = &wasm_host_call_results(call)[0];
+    (void) nparams;
+
+    if(op == CHANNEL_OP_ID) {
+        uint32_t len = (uint32_t) params[1].of.i32;
+        uint8_t *name = wasm_host_guest_buffer(caller, (uint32_t) params[0].of.i32, len);
+        if(name == NULL) {
+            return -1;
+        }
+
+        result->of.i32 = -ENOENT;
+        for(int i = 0; i < g_channel_count; i++) {
+            if(strlen(g_channels[i]->name) == len && memcmp(g_channels[i]->name, name, len) == 0) {
+                result->of.i32 = i;
+                break;
+            }
+        }
+        return 1;
+    }
+
+    int32_t id = params[0].of.i32;
+    if(id < 0 || id >= g_channel_count) {
+        result->of.i32 = -EINVAL;
+        return 1;
+    }
+    channel_t *channel = g_channels[id];
+
+    if(op == CHANNEL_OP_NOTIFY) {
+        result->of.i32 = channel_notify(channel);
+        return 1;
+    }
+
+    // Only header fields can be waited on
+    uint32_t offset = (uint32_t) params[1].of.i32;
+    if(offset >= CHANNEL_DATA || (offset & 3) != 0) {
+        result->of.i32 = -EINVAL;
+        return 1;
+    }
+
+    return channel_wait(channel, partition->partition_id, offset, (uint32_t) params[2].of.i32, call,
+                        &result->of.i32);
+}
+
+
+/****************************************************************************
+ * Function Implementations
+****************************************************************************/
+
+/**
+ * @brief Create a channel backed by a shared memory. The first channel
+ *        registers the channel host module
+ *
+ * @param engine Engine of the partitions, threads must be enabled
+ * @param name Channel name
+ * @param slot_size Bytes per slot including CHANNEL_PAYLOAD, multiple of 8
+ * @param slots Slot count, rounded up to a power of two
+ * @return Channel id, else -1
+ */
+int wasm_channel_create(wasm_engine_t *engine, const char *name, uint32_t slot_size, uint32_t slots) {
+
+    if(g_channel_count >= CHANNEL_MAX_CHANNELS || strlen(name) >= CHANNEL_MAX_NAME
+       || slot_size <= CHANNEL_PAYLOAD || (slot_size & 7) != 0 || slots == 0 || slots > (1u << 20)) {
+        printf("Cannot create channel %s\n", name);
+        return -1;
+    }
+
+    for(int i = 0; i < g_channel_count; i++) {
+        if(strcmp(g_channels[i]->name, name) == 0) {
+            printf("Channel %s already exists\n", name);
+            return -1;
+        }
+    }
+
+    if(channel_register() != 0) {
+        return -1;
+    }
+
+    uint32_t count = 1;
+    while(count < slots) {
+        count <<= 1;
+    }
+
+    uint64_t bytes = CHANNEL_DATA + (uint64_t) count * slot_size;
+    uint64_t pages = (bytes + WASM_PAGE_SIZE - 1) / WASM_PAGE_SIZE;
+    if(pages > 65536) {
+        printf("Channel %s does not fit a 32-bit memory\n", name);
+        return -1;
+    }
+
+    channel_t *channel = calloc(1, sizeof(channel_t));
+    if(!channel) {
+        printf("Memory allocation failed!\n");
+        return -1;
+    }
+
+    // Fixed size, so the host's view of the data never moves
+    wasm_memorytype_t *type = wasmtime_memorytype_new(pages, true, pages, false, true);
+    wasmtime_error_t *error = wasmtime_sharedmemory_new(engine, type, &channel->memory);
+    wasm_memorytype_delete(type);
+    if(error != NULL) {
+        wasm_byte_vec_t message;
+        wasmtime_error_message(error, &message);
+        printf("Failed to create channel %s: %.*s\n", name, (int) message.size, message.data);
+        wasm_byte_vec_delete(&message);
+        wasmtime_error_delete(error);
+        free(channel);
+        return -1;
+    }
+
+    strcpy(channel->name, name);
+    channel->data = wasmtime_sharedmemory_data(channel->memory);
+    for(size_t slot = 0; slot < CHANNEL_MAX_WAITERS; slot++) {
+        atomic_init(&channel->waiters[slot], NULL);
+    }
+    *channel_field(channel, CHANNEL_SLOTS) = count;
+    *channel_field(channel, CHANNEL_SLOT_SIZE) = slot_size;
+
+    g_channels[g_channel_count] = channel;
+    return g_channel_count++;
+}
+
+
+/**
+ * @brief Define a channel's shared memory as import channel.<name>
+ *
+ * @return NULL when successful, else the error of the linker
+ */
+wasmtime_error_t *wasm_channel_link(wasmtime_linker_t *linker, wasmtime_context_t *context, const char *name) {
+
+    for(int i = 0; i < g_channel_count; i++) {
+        if(strcmp(g_channels[i]->name, name) == 0) {
+            wasmtime_extern_t item;
+            item.kind = WASMTIME_EXTERN_SHAREDMEMORY;
+            item.of.sharedmemory = g_channels[i]->memory;
+            return wasmtime_linker_define(linker, context, "channel", 7, name, strlen(name), &item);
+        }
+    }
+
+    return wasmtime_error_new("unknown channel");
+}
+
+
+/**
+ * @brief Host view of a channel's shared memory, NULL for unknown channels
+ */
+uint8_t *wasm_channel_data(int channel_id) {
+
+    if(channel_id < 0 || channel_id >= g_channel_count) {
+        return NULL;
+    }
+
+    return g_channels[channel_id]->data;
+}
+
+
+/**
+ * @brief Cancel parked calls of a partition before its store is deleted,
+ *        they complete with -ECANCELED
+ */
+void wasm_channel_detach(int partition_id) {
+
+    for(int i = 0; i < g_channel_count; i++) {
+        for(size_t slot = 0; slot < CHANNEL_MAX_WAITERS; slot++) {
+            channel_waiter_t *waiter = atomic_load(&g_channels[i]->waiters[slot]);
+            if(waiter != NULL && waiter->partition_id == partition_id
+               && atomic_compare_exchange_strong(&g_channels[i]->waiters[slot], &waiter, NULL)) {
+                channel_complete(waiter, -ECANCELED);
+            }
+        }
+    }
+}
+
+
+/**
+ * @brief Statistics of all channels
+ *
+ * @param stats Output
+ */
+void wasm_channel_stats(wasm_channel_stats_t *stats) {
+    stats->waits = atomic_load_explicit(&g_channel_waits, memory_order_relaxed);
+    stats->wakeups = atomic_load_explicit(&g_channel_wakeups, memory_order_relaxed);
+}
+
+
+/**
+ * @brief Delete all channels. Partitions must have been unloaded
+ */
+void wasm_channel_destroy(void) {
+
+    for(int i = 0; i < g_channel_count; i++) {
+        wasmtime_sharedmemory_delete(g_channels[i]->memory);
+        free(g_channels[i]);
+        g_channels[i] = NULL;
+    }
+    g_channel_count = 0;
+
+    // wasm_host_shutdown drops the definitions
+    g_channel_registered = false;
+}
@@ -0,0 +1,111 @@
+/*
+ * wasm_channel.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+#ifndef WASM_CHANNEL_H
+#define WASM_CHANNEL_H
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wasm.h>
+#include <wasmtime.h>
+
+
+/****************************************************************************
+ * Defines
+****************************************************************************/
+#define CHANNEL_MAX_CHANNELS    32
+#define CHANNEL_MAX_NAME        32
+#define CHANNEL_MAX_WAITERS     4           // Partitions parked on one channel at a time
+
+// Layout of a channel's shared memory, header fields are little-endian u32
+// accessed with atomics. Message i lives in slot i & (slots - 1) at
+// CHANNEL_DATA + slot * slot_size, a u32 length followed by the payload at
+// CHANNEL_PAYLOAD
+#define CHANNEL_HEAD            0           // Messages consumed, written by the receiver
+#define CHANNEL_TAIL            64          // Messages produced, written by the sender
+#define CHANNEL_WAITING         128         // Nonzero while a partition is parked, call channel.notify then
+#define CHANNEL_SLOTS           192         // Slot count, power of two
+#define CHANNEL_SLOT_SIZE       196         // Bytes per slot including the length
+#define CHANNEL_DATA            256
+#define CHANNEL_PAYLOAD         8           // Offset of the payload in a slot
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+typedef struct wasm_channel_stats {
+    uint64_t waits;                 // Partitions parked by channel.wait
+    uint64_t wakeups;               // Parked partitions woken by channel.notify
+} wasm_channel_stats_t;
+
+
+/****************************************************************************
+ * Function Prototypes
+****************************************************************************/
+
+/**
+ * @brief Create a channel backed by a shared memory. The first channel
+ *        registers the channel host module. Guests import the memory as
+ *        channel.<name> and:
+ *
+ *          channel.id(name_ptr: i32, name_len: i32) -> channel or -ENOENT
+ *          channel.wait(channel: i32, offset: i32, expected: i32) -> 0 woken, 1 value differs
+ *          channel.notify(channel: i32) -> partitions woken
+ *
+ *        wait parks the partition while the header field at offset still
+ *        holds expected. The guest must export its own memory as "memory"
+ *
+ * @param engine Engine of the partitions, threads must be enabled
+ * @param name Channel name
+ * @param slot_size Bytes per slot including CHANNEL_PAYLOAD, multiple of 8
+ * @param slots Slot count, rounded up to a power of two
+ * @return Channel id, else -1
+ */
+int wasm_channel_create(wasm_engine_t *engine, const char *name, uint32_t slot_size, uint32_t slots);
+
+
+/**
+ * @brief Define a channel's shared memory as import channel.<name>
+ *
+ * @return NULL when successful, else the error of the linker
+ */
+wasmtime_error_t *wasm_channel_link(wasmtime_linker_t *linker, wasmtime_context_t *context, const char *name);
+
+
+/**
+ * @brief Host view of a channel's shared memory, NULL for unknown channels
+ */
+uint8_t *wasm_channel_data(int channel_id);
+
+
+/**
+ * @brief Cancel parked calls of a partition before its store is deleted,
+ *        they complete with -ECANCELED
+ */
+void wasm_channel_detach(int partition_id);
+
+
+/**
+ * @brief Statistics of all channels
+ *
+ * @param stats Output
+ */
+void wasm_channel_stats(wasm_channel_stats_t *stats);
+
+
+/**
+ * @brief Delete all channels. Partitions must have been unloaded
+ */
+void wasm_channel_destroy(void);
+
+
+#endif // WASM_CHANNEL_H
@@ -0,0 +1,599 @@
+/*
+ * wasm_coro.hh
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+// C++20 front end over wasm_api: a partition call is an awaitable, a fuel
+// yield suspends the awaiting coroutine and hands control back to the
+// Executor, which resumes it once its partition ran to completion. Calls
+// compose with co_await through Task<T>. Frames come from a per-thread pool
+// and queue entries live inside the frames, so resumes never allocate
+
+#ifndef WASM_CORO_HH
+#define WASM_CORO_HH
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+extern "C" {
+#include "wasm_api.h"
+}
+#include <cerrno>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+
+/****************************************************************************
+ * Defines
+****************************************************************************/
+#define CORO_FRAME_ALIGN    64              // Frame sizes are rounded up to this
+#define CORO_FRAME_CLASSES  32              // Pooled up to 2 KiB, larger frames use operator new
+#define CORO_SLAB_FRAMES    64              // Frames carved from one slab
+
+
+namespace wasm_coro {
+
+/****************************************************************************
+ * Frame pool
+****************************************************************************/
+
+// Per-thread free lists of coroutine frames by size class. Slabs are kept
+// until the thread exits, a finished frame is reused by the next frame of
+// its class. Frames must be freed on the thread that allocated them
+class FramePool {
+public:
+
+    /**
+     * @brief Frame of at least size bytes, throws std::bad_alloc
+     */
+    static void *allocate(std::size_t size) {
+        std::size_t cls = (size + CORO_FRAME_ALIGN - 1) / CORO_FRAME_ALIGN - 1;
+        if(cls >= CORO_FRAME_CLASSES) {
+            return ::operator new(size);
+        }
+
+        FramePool &pool = local();
+        if(pool.free_[cls] == nullptr && !pool.grow(cls)) {
+            throw std::bad_alloc();
+        }
+
+        Free *frame = pool.free_[cls];
+        pool.free_[cls] = frame->next;
+        return frame;
+    }
+
+    static void deallocate(void *frame, std::size_t size) noexcept {
+        std::size_t cls = (size + CORO_FRAME_ALIGN - 1) / CORO_FRAME_ALIGN - 1;
+        if(cls >= CORO_FRAME_CLASSES) {
+            ::operator delete(frame);
+            return;
+        }
+
+        FramePool &pool = local();
+        pool.free_[cls] = new (frame) Free{ pool.free_[cls] };
+    }
+
+    /**
+     * @brief Slabs allocated by this thread, stays flat once frames are reused
+     */
+    static std::size_t slabs() {
+        return local().nslabs_;
+    }
+
+private:
+    struct Free {
+        Free *next;
+    };
+
+    struct alignas(CORO_FRAME_ALIGN) Slab {
+        Slab *next;
+    };
+
+    Free *free_[CORO_FRAME_CLASSES] = {};
+    Slab *slabs_ = nullptr;
+    std::size_t nslabs_ = 0;
+
+    FramePool() = default;
+
+    ~FramePool() {
+        while(slabs_ != nullptr) {
+            Slab *next = slabs_->next;
+            std::free(slabs_);
+            slabs_ = next;
+        }
+    }
+
+    static FramePool &local() {
+        static thread_local FramePool pool;
+        return pool;
+    }
+
+    bool grow(std::size_t cls) {
+        std::size_t frame_size = (cls + 1) * CORO_FRAME_ALIGN;
+        void *memory = std::aligned_alloc(CORO_FRAME_ALIGN, sizeof(Slab) + frame_size * CORO_SLAB_FRAMES);
+        if(memory == nullptr) {
+            printf("Memory allocation failed!\n");
+            return false;
+        }
+
+        Slab *slab = new (memory) Slab{ slabs_ };
+        slabs_ = slab;
+        nslabs_++;
+
+        char *frames = reinterpret_cast<char *>(slab + 1);
+        for(std::size_t i = CORO_SLAB_FRAMES; i-- > 0;) {
+            free_[cls] = new (frames + i * frame_size) Free{ free_[cls] };
+        }
+
+        return true;
+    }
+};
+
+
+/****************************************************************************
+ * Work
+****************************************************************************/
+
+// Entry on the executor's ready or parked list. Embedded in a coroutine
+// frame or an awaiter living in one, queueing never allocates
+struct Work {
+    void (*run)(Work *work) = nullptr;
+    Work *next = nullptr;
+    int partition_id = -1;              // Partition a parked entry waits for
+};
+
+
+template<typename T = void> class Task;
+class Executor;
+
+
+/****************************************************************************
+ * Promises
+****************************************************************************/
+namespace detail {
+
+// Frames from the FramePool, lazily started, the continuation resumes by
+// symmetric transfer when the body finished
+struct PromiseBase {
+    std::coroutine_handle<> continuation;
+
+    static void *operator new(std::size_t size) {
+        return FramePool::allocate(size);
+    }
+
+    static void operator delete(void *frame, std::size_t size) noexcept {
+        FramePool::deallocate(frame, size);
+    }
+
+    struct FinalAwaiter {
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        template<typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> self) noexcept {
+            std::coroutine_handle<> continuation = self.promise().continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() const noexcept {
+        return {};
+    }
+
+    FinalAwaiter final_suspend() const noexcept {
+        return {};
+    }
+
+    // Partitions report failures as results, exceptions are bugs
+    void unhandled_exception() const noexcept {
+        std::terminate();
+    }
+};
+
+template<typename T>
+struct Promise : PromiseBase {
+    T value{};
+
+    Task<T> get_return_object();
+
+    void return_value(T result) {
+        value = std::move(result);
+    }
+};
+
+template<>
+struct Promise<void> : PromiseBase {
+    Task<void> get_return_object();
+
+    void return_void() const noexcept {}
+};
+
+} // namespace detail
+
+
+/****************************************************************************
+ * Task
+****************************************************************************/
+
+// Coroutine returning T, runs when awaited and resumes the awaiting
+// coroutine when finished. Spawn a Task<void> on an Executor to start a root
+template<typename T>
+class [[nodiscard]] Task {
+public:
+    using promise_type = detail::Promise<T>;
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    explicit Task(handle_type handle) noexcept : handle_(handle) {}
+
+    Task(Task &&other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+    Task &operator=(Task &&) = delete;
+
+    ~Task() {
+        if(handle_) {
+            handle_.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+        handle_.promise().continuation = caller;
+        return handle_;
+    }
+
+    T await_resume() {
+        if constexpr(!std::is_void_v<T>) {
+            return std::move(handle_.promise().value);
+        }
+    }
+
+private:
+    handle_type handle_;
+};
+
+
+namespace detail {
+
+template<typename T>
+inline Task<T> Promise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+// Spawned task, frees its frame when done. The promise is its own queue entry
+struct Root {
+    struct promise_type : PromiseBase, Work {
+        Root get_return_object() noexcept {
+            return Root{ std::coroutine_handle<promise_type>::from_promise(*this) };
+        }
+
+        std::suspend_never final_suspend() const noexcept {
+            return {};
+        }
+
+        void return_void() const noexcept {}
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+} // namespace detail
+
+
+/****************************************************************************
+ * Partition call
+****************************************************************************/
+
+/**
+ * @brief Awaitable running a partition's function slice by slice on an
+ *        Executor. Resumes the awaiting coroutine with PARTITION_DONE,
+ *        PARTITION_ERROR, PARTITION_LIMIT or WASM_API_ERR, results are in
+ *        get_wasm_partition(partition_id)->results
+ */
+class [[nodiscard]] PartitionCall : private Work {
+public:
+    PartitionCall(Executor &executor, int partition_id, const char *func_name) noexcept
+        : executor_(executor), func_name_(func_name) {
+        run = &PartitionCall::slice;
+        this->partition_id = partition_id;
+    }
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    inline void await_suspend(std::coroutine_handle<> caller) noexcept;
+
+    wasm_api_result_t await_resume() const noexcept {
+        return status_;
+    }
+
+private:
+    friend class Executor;
+
+    Executor &executor_;
+    const char *func_name_;
+    std::coroutine_handle<> caller_;
+    wasm_api_result_t status_ = WASM_API_ERR;
+
+    static inline void slice(Work *work);
+};
+
+
+/****************************************************************************
+ * Executor
+****************************************************************************/
+
+// Single-threaded run loop over spawned tasks. The eventfd is readable when
+// a host or io_uring completion arrived, embed it in an event loop or call
+// run. Takes the host completion hook, do not combine with wasm_sched
+class Executor {
+public:
+    Executor() {
+        fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if(fd_ < 0) {
+            printf("Failed to create the executor eventfd: %s\n", strerror(errno));
+            return;
+        }
+
+        wasm_host_set_notify(&Executor::signal, this);
+        wasm_uring_set_eventfd(fd_);
+    }
+
+    ~Executor() {
+        if(fd_ >= 0) {
+            wasm_host_set_notify(NULL, NULL);
+            wasm_uring_set_eventfd(-1);
+            close(fd_);
+        }
+    }
+
+    Executor(const Executor &) = delete;
+    Executor &operator=(const Executor &) = delete;
+
+    /**
+     * @brief Start a task on the next pass, its frame is freed when it returns
+     */
+    void spawn(Task<void> task) {
+        detail::Root root = start(*this, std::move(task));
+        root.handle.promise().run = &Executor::resume_root;
+        tasks_++;
+        schedule(&root.handle.promise());
+    }
+
+    /**
+     * @brief Awaitable call of a loaded partition's exported function
+     */
+    PartitionCall call(int partition_id, const char *func_name) noexcept {
+        return PartitionCall(*this, partition_id, func_name);
+    }
+
+    /**
+     * @brief One pass: poll completions, wake partitions they unblocked and
+     *        run everything that was ready. Never blocks
+     *
+     * @return Entries run, 0 when every task is parked or none is left
+     */
+    std::size_t run_once() {
+        uint64_t count;
+        std::size_t ran = 0;
+
+        if(fd_ >= 0 && read(fd_, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+            printf("Failed to read the executor eventfd: %s\n", strerror(errno));
+        }
+
+        wasm_api_poll_completions();
+        wake();
+
+        // Entries queued while running wait for the next pass
+        Work *last = ready_tail_;
+        while(last != nullptr) {
+            Work *work = ready_head_;
+            ready_head_ = work->next;
+            if(ready_head_ == nullptr) {
+                ready_tail_ = nullptr;
+            }
+            work->next = nullptr;
+
+            // The entry may be freed by the time run returns
+            bool done = work == last;
+            work->run(work);
+            ran++;
+
+            if(done) {
+                break;
+            }
+        }
+
+        resumes_ += ran;
+        return ran;
+    }
+
+    /**
+     * @brief Run until every spawned task returned, waits on the eventfd
+     *        while all of them are parked. Returns early when only starved
+     *        calls are left, nothing but wasm_api_inject_fuel wakes them
+     */
+    void run() {
+        while(tasks_ > 0) {
+            if(run_once() > 0 || ready_head_ != nullptr) {
+                continue;
+            }
+
+            if(parked_ == nullptr) {
+                printf("Executor stalled with %zu tasks and nothing parked\n", tasks_);
+                return;
+            }
+
+            if(!blocked()) {
+                printf("Executor stalled with %zu tasks starved of fuel\n", tasks_);
+                return;
+            }
+
+            struct pollfd pfd = { fd_, POLLIN, 0 };
+            if(fd_ >= 0 && poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+                printf("Failed to wait for the executor: %s\n", strerror(errno));
+                return;
+            }
+        }
+    }
+
+    /**
+     * @brief Readiness source for an event loop, run_once consumes it
+     */
+    int fd() const noexcept {
+        return fd_;
+    }
+
+    /**
+     * @brief Spawned tasks that did not return yet
+     */
+    std::size_t tasks() const noexcept {
+        return tasks_;
+    }
+
+    /**
+     * @brief Queue entries run so far, slices and task resumes
+     */
+    uint64_t resumes() const noexcept {
+        return resumes_;
+    }
+
+private:
+    friend class PartitionCall;
+
+    int fd_ = -1;
+    Work *ready_head_ = nullptr;
+    Work *ready_tail_ = nullptr;
+    Work *parked_ = nullptr;            // Partitions blocked in async host calls or starved of fuel
+    std::size_t tasks_ = 0;
+    uint64_t resumes_ = 0;
+
+    void schedule(Work *work) noexcept {
+        work->next = nullptr;
+        if(ready_tail_ != nullptr) {
+            ready_tail_->next = work;
+        } else {
+            ready_head_ = work;
+        }
+        ready_tail_ = work;
+    }
+
+    void park(Work *work) noexcept {
+        work->next = parked_;
+        parked_ = work;
+    }
+
+    /**
+     * @brief Whether a parked entry waits for a host call, which signals the
+     *        eventfd when it completes
+     */
+    bool blocked() const noexcept {
+        for(const Work *work = parked_; work != nullptr; work = work->next) {
+            if(!wasm_api_partition_starved(work->partition_id)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Move parked entries whose partition is runnable again to the
+     *        ready list
+     */
+    void wake() noexcept {
+        Work **link = &parked_;
+
+        while(*link != nullptr) {
+            Work *work = *link;
+            if(wasm_api_partition_runnable(work->partition_id)) {
+                *link = work->next;
+                schedule(work);
+            } else {
+                link = &work->next;
+            }
+        }
+    }
+
+    static detail::Root start(Executor &executor, Task<void> task) {
+        co_await task;
+        executor.tasks_--;
+    }
+
+    static void resume_root(Work *work) {
+        auto *promise = static_cast<detail::Root::promise_type *>(work);
+        std::coroutine_handle<detail::Root::promise_type>::from_promise(*promise).resume();
+    }
+
+    /**
+     * @brief Host completion hook, may run on a worker thread
+     */
+    static void signal(void *env) {
+        auto *executor = static_cast<Executor *>(env);
+        uint64_t one = 1;
+
+        if(write(executor->fd_, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            printf("Failed to signal the executor: %s\n", strerror(errno));
+        }
+    }
+};
+
+
+/****************************************************************************
+ * Partition call implementation
+****************************************************************************/
+
+inline void PartitionCall::await_suspend(std::coroutine_handle<> caller) noexcept {
+    caller_ = caller;
+    executor_.schedule(this);
+}
+
+
+/**
+ * @brief Run one slice. A fuel yield requeues the call behind the other
+ *        ready entries, a blocked partition is parked until its completion
+ *        and a starved one until it has fuel again
+ */
+inline void PartitionCall::slice(Work *work) {
+    auto *call = static_cast<PartitionCall *>(work);
+    wasm_api_result_t status = wasm_api_run_partition(call->partition_id, call->func_name_);
+
+    if(status == PARTITION_YIELDED) {
+        call->executor_.schedule(call);
+    } else if(status == PARTITION_BLOCKED || status == PARTITION_STARVED) {
+        call->executor_.park(call);
+    } else {
+        // Lives in the caller's frame, which may be gone after the resume
+        call->status_ = status;
+        call->caller_.resume();
+    }
+}
+
+} // namespace wasm_coro
+
+
+#endif // WASM_CORO_HH
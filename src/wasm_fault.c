@@ -0,0 +1,228 @@
+/*
+ * wasm_fault.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+// Traps are recorded on the slice path, which a partition that keeps
+// trapping hits on every call. Recording only reads the trap code, the
+// message, frames and function index come from Wasmtime when asked for
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include "wasm_fault.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+
+/****************************************************************************
+ * Static Function Prototypes
+****************************************************************************/
+static size_t fault_append(char *buf, size_t size, size_t len, const char *fmt, ...);
+static void fault_frames(const wasm_fault_t *fault, wasm_frame_vec_t *frames);
+
+
+/****************************************************************************
+ * Static Function Implementations
+****************************************************************************/
+
+/**
+ * @brief snprintf at offset len of buf, the return value counts what did not fit
+ */
+static size_t fault_append(char *buf, size_t size, size_t len, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(len < size ? buf + len : NULL, len < size ? size - len : 0, fmt, args);
+    va_end(args);
+
+    return n > 0 ? len + (size_t) n : len;
+}
+
+
+static void fault_frames(const wasm_fault_t *fault, wasm_frame_vec_t *frames) {
+    if(fault->trap != NULL) {
+        wasm_trap_trace(fault->trap, frames);
+    } else if(fault->error != NULL) {
+        wasmtime_error_wasm_trace(fault->error, frames);
+    } else {
+        wasm_frame_vec_new_empty(frames);
+    }
+}
+
+
+/****************************************************************************
+ * Function Implementations
+****************************************************************************/
+
+/**
+ * @brief Record a fault, replacing the previous one. Takes ownership of the
+ *        error or trap and neither allocates nor formats
+ *
+ * @param fault Fault record of the partition
+ * @param partition_id Partition identifier
+ * @param site Where the fault was raised
+ * @param error Error or NULL
+ * @param trap Trap or NULL
+ */
+void wasm_fault_record(wasm_fault_t *fault, int partition_id, wasm_fault_site_t site,
+                       wasmtime_error_t *error, wasm_trap_t *trap) {
+    wasm_fault_clear(fault);
+
+    fault->info.kind = trap != NULL ? FAULT_TRAP : FAULT_ERROR;
+    fault->info.site = site;
+    fault->info.partition_id = partition_id;
+    fault->info.has_code = trap != NULL && wasmtime_trap_code(trap, &fault->info.code);
+    fault->info.limit = false;
+    fault->info.func_index = FAULT_FUNC_UNKNOWN;
+    fault->info.count++;
+    fault->func_resolved = false;
+    fault->trap = trap;
+    fault->error = error;
+}
+
+
+/**
+ * @brief Resolve the faulting function index. Walks the trap's frames, so
+ *        it is left to the callers asking for it
+ *
+ * @param fault Fault record
+ */
+void wasm_fault_resolve(wasm_fault_t *fault) {
+    if(fault->func_resolved || fault->info.kind == FAULT_NONE) {
+        return;
+    }
+
+    if(fault->trap != NULL) {
+        wasm_frame_t *origin = wasm_trap_origin(fault->trap);
+        if(origin != NULL) {
+            fault->info.func_index = wasm_frame_func_index(origin);
+            wasm_frame_delete(origin);
+        }
+    } else if(fault->error != NULL) {
+        wasm_frame_vec_t frames;
+        wasmtime_error_wasm_trace(fault->error, &frames);
+        if(frames.size > 0) {
+            fault->info.func_index = wasm_frame_func_index(frames.data[0]);
+        }
+        wasm_frame_vec_delete(&frames);
+    }
+
+    fault->func_resolved = true;
+}
+
+
+/**
+ * @brief Write "<site>: <message>" of the fault, truncated to the buffer
+ *
+ * @param fault Fault record
+ * @param buf Output, NUL terminated when size > 0
+ * @param size Size of buf
+ * @return Length of the full text like snprintf, 0 without a fault
+ */
+size_t wasm_fault_message(const wasm_fault_t *fault, char *buf, size_t size) {
+    if(size > 0) {
+        buf[0] = '\0';
+    }
+    if(fault->trap == NULL && fault->error == NULL) {
+        return 0;
+    }
+
+    wasm_byte_vec_t msg;
+    if(fault->trap != NULL) {
+        wasm_trap_message(fault->trap, &msg);
+    } else {
+        wasmtime_error_message(fault->error, &msg);
+    }
+
+    // Trap messages count their NUL terminator
+    int msg_len = (int) msg.size;
+    while(msg_len > 0 && msg.data[msg_len - 1] == '\0') {
+        msg_len--;
+    }
+
+    size_t len = fault_append(buf, size, 0, "%s%s: %.*s", wasm_fault_site_name(fault->info.site),
+                              fault->info.limit ? " at resource limit" : "", msg_len, msg.data);
+    wasm_byte_vec_delete(&msg);
+
+    return len;
+}
+
+
+/**
+ * @brief Write the Wasm backtrace of the fault, one frame per line,
+ *        innermost first, truncated to the buffer
+ *
+ * @param fault Fault record
+ * @param buf Output, NUL terminated when size > 0
+ * @param size Size of buf
+ * @return Length of the full text like snprintf, 0 without frames
+ */
+size_t wasm_fault_backtrace(const wasm_fault_t *fault, char *buf, size_t size) {
+    wasm_frame_vec_t frames;
+    size_t len = 0;
+
+    if(size > 0) {
+        buf[0] = '\0';
+    }
+
+    fault_frames(fault, &frames);
+    for(size_t i = 0; i < frames.size; i++) {
+        const wasm_frame_t *frame = frames.data[i];
+        const wasm_name_t *module = wasmtime_frame_module_name(frame);
+        const wasm_name_t *func = wasmtime_frame_func_name(frame);
+
+        len = fault_append(buf, size, len, "#%zu %.*s!", i,
+                           module ? (int) module->size : 1, module ? module->data : "?");
+        if(func != NULL) {
+            len = fault_append(buf, size, len, "%.*s", (int) func->size, func->data);
+        } else {
+            len = fault_append(buf, size, len, "func[%u]", wasm_frame_func_index(frame));
+        }
+        len = fault_append(buf, size, len, " @ 0x%zx\n", wasm_frame_module_offset(frame));
+    }
+    wasm_frame_vec_delete(&frames);
+
+    return len;
+}
+
+
+/**
+ * @brief Name of a fault site, "unknown" when out of range
+ */
+const char *wasm_fault_site_name(wasm_fault_site_t site) {
+    static const char *names[FAULT_SITE_COUNT] = {
+        [FAULT_SITE_COMPILE]        = "Failed to compile wasm module",
+        [FAULT_SITE_LINK]           = "Failed to link host functions or channels",
+        [FAULT_SITE_INSTANTIATE]    = "Error during async instantiation",
+        [FAULT_SITE_CALL]           = "Error calling function",
+        [FAULT_SITE_RUN]            = "Fault while running function",
+        [FAULT_SITE_RELOAD]         = "Reload failed",
+        [FAULT_SITE_FUEL]           = "Error setting fuel",
+        [FAULT_SITE_PROFILE]        = "Error finishing guest profile",
+    };
+
+    return ((unsigned) site < FAULT_SITE_COUNT) ? names[site] : "unknown";
+}
+
+
+/**
+ * @brief Delete the kept error or trap, the fault count is kept
+ *
+ * @param fault Fault record
+ */
+void wasm_fault_clear(wasm_fault_t *fault) {
+    if(fault->trap != NULL) {
+        wasm_trap_delete(fault->trap);
+    }
+    if(fault->error != NULL) {
+        wasmtime_error_delete(fault->error);
+    }
+
+    fault->trap = NULL;
+    fault->error = NULL;
+    fault->func_resolved = false;
+    fault->info.kind = FAULT_NONE;
+}
@@ -0,0 +1,137 @@
+/*
+ * wasm_fault.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+#ifndef WASM_FAULT_H
+#define WASM_FAULT_H
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wasm.h>
+#include <wasmtime.h>
+
+
+/****************************************************************************
+ * Defines
+****************************************************************************/
+#define FAULT_FUNC_UNKNOWN  UINT32_MAX      // No Wasm frame, e.g. a compile error or a trap in the host
+#define FAULT_MESSAGE_MAX   512             // Buffer of the faults printed on load and reload
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+typedef enum {
+    FAULT_NONE = 0,
+    FAULT_TRAP,                     // The guest trapped, code is set for instruction traps
+    FAULT_ERROR                     // Wasmtime or a host function failed
+} wasm_fault_kind_t;
+
+// Where the fault was raised
+typedef enum {
+    FAULT_SITE_COMPILE = 0,
+    FAULT_SITE_LINK,                // Defining host functions or importing channels
+    FAULT_SITE_INSTANTIATE,
+    FAULT_SITE_CALL,                // Starting a call
+    FAULT_SITE_RUN,                 // Running a slice of a call
+    FAULT_SITE_RELOAD,              // Compiling new code or running its hooks
+    FAULT_SITE_FUEL,
+    FAULT_SITE_PROFILE,
+    FAULT_SITE_COUNT
+} wasm_fault_site_t;
+
+// Plain description of a fault, see wasm_api_get_fault
+typedef struct wasm_fault_info {
+    wasm_fault_kind_t kind;
+    wasm_fault_site_t site;
+    int partition_id;
+    bool has_code;                  // False for errors and traps raised by the host
+    wasmtime_trap_code_t code;
+    bool limit;                     // Instantiation exceeded a limit, or the call trapped after a denied memory grow
+    uint32_t func_index;            // Innermost Wasm function, FAULT_FUNC_UNKNOWN when none
+    uint64_t count;                 // Faults recorded for the partition id since init
+} wasm_fault_info_t;
+
+// Last fault of a partition. Keeps the trap or error, the text is only
+// produced when asked for
+typedef struct wasm_fault {
+    wasm_fault_info_t info;
+    bool func_resolved;
+    wasm_trap_t *trap;
+    wasmtime_error_t *error;
+} wasm_fault_t;
+
+
+/****************************************************************************
+ * Function Prototypes
+****************************************************************************/
+
+/**
+ * @brief Record a fault, replacing the previous one. Takes ownership of the
+ *        error or trap and neither allocates nor formats
+ *
+ * @param fault Fault record of the partition
+ * @param partition_id Partition identifier
+ * @param site Where the fault was raised
+ * @param error Error or NULL
+ * @param trap Trap or NULL
+ */
+void wasm_fault_record(wasm_fault_t *fault, int partition_id, wasm_fault_site_t site,
+                       wasmtime_error_t *error, wasm_trap_t *trap);
+
+
+/**
+ * @brief Resolve the faulting function index. Walks the trap's frames, so
+ *        it is left to the callers asking for it
+ *
+ * @param fault Fault record
+ */
+void wasm_fault_resolve(wasm_fault_t *fault);
+
+
+/**
+ * @brief Write "<site>: <message>" of the fault, truncated to the buffer
+ *
+ * @param fault Fault record
+ * @param buf Output, NUL terminated when size > 0
+ * @param size Size of buf
+ * @return Length of the full text like snprintf, 0 without a fault
+ */
+size_t wasm_fault_message(const wasm_fault_t *fault, char *buf, size_t size);
+
+
+/**
+ * @brief Write the Wasm backtrace of the fault, one frame per line,
+ *        innermost first, truncated to the buffer
+ *
+ * @param fault Fault record
+ * @param buf Output, NUL terminated when size > 0
+ * @param size Size of buf
+ * @return Length of the full text like snprintf, 0 without frames
+ */
+size_t wasm_fault_backtrace(const wasm_fault_t *fault, char *buf, size_t size);
+
+
+/**
+ * @brief Name of a fault site, "unknown" when out of range
+ */
+const char *wasm_fault_site_name(wasm_fault_site_t site);
+
+
+/**
+ * @brief Delete the kept error or trap, the fault count is kept
+ *
+ * @param fault Fault record
+ */
+void wasm_fault_clear(wasm_fault_t *fault);
+
+
+#endif // WASM_FAULT_H
@@ -0,0 +1,631 @@
+/*
+ * wasm_host.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+// https://docs.wasmtime.dev/api/wasmtime/struct.Linker.html#method.func_new_async
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include "wasm_host.h"
+#include "wasm_api.h"
+#include "wasm_replay.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+typedef struct host_func {
+    char *module;
+    char *name;
+    wasm_valkind_t params[HOST_MAX_VALUES];
+    size_t nparams;
+    wasm_valkind_t results[HOST_MAX_VALUES];
+    size_t nresults;
+    wasm_host_work_t work;              // Run on a worker, or
+    wasm_host_submit_t submit;          // started here and completed by its source
+    void *env;
+    bool external;                      // Results come from outside the process, recorded for replay
+} host_func_t;
+
+// Referenced by the continuation and by the queues, freed by the last one
+struct wasm_host_call {
+    const host_func_t *func;
+    wasm_partition_t *partition;    // Only touched on the scheduler thread
+    int partition_id;
+    wasmtime_val_t params[HOST_MAX_VALUES];
+    wasmtime_val_t results[HOST_MAX_VALUES];   // Written by the worker
+    wasmtime_val_t *guest_results;              // Wasmtime's, alive until the continuation completes
+    uint8_t *memory_base;                       // Recording or replaying: caller's linear memory
+    size_t memory_size;
+    uint32_t output_ptr;                        // Guest memory written by the call, see wasm_host_call_set_output
+    uint32_t output_len;
+    bool replayed;                              // Results are taken from the replay log
+    _Atomic bool done;
+    _Atomic int refs;
+    struct wasm_host_call *next;
+};
+
+typedef struct host_queue {
+    wasm_host_call_t *head;
+    wasm_host_call_t *tail;
+} host_queue_t;
+
+
+/****************************************************************************
+ * Host state
+****************************************************************************/
+static host_func_t g_host_funcs[HOST_MAX_FUNCS];
+static size_t g_host_nfuncs = 0;
+
+static pthread_t *g_host_workers = NULL;
+static size_t g_host_nworkers = 0;
+static bool g_host_stop = false;
+static host_queue_t g_host_submissions = { NULL, NULL };
+static host_queue_t g_host_completions = { NULL, NULL };
+static pthread_mutex_t g_host_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_host_cond = PTHREAD_COND_INITIALIZER;
+static wasm_host_notify_t g_host_notify = NULL;
+static void *g_host_notify_env = NULL;
+
+
+/****************************************************************************
+ * Static Function Prototypes
+****************************************************************************/
+static void host_trampoline(void *env, wasmtime_caller_t *caller, const wasmtime_val_t *args, size_t nargs,
+                            wasmtime_val_t *results, size_t nresults, wasm_trap_t **trap_ret,
+                            wasmtime_async_continuation_t *continuation_ret);
+static bool host_continuation(void *env);
+static uint8_t *host_guest_memory(wasmtime_caller_t *caller, size_t *size);
+static bool host_continuation_failed(void *env);
+static void host_call_release(void *env);
+static void *host_worker(void *arg);
+static void host_queue_push(host_queue_t *queue, wasm_host_call_t *call);
+static wasm_host_call_t *host_queue_pop(host_queue_t *queue);
+static int host_start(size_t workers);
+static int host_register(const char *module, const char *name,
+                         const wasm_valkind_t *params, size_t nparams,
+                         const wasm_valkind_t *results, size_t nresults,
+                         wasm_host_work_t work, wasm_host_submit_t submit, void *env, bool external);
+
+
+/****************************************************************************
+ * Static Function Implementations
+****************************************************************************/
+
+static void host_queue_push(host_queue_t *queue, wasm_host_call_t *call) {
+    call->next = NULL;
+    if(queue->tail) {
+        queue->tail->next = call;
+    } else {
+        queue->head = call;
+    }
+    queue->tail = call;
+}
+
+
+static wasm_host_call_t *host_queue_pop(host_queue_t *queue) {
+    wasm_host_call_t *call = queue->head;
+    if(call) {
+        queue->head = call->next;
+        if(queue->head == NULL) {
+            queue->tail = NULL;
+        }
+    }
+    return call;
+}
+
+
+/**
+ * @brief Drops one reference of a call, also the continuation's finalizer
+ */
+static void host_call_release(void *env) {
+    wasm_host_call_t *call = env;
+
+    if(atomic_fetch_sub_explicit(&call->refs, 1, memory_order_acq_rel) == 1) {
+        free(call);
+    }
+}
+
+
+/**
+ * @brief Called by Wasmtime whenever the suspended partition is polled,
+ *        resumes the guest once the worker has finished
+ */
+static bool host_continuation(void *env) {
+    wasm_host_call_t *call = env;
+
+    if(call->replayed) {
+        if(!wasm_replay_take_host(call->partition_id, call->results, call->func->nresults,
+                                  call->memory_base, call->memory_size)) {
+            return false;
+        }
+    } else if(!atomic_load_explicit(&call->done, memory_order_acquire)) {
+        return false;
+    } else if(call->func->external && wasm_replay_mode() == REPLAY_RECORD) {
+        bool output = call->memory_base != NULL && (uint64_t) call->output_ptr + call->output_len <= call->memory_size;
+        wasm_replay_host(call->partition_id, call->results, call->func->nresults, call->output_ptr,
+                         output ? call->memory_base + call->output_ptr : NULL, output ? call->output_len : 0);
+    }
+
+    memcpy(call->guest_results, call->results, call->func->nresults * sizeof(wasmtime_val_t));
+
+    if(call->partition->pending_call == call) {
+        call->partition->pending_call = NULL;
+        call->partition->blocked = false;
+    }
+
+    return true;
+}
+
+
+/**
+ * @brief Caller's exported linear memory, NULL when it has none
+ */
+static uint8_t *host_guest_memory(wasmtime_caller_t *caller, size_t *size) {
+    wasmtime_extern_t item;
+
+    *size = 0;
+    if(!wasmtime_caller_export_get(caller, "memory", 6, &item)) {
+        return NULL;
+    }
+    if(item.kind != WASMTIME_EXTERN_MEMORY) {
+        wasmtime_extern_delete(&item);
+        return NULL;
+    }
+
+    wasmtime_context_t *context = wasmtime_caller_context(caller);
+    uint8_t *data = wasmtime_memory_data(context, &item.of.memory);
+    *size = wasmtime_memory_data_size(context, &item.of.memory);
+    wasmtime_extern_delete(&item);
+
+    return data;
+}
+
+
+static bool host_continuation_failed(void *env) {
+    (void) env;
+    return true;
+}
+
+
+/**
+ * @brief Entry of every async host function, runs on the partition's fiber.
+ *        Submits the work and hands Wasmtime a continuation, the guest stays
+ *        suspended until the continuation reports completion
+ */
+static void host_trampoline(void *env, wasmtime_caller_t *caller, const wasmtime_val_t *args, size_t nargs,
+                            wasmtime_val_t *results, size_t nresults, wasm_trap_t **trap_ret,
+                            wasmtime_async_continuation_t *continuation_ret) {
+    const host_func_t *func = env;
+    (void) nresults;
+    wasm_partition_t *partition = wasmtime_context_get_data(wasmtime_caller_context(caller));
+
+    continuation_ret->callback = host_continuation_failed;
+    continuation_ret->env = NULL;
+    continuation_ret->finalizer = NULL;
+
+    wasm_host_call_t *call = calloc(1, sizeof(wasm_host_call_t));
+    if(!call) {
+        *trap_ret = wasmtime_trap_new("host call allocation failed", 27);
+        return;
+    }
+
+    call->func = func;
+    call->partition = partition;
+    call->partition_id = partition->partition_id;
+    call->guest_results = results;
+    memcpy(call->params, args, nargs * sizeof(wasmtime_val_t));
+    for(size_t i = 0; i < func->nresults; i++) {
+        call->results[i].kind = (wasmtime_valkind_t) func->results[i];
+    }
+    atomic_init(&call->refs, 2);                // Continuation + queues
+    atomic_init(&call->done, false);
+
+    if(func->external && wasm_replay_mode() != REPLAY_OFF) {
+        call->memory_base = host_guest_memory(caller, &call->memory_size);
+    }
+
+    if(func->external && wasm_replay_mode() == REPLAY_REPLAY) {
+        // Nothing is started, the log holds what the call returned
+        call->replayed = true;
+        atomic_store_explicit(&call->refs, 1, memory_order_relaxed);
+    } else if(func->submit != NULL) {
+        int submitted = func->submit(func->env, caller, args, nargs, call);
+        if(submitted < 0) {
+            free(call);
+            *trap_ret = wasmtime_trap_new("host call failed", 16);
+            return;
+        }
+        if(submitted > 0) {
+            // Completed inline, the guest resumes within this poll
+            atomic_store_explicit(&call->done, true, memory_order_release);
+            atomic_store_explicit(&call->refs, 1, memory_order_relaxed);
+        }
+    } else {
+        pthread_mutex_lock(&g_host_lock);
+        host_queue_push(&g_host_submissions, call);
+        pthread_cond_signal(&g_host_cond);
+        pthread_mutex_unlock(&g_host_lock);
+    }
+
+    partition->pending_call = call;
+
+    continuation_ret->callback = host_continuation;
+    continuation_ret->env = call;
+    continuation_ret->finalizer = host_call_release;
+}
+
+
+/**
+ * @brief Worker of the completion queue, runs host work and posts completions
+ */
+static void *host_worker(void *arg) {
+    (void) arg;
+
+    pthread_mutex_lock(&g_host_lock);
+    for(;;) {
+        wasm_host_call_t *call = host_queue_pop(&g_host_submissions);
+        if(call == NULL) {
+            if(g_host_stop) {
+                break;
+            }
+            pthread_cond_wait(&g_host_cond, &g_host_lock);
+            continue;
+        }
+        pthread_mutex_unlock(&g_host_lock);
+
+        const host_func_t *func = call->func;
+        func->work(func->env, call->params, func->nparams, call->results, func->nresults);
+
+        wasm_host_complete(call);
+        pthread_mutex_lock(&g_host_lock);
+    }
+    pthread_mutex_unlock(&g_host_lock);
+
+    return NULL;
+}
+
+
+/**
+ * @brief Start the completion queue's worker threads
+ */
+static int host_start(size_t workers) {
+    g_host_workers = calloc(workers, sizeof(pthread_t));
+    if(!g_host_workers) {
+        printf("Memory allocation failed!\n");
+        return -1;
+    }
+
+    g_host_stop = false;
+    for(g_host_nworkers = 0; g_host_nworkers < workers; g_host_nworkers++) {
+        if(pthread_create(&g_host_workers[g_host_nworkers], wasm_rt_housekeeping_attr(), host_worker, NULL) != 0) {
+            printf("Failed to start host worker %zu\n", g_host_nworkers);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Add a host function to the table linked into new partitions
+ */
+static int host_register(const char *module, const char *name,
+                         const wasm_valkind_t *params, size_t nparams,
+                         const wasm_valkind_t *results, size_t nresults,
+                         wasm_host_work_t work, wasm_host_submit_t submit, void *env, bool external) {
+
+    if(g_host_nfuncs >= HOST_MAX_FUNCS || nparams > HOST_MAX_VALUES || nresults > HOST_MAX_VALUES) {
+        printf("Cannot define host function %s.%s\n", module, name);
+        return -1;
+    }
+
+    for(size_t i = 0; i < nparams + nresults; i++) {
+        wasm_valkind_t kind = i < nparams ? params[i] : results[i - nparams];
+        if(kind != WASM_I32 && kind != WASM_I64 && kind != WASM_F32 && kind != WASM_F64) {
+            printf("Host function %s.%s: only numeric values are supported\n", module, name);
+            return -1;
+        }
+    }
+
+    host_func_t *func = &g_host_funcs[g_host_nfuncs];
+    func->module = strdup(module);
+    func->name = strdup(name);
+    if(!func->module || !func->name) {
+        free(func->module);
+        free(func->name);
+        printf("Memory allocation failed!\n");
+        return -1;
+    }
+
+    memcpy(func->params, params, nparams * sizeof(wasm_valkind_t));
+    memcpy(func->results, results, nresults * sizeof(wasm_valkind_t));
+    func->nparams = nparams;
+    func->nresults = nresults;
+    func->work = work;
+    func->submit = submit;
+    func->env = env;
+    func->external = external;
+    g_host_nfuncs++;
+
+    return 0;
+}
+
+
+/****************************************************************************
+ * Function Implementations
+****************************************************************************/
+
+/**
+ * @brief Register an async host function, linked into every partition loaded
+ *        afterwards. Only numeric value kinds are supported
+ *
+ * @param module Import module name
+ * @param name Import name
+ * @param params Parameter kinds
+ * @param results Result kinds
+ * @param work Host work, run on the completion queue's workers
+ * @param env Passed to work
+ * @param workers Worker threads, started with the first definition, 0 for HOST_WORKERS
+ * @return 0 when successful, else -1
+ */
+int wasm_host_define(const char *module, const char *name,
+                     const wasm_valkind_t *params, size_t nparams,
+                     const wasm_valkind_t *results, size_t nresults,
+                     wasm_host_work_t work, void *env, size_t workers) {
+
+    if(work == NULL) {
+        return -1;
+    }
+
+    if(g_host_workers == NULL && host_start(workers ? workers : HOST_WORKERS) != 0) {
+        wasm_host_shutdown();
+        return -1;
+    }
+
+    // Worker results are the outside world's, recorded for replay
+    return host_register(module, name, params, nparams, results, nresults, work, NULL, env, true);
+}
+
+
+/**
+ * @brief Register an async host function whose work is started by submit
+ *        and completed by wasm_host_complete, no worker thread involved
+ *
+ * @param module Import module name
+ * @param name Import name
+ * @param params Parameter kinds
+ * @param results Result kinds
+ * @param submit Starts the work on the scheduler thread
+ * @param env Passed to submit
+ * @return 0 when successful, else -1
+ */
+int wasm_host_define_submit(const char *module, const char *name,
+                            const wasm_valkind_t *params, size_t nparams,
+                            const wasm_valkind_t *results, size_t nresults,
+                            wasm_host_submit_t submit, void *env) {
+
+    if(submit == NULL) {
+        return -1;
+    }
+
+    return host_register(module, name, params, nparams, results, nresults, NULL, submit, env, false);
+}
+
+
+/**
+ * @brief Register an async host function like wasm_host_define_submit whose
+ *        results come from outside the process, e.g. file I/O. They are
+ *        recorded to the replay log and taken from it when replaying,
+ *        without calling submit
+ *
+ * @param module Import module name
+ * @param name Import name
+ * @param params Parameter kinds
+ * @param results Result kinds
+ * @param submit Starts the work on the scheduler thread
+ * @param env Passed to submit
+ * @return 0 when successful, else -1
+ */
+int wasm_host_define_submit_external(const char *module, const char *name,
+                                     const wasm_valkind_t *params, size_t nparams,
+                                     const wasm_valkind_t *results, size_t nresults,
+                                     wasm_host_submit_t submit, void *env) {
+
+    if(submit == NULL) {
+        return -1;
+    }
+
+    return host_register(module, name, params, nparams, results, nresults, NULL, submit, env, true);
+}
+
+
+/**
+ * @brief Results of a call, kinds are preset. Written before wasm_host_complete
+ */
+wasmtime_val_t *wasm_host_call_results(wasm_host_call_t *call) {
+    return call->results;
+}
+
+
+/**
+ * @brief Partition that made the call
+ */
+int wasm_host_call_partition(wasm_host_call_t *call) {
+    return call->partition_id;
+}
+
+
+/**
+ * @brief Guest memory range the call wrote, [ptr, ptr + len). Recorded with
+ *        the results of external calls so a replay restores it. Set before
+ *        wasm_host_complete
+ */
+void wasm_host_call_set_output(wasm_host_call_t *call, uint32_t ptr, uint32_t len) {
+    call->output_ptr = ptr;
+    call->output_len = len;
+}
+
+
+/**
+ * @brief Guest memory range [ptr, ptr + len), NULL when out of bounds. Stays
+ *        valid while the guest is suspended, nothing else runs in its store
+ */
+uint8_t *wasm_host_guest_buffer(wasmtime_caller_t *caller, uint32_t ptr, uint32_t len) {
+    size_t size;
+
+    uint8_t *data = host_guest_memory(caller, &size);
+    if(data == NULL || (uint64_t) ptr + len > size) {
+        return NULL;
+    }
+
+    return data + ptr;
+}
+
+
+/**
+ * @brief Post a call to the completion queue, its partition becomes runnable
+ *        at the next wasm_host_poll. Thread-safe
+ */
+void wasm_host_complete(wasm_host_call_t *call) {
+    pthread_mutex_lock(&g_host_lock);
+    atomic_store_explicit(&call->done, true, memory_order_release);
+    host_queue_push(&g_host_completions, call);
+    wasm_host_notify_t notify = g_host_notify;
+    void *env = g_host_notify_env;
+    pthread_mutex_unlock(&g_host_lock);
+
+    if(notify != NULL) {
+        notify(env);
+    }
+}
+
+
+/**
+ * @brief Set the callback run after every completion, NULL to remove it
+ */
+void wasm_host_set_notify(wasm_host_notify_t notify, void *env) {
+    pthread_mutex_lock(&g_host_lock);
+    g_host_notify = notify;
+    g_host_notify_env = env;
+    pthread_mutex_unlock(&g_host_lock);
+}
+
+
+/**
+ * @brief Define all registered host functions in a partition's linker
+ *
+ * @return NULL when successful, else the error of the linker
+ */
+wasmtime_error_t *wasm_host_link(wasmtime_linker_t *linker) {
+
+    for(size_t i = 0; i < g_host_nfuncs; i++) {
+        host_func_t *func = &g_host_funcs[i];
+
+        wasm_valtype_vec_t params;
+        wasm_valtype_vec_t results;
+        wasm_valtype_vec_new_uninitialized(&params, func->nparams);
+        wasm_valtype_vec_new_uninitialized(&results, func->nresults);
+        for(size_t p = 0; p < func->nparams; p++) {
+            params.data[p] = wasm_valtype_new(func->params[p]);
+        }
+        for(size_t r = 0; r < func->nresults; r++) {
+            results.data[r] = wasm_valtype_new(func->results[r]);
+        }
+
+        wasm_functype_t *type = wasm_functype_new(&params, &results);
+        wasmtime_error_t *error = wasmtime_linker_define_async_func(linker, func->module, strlen(func->module),
+                                                                    func->name, strlen(func->name), type,
+                                                                    host_trampoline, func, NULL);
+        wasm_functype_delete(type);
+
+        if(error != NULL) {
+            return error;
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ * @brief Drain the completion queue and mark partitions whose host call
+ *        completed as runnable
+ *
+ * @return Number of partitions made runnable
+ */
+size_t wasm_host_poll(void) {
+    size_t runnable = 0;
+
+    pthread_mutex_lock(&g_host_lock);
+    wasm_host_call_t *call = g_host_completions.head;
+    g_host_completions.head = NULL;
+    g_host_completions.tail = NULL;
+    pthread_mutex_unlock(&g_host_lock);
+
+    while(call != NULL) {
+        wasm_host_call_t *next = call->next;
+
+        // The partition may have been unloaded or moved on, the queue's
+        // reference keeps the call alive for this comparison
+        wasm_partition_t *partition = get_wasm_partition(call->partition_id);
+        if(partition != NULL && partition->pending_call == call && partition->blocked) {
+            partition->blocked = false;
+            runnable++;
+        }
+
+        host_call_release(call);
+        call = next;
+    }
+
+    return runnable;
+}
+
+
+/**
+ * @brief Whether the host work of a call has completed
+ */
+bool wasm_host_call_done(wasm_host_call_t *call) {
+    // A replayed call never blocks, its partition runs when the log says so
+    return call->replayed || atomic_load_explicit(&call->done, memory_order_acquire);
+}
+
+
+/**
+ * @brief Stop the workers and drop all definitions. Partitions must have been
+ *        unloaded
+ */
+void wasm_host_shutdown(void) {
+
+    // Queued work still runs, its partitions are gone but the calls are not
+    pthread_mutex_lock(&g_host_lock);
+    g_host_stop = true;
+    pthread_cond_broadcast(&g_host_cond);
+    pthread_mutex_unlock(&g_host_lock);
+
+    for(size_t i = 0; i < g_host_nworkers; i++) {
+        pthread_join(g_host_workers[i], NULL);
+    }
+    free(g_host_workers);
+    g_host_workers = NULL;
+    g_host_nworkers = 0;
+
+    wasm_host_poll();
+
+    for(size_t i = 0; i < g_host_nfuncs; i++) {
+        free(g_host_funcs[i].module);
+        free(g_host_funcs[i].name);
+    }
+    g_host_nfuncs = 0;
+}
@@ -0,0 +1,203 @@
+/*
+ * wasm_host.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+#ifndef WASM_HOST_H
+#define WASM_HOST_H
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wasm.h>
+#include <wasmtime.h>
+
+
+/****************************************************************************
+ * Defines
+****************************************************************************/
+#define HOST_MAX_FUNCS      32
+#define HOST_MAX_VALUES     8           // Max params/results of a host function
+#define HOST_WORKERS        4           // Completion queue worker threads by default
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+/**
+ * @brief Host work behind an async host function. Runs on a worker thread
+ *        while the calling partition is suspended, so it may block
+ *
+ * @param env User data given at definition
+ * @param params Copied arguments of the guest's call
+ * @param results Results handed back to the guest, kinds are preset
+ */
+typedef void (*wasm_host_work_t)(void *env, const wasmtime_val_t *params, size_t nparams,
+                                 wasmtime_val_t *results, size_t nresults);
+
+/**
+ * @brief Called after a call was posted to the completion queue, possibly
+ *        from a worker thread
+ *
+ * @param env User data given to wasm_host_set_notify
+ */
+typedef void (*wasm_host_notify_t)(void *env);
+
+// One pending call of a partition, owned by the host module
+typedef struct wasm_host_call wasm_host_call_t;
+
+/**
+ * @brief Starts host work that completes elsewhere, e.g. on an io_uring.
+ *        Runs on the partition's fiber, so the caller's memory is reachable.
+ *        The completion source fills wasm_host_call_results and calls
+ *        wasm_host_complete
+ *
+ * @param env User data given at definition
+ * @param caller Calling partition, valid during this call only
+ * @param params Arguments of the guest's call
+ * @param call Handle to complete later
+ * @return 0 when submitted, 1 when the results were written inline and
+ *         wasm_host_complete must not be called, else -1 and the guest traps
+ */
+typedef int (*wasm_host_submit_t)(void *env, wasmtime_caller_t *caller, const wasmtime_val_t *params, size_t nparams,
+                                  wasm_host_call_t *call);
+
+
+/****************************************************************************
+ * Function Prototypes
+****************************************************************************/
+
+/**
+ * @brief Register an async host function, linked into every partition loaded
+ *        afterwards. Only numeric value kinds are supported
+ *
+ * @param module Import module name
+ * @param name Import name
+ * @param params Parameter kinds
+ * @param results Result kinds
+ * @param work Host work, run on the completion queue's workers
+ * @param env Passed to work
+ * @param workers Worker threads, started with the first definition, 0 for HOST_WORKERS
+ * @return 0 when successful, else -1
+ */
+int wasm_host_define(const char *module, const char *name,
+                     const wasm_valkind_t *params, size_t nparams,
+                     const wasm_valkind_t *results, size_t nresults,
+                     wasm_host_work_t work, void *env, size_t workers);
+
+
+/**
+ * @brief Register an async host function whose work is started by submit
+ *        and completed by wasm_host_complete, no worker thread involved
+ *
+ * @param module Import module name
+ * @param name Import name
+ * @param params Parameter kinds
+ * @param results Result kinds
+ * @param submit Starts the work on the scheduler thread
+ * @param env Passed to submit
+ * @return 0 when successful, else -1
+ */
+int wasm_host_define_submit(const char *module, const char *name,
+                            const wasm_valkind_t *params, size_t nparams,
+                            const wasm_valkind_t *results, size_t nresults,
+                            wasm_host_submit_t submit, void *env);
+
+
+/**
+ * @brief Register an async host function like wasm_host_define_submit whose
+ *        results come from outside the process, e.g. file I/O. They are
+ *        recorded to the replay log and taken from it when replaying,
+ *        without calling submit
+ *
+ * @param module Import module name
+ * @param name Import name
+ * @param params Parameter kinds
+ * @param results Result kinds
+ * @param submit Starts the work on the scheduler thread
+ * @param env Passed to submit
+ * @return 0 when successful, else -1
+ */
+int wasm_host_define_submit_external(const char *module, const char *name,
+                                     const wasm_valkind_t *params, size_t nparams,
+                                     const wasm_valkind_t *results, size_t nresults,
+                                     wasm_host_submit_t submit, void *env);
+
+
+/**
+ * @brief Results of a call, kinds are preset. Written before wasm_host_complete
+ */
+wasmtime_val_t *wasm_host_call_results(wasm_host_call_t *call);
+
+
+/**
+ * @brief Partition that made the call
+ */
+int wasm_host_call_partition(wasm_host_call_t *call);
+
+
+/**
+ * @brief Guest memory range the call wrote, [ptr, ptr + len). Recorded with
+ *        the results of external calls so a replay restores it. Set before
+ *        wasm_host_complete
+ */
+void wasm_host_call_set_output(wasm_host_call_t *call, uint32_t ptr, uint32_t len);
+
+
+/**
+ * @brief Guest memory range [ptr, ptr + len), NULL when out of bounds. Stays
+ *        valid while the guest is suspended, nothing else runs in its store
+ */
+uint8_t *wasm_host_guest_buffer(wasmtime_caller_t *caller, uint32_t ptr, uint32_t len);
+
+
+/**
+ * @brief Post a call to the completion queue, its partition becomes runnable
+ *        at the next wasm_host_poll. Thread-safe
+ */
+void wasm_host_complete(wasm_host_call_t *call);
+
+
+/**
+ * @brief Set the callback run after every completion, NULL to remove it
+ */
+void wasm_host_set_notify(wasm_host_notify_t notify, void *env);
+
+
+/**
+ * @brief Define all registered host functions in a partition's linker
+ *
+ * @return NULL when successful, else the error of the linker
+ */
+wasmtime_error_t *wasm_host_link(wasmtime_linker_t *linker);
+
+
+/**
+ * @brief Drain the completion queue and mark partitions whose host call
+ *        completed as runnable
+ *
+ * @return Number of partitions made runnable
+ */
+size_t wasm_host_poll(void);
+
+
+/**
+ * @brief Whether the host work of a call has completed
+ */
+bool wasm_host_call_done(wasm_host_call_t *call);
+
+
+/**
+ * @brief Stop the workers and drop all definitions. Partitions must have been
+ *        unloaded
+ */
+void wasm_host_shutdown(void);
+
+
+#endif // WASM_HOST_H
@@ -0,0 +1,293 @@
+/*
+ * wasm_limits.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+// https://webassembly.github.io/spec/core/binary/modules.html
+//
+// Wasmtime's store limiter only makes instantiation fail with an error text.
+// Reading the defined tables and memories up front tells the exact limit a
+// module exceeds before it is instantiated
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include "wasm_limits.h"
+#include <stdbool.h>
+#include <string.h>
+
+
+/****************************************************************************
+ * Defines
+****************************************************************************/
+#define SECTION_TABLE           4
+#define SECTION_MEMORY          5
+#define LIMITS_HAS_MAX          0x01
+#define LIMITS_PAGE_SIZE        0x08    // Custom page sizes, log2 of the page size follows
+#define TABLE_WITH_INIT         0x40    // Function references: 0x40 0x00 tabletype expr
+#define REFTYPE_REF             0x64
+#define REFTYPE_REF_NULL        0x63
+#define WASM_PAGE_LOG2          16
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+typedef struct scan_reader {
+    const uint8_t *pos;
+    const uint8_t *end;
+} scan_reader_t;
+
+
+/****************************************************************************
+ * Static Function Prototypes
+****************************************************************************/
+static bool scan_byte(scan_reader_t *r, uint8_t *value);
+static bool scan_leb(scan_reader_t *r, uint64_t *value);
+static bool scan_skip(scan_reader_t *r, uint64_t len);
+static bool scan_limits(scan_reader_t *r, bool memory, uint64_t *initial);
+static bool scan_reftype(scan_reader_t *r);
+static bool scan_const_expr(scan_reader_t *r);
+static bool scan_tables(scan_reader_t *r, wasm_module_needs_t *needs);
+static bool scan_memories(scan_reader_t *r, wasm_module_needs_t *needs);
+
+
+/****************************************************************************
+ * Static Function Implementations
+****************************************************************************/
+
+static bool scan_byte(scan_reader_t *r, uint8_t *value) {
+    if(r->pos >= r->end) {
+        return false;
+    }
+    *value = *r->pos++;
+    return true;
+}
+
+
+/**
+ * @brief Unsigned LEB128 up to 64 bits, signed ones are only skipped so the
+ *        value is of no use for them
+ */
+static bool scan_leb(scan_reader_t *r, uint64_t *value) {
+    uint64_t result = 0;
+    uint8_t byte;
+
+    for(unsigned shift = 0; shift < 70; shift += 7) {
+        if(!scan_byte(r, &byte)) {
+            return false;
+        }
+        if(shift < 64) {
+            result |= (uint64_t) (byte & 0x7f) << shift;
+        }
+        if(!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+static bool scan_skip(scan_reader_t *r, uint64_t len) {
+    if(len > (uint64_t) (r->end - r->pos)) {
+        return false;
+    }
+    r->pos += len;
+    return true;
+}
+
+
+/**
+ * @brief Limits of a table or memory, initial is in elements or bytes
+ */
+static bool scan_limits(scan_reader_t *r, bool memory, uint64_t *initial) {
+    uint8_t flags;
+    uint64_t minimum;
+    uint64_t maximum;
+    uint64_t page_log2 = WASM_PAGE_LOG2;
+
+    if(!scan_byte(r, &flags) || !scan_leb(r, &minimum)) {
+        return false;
+    }
+    if((flags & LIMITS_HAS_MAX) && !scan_leb(r, &maximum)) {
+        return false;
+    }
+    if(memory && (flags & LIMITS_PAGE_SIZE) && (!scan_leb(r, &page_log2) || page_log2 > WASM_PAGE_LOG2)) {
+        return false;
+    }
+
+    if(!memory) {
+        *initial = minimum;
+    } else {
+        *initial = minimum > (UINT64_MAX >> page_log2) ? UINT64_MAX : minimum << page_log2;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Skip a reference type, a one byte abbreviation or ref/ref null with
+ *        a heap type
+ */
+static bool scan_reftype(scan_reader_t *r) {
+    uint8_t type;
+    uint64_t heap_type;
+
+    if(!scan_byte(r, &type)) {
+        return false;
+    }
+    if(type == REFTYPE_REF || type == REFTYPE_REF_NULL) {
+        return scan_leb(r, &heap_type);
+    }
+    return true;
+}
+
+
+/**
+ * @brief Skip the initialiser of a table, the MVP constant instructions,
+ *        extended constants and references
+ */
+static bool scan_const_expr(scan_reader_t *r) {
+    uint8_t opcode;
+    uint64_t immediate;
+
+    while(scan_byte(r, &opcode)) {
+        switch(opcode) {
+        case 0x0b:                              // end
+            return true;
+        case 0x41:                              // i32.const
+        case 0x42:                              // i64.const
+        case 0x23:                              // global.get
+        case 0xd2:                              // ref.func
+        case 0xd0:                              // ref.null, heap type
+            if(!scan_leb(r, &immediate)) {
+                return false;
+            }
+            break;
+        case 0x43:                              // f32.const
+            if(!scan_skip(r, 4)) {
+                return false;
+            }
+            break;
+        case 0x44:                              // f64.const
+            if(!scan_skip(r, 8)) {
+                return false;
+            }
+            break;
+        case 0x6a: case 0x6b: case 0x6c:        // i32.add/sub/mul
+        case 0x7c: case 0x7d: case 0x7e:        // i64.add/sub/mul
+            break;
+        default:
+            return false;
+        }
+    }
+
+    return false;
+}
+
+
+static bool scan_tables(scan_reader_t *r, wasm_module_needs_t *needs) {
+    uint64_t count;
+    uint8_t prefix;
+    uint64_t elements;
+
+    if(!scan_leb(r, &count)) {
+        return false;
+    }
+
+    for(uint64_t i = 0; i < count; i++) {
+        bool with_init = r->pos < r->end && *r->pos == TABLE_WITH_INIT;
+        if(with_init && (!scan_skip(r, 1) || !scan_byte(r, &prefix) || prefix != 0)) {
+            return false;
+        }
+        if(!scan_reftype(r) || !scan_limits(r, false, &elements)) {
+            return false;
+        }
+        if(with_init && !scan_const_expr(r)) {
+            return false;
+        }
+
+        needs->tables++;
+        if(elements > needs->table_elements) {
+            needs->table_elements = elements;
+        }
+    }
+
+    return true;
+}
+
+
+static bool scan_memories(scan_reader_t *r, wasm_module_needs_t *needs) {
+    uint64_t count;
+    uint64_t bytes;
+
+    if(!scan_leb(r, &count)) {
+        return false;
+    }
+
+    for(uint64_t i = 0; i < count; i++) {
+        if(!scan_limits(r, true, &bytes)) {
+            return false;
+        }
+
+        needs->memories++;
+        if(bytes > needs->memory_bytes) {
+            needs->memory_bytes = bytes;
+        }
+    }
+
+    return true;
+}
+
+
+/****************************************************************************
+ * Function Implementations
+****************************************************************************/
+
+/**
+ * @brief Read the table and memory sections of a module binary. Only the
+ *        section headers and the table/memory types are decoded, the rest
+ *        is skipped by size
+ *
+ * @param wasm Module binary, already validated by compiling it
+ * @param size Bytes of wasm
+ * @param needs Output
+ * @return 0 when successful, -1 for a malformed binary or an encoding not
+ *         known here, e.g. a table initialised by a GC instruction
+ */
+int wasm_limits_scan(const uint8_t *wasm, size_t size, wasm_module_needs_t *needs) {
+    static const uint8_t header[8] = { 0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00 };
+    scan_reader_t r = { .pos = wasm, .end = wasm + size };
+
+    memset(needs, 0, sizeof(*needs));
+
+    if(size < sizeof(header) || memcmp(wasm, header, sizeof(header)) != 0) {
+        return -1;
+    }
+    r.pos += sizeof(header);
+
+    while(r.pos < r.end) {
+        uint8_t id;
+        uint64_t len;
+
+        if(!scan_byte(&r, &id) || !scan_leb(&r, &len) || len > (uint64_t) (r.end - r.pos)) {
+            return -1;
+        }
+
+        scan_reader_t section = { .pos = r.pos, .end = r.pos + len };
+        if(id == SECTION_TABLE && !scan_tables(&section, needs)) {
+            return -1;
+        }
+        if(id == SECTION_MEMORY && !scan_memories(&section, needs)) {
+            return -1;
+        }
+        r.pos += len;
+    }
+
+    return 0;
+}
@@ -0,0 +1,50 @@
+/*
+ * wasm_limits.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+#ifndef WASM_LIMITS_H
+#define WASM_LIMITS_H
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include <stddef.h>
+#include <stdint.h>
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+// What instantiating a module takes from its store. Imported memories and
+// tables belong to another store and are not counted
+typedef struct wasm_module_needs {
+    uint32_t memories;              // Defined memories
+    uint32_t tables;                // Defined tables
+    uint64_t memory_bytes;          // Largest initial size of a defined memory
+    uint64_t table_elements;        // Largest initial size of a defined table
+} wasm_module_needs_t;
+
+
+/****************************************************************************
+ * Function Prototypes
+****************************************************************************/
+
+/**
+ * @brief Read the table and memory sections of a module binary. Only the
+ *        section headers and the table/memory types are decoded, the rest
+ *        is skipped by size
+ *
+ * @param wasm Module binary, already validated by compiling it
+ * @param size Bytes of wasm
+ * @param needs Output
+ * @return 0 when successful, -1 for a malformed binary or an encoding not
+ *         known here, e.g. a table initialised by a GC instruction
+ */
+int wasm_limits_scan(const uint8_t *wasm, size_t size, wasm_module_needs_t *needs);
+
+
+#endif // WASM_LIMITS_H
@@ -0,0 +1,416 @@
+/*
+ * wasm_map.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+// Data-parallel calls of one export. Workers claim batches of elements from
+// a shared counter, so a slow batch does not hold back the others, and call
+// through wasmtime_func_call_unchecked on their own instance
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include "wasm_map.h"
+#include "wasm_api.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+/****************************************************************************
+ * Defines
+****************************************************************************/
+#define MAP_EPOCH_NEVER     (1ull << 62)   // Profiling enables epoch checks engine wide
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+// One map, shared by its workers
+typedef struct map_job {
+    wasm_engine_t *engine;
+    wasmtime_instance_pre_t *instance_pre;
+    const char *func_name;
+    const wasmtime_val_t *inputs;
+    wasmtime_val_t *outputs;
+    uint8_t *status;
+    size_t n;
+    size_t batch;
+    size_t nparams;
+    size_t nresults;
+    wasmtime_valkind_t params[MAP_MAX_VALUES];
+    wasmtime_valkind_t results[MAP_MAX_VALUES];
+    bool metered;
+    uint64_t fuel;
+    bool fuel_per_batch;
+
+    _Atomic size_t next;            // First element not claimed yet
+    _Atomic size_t failed;
+    _Atomic uint64_t batches;
+} map_job_t;
+
+
+/****************************************************************************
+ * Statistics
+****************************************************************************/
+static _Atomic uint64_t g_map_maps = 0;
+static _Atomic uint64_t g_map_elements = 0;
+static _Atomic uint64_t g_map_batches = 0;
+static _Atomic uint64_t g_map_failed = 0;
+
+
+/****************************************************************************
+ * Static Function Prototypes
+****************************************************************************/
+static bool map_signature(const wasmtime_module_t *module, map_job_t *job);
+static bool map_kind_numeric(wasm_valkind_t kind);
+static void map_fail(map_job_t *job, size_t i, wasm_map_status_t status);
+static void map_call(map_job_t *job, wasmtime_context_t *context, const wasmtime_func_t *func, size_t i);
+static void *map_worker(void *arg);
+
+
+/****************************************************************************
+ * Static Function Implementations
+****************************************************************************/
+
+static bool map_kind_numeric(wasm_valkind_t kind) {
+    return kind == WASM_I32 || kind == WASM_I64 || kind == WASM_F32 || kind == WASM_F64;
+}
+
+
+/**
+ * @brief Find the export in the module's type and record its signature
+ *
+ * @return True when it is a function with numeric params and results
+ */
+static bool map_signature(const wasmtime_module_t *module, map_job_t *job) {
+    wasm_exporttype_vec_t exports;
+    bool found = false;
+    bool ok = false;
+
+    wasmtime_module_exports(module, &exports);
+
+    for(size_t e = 0; e < exports.size && !found; e++) {
+        const wasm_name_t *name = wasm_exporttype_name(exports.data[e]);
+        if(name->size != strlen(job->func_name) || memcmp(name->data, job->func_name, name->size) != 0) {
+            continue;
+        }
+        found = true;
+
+        const wasm_functype_t *functype = wasm_externtype_as_functype_const(wasm_exporttype_type(exports.data[e]));
+        if(functype == NULL) {
+            break;
+        }
+
+        const wasm_valtype_vec_t *params = wasm_functype_params(functype);
+        const wasm_valtype_vec_t *results = wasm_functype_results(functype);
+        ok = params->size <= MAP_MAX_VALUES && results->size <= MAP_MAX_VALUES;
+
+        for(size_t p = 0; ok && p < params->size; p++) {
+            ok = map_kind_numeric(wasm_valtype_kind(params->data[p]));
+            job->params[p] = (wasmtime_valkind_t) wasm_valtype_kind(params->data[p]);
+        }
+        for(size_t r = 0; ok && r < results->size; r++) {
+            ok = map_kind_numeric(wasm_valtype_kind(results->data[r]));
+            job->results[r] = (wasmtime_valkind_t) wasm_valtype_kind(results->data[r]);
+        }
+
+        job->nparams = params->size;
+        job->nresults = results->size;
+    }
+
+    wasm_exporttype_vec_delete(&exports);
+
+    if(!ok) {
+        printf("Function '%s' not found or not a function of numeric values\n", job->func_name);
+    }
+    return ok;
+}
+
+
+static void map_fail(map_job_t *job, size_t i, wasm_map_status_t status) {
+    memset(&job->outputs[i * job->nresults], 0, job->nresults * sizeof(wasmtime_val_t));
+    for(size_t r = 0; r < job->nresults; r++) {
+        job->outputs[i * job->nresults + r].kind = job->results[r];
+    }
+
+    if(job->status != NULL) {
+        job->status[i] = status;
+    }
+    atomic_fetch_add_explicit(&job->failed, 1, memory_order_relaxed);
+}
+
+
+/**
+ * @brief Call element i, raw values are packed by the param kinds, the
+ *        inputs were checked against them up front
+ */
+static void map_call(map_job_t *job, wasmtime_context_t *context, const wasmtime_func_t *func, size_t i) {
+    wasmtime_val_raw_t raw[MAP_MAX_VALUES];
+    const wasmtime_val_t *in = &job->inputs[i * job->nparams];
+    wasmtime_val_t *out = &job->outputs[i * job->nresults];
+    wasm_trap_t *trap = NULL;
+
+    // Same layout for the numeric members of both unions
+    for(size_t p = 0; p < job->nparams; p++) {
+        memset(&raw[p], 0, sizeof(raw[p]));
+        if(job->params[p] == WASMTIME_I64 || job->params[p] == WASMTIME_F64) {
+            raw[p].i64 = in[p].of.i64;
+        } else {
+            raw[p].i32 = in[p].of.i32;
+        }
+    }
+
+    if(job->metered && !job->fuel_per_batch) {
+        wasmtime_error_t *error = wasmtime_context_set_fuel(context, job->fuel);
+        if(error != NULL) {
+            wasmtime_error_delete(error);
+        }
+    }
+
+    wasmtime_error_t *error = wasmtime_func_call_unchecked(context, func, raw, MAP_MAX_VALUES, &trap);
+    if(error != NULL) {
+        wasmtime_error_delete(error);
+        map_fail(job, i, MAP_TRAP);
+        return;
+    }
+    if(trap != NULL) {
+        wasmtime_trap_code_t code;
+        bool out_of_fuel = wasmtime_trap_code(trap, &code) && code == WASMTIME_TRAP_CODE_OUT_OF_FUEL;
+        wasm_trap_delete(trap);
+        map_fail(job, i, out_of_fuel ? MAP_NO_FUEL : MAP_TRAP);
+        return;
+    }
+
+    for(size_t r = 0; r < job->nresults; r++) {
+        out[r].kind = job->results[r];
+        if(out[r].kind == WASMTIME_I64 || out[r].kind == WASMTIME_F64) {
+            out[r].of.i64 = raw[r].i64;
+        } else {
+            out[r].of.i32 = raw[r].i32;
+        }
+    }
+
+    if(job->status != NULL) {
+        job->status[i] = MAP_DONE;
+    }
+}
+
+
+/**
+ * @brief Instantiate once, then claim batches until every element is taken
+ */
+static void *map_worker(void *arg) {
+    map_job_t *job = arg;
+    wasm_trap_t *trap = NULL;
+    wasmtime_error_t *error = NULL;
+    wasmtime_instance_t instance;
+    wasmtime_extern_t ext;
+
+    wasmtime_store_t *store = wasmtime_store_new(job->engine, NULL, NULL);
+    if(!store) {
+        printf("Failed to create Wasmtime store\n");
+        return NULL;
+    }
+    wasmtime_context_t *context = wasmtime_store_context(store);
+    wasmtime_context_set_epoch_deadline(context, MAP_EPOCH_NEVER);
+
+    // Start functions run on this fuel as well
+    if(job->metered) {
+        error = wasmtime_context_set_fuel(context, job->fuel);
+        if(error != NULL) {
+            wasmtime_error_delete(error);
+            error = NULL;
+        }
+    }
+
+    // Instantiation has to go through a future on an async engine, calls do not
+    wasmtime_call_future_t *future = wasmtime_instance_pre_instantiate_async(job->instance_pre, context, &instance, &trap, &error);
+    if(future != NULL) {
+        while(!wasmtime_call_future_poll(future)) {
+        }
+        wasmtime_call_future_delete(future);
+    }
+
+    bool found = error == NULL && trap == NULL && future != NULL
+                 && wasmtime_instance_export_get(context, &instance, job->func_name, strlen(job->func_name), &ext)
+                 && ext.kind == WASMTIME_EXTERN_FUNC;
+
+    if(error != NULL) {
+        wasmtime_error_delete(error);
+    }
+    if(trap != NULL) {
+        wasm_trap_delete(trap);
+    }
+    if(!found) {
+        printf("Map worker failed to instantiate %s\n", job->func_name);
+        wasmtime_store_delete(store);
+        return NULL;
+    }
+
+    while(true) {
+        size_t start = atomic_fetch_add_explicit(&job->next, job->batch, memory_order_relaxed);
+        if(start >= job->n) {
+            break;
+        }
+        size_t end = start + job->batch < job->n ? start + job->batch : job->n;
+
+        if(job->metered && job->fuel_per_batch) {
+            error = wasmtime_context_set_fuel(context, job->fuel);
+            if(error != NULL) {
+                wasmtime_error_delete(error);
+            }
+        }
+
+        for(size_t i = start; i < end; i++) {
+            map_call(job, context, &ext.of.func, i);
+        }
+        atomic_fetch_add_explicit(&job->batches, 1, memory_order_relaxed);
+    }
+
+    wasmtime_store_delete(store);
+    return NULL;
+}
+
+
+/****************************************************************************
+ * Function Implementations
+****************************************************************************/
+
+/**
+ * @brief Link a module for mapping. Maps take no host functions, so their
+ *        stores carry no partition
+ *
+ * @param engine Engine the module is compiled with
+ * @param module Module, not taken over
+ * @return Instance pre to pass to wasm_map_run(), NULL when the module
+ *         imports anything
+ */
+wasmtime_instance_pre_t *wasm_map_prepare(wasm_engine_t *engine, wasmtime_module_t *module) {
+    wasmtime_instance_pre_t *instance_pre = NULL;
+
+    wasmtime_linker_t *linker = wasmtime_linker_new(engine);
+    wasmtime_error_t *error = wasmtime_linker_instantiate_pre(linker, module, &instance_pre);
+    wasmtime_linker_delete(linker);
+
+    if(error != NULL) {
+        wasm_byte_vec_t msg;
+        wasmtime_error_message(error, &msg);
+        printf("Module cannot be mapped: %.*s\n", (int) msg.size, msg.data);
+        wasm_byte_vec_delete(&msg);
+        wasmtime_error_delete(error);
+        return NULL;
+    }
+
+    return instance_pre;
+}
+
+
+/**
+ * @brief Call one export over n inputs on a pool of worker threads. Each
+ *        worker instantiates the same wasmtime_instance_pre_t once and calls
+ *        synchronously, batch by batch
+ *
+ * @param engine Engine the module is compiled with
+ * @param metered Whether the engine consumes fuel
+ * @param module Module, for the signature of the export
+ * @param instance_pre From wasm_map_prepare() for the module, may be reused
+ *        across maps
+ * @param func_name Export with numeric params and results
+ * @param inputs n * nparams values of the param kinds, element i starts at
+ *        i * nparams
+ * @param outputs n * nresults values, element i starts at i * nresults
+ * @param n Number of elements
+ * @param opts Options, may be NULL
+ * @return Elements that failed, -1 when the map could not run
+ */
+long wasm_map_run(wasm_engine_t *engine, bool metered, const wasmtime_module_t *module,
+                  wasmtime_instance_pre_t *instance_pre, const char *func_name,
+                  const wasmtime_val_t *inputs, wasmtime_val_t *outputs, size_t n, const wasm_map_opts_t *opts) {
+    wasm_map_opts_t defaults = { 0 };
+    map_job_t job = { 0 };
+    pthread_t threads[MAP_MAX_WORKERS];
+    size_t started = 0;
+    long rc = -1;
+
+    if(opts == NULL) {
+        opts = &defaults;
+    }
+
+    job.engine = engine;
+    job.instance_pre = instance_pre;
+    job.func_name = func_name;
+    job.inputs = inputs;
+    job.outputs = outputs;
+    job.status = opts->status;
+    job.n = n;
+    job.batch = opts->batch ? opts->batch : MAP_BATCH;
+    job.metered = metered;
+    job.fuel = opts->fuel ? opts->fuel : FUEL_AMOUNT;
+    job.fuel_per_batch = opts->fuel_per_batch;
+
+    if(!map_signature(module, &job)) {
+        return -1;
+    }
+
+    // Raw values are packed by the param kinds, another kind would be reinterpreted
+    for(size_t i = 0; i < n * job.nparams; i++) {
+        if(inputs[i].kind != job.params[i % job.nparams]) {
+            printf("Input %zu: value %zu does not match the kind of its param\n", i / job.nparams, i % job.nparams);
+            return -1;
+        }
+    }
+
+    size_t workers = opts->workers;
+    if(workers == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = online > 0 ? (size_t) online : 1;
+    }
+    size_t batches = (n + job.batch - 1) / job.batch;
+    workers = workers < batches ? workers : batches;
+    workers = workers < MAP_MAX_WORKERS ? workers : MAP_MAX_WORKERS;
+
+    for(; started < workers; started++) {
+        if(pthread_create(&threads[started], wasm_rt_housekeeping_attr(), map_worker, &job) != 0) {
+            printf("Failed to start map worker %zu\n", started);
+            break;
+        }
+    }
+
+    for(size_t w = 0; w < started; w++) {
+        pthread_join(threads[w], NULL);
+    }
+
+    // Claimed batches always finish, anything unclaimed means no worker ran
+    if(atomic_load(&job.next) >= n) {
+        rc = (long) atomic_load(&job.failed);
+
+        atomic_fetch_add_explicit(&g_map_maps, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&g_map_elements, n, memory_order_relaxed);
+        atomic_fetch_add_explicit(&g_map_batches, atomic_load(&job.batches), memory_order_relaxed);
+        atomic_fetch_add_explicit(&g_map_failed, (uint64_t) rc, memory_order_relaxed);
+    } else {
+        printf("Map of %s did not run, no worker could instantiate it\n", func_name);
+    }
+
+    return rc;
+}
+
+
+/**
+ * @brief Statistics of all maps
+ *
+ * @param stats Output
+ */
+void wasm_map_stats(wasm_map_stats_t *stats) {
+    stats->maps = atomic_load_explicit(&g_map_maps, memory_order_relaxed);
+    stats->elements = atomic_load_explicit(&g_map_elements, memory_order_relaxed);
+    stats->batches = atomic_load_explicit(&g_map_batches, memory_order_relaxed);
+    stats->failed = atomic_load_explicit(&g_map_failed, memory_order_relaxed);
+}
@@ -0,0 +1,104 @@
+/*
+ * wasm_map.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+#ifndef WASM_MAP_H
+#define WASM_MAP_H
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wasm.h>
+#include <wasmtime.h>
+
+
+/****************************************************************************
+ * Defines
+****************************************************************************/
+#define MAP_BATCH           256             // Elements claimed by a worker at a time
+#define MAP_MAX_WORKERS     256
+#define MAP_MAX_VALUES      8               // Params/results of a mapped export
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+// Outcome of one element, see wasm_map_opts_t.status
+typedef enum {
+    MAP_DONE,
+    MAP_TRAP,                       // Trapped or failed, its outputs are zero
+    MAP_NO_FUEL                     // Ran out of fuel, its outputs are zero
+} wasm_map_status_t;
+
+// Options of a map, 0 selects the defaults
+typedef struct wasm_map_opts {
+    size_t workers;                 // Threads, each with its own instance, 0 for the online CPUs
+    size_t batch;                   // Elements per batch, 0 for MAP_BATCH
+    uint64_t fuel;                  // Fuel per element, or per batch with fuel_per_batch
+    bool fuel_per_batch;            // One fuel budget shared by the elements of a batch
+    uint8_t *status;                // n wasm_map_status_t outputs, may be NULL
+} wasm_map_opts_t;
+
+typedef struct wasm_map_stats {
+    uint64_t maps;
+    uint64_t elements;
+    uint64_t batches;
+    uint64_t failed;                // Elements that trapped or ran out of fuel
+} wasm_map_stats_t;
+
+
+/****************************************************************************
+ * Function Prototypes
+****************************************************************************/
+
+/**
+ * @brief Link a module for mapping. Maps take no host functions, so their
+ *        stores carry no partition
+ *
+ * @param engine Engine the module is compiled with
+ * @param module Module, not taken over
+ * @return Instance pre to pass to wasm_map_run(), NULL when the module
+ *         imports anything
+ */
+wasmtime_instance_pre_t *wasm_map_prepare(wasm_engine_t *engine, wasmtime_module_t *module);
+
+
+/**
+ * @brief Call one export over n inputs on a pool of worker threads. Each
+ *        worker instantiates the same wasmtime_instance_pre_t once and calls
+ *        synchronously, batch by batch
+ *
+ * @param engine Engine the module is compiled with
+ * @param metered Whether the engine consumes fuel
+ * @param module Module, for the signature of the export
+ * @param instance_pre From wasm_map_prepare() for the module, may be reused
+ *        across maps
+ * @param func_name Export with numeric params and results
+ * @param inputs n * nparams values of the param kinds, element i starts at
+ *        i * nparams
+ * @param outputs n * nresults values, element i starts at i * nresults
+ * @param n Number of elements
+ * @param opts Options, may be NULL
+ * @return Elements that failed, -1 when the map could not run
+ */
+long wasm_map_run(wasm_engine_t *engine, bool metered, const wasmtime_module_t *module,
+                  wasmtime_instance_pre_t *instance_pre, const char *func_name,
+                  const wasmtime_val_t *inputs, wasmtime_val_t *outputs, size_t n, const wasm_map_opts_t *opts);
+
+
+/**
+ * @brief Statistics of all maps
+ *
+ * @param stats Output
+ */
+void wasm_map_stats(wasm_map_stats_t *stats);
+
+
+#endif // WASM_MAP_H
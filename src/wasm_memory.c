@@ -0,0 +1,641 @@
+/*
+ * wasm_memory.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+// https://docs.wasmtime.dev/api/wasmtime/trait.MemoryCreator.html
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#define _GNU_SOURCE
+#include "wasm_memory.h"
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+// Layout: [reserved | guard], only [0, size) is accessible
+typedef struct host_memory {
+    uint8_t *mapping;           // Start of the mmap, base is aligned within it
+    size_t mapping_size;
+    uint8_t *base;
+    size_t reserved;            // Bytes that can become accessible without moving
+    bool movable;               // Wasmtime re-reads the base after a grow, it may move past reserved
+    size_t guard;
+    size_t size;                // Accessible bytes
+    size_t hugetlb_end;         // Prefix [0, hugetlb_end) is backed by explicit hugepages
+    bool hugetlb_failed;        // Explicit hugepages ran out, rest uses 4 KiB pages
+    size_t locked_end;          // Prefix [0, locked_end) is mlocked
+    int node;
+    wasm_memory_limit_t *limit; // Of the partition that created it, NULL for none
+    struct host_memory *next;   // Free list of released reservations
+} host_memory_t;
+
+typedef struct wasm_memory_creator_state {
+    wasm_memory_page_mode_t pages;
+    bool numa_bind;
+    bool mlock;
+    size_t growth;              // Headroom of memories Wasmtime lets move, 0 for the default reservation
+    host_memory_t *free_list;
+    size_t free_count;
+    wasm_memory_stats_t stats;
+    pthread_mutex_t lock;
+} wasm_memory_creator_state_t;
+
+
+/****************************************************************************
+ * Creator state
+****************************************************************************/
+static wasm_memory_creator_state_t *g_memory = NULL;
+
+// Limit of the partition instantiating on this thread
+static _Thread_local wasm_memory_limit_t *t_limit = NULL;
+
+
+/****************************************************************************
+ * Static Function Prototypes
+****************************************************************************/
+static wasmtime_error_t *memory_new(void *env, const wasm_memorytype_t *ty, size_t minimum, size_t maximum,
+                                    size_t reserved_size, size_t guard_size, wasmtime_linear_memory_t *memory_ret);
+static uint8_t *memory_get(void *env, size_t *byte_size, size_t *byte_capacity);
+static wasmtime_error_t *memory_grow(void *env, size_t new_size);
+static void memory_release(void *env);
+static host_memory_t *memory_reserve(size_t reserved, size_t guard);
+static void memory_apply_policy(host_memory_t *mem, uint8_t *addr, size_t len);
+static int memory_commit(host_memory_t *mem, size_t new_size);
+static int memory_move(host_memory_t *mem, size_t new_size);
+static void memory_lock(host_memory_t *mem, size_t end);
+static int memory_current_node(void);
+static size_t round_up(size_t value, size_t align);
+static size_t round_down(size_t value, size_t align);
+
+
+/****************************************************************************
+ * Static Function Implementations
+****************************************************************************/
+
+static size_t round_up(size_t value, size_t align) {
+    return (value + align - 1) / align * align;
+}
+
+
+static size_t round_down(size_t value, size_t align) {
+    return value / align * align;
+}
+
+
+/**
+ * @brief NUMA node of the CPU the calling thread runs on, -1 if unknown
+ */
+static int memory_current_node(void) {
+    unsigned cpu = 0;
+    unsigned node = 0;
+
+    if(syscall(SYS_getcpu, &cpu, &node, NULL) != 0) {
+        return -1;
+    }
+
+    return (int) node;
+}
+
+
+/**
+ * @brief Hugepage advice and NUMA policy for a range of the memory. Needed
+ *        again whenever the range was replaced by a new mapping
+ */
+static void memory_apply_policy(host_memory_t *mem, uint8_t *addr, size_t len) {
+    wasm_memory_creator_state_t *state = g_memory;
+
+    if(state->pages == MEMORY_PAGES_TRANSPARENT) {
+        madvise(addr, len, MADV_HUGEPAGE);
+    }
+
+    if(!state->numa_bind || mem->node < 0 || mem->node >= MEMORY_MAX_NODES) {
+        return;
+    }
+
+    // Preferred rather than strict binding, a full node falls back instead of OOM
+    unsigned long mask[MEMORY_MAX_NODES / (8 * sizeof(unsigned long))] = { 0 };
+    mask[mem->node / (8 * sizeof(unsigned long))] = 1ul << (mem->node % (8 * sizeof(unsigned long)));
+
+    if(syscall(SYS_mbind, addr, len, MPOL_PREFERRED, mask, MEMORY_MAX_NODES + 1, 0) != 0) {
+        pthread_mutex_lock(&state->lock);
+        state->stats.numa_bind_errors++;
+        pthread_mutex_unlock(&state->lock);
+    }
+}
+
+
+/**
+ * @brief Reserve address space for a memory, nothing accessible yet
+ */
+static host_memory_t *memory_reserve(size_t reserved, size_t guard) {
+    size_t align = g_memory->pages == MEMORY_PAGES_DEFAULT ? (size_t) sysconf(_SC_PAGESIZE) : MEMORY_HUGE_PAGE;
+
+    host_memory_t *mem = calloc(1, sizeof(host_memory_t));
+    if(!mem) {
+        return NULL;
+    }
+
+    mem->reserved = reserved;
+    mem->guard = guard;
+    mem->mapping_size = reserved + guard + (align > (size_t) sysconf(_SC_PAGESIZE) ? align : 0);
+    mem->mapping = mmap(NULL, mem->mapping_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(mem->mapping == MAP_FAILED) {
+        free(mem);
+        return NULL;
+    }
+
+    mem->base = (uint8_t *) round_up((size_t) mem->mapping, align);
+
+    return mem;
+}
+
+
+/**
+ * @brief Make [size, new_size) accessible. With explicit hugepages every
+ *        fully covered 2 MiB chunk is remapped with MAP_HUGETLB, the tail stays
+ *        on 4 KiB pages so accesses past new_size still fault
+ *
+ * @return 0 when successful, else -1
+ */
+static int memory_commit(host_memory_t *mem, size_t new_size) {
+    size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+    size_t hugetlb_end = round_down(new_size, MEMORY_HUGE_PAGE);
+
+    if(g_memory->pages == MEMORY_PAGES_EXPLICIT && !mem->hugetlb_failed && hugetlb_end > mem->hugetlb_end) {
+        uint8_t *start = mem->base + mem->hugetlb_end;
+        size_t len = hugetlb_end - mem->hugetlb_end;
+
+        // The 4 KiB tail below the old size holds data, at most one hugepage
+        size_t keep = mem->size > mem->hugetlb_end ? mem->size - mem->hugetlb_end : 0;
+        uint8_t *saved = NULL;
+        if(keep > 0) {
+            saved = malloc(keep);
+            if(!saved) {
+                return -1;
+            }
+            memcpy(saved, start, keep);
+        }
+
+        bool huge = mmap(start, len, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB, -1, 0) != MAP_FAILED;
+        if(!huge && mmap(start, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED) {
+            free(saved);
+            return -1;
+        }
+
+        memory_apply_policy(mem, start, len);
+
+        if(keep > 0) {
+            memcpy(start, saved, keep);
+            free(saved);
+        }
+
+        // The new mapping dropped the lock of the replaced tail
+        if(mem->locked_end > mem->hugetlb_end) {
+            pthread_mutex_lock(&g_memory->lock);
+            g_memory->stats.locked_bytes -= mem->locked_end - mem->hugetlb_end;
+            pthread_mutex_unlock(&g_memory->lock);
+            mem->locked_end = mem->hugetlb_end;
+        }
+
+        pthread_mutex_lock(&g_memory->lock);
+        if(huge) {
+            mem->hugetlb_end = hugetlb_end;
+            g_memory->stats.hugetlb_bytes += len;
+        } else {
+            mem->hugetlb_failed = true;
+            g_memory->stats.hugetlb_fallbacks++;
+        }
+        pthread_mutex_unlock(&g_memory->lock);
+    }
+
+    size_t from = round_up(mem->size > mem->hugetlb_end ? mem->size : mem->hugetlb_end, page_size);
+    size_t to = round_up(new_size, page_size);
+
+    if(to > from && mprotect(mem->base + from, to - from, PROT_READ | PROT_WRITE) != 0) {
+        return -1;
+    }
+
+    if(g_memory->mlock) {
+        memory_lock(mem, to);
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Move a memory that outgrew its reservation into a new one of twice
+ *        new_size, at least new_size plus the growth headroom. The accessible
+ *        pages are moved with mremap, explicit hugepages or a range mremap
+ *        rejects are copied. mem keeps its address, Wasmtime holds it as env
+ *
+ * @return 0 when successful, else -1 and the memory is unchanged
+ */
+static int memory_move(host_memory_t *mem, size_t new_size) {
+    wasm_memory_creator_state_t *state = g_memory;
+    size_t align = state->pages == MEMORY_PAGES_DEFAULT ? (size_t) sysconf(_SC_PAGESIZE) : MEMORY_HUGE_PAGE;
+    size_t used = round_up(mem->size, (size_t) sysconf(_SC_PAGESIZE));
+
+    // At least doubles, a memory growing page by page moves a logarithmic number of times
+    size_t headroom = new_size > state->growth ? new_size : state->growth;
+    host_memory_t *moved = memory_reserve(round_up(new_size + headroom, align), mem->guard);
+    if(moved == NULL) {
+        return -1;
+    }
+    moved->node = mem->node;
+    moved->hugetlb_failed = mem->hugetlb_failed;
+    memory_apply_policy(moved, moved->base, moved->reserved);
+
+    // Page tables move along, locked pages stay locked
+    bool remapped = used > 0 && mem->hugetlb_end == 0
+                    && mremap(mem->base, used, used, MREMAP_MAYMOVE | MREMAP_FIXED, moved->base) != MAP_FAILED;
+    if(remapped) {
+        moved->size = mem->size;
+        moved->locked_end = mem->locked_end;
+    } else if(memory_commit(moved, mem->size) == 0) {
+        memcpy(moved->base, mem->base, mem->size);
+        moved->size = mem->size;
+    } else {
+        pthread_mutex_lock(&state->lock);
+        state->stats.hugetlb_bytes -= moved->hugetlb_end;
+        state->stats.locked_bytes -= moved->locked_end;
+        pthread_mutex_unlock(&state->lock);
+        munmap(moved->mapping, moved->mapping_size);
+        free(moved);
+        return -1;
+    }
+
+    // The old mapping is gone, so is what it had backed and locked
+    pthread_mutex_lock(&state->lock);
+    state->stats.hugetlb_bytes -= mem->hugetlb_end;
+    if(!remapped) {
+        state->stats.locked_bytes -= mem->locked_end;
+    }
+    state->stats.memories_moved++;
+    pthread_mutex_unlock(&state->lock);
+    munmap(mem->mapping, mem->mapping_size);
+
+    mem->mapping = moved->mapping;
+    mem->mapping_size = moved->mapping_size;
+    mem->base = moved->base;
+    mem->reserved = moved->reserved;
+    mem->hugetlb_end = moved->hugetlb_end;
+    mem->hugetlb_failed = moved->hugetlb_failed;
+    mem->locked_end = moved->locked_end;
+    free(moved);
+
+    return 0;
+}
+
+
+/**
+ * @brief Fault in and mlock [locked_end, end), a guest touching new pages then
+ *        never waits for the kernel. A failure leaves the pages unlocked
+ */
+static void memory_lock(host_memory_t *mem, size_t end) {
+    if(end <= mem->locked_end) {
+        return;
+    }
+
+    bool locked = mlock(mem->base + mem->locked_end, end - mem->locked_end) == 0;
+
+    pthread_mutex_lock(&g_memory->lock);
+    if(locked) {
+        g_memory->stats.locked_bytes += end - mem->locked_end;
+    } else {
+        g_memory->stats.lock_errors++;
+    }
+    pthread_mutex_unlock(&g_memory->lock);
+
+    if(locked) {
+        mem->locked_end = end;
+    }
+}
+
+
+/**
+ * @brief Wasmtime's new_memory callback. Reuses a released reservation of the
+ *        same shape before mapping a new one. Must be thread-safe
+ */
+static wasmtime_error_t *memory_new(void *env, const wasm_memorytype_t *ty, size_t minimum, size_t maximum,
+                                    size_t reserved_size, size_t guard_size, wasmtime_linear_memory_t *memory_ret) {
+    wasm_memory_creator_state_t *state = env;
+    (void) ty;
+
+    if(t_limit != NULL && t_limit->max_size > 0 && minimum > t_limit->max_size) {
+        t_limit->hit = true;
+        return wasmtime_error_new("linear memory minimum exceeds the memory limit");
+    }
+
+    size_t align = state->pages == MEMORY_PAGES_DEFAULT ? (size_t) sysconf(_SC_PAGESIZE) : MEMORY_HUGE_PAGE;
+
+    // A reserved size means the memory must never move, else we pick one and move it when it is outgrown
+    size_t reserved = reserved_size;
+    if(reserved == 0) {
+        size_t budget = state->growth > 0 ? minimum + state->growth : MEMORY_DEFAULT_RESERVATION;
+        reserved = maximum < budget ? maximum : budget;
+        if(reserved < minimum) {
+            reserved = minimum;
+        }
+    }
+    reserved = round_up(reserved, align);
+    guard_size = round_up(guard_size, (size_t) sysconf(_SC_PAGESIZE));
+
+    host_memory_t *mem = NULL;
+
+    pthread_mutex_lock(&state->lock);
+    for(host_memory_t **it = &state->free_list; *it != NULL; it = &(*it)->next) {
+        if((*it)->reserved == reserved && (*it)->guard == guard_size) {
+            mem = *it;
+            *it = mem->next;
+            state->free_count--;
+            state->stats.reservations_reused++;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&state->lock);
+
+    if(mem == NULL) {
+        mem = memory_reserve(reserved, guard_size);
+        if(mem == NULL) {
+            return wasmtime_error_new("failed to reserve linear memory");
+        }
+    }
+
+    mem->next = NULL;
+    mem->movable = reserved_size == 0;
+    mem->limit = t_limit;
+    mem->node = memory_current_node();
+    memory_apply_policy(mem, mem->base, mem->reserved);
+
+    if(memory_commit(mem, minimum) != 0) {
+        munmap(mem->mapping, mem->mapping_size);
+        free(mem);
+        return wasmtime_error_new("failed to commit linear memory");
+    }
+    mem->size = minimum;
+
+    pthread_mutex_lock(&state->lock);
+    state->stats.memories_created++;
+    state->stats.memories_live++;
+    pthread_mutex_unlock(&state->lock);
+
+    memory_ret->env = mem;
+    memory_ret->get_memory = memory_get;
+    memory_ret->grow_memory = memory_grow;
+    memory_ret->finalizer = memory_release;
+
+    return NULL;
+}
+
+
+/**
+ * @brief Base, accessible size and the size reachable without moving
+ */
+static uint8_t *memory_get(void *env, size_t *byte_size, size_t *byte_capacity) {
+    host_memory_t *mem = env;
+    *byte_size = mem->size;
+    *byte_capacity = mem->reserved;
+    return mem->base;
+}
+
+
+/**
+ * @brief memory.grow, Wasmtime has already checked the maximum. A grow past
+ *        the partition's limit is recorded, the guest sees -1
+ */
+static wasmtime_error_t *memory_grow(void *env, size_t new_size) {
+    host_memory_t *mem = env;
+
+    if(mem->limit != NULL && mem->limit->max_size > 0 && new_size > mem->limit->max_size) {
+        mem->limit->hit = true;
+        return wasmtime_error_new("linear memory grows beyond the memory limit");
+    }
+
+    if(new_size > mem->reserved && (!mem->movable || memory_move(mem, new_size) != 0)) {
+        return wasmtime_error_new("linear memory grows beyond its reservation");
+    }
+
+    if(memory_commit(mem, new_size) != 0) {
+        return wasmtime_error_new("failed to commit linear memory");
+    }
+    mem->size = new_size;
+
+    return NULL;
+}
+
+
+/**
+ * @brief Finalizer of a memory. Pages are dropped, the address space is kept
+ *        for the next memory of the same shape
+ */
+static void memory_release(void *env) {
+    host_memory_t *mem = env;
+    wasm_memory_creator_state_t *state = g_memory;
+    size_t used = round_up(mem->size, (size_t) sysconf(_SC_PAGESIZE));
+
+    // Replacing the mapping frees the pages and hands out zeroes on reuse
+    bool reset = used == 0 || mmap(mem->base, used, PROT_NONE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0) != MAP_FAILED;
+
+    pthread_mutex_lock(&state->lock);
+    state->stats.memories_live--;
+    state->stats.hugetlb_bytes -= mem->hugetlb_end;
+    state->stats.locked_bytes -= mem->locked_end;
+    mem->locked_end = 0;
+
+    if(reset && state->free_count < MEMORY_MAX_CACHED) {
+        mem->size = 0;
+        mem->limit = NULL;
+        mem->hugetlb_end = 0;
+        mem->hugetlb_failed = false;
+        mem->next = state->free_list;
+        state->free_list = mem;
+        state->free_count++;
+        mem = NULL;
+    }
+    pthread_mutex_unlock(&state->lock);
+
+    if(mem != NULL) {
+        munmap(mem->mapping, mem->mapping_size);
+        free(mem);
+    }
+}
+
+
+/****************************************************************************
+ * Function Implementations
+****************************************************************************/
+
+/**
+ * @brief Register the host memory creator for linear memories
+ *
+ * @param config Config the memory creator is set on
+ * @param pages Page size used to back linear memories
+ * @param numa_bind Bind each memory to the NUMA node of the instantiating thread
+ * @param lock Prefault and mlock the accessible part of every memory
+ * @param growth Bytes reserved past the minimum of memories Wasmtime lets move,
+ *        0 for MEMORY_DEFAULT_RESERVATION. Growing further moves them
+ * @return 0 when successful, else -1
+ */
+int wasm_memory_init(wasm_config_t *config, wasm_memory_page_mode_t pages, bool numa_bind, bool lock, size_t growth) {
+
+    if(g_memory != NULL) {
+        printf("Memory creator already initialised\n");
+        return -1;
+    }
+
+    wasm_memory_creator_state_t *state = calloc(1, sizeof(wasm_memory_creator_state_t));
+    if(!state) {
+        printf("Memory allocation failed!\n");
+        return -1;
+    }
+
+    state->pages = pages;
+    state->numa_bind = numa_bind;
+    state->mlock = lock;
+    state->growth = growth;
+    pthread_mutex_init(&state->lock, NULL);
+    g_memory = state;
+
+    return wasm_memory_attach(config);
+}
+
+
+/**
+ * @brief Register the existing memory creator on another config, engines
+ *        built from both allocate through it
+ *
+ * @param config Config the memory creator is set on
+ * @return 0 when successful, -1 without a memory creator
+ */
+int wasm_memory_attach(wasm_config_t *config) {
+
+    if(g_memory == NULL) {
+        return -1;
+    }
+
+    wasmtime_memory_creator_t creator = {
+        .env = g_memory,
+        .new_memory = memory_new,
+        .finalizer = NULL
+    };
+    wasmtime_config_host_memory_creator_set(config, &creator);
+
+    // Copy-on-write images of data segments need Wasmtime's own mmap memories
+    wasmtime_config_memory_init_cow_set(config, false);
+
+    return 0;
+}
+
+
+/**
+ * @brief Limit of the memories the calling thread creates from now on. The
+ *        memory creator checks it on creation and on every grow, Wasmtime's
+ *        store limiter has no callback to tell a denied grow apart
+ *
+ * @param limit Must outlive the memories, NULL for none
+ */
+void wasm_memory_limit_enter(wasm_memory_limit_t *limit) {
+    t_limit = limit;
+}
+
+
+/**
+ * @brief Whether linear memories come from the memory creator
+ */
+bool wasm_memory_enabled(void) {
+    return g_memory != NULL;
+}
+
+
+/**
+ * @brief Address space layout of a budget preset. MEMORY_BUDGET_CUSTOM keeps
+ *        the given values
+ *
+ * @param budget Preset
+ * @param reservation In/out, bytes reserved per memory, 0 to allocate the exact size
+ * @param guard_size In/out, guard bytes after each memory
+ * @param growth In/out, bytes reserved past the size of memories that may move
+ * @return 0 when successful, -1 for MEMORY_BUDGET_DEFAULT or an unknown preset
+ */
+int wasm_memory_budget_preset(wasm_memory_budget_t budget, uint64_t *reservation, uint64_t *guard_size, uint64_t *growth) {
+
+    switch(budget) {
+        case MEMORY_BUDGET_MANY_SMALL:
+            *reservation = MEMORY_SMALL_RESERVATION;
+            *guard_size = MEMORY_SMALL_GUARD;
+            *growth = MEMORY_SMALL_GROWTH;
+            return 0;
+        case MEMORY_BUDGET_FEW_LARGE:
+            *reservation = MEMORY_LARGE_RESERVATION;
+            *guard_size = MEMORY_LARGE_GUARD;
+            *growth = MEMORY_LARGE_GROWTH;
+            return 0;
+        case MEMORY_BUDGET_CUSTOM:
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+
+/**
+ * @brief Current memory creator statistics, zeroed when not in use
+ *
+ * @param stats Output
+ */
+void wasm_memory_stats(wasm_memory_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+
+    wasm_memory_creator_state_t *state = g_memory;
+    if(state == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&state->lock);
+    *stats = state->stats;
+    pthread_mutex_unlock(&state->lock);
+}
+
+
+/**
+ * @brief Unmap cached reservations. Every store must have been deleted
+ */
+void wasm_memory_destroy(void) {
+    wasm_memory_creator_state_t *state = g_memory;
+    if(state == NULL) {
+        return;
+    }
+
+    if(state->stats.memories_live != 0) {
+        printf("Memory creator destroyed with %lu memories in use\n", state->stats.memories_live);
+    }
+
+    host_memory_t *mem = state->free_list;
+    while(mem != NULL) {
+        host_memory_t *next = mem->next;
+        munmap(mem->mapping, mem->mapping_size);
+        free(mem);
+        mem = next;
+    }
+
+    pthread_mutex_destroy(&state->lock);
+    free(state);
+    g_memory = NULL;
+}
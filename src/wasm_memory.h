@@ -0,0 +1,148 @@
+/*
+ * wasm_memory.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+#ifndef WASM_MEMORY_H
+#define WASM_MEMORY_H
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wasm.h>
+#include <wasmtime.h>
+
+
+/****************************************************************************
+ * Defines
+****************************************************************************/
+#define MEMORY_HUGE_PAGE            (2ull * 1024 * 1024)
+#define MEMORY_DEFAULT_RESERVATION  (4ull * 1024 * 1024 * 1024)    // For memories Wasmtime lets move
+#define MEMORY_MAX_CACHED           16                              // Released reservations kept for reuse
+#define MEMORY_MAX_NODES            1024
+
+// MEMORY_BUDGET_MANY_SMALL: exact-size memories that move when they outgrow the headroom
+#define MEMORY_SMALL_RESERVATION    0ull
+#define MEMORY_SMALL_GUARD          (64ull * 1024)
+#define MEMORY_SMALL_GROWTH         (1ull * 1024 * 1024)
+
+// MEMORY_BUDGET_FEW_LARGE: 4 GiB plus a 2 GiB guard, memories never move and need no bounds checks
+#define MEMORY_LARGE_RESERVATION    (4ull * 1024 * 1024 * 1024)
+#define MEMORY_LARGE_GUARD          (2ull * 1024 * 1024 * 1024)
+#define MEMORY_LARGE_GROWTH         0ull
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+typedef enum {
+    MEMORY_PAGES_DEFAULT = 0,   // 4 KiB pages, the kernel may still use THP if set to "always"
+    MEMORY_PAGES_TRANSPARENT,   // madvise(MADV_HUGEPAGE)
+    MEMORY_PAGES_EXPLICIT       // MAP_HUGETLB, needs vm.nr_hugepages, falls back to 4 KiB pages
+} wasm_memory_page_mode_t;
+
+// Address space each linear memory takes
+typedef enum {
+    MEMORY_BUDGET_DEFAULT = 0,  // Wasmtime's defaults, 4 GiB reservation plus 32 MiB guard
+    MEMORY_BUDGET_MANY_SMALL,   // Thousands of partitions with small memories
+    MEMORY_BUDGET_FEW_LARGE,    // Few partitions, fastest memory access
+    MEMORY_BUDGET_CUSTOM        // The reservation, guard and growth given by the caller
+} wasm_memory_budget_t;
+
+// Memory limit of a partition, the memories created for it keep a pointer
+typedef struct wasm_memory_limit {
+    uint64_t max_size;              // Bytes per memory, 0 for none
+    bool hit;                       // A memory was denied its size, cleared by the owner
+} wasm_memory_limit_t;
+
+typedef struct wasm_memory_stats {
+    uint64_t memories_created;
+    uint64_t memories_live;
+    uint64_t reservations_reused;   // Memories served from a released reservation
+    uint64_t memories_moved;        // Grows past the reservation that moved a memory
+    uint64_t hugetlb_bytes;         // Currently backed by explicit hugepages
+    uint64_t hugetlb_fallbacks;     // Explicit hugepage mappings that fell back to 4 KiB pages
+    uint64_t numa_bind_errors;
+    uint64_t locked_bytes;          // Currently mlocked
+    uint64_t lock_errors;           // mlock failures, usually RLIMIT_MEMLOCK
+} wasm_memory_stats_t;
+
+
+/****************************************************************************
+ * Function Prototypes
+****************************************************************************/
+
+/**
+ * @brief Register the host memory creator for linear memories
+ *
+ * @param config Config the memory creator is set on
+ * @param pages Page size used to back linear memories
+ * @param numa_bind Bind each memory to the NUMA node of the instantiating thread
+ * @param lock Prefault and mlock the accessible part of every memory
+ * @param growth Bytes reserved past the minimum of memories Wasmtime lets move,
+ *        0 for MEMORY_DEFAULT_RESERVATION. Growing further moves them
+ * @return 0 when successful, else -1
+ */
+int wasm_memory_init(wasm_config_t *config, wasm_memory_page_mode_t pages, bool numa_bind, bool lock, size_t growth);
+
+
+/**
+ * @brief Address space layout of a budget preset. MEMORY_BUDGET_CUSTOM keeps
+ *        the given values
+ *
+ * @param budget Preset
+ * @param reservation In/out, bytes reserved per memory, 0 to allocate the exact size
+ * @param guard_size In/out, guard bytes after each memory
+ * @param growth In/out, bytes reserved past the size of memories that may move
+ * @return 0 when successful, -1 for MEMORY_BUDGET_DEFAULT or an unknown preset
+ */
+int wasm_memory_budget_preset(wasm_memory_budget_t budget, uint64_t *reservation, uint64_t *guard_size, uint64_t *growth);
+
+
+/**
+ * @brief Register the existing memory creator on another config, engines
+ *        built from both allocate through it
+ *
+ * @param config Config the memory creator is set on
+ * @return 0 when successful, -1 without a memory creator
+ */
+int wasm_memory_attach(wasm_config_t *config);
+
+
+/**
+ * @brief Limit of the memories the calling thread creates from now on. The
+ *        memory creator checks it on creation and on every grow, Wasmtime's
+ *        store limiter has no callback to tell a denied grow apart
+ *
+ * @param limit Must outlive the memories, NULL for none
+ */
+void wasm_memory_limit_enter(wasm_memory_limit_t *limit);
+
+
+/**
+ * @brief Whether linear memories come from the memory creator
+ */
+bool wasm_memory_enabled(void);
+
+
+/**
+ * @brief Current memory creator statistics, zeroed when not in use
+ *
+ * @param stats Output
+ */
+void wasm_memory_stats(wasm_memory_stats_t *stats);
+
+
+/**
+ * @brief Unmap cached reservations. Every store must have been deleted
+ */
+void wasm_memory_destroy(void);
+
+
+#endif // WASM_MEMORY_H
@@ -0,0 +1,538 @@
+/*
+ * wasm_port.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+// ARINC 653 Part 1, queuing and sampling ports
+// Queuing ports are single-producer/single-consumer rings. A partition that
+// cannot proceed publishes itself as the port's parked receiver or sender and
+// stays blocked until the other side hands it a message or a free slot
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include "wasm_port.h"
+#include "wasm_api.h"
+#include "wasm_host.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+typedef enum {
+    PORT_QUEUING,
+    PORT_SAMPLING
+} port_kind_t;
+
+typedef enum {
+    PORT_OP_ID,
+    PORT_OP_SEND,
+    PORT_OP_RECEIVE,
+    PORT_OP_WRITE,
+    PORT_OP_READ
+} port_op_t;
+
+// A blocked call, owned by whoever takes it out of the port
+typedef struct port_waiter {
+    wasm_host_call_t *call;
+    uint8_t *buffer;                // Guest memory of the parked partition
+    uint32_t len;                   // Message length of a sender
+} port_waiter_t;
+
+typedef struct port {
+    char name[PORT_MAX_NAME];
+    port_kind_t kind;
+    int source;
+    int destination;                // -1 for sampling ports
+    uint32_t max_message;
+    uint32_t depth;                 // Power of two
+    size_t stride;                  // Length prefix + max_message
+    uint8_t *slots;
+
+    _Alignas(64) _Atomic uint32_t head;     // Consumer
+    _Alignas(64) _Atomic uint32_t tail;     // Producer
+    _Alignas(64) _Atomic(port_waiter_t *) receiver;
+    _Atomic(port_waiter_t *) sender;
+    port_waiter_t receiver_slot;
+    port_waiter_t sender_slot;
+
+    _Atomic uint32_t sequence;      // Sampling seqlock, odd while writing
+} port_t;
+
+
+/****************************************************************************
+ * Port state
+****************************************************************************/
+static port_t *g_ports[PORT_MAX_PORTS];
+static int g_port_count = 0;
+static bool g_port_registered = false;
+
+static _Atomic uint64_t g_port_messages = 0;
+static _Atomic uint64_t g_port_bytes = 0;
+static _Atomic uint64_t g_port_direct = 0;
+static _Atomic uint64_t g_port_parked_receivers = 0;
+static _Atomic uint64_t g_port_parked_senders = 0;
+static _Atomic uint64_t g_port_samples_written = 0;
+static _Atomic uint64_t g_port_samples_read = 0;
+
+
+/****************************************************************************
+ * Static Function Prototypes
+****************************************************************************/
+static int port_register(void);
+static int port_create(const char *name, port_kind_t kind, uint32_t max_message, uint32_t depth,
+                       int source, int destination);
+static uint8_t *port_slot(port_t *port, uint32_t index);
+static void port_push(port_t *port, const uint8_t *message, uint32_t len);
+static uint32_t port_pop(port_t *port, uint8_t *buffer);
+static void port_wake_sender(port_t *port);
+static void port_complete(port_waiter_t *waiter, int32_t result);
+static int32_t port_send(port_t *port, uint8_t *buffer, uint32_t len, wasm_host_call_t *call);
+static int32_t port_receive(port_t *port, uint8_t *buffer, wasm_host_call_t *call);
+static int32_t port_write(port_t *port, const uint8_t *buffer, uint32_t len);
+static int32_t port_read(port_t *port, uint8_t *buffer, uint32_t cap);
+static int port_submit(void *env, wasmtime_caller_t *caller, const wasmtime_val_t *params, size_t nparams,
+                       wasm_host_call_t *call);
+
+
+/****************************************************************************
+ * Static Function Implementations
+****************************************************************************/
+
+/**
+ * @brief Define the port host module on first use
+ */
+static int port_register(void) {
+    const wasm_valkind_t i32x3[] = { WASM_I32, WASM_I32, WASM_I32 };
+    const wasm_valkind_t result[] = { WASM_I32 };
+
+    if(g_port_registered) {
+        return 0;
+    }
+
+    if(wasm_host_define_submit("port", "id", i32x3, 2, result, 1, port_submit, (void *) (uintptr_t) PORT_OP_ID) != 0
+       || wasm_host_define_submit("port", "send", i32x3, 3, result, 1, port_submit, (void *) (uintptr_t) PORT_OP_SEND) != 0
+       || wasm_host_define_submit("port", "receive", i32x3, 3, result, 1, port_submit, (void *) (uintptr_t) PORT_OP_RECEIVE) != 0
+       || wasm_host_define_submit("port", "write", i32x3, 3, result, 1, port_submit, (void *) (uintptr_t) PORT_OP_WRITE) != 0
+       || wasm_host_define_submit("port", "read", i32x3, 3, result, 1, port_submit, (void *) (uintptr_t) PORT_OP_READ) != 0) {
+        return -1;
+    }
+
+    g_port_registered = true;
+    return 0;
+}
+
+
+static int port_create(const char *name, port_kind_t kind, uint32_t max_message, uint32_t depth,
+                       int source, int destination) {
+
+    if(g_port_count >= PORT_MAX_PORTS || strlen(name) >= PORT_MAX_NAME
+       || max_message == 0 || max_message > PORT_MAX_MESSAGE || depth == 0 || depth > (1u << 16)) {
+        printf("Cannot create port %s\n", name);
+        return -1;
+    }
+
+    for(int i = 0; i < g_port_count; i++) {
+        if(strcmp(g_ports[i]->name, name) == 0) {
+            printf("Port %s already exists\n", name);
+            return -1;
+        }
+    }
+
+    if(port_register() != 0) {
+        return -1;
+    }
+
+    uint32_t slots = 1;
+    while(slots < depth) {
+        slots <<= 1;
+    }
+
+    port_t *port = aligned_alloc(64, (sizeof(port_t) + 63) & ~(size_t) 63);
+    if(!port) {
+        printf("Memory allocation failed!\n");
+        return -1;
+    }
+    memset(port, 0, sizeof(port_t));
+
+    // Length prefix keeps the payload 8 byte aligned
+    port->stride = sizeof(uint64_t) + ((max_message + 7) & ~7u);
+    port->slots = malloc(port->stride * slots);
+    if(!port->slots) {
+        printf("Memory allocation failed!\n");
+        free(port);
+        return -1;
+    }
+
+    strcpy(port->name, name);
+    port->kind = kind;
+    port->source = source;
+    port->destination = destination;
+    port->max_message = max_message;
+    port->depth = slots;
+    atomic_init(&port->head, 0);
+    atomic_init(&port->tail, 0);
+    atomic_init(&port->receiver, NULL);
+    atomic_init(&port->sender, NULL);
+    atomic_init(&port->sequence, 0);
+
+    g_ports[g_port_count] = port;
+    return g_port_count++;
+}
+
+
+static uint8_t *port_slot(port_t *port, uint32_t index) {
+    return port->slots + (size_t) (index & (port->depth - 1)) * port->stride;
+}
+
+
+/**
+ * @brief Append a message, the caller is the producer and the ring has room
+ */
+static void port_push(port_t *port, const uint8_t *message, uint32_t len) {
+    uint32_t tail = atomic_load_explicit(&port->tail, memory_order_relaxed);
+    uint8_t *slot = port_slot(port, tail);
+
+    *(uint32_t *) slot = len;
+    memcpy(slot + sizeof(uint64_t), message, len);
+    atomic_store(&port->tail, tail + 1);
+}
+
+
+/**
+ * @brief Remove the oldest message, the caller is the consumer and the ring
+ *        is not empty
+ *
+ * @return Message length
+ */
+static uint32_t port_pop(port_t *port, uint8_t *buffer) {
+    uint32_t head = atomic_load_explicit(&port->head, memory_order_relaxed);
+    uint8_t *slot = port_slot(port, head);
+    uint32_t len = *(uint32_t *) slot;
+
+    memcpy(buffer, slot + sizeof(uint64_t), len);
+    atomic_store(&port->head, head + 1);
+
+    atomic_fetch_add_explicit(&g_port_messages, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&g_port_bytes, len, memory_order_relaxed);
+
+    return len;
+}
+
+
+static void port_complete(port_waiter_t *waiter, int32_t result) {
+    wasm_host_call_results(waiter->call)[0].of.i32 = result;
+    wasm_host_complete(waiter->call);
+}
+
+
+/**
+ * @brief After a pop, move a parked sender's message into the freed slot
+ */
+static void port_wake_sender(port_t *port) {
+    port_waiter_t *sender = atomic_exchange(&port->sender, NULL);
+
+    if(sender != NULL) {
+        port_push(port, sender->buffer, sender->len);
+        port_complete(sender, 0);
+    }
+}
+
+
+/**
+ * @brief Producer side of a queuing port
+ *
+ * @return 0 when delivered inline, -1 when parked
+ */
+static int32_t port_send(port_t *port, uint8_t *buffer, uint32_t len, wasm_host_call_t *call) {
+
+    // A parked receiver normally saw the ring empty, then the message goes
+    // straight into its memory. Taking it makes this side the consumer
+    port_waiter_t *receiver = atomic_load(&port->receiver);
+    if(receiver != NULL && (receiver = atomic_exchange(&port->receiver, NULL)) != NULL) {
+        if(atomic_load(&port->tail) != atomic_load(&port->head)) {
+            port_complete(receiver, (int32_t) port_pop(port, receiver->buffer));
+            port_push(port, buffer, len);
+            return 0;
+        }
+        memcpy(receiver->buffer, buffer, len);
+        atomic_fetch_add_explicit(&g_port_messages, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&g_port_bytes, len, memory_order_relaxed);
+        atomic_fetch_add_explicit(&g_port_direct, 1, memory_order_relaxed);
+        port_complete(receiver, (int32_t) len);
+        return 0;
+    }
+
+    if(atomic_load(&port->tail) - atomic_load(&port->head) >= port->depth) {
+        port->sender_slot.call = call;
+        port->sender_slot.buffer = buffer;
+        port->sender_slot.len = len;
+        atomic_store(&port->sender, &port->sender_slot);
+        atomic_fetch_add_explicit(&g_port_parked_senders, 1, memory_order_relaxed);
+
+        // The receiver may have drained the ring before seeing us parked
+        if(atomic_load(&port->tail) - atomic_load(&port->head) >= port->depth
+           || atomic_exchange(&port->sender, NULL) == NULL) {
+            return -1;
+        }
+    }
+
+    port_push(port, buffer, len);
+
+    // The receiver may have parked before seeing the message
+    receiver = atomic_exchange(&port->receiver, NULL);
+    if(receiver != NULL) {
+        port_complete(receiver, (int32_t) port_pop(port, receiver->buffer));
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Consumer side of a queuing port, buffer holds max_message bytes
+ *
+ * @return Message length when received inline, -1 when parked
+ */
+static int32_t port_receive(port_t *port, uint8_t *buffer, wasm_host_call_t *call) {
+
+    if(atomic_load(&port->tail) == atomic_load(&port->head)) {
+        port->receiver_slot.call = call;
+        port->receiver_slot.buffer = buffer;
+        port->receiver_slot.len = 0;
+        atomic_store(&port->receiver, &port->receiver_slot);
+        atomic_fetch_add_explicit(&g_port_parked_receivers, 1, memory_order_relaxed);
+
+        // The sender may have pushed before seeing us parked
+        if(atomic_load(&port->tail) == atomic_load(&port->head)
+           || atomic_exchange(&port->receiver, NULL) == NULL) {
+            return -1;
+        }
+    }
+
+    int32_t len = (int32_t) port_pop(port, buffer);
+    port_wake_sender(port);
+
+    return len;
+}
+
+
+/**
+ * @brief Replace the message of a sampling port, readers retry while the
+ *        sequence is odd or changed under them
+ */
+static int32_t port_write(port_t *port, const uint8_t *buffer, uint32_t len) {
+    uint32_t sequence = atomic_load_explicit(&port->sequence, memory_order_relaxed);
+
+    atomic_store_explicit(&port->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    *(uint32_t *) port->slots = len;
+    memcpy(port->slots + sizeof(uint64_t), buffer, len);
+    atomic_store_explicit(&port->sequence, sequence + 2, memory_order_release);
+
+    atomic_fetch_add_explicit(&g_port_samples_written, 1, memory_order_relaxed);
+    return 0;
+}
+
+
+static int32_t port_read(port_t *port, uint8_t *buffer, uint32_t cap) {
+    uint32_t before;
+    uint32_t len;
+
+    do {
+        before = atomic_load_explicit(&port->sequence, memory_order_acquire);
+        if(before == 0) {
+            return -EAGAIN;
+        }
+        len = *(volatile uint32_t *) port->slots;
+        if(len > cap) {
+            len = cap;
+        }
+        memcpy(buffer, port->slots + sizeof(uint64_t), len);
+        atomic_thread_fence(memory_order_acquire);
+    } while((before & 1) || atomic_load_explicit(&port->sequence, memory_order_relaxed) != before);
+
+    atomic_fetch_add_explicit(&g_port_samples_read, 1, memory_order_relaxed);
+    return (int32_t) len;
+}
+
+
+/**
+ * @brief Submit callback of all port functions, env is the operation.
+ *        Completes inline unless the partition has to be parked
+ */
+static int port_submit(void *env, wasmtime_caller_t *caller, const wasmtime_val_t *params, size_t nparams,
+                       wasm_host_call_t *call) {
+    port_op_t op = (port_op_t) (uintptr_t) env;
+    wasm_partition_t *partition = wasmtime_context_get_data(wasmtime_caller_context(caller));
+    wasmtime_val_t *result = &wasm_host_call_results(call)[0];
+    (void) nparams;
+
+    if(op == PORT_OP_ID) {
+        uint32_t len = (uint32_t) params[1].of.i32;
+        uint8_t *name = wasm_host_guest_buffer(caller, (uint32_t) params[0].of.i32, len);
+        if(name == NULL) {
+            return -1;
+        }
+
+        result->of.i32 = -ENOENT;
+        for(int i = 0; i < g_port_count; i++) {
+            if(strlen(g_ports[i]->name) == len && memcmp(g_ports[i]->name, name, len) == 0) {
+                result->of.i32 = i;
+                break;
+            }
+        }
+        return 1;
+    }
+
+    int32_t id = params[0].of.i32;
+    if(id < 0 || id >= g_port_count) {
+        result->of.i32 = -EINVAL;
+        return 1;
+    }
+
+    port_t *port = g_ports[id];
+    uint32_t len = (uint32_t) params[2].of.i32;
+    bool sending = op == PORT_OP_SEND || op == PORT_OP_WRITE;
+    bool queuing = op == PORT_OP_SEND || op == PORT_OP_RECEIVE;
+
+    if(queuing != (port->kind == PORT_QUEUING)) {
+        result->of.i32 = -EINVAL;
+        return 1;
+    }
+    if((sending && partition->partition_id != port->source)
+       || (op == PORT_OP_RECEIVE && partition->partition_id != port->destination)) {
+        result->of.i32 = -EPERM;
+        return 1;
+    }
+    if((sending && len > port->max_message) || (op == PORT_OP_RECEIVE && len < port->max_message)) {
+        result->of.i32 = -EMSGSIZE;
+        return 1;
+    }
+
+    uint8_t *buffer = wasm_host_guest_buffer(caller, (uint32_t) params[1].of.i32, len);
+    if(buffer == NULL) {
+        return -1;
+    }
+
+    switch(op) {
+        case PORT_OP_SEND:
+            result->of.i32 = port_send(port, buffer, len, call);
+        break;
+
+        case PORT_OP_RECEIVE:
+            result->of.i32 = port_receive(port, buffer, call);
+        break;
+
+        case PORT_OP_WRITE:
+            result->of.i32 = port_write(port, buffer, len);
+        break;
+
+        default:
+            result->of.i32 = port_read(port, buffer, len);
+        break;
+    }
+
+    // Parked, completed by the other side of the port
+    if(queuing && result->of.i32 == -1) {
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/****************************************************************************
+ * Function Implementations
+****************************************************************************/
+
+/**
+ * @brief Create a queuing port, a bounded FIFO from one partition to another.
+ *        The first port registers the port host module, so ports must exist
+ *        before their partitions are loaded
+ *
+ * @param name Port name, looked up by port.id
+ * @param max_message Largest message in bytes, receive buffers must hold it
+ * @param depth Messages in flight, rounded up to a power of two
+ * @param source Only partition allowed to send
+ * @param destination Only partition allowed to receive
+ * @return Port id, else -1
+ */
+int wasm_port_create_queuing(const char *name, uint32_t max_message, uint32_t depth, int source, int destination) {
+    return port_create(name, PORT_QUEUING, max_message, depth, source, destination);
+}
+
+
+/**
+ * @brief Create a sampling port holding the latest message of one partition.
+ *        Any partition may read it, reads never block
+ *
+ * @param name Port name, looked up by port.id
+ * @param max_message Largest message in bytes
+ * @param source Only partition allowed to write
+ * @return Port id, else -1
+ */
+int wasm_port_create_sampling(const char *name, uint32_t max_message, int source) {
+    return port_create(name, PORT_SAMPLING, max_message, 1, source, -1);
+}
+
+
+/**
+ * @brief Cancel parked calls of a partition before its store is deleted,
+ *        they complete with -ECANCELED
+ */
+void wasm_port_detach(int partition_id) {
+
+    for(int i = 0; i < g_port_count; i++) {
+        port_t *port = g_ports[i];
+        port_waiter_t *waiter;
+
+        if(port->source == partition_id && (waiter = atomic_exchange(&port->sender, NULL)) != NULL) {
+            port_complete(waiter, -ECANCELED);
+        }
+        if(port->destination == partition_id && (waiter = atomic_exchange(&port->receiver, NULL)) != NULL) {
+            port_complete(waiter, -ECANCELED);
+        }
+    }
+}
+
+
+/**
+ * @brief Statistics of all ports
+ *
+ * @param stats Output
+ */
+void wasm_port_stats(wasm_port_stats_t *stats) {
+    stats->messages = atomic_load_explicit(&g_port_messages, memory_order_relaxed);
+    stats->bytes = atomic_load_explicit(&g_port_bytes, memory_order_relaxed);
+    stats->direct = atomic_load_explicit(&g_port_direct, memory_order_relaxed);
+    stats->parked_receivers = atomic_load_explicit(&g_port_parked_receivers, memory_order_relaxed);
+    stats->parked_senders = atomic_load_explicit(&g_port_parked_senders, memory_order_relaxed);
+    stats->samples_written = atomic_load_explicit(&g_port_samples_written, memory_order_relaxed);
+    stats->samples_read = atomic_load_explicit(&g_port_samples_read, memory_order_relaxed);
+}
+
+
+/**
+ * @brief Free all ports. Partitions must have been unloaded
+ */
+void wasm_port_destroy(void) {
+
+    for(int i = 0; i < g_port_count; i++) {
+        free(g_ports[i]->slots);
+        free(g_ports[i]);
+        g_ports[i] = NULL;
+    }
+    g_port_count = 0;
+
+    // wasm_host_shutdown drops the definitions
+    g_port_registered = false;
+}
@@ -0,0 +1,103 @@
+/*
+ * wasm_port.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+#ifndef WASM_PORT_H
+#define WASM_PORT_H
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/****************************************************************************
+ * Defines
+****************************************************************************/
+#define PORT_MAX_PORTS      64
+#define PORT_MAX_NAME       32
+#define PORT_MAX_MESSAGE    (64 * 1024)
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+typedef struct wasm_port_stats {
+    uint64_t messages;              // Delivered through queuing ports
+    uint64_t bytes;
+    uint64_t direct;                // Copied straight into a parked receiver, no slot
+    uint64_t parked_receivers;      // Receives that found the queue empty
+    uint64_t parked_senders;        // Sends that found the queue full
+    uint64_t samples_written;
+    uint64_t samples_read;
+} wasm_port_stats_t;
+
+
+/****************************************************************************
+ * Function Prototypes
+****************************************************************************/
+
+/**
+ * @brief Create a queuing port, a bounded FIFO from one partition to another.
+ *        The first port registers the port host module, so ports must exist
+ *        before their partitions are loaded. Guests import:
+ *
+ *          port.id(name_ptr: i32, name_len: i32) -> port or -ENOENT
+ *          port.send(port: i32, ptr: i32, len: i32) -> 0 or -errno
+ *          port.receive(port: i32, ptr: i32, cap: i32) -> len or -errno
+ *          port.write(port: i32, ptr: i32, len: i32) -> 0 or -errno
+ *          port.read(port: i32, ptr: i32, cap: i32) -> len or -errno
+ *
+ *        send parks the sender while the queue is full, receive parks the
+ *        receiver while it is empty. The guest must export its memory as "memory"
+ *
+ * @param name Port name, looked up by port.id
+ * @param max_message Largest message in bytes, receive buffers must hold it
+ * @param depth Messages in flight, rounded up to a power of two
+ * @param source Only partition allowed to send
+ * @param destination Only partition allowed to receive
+ * @return Port id, else -1
+ */
+int wasm_port_create_queuing(const char *name, uint32_t max_message, uint32_t depth, int source, int destination);
+
+
+/**
+ * @brief Create a sampling port holding the latest message of one partition.
+ *        Any partition may read it, reads never block
+ *
+ * @param name Port name, looked up by port.id
+ * @param max_message Largest message in bytes
+ * @param source Only partition allowed to write
+ * @return Port id, else -1
+ */
+int wasm_port_create_sampling(const char *name, uint32_t max_message, int source);
+
+
+/**
+ * @brief Cancel parked calls of a partition before its store is deleted,
+ *        they complete with -ECANCELED
+ */
+void wasm_port_detach(int partition_id);
+
+
+/**
+ * @brief Statistics of all ports
+ *
+ * @param stats Output
+ */
+void wasm_port_stats(wasm_port_stats_t *stats);
+
+
+/**
+ * @brief Free all ports. Partitions must have been unloaded
+ */
+void wasm_port_destroy(void);
+
+
+#endif // WASM_PORT_H
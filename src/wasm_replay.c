@@ -0,0 +1,522 @@
+/*
+ * wasm_replay.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+// Record/replay of the scheduler. Fuel already makes a partition's slices
+// deterministic, what is left to record is the order of the slices and what
+// external host calls returned. Internal ones (ports, channels) follow from
+// the order and run again during replay. The log is a shared file mapping,
+// appending a record is a store into it, and a crashed process leaves every
+// record it wrote in the page cache
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include "wasm_replay.h"
+#include "wasm_api.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+/****************************************************************************
+ * Defines
+****************************************************************************/
+#define REPLAY_VERSION      1
+
+
+/****************************************************************************
+ * Log state
+****************************************************************************/
+wasm_replay_mode_t g_replay_mode = REPLAY_OFF;
+
+static int g_replay_fd = -1;
+static uint8_t *g_replay_map = NULL;        // Recording: window of the file, replaying: all of it
+static size_t g_replay_map_size = 0;
+static uint64_t g_replay_window = 0;        // File offset of the window
+static uint64_t g_replay_pos = 0;           // File offset of the next record
+static uint64_t g_replay_size = 0;          // Replaying: file size
+static bool g_replay_stopped = false;       // Replaying: end of the log or diverged
+static wasm_replay_stats_t g_replay_stats;
+
+
+/****************************************************************************
+ * Static Function Prototypes
+****************************************************************************/
+static uint8_t *replay_append(size_t size);
+static const wasm_replay_record_t *replay_peek(void);
+static size_t replay_padded(uint64_t size);
+static bool replay_status_matches(int a, int b);
+
+
+/****************************************************************************
+ * Static Function Implementations
+****************************************************************************/
+
+static size_t replay_padded(uint64_t size) {
+    return (size_t) ((size + 7) & ~7ull);
+}
+
+
+/**
+ * @brief Room for size bytes at the end of the log. The window moves in
+ *        REPLAY_CHUNK steps, the file is extended ahead of it
+ *
+ * @return Where to write, NULL when the log cannot grow
+ */
+static uint8_t *replay_append(size_t size) {
+
+    if(g_replay_pos + size > g_replay_window + g_replay_map_size) {
+        size_t page = (size_t) sysconf(_SC_PAGESIZE);
+        uint64_t window = g_replay_pos / page * page;
+        size_t map_size = (size_t) ((g_replay_pos - window + size + REPLAY_CHUNK - 1) / REPLAY_CHUNK * REPLAY_CHUNK);
+
+        if(ftruncate(g_replay_fd, (off_t) (window + map_size)) != 0) {
+            printf("Failed to extend the replay log: %s\n", strerror(errno));
+            return NULL;
+        }
+
+        uint8_t *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, g_replay_fd, (off_t) window);
+        if(map == MAP_FAILED) {
+            printf("Failed to map the replay log: %s\n", strerror(errno));
+            return NULL;
+        }
+
+#ifdef MADV_POPULATE_WRITE
+        // A write fault per page costs more than the records written to it,
+        // MAP_POPULATE only prefaults shared file mappings for reading
+        madvise(map, map_size, MADV_POPULATE_WRITE);
+#endif
+
+        if(g_replay_map != NULL) {
+            munmap(g_replay_map, g_replay_map_size);
+        }
+        g_replay_map = map;
+        g_replay_map_size = map_size;
+        g_replay_window = window;
+    }
+
+    uint8_t *at = g_replay_map + (g_replay_pos - g_replay_window);
+    g_replay_pos += size;
+    g_replay_stats.bytes = g_replay_pos;
+    return at;
+}
+
+
+/**
+ * @brief Next record of the log being replayed, NULL at its end
+ */
+static const wasm_replay_record_t *replay_peek(void) {
+
+    if(g_replay_stopped || g_replay_pos + sizeof(wasm_replay_record_t) > g_replay_size) {
+        return NULL;
+    }
+
+    const wasm_replay_record_t *record = (const wasm_replay_record_t *) (g_replay_map + g_replay_pos);
+    if(record->type == REPLAY_END || g_replay_pos + sizeof(*record) + replay_padded(record->type == REPLAY_HOST ? record->value : 0) > g_replay_size) {
+        return NULL;
+    }
+
+    return record;
+}
+
+
+/**
+ * @brief Slice outcomes compare equal when both left the call in flight
+ */
+static bool replay_status_matches(int a, int b) {
+    bool a_running = a == PARTITION_YIELDED || a == PARTITION_BLOCKED;
+    bool b_running = b == PARTITION_YIELDED || b == PARTITION_BLOCKED;
+    return a == b || (a_running && b_running);
+}
+
+
+/****************************************************************************
+ * Function Implementations
+****************************************************************************/
+
+/**
+ * @brief Start recording to a new log file, truncated if it exists
+ *
+ * @param log_file Log file
+ * @return 0 when successful, else -1
+ */
+int wasm_replay_record(const char *log_file) {
+
+    if(g_replay_mode != REPLAY_OFF) {
+        printf("Replay log already open\n");
+        return -1;
+    }
+
+    g_replay_fd = open(log_file, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(g_replay_fd < 0) {
+        printf("> Error opening replay log: %s\n", log_file);
+        return -1;
+    }
+
+    memset(&g_replay_stats, 0, sizeof(g_replay_stats));
+    g_replay_pos = 0;
+    g_replay_window = 0;
+
+    wasm_replay_header_t *header = (wasm_replay_header_t *) replay_append(sizeof(wasm_replay_header_t));
+    if(header == NULL) {
+        close(g_replay_fd);
+        g_replay_fd = -1;
+        return -1;
+    }
+
+    header->magic = REPLAY_MAGIC;
+    header->version = REPLAY_VERSION;
+    header->record_size = sizeof(wasm_replay_record_t);
+
+    g_replay_mode = REPLAY_RECORD;
+    return 0;
+}
+
+
+/**
+ * @brief Start replaying a recorded log
+ *
+ * @param log_file Log file
+ * @return 0 when successful, else -1
+ */
+int wasm_replay_open(const char *log_file) {
+    struct stat st;
+
+    if(g_replay_mode != REPLAY_OFF) {
+        printf("Replay log already open\n");
+        return -1;
+    }
+
+    g_replay_fd = open(log_file, O_RDONLY | O_CLOEXEC);
+    if(g_replay_fd < 0 || fstat(g_replay_fd, &st) != 0 || (size_t) st.st_size < sizeof(wasm_replay_header_t)) {
+        printf("> Error opening replay log: %s\n", log_file);
+        if(g_replay_fd >= 0) {
+            close(g_replay_fd);
+            g_replay_fd = -1;
+        }
+        return -1;
+    }
+
+    g_replay_map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, g_replay_fd, 0);
+    if(g_replay_map == MAP_FAILED) {
+        printf("Failed to map the replay log: %s\n", strerror(errno));
+        g_replay_map = NULL;
+        close(g_replay_fd);
+        g_replay_fd = -1;
+        return -1;
+    }
+    g_replay_map_size = (size_t) st.st_size;
+
+    const wasm_replay_header_t *header = (const wasm_replay_header_t *) g_replay_map;
+    if(header->magic != REPLAY_MAGIC || header->version != REPLAY_VERSION
+       || header->record_size != sizeof(wasm_replay_record_t)) {
+        printf("%s is not a replay log of this version\n", log_file);
+        munmap(g_replay_map, g_replay_map_size);
+        g_replay_map = NULL;
+        close(g_replay_fd);
+        g_replay_fd = -1;
+        return -1;
+    }
+
+    memset(&g_replay_stats, 0, sizeof(g_replay_stats));
+    g_replay_stats.bytes = (uint64_t) st.st_size;
+    g_replay_size = (uint64_t) st.st_size;
+    g_replay_pos = sizeof(wasm_replay_header_t);
+    g_replay_stopped = false;
+
+    g_replay_mode = REPLAY_REPLAY;
+    return 0;
+}
+
+
+/**
+ * @brief Record one slice, or check it against the log while replaying.
+ *        YIELDED and BLOCKED compare equal, replayed host calls never block
+ *
+ * @param partition_id Partition identifier
+ * @param status wasm_api_result_t of the slice
+ * @param fuel Fuel left after the slice
+ */
+void wasm_replay_slice(int partition_id, int status, uint64_t fuel) {
+
+    if(g_replay_mode == REPLAY_RECORD) {
+        wasm_replay_record_t *record = (wasm_replay_record_t *) replay_append(sizeof(wasm_replay_record_t));
+        if(record != NULL) {
+            record->type = REPLAY_SLICE;
+            record->status = (uint8_t) status;
+            record->reserved = 0;
+            record->partition_id = partition_id;
+            record->value = fuel;
+            g_replay_stats.slices++;
+        }
+        return;
+    }
+
+    if(g_replay_mode != REPLAY_REPLAY || g_replay_stopped) {
+        return;
+    }
+
+    const wasm_replay_record_t *record = replay_peek();
+    if(record == NULL || record->type != REPLAY_SLICE || record->partition_id != partition_id) {
+        wasm_replay_diverged(partition_id, "slice not in the log");
+        return;
+    }
+    if(!replay_status_matches(record->status, status) || record->value != fuel) {
+        printf("Recorded status %u with %lu fuel left, replayed %d with %lu fuel left\n",
+               record->status, record->value, status, fuel);
+        wasm_replay_diverged(partition_id, "slice differs");
+        return;
+    }
+
+    g_replay_pos += sizeof(wasm_replay_record_t);
+    g_replay_stats.slices++;
+}
+
+
+/**
+ * @brief Record the results of an external host call as the guest receives
+ *        them, with the guest memory the call wrote
+ *
+ * @param partition_id Partition identifier
+ * @param results Results handed to the guest
+ * @param nresults Number of results
+ * @param guest_ptr Guest address of the written buffer
+ * @param data Written buffer, NULL when none
+ * @param len Bytes written
+ */
+void wasm_replay_host(int partition_id, const wasmtime_val_t *results, size_t nresults,
+                      uint32_t guest_ptr, const uint8_t *data, uint32_t len) {
+
+    if(g_replay_mode != REPLAY_RECORD) {
+        return;
+    }
+
+    if(data == NULL || len > REPLAY_MAX_DATA) {
+        len = 0;
+    }
+
+    uint64_t payload = nresults * sizeof(uint64_t) + 2 * sizeof(uint32_t) + len;
+    uint8_t *at = replay_append(sizeof(wasm_replay_record_t) + replay_padded(payload));
+    if(at == NULL) {
+        return;
+    }
+
+    wasm_replay_record_t *record = (wasm_replay_record_t *) at;
+    record->type = REPLAY_HOST;
+    record->status = (uint8_t) nresults;
+    record->reserved = 0;
+    record->partition_id = partition_id;
+    record->value = payload;
+
+    // Numeric values only, their union members all start at offset 0
+    uint8_t *it = at + sizeof(*record);
+    for(size_t i = 0; i < nresults; i++, it += sizeof(uint64_t)) {
+        memcpy(it, &results[i].of, sizeof(uint64_t));
+    }
+    memcpy(it, &guest_ptr, sizeof(uint32_t));
+    memcpy(it + sizeof(uint32_t), &len, sizeof(uint32_t));
+    if(len > 0) {
+        memcpy(it + 2 * sizeof(uint32_t), data, len);
+    }
+
+    g_replay_stats.host_results++;
+}
+
+
+/**
+ * @brief Take the results of an external host call from the log. They are
+ *        due when the next record is a host record of the partition
+ *
+ * @param partition_id Partition identifier
+ * @param results Output, kinds are preset
+ * @param nresults Number of results
+ * @param memory Base of the guest's linear memory, NULL when it has none
+ * @param memory_size Size of the guest's linear memory
+ * @return True when taken, false when the call has not completed yet
+ */
+bool wasm_replay_take_host(int partition_id, wasmtime_val_t *results, size_t nresults,
+                           uint8_t *memory, size_t memory_size) {
+    uint32_t guest_ptr;
+    uint32_t len;
+
+    const wasm_replay_record_t *record = replay_peek();
+    if(record == NULL || record->type != REPLAY_HOST || record->partition_id != partition_id) {
+        return false;
+    }
+
+    const uint8_t *it = (const uint8_t *) record + sizeof(*record);
+    memcpy(&guest_ptr, it + record->status * sizeof(uint64_t), sizeof(uint32_t));
+    memcpy(&len, it + record->status * sizeof(uint64_t) + sizeof(uint32_t), sizeof(uint32_t));
+
+    if(record->status != nresults || record->value != record->status * sizeof(uint64_t) + 2 * sizeof(uint32_t) + len
+       || (len > 0 && (memory == NULL || (uint64_t) guest_ptr + len > memory_size))) {
+        wasm_replay_diverged(partition_id, "host call differs");
+        return false;
+    }
+
+    for(size_t i = 0; i < nresults; i++, it += sizeof(uint64_t)) {
+        memcpy(&results[i].of, it, sizeof(uint64_t));
+    }
+    if(len > 0) {
+        memcpy(memory + guest_ptr, it + 2 * sizeof(uint32_t), len);
+    }
+
+    g_replay_pos += sizeof(*record) + replay_padded(record->value);
+    g_replay_stats.host_results++;
+    return true;
+}
+
+
+/**
+ * @brief Record a fuel refill. Refills follow the clock, a replay takes
+ *        them from the log with wasm_replay_take_fuel
+ *
+ * @param partition_id Partition identifier
+ * @param fuel Budget the partition was refilled to
+ */
+void wasm_replay_fuel(int partition_id, uint64_t fuel) {
+
+    if(g_replay_mode != REPLAY_RECORD) {
+        return;
+    }
+
+    wasm_replay_record_t *record = (wasm_replay_record_t *) replay_append(sizeof(wasm_replay_record_t));
+    if(record != NULL) {
+        record->type = REPLAY_FUEL;
+        record->status = 0;
+        record->reserved = 0;
+        record->partition_id = partition_id;
+        record->value = fuel;
+        g_replay_stats.refills++;
+    }
+}
+
+
+/**
+ * @brief Take the refill due before the next slice from the log
+ *
+ * @param partition_id Output, partition identifier
+ * @param fuel Output, budget to refill to
+ * @return True when taken, false when the next record is no refill
+ */
+bool wasm_replay_take_fuel(int *partition_id, uint64_t *fuel) {
+
+    if(g_replay_mode != REPLAY_REPLAY) {
+        return false;
+    }
+
+    const wasm_replay_record_t *record = replay_peek();
+    if(record == NULL || record->type != REPLAY_FUEL) {
+        return false;
+    }
+
+    *partition_id = record->partition_id;
+    *fuel = record->value;
+    g_replay_pos += sizeof(wasm_replay_record_t);
+    g_replay_stats.refills++;
+    return true;
+}
+
+
+/**
+ * @brief Partition whose slice comes next in the log
+ *
+ * @return Partition identifier, -1 at the end of the log or after a divergence
+ */
+int wasm_replay_next(void) {
+
+    if(g_replay_mode != REPLAY_REPLAY || g_replay_stopped) {
+        return -1;
+    }
+
+    const wasm_replay_record_t *record = replay_peek();
+    if(record == NULL) {
+        printf("Replay finished after %lu slices\n", g_replay_stats.slices);
+        g_replay_stopped = true;
+        return -1;
+    }
+
+    // Host results precede the slice that took them, all of one partition
+    uint64_t pos = g_replay_pos;
+    while(record->type == REPLAY_HOST) {
+        pos += sizeof(*record) + replay_padded(record->value);
+        if(pos + sizeof(*record) > g_replay_size) {
+            break;
+        }
+
+        const wasm_replay_record_t *next = (const wasm_replay_record_t *) (g_replay_map + pos);
+        if(next->partition_id != record->partition_id || next->type == REPLAY_END) {
+            break;
+        }
+        record = next;
+    }
+
+    if(record->type != REPLAY_SLICE) {
+        wasm_replay_diverged(record->partition_id, "host results without a slice");
+        return -1;
+    }
+
+    return record->partition_id;
+}
+
+
+/**
+ * @brief Mark the replay diverged at the current record, it stops there
+ */
+void wasm_replay_diverged(int partition_id, const char *what) {
+
+    if(g_replay_stopped) {
+        return;
+    }
+
+    printf("Replay diverged at offset %lu, partition %d: %s\n", g_replay_pos, partition_id, what);
+    g_replay_stats.divergences++;
+    g_replay_stopped = true;
+}
+
+
+/**
+ * @brief Recording and replay statistics
+ *
+ * @param stats Output
+ */
+void wasm_replay_stats(wasm_replay_stats_t *stats) {
+    *stats = g_replay_stats;
+}
+
+
+/**
+ * @brief Finish the log, a recorded log is truncated to its records
+ */
+void wasm_replay_close(void) {
+
+    if(g_replay_mode == REPLAY_OFF) {
+        return;
+    }
+
+    if(g_replay_map != NULL) {
+        munmap(g_replay_map, g_replay_map_size);
+    }
+    if(g_replay_mode == REPLAY_RECORD && ftruncate(g_replay_fd, (off_t) g_replay_pos) != 0) {
+        printf("Failed to truncate the replay log: %s\n", strerror(errno));
+    }
+    close(g_replay_fd);
+
+    g_replay_fd = -1;
+    g_replay_map = NULL;
+    g_replay_map_size = 0;
+    g_replay_window = 0;
+    g_replay_pos = 0;
+    g_replay_size = 0;
+    g_replay_stopped = false;
+    g_replay_mode = REPLAY_OFF;
+}
@@ -0,0 +1,202 @@
+/*
+ * wasm_replay.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+#ifndef WASM_REPLAY_H
+#define WASM_REPLAY_H
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wasm.h>
+#include <wasmtime.h>
+
+
+/****************************************************************************
+ * Defines
+****************************************************************************/
+#define REPLAY_MAGIC            0x31594c5052534157ull  // "WASRPLY1"
+#define REPLAY_CHUNK            (16ull * 1024 * 1024)  // Log grows and is mapped by this much
+#define REPLAY_MAX_DATA         (1u << 30)             // Largest guest buffer a host record carries
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+typedef enum {
+    REPLAY_OFF = 0,
+    REPLAY_RECORD,
+    REPLAY_REPLAY
+} wasm_replay_mode_t;
+
+// Log layout: header, then records until one of type REPLAY_END. A crashed
+// recorder leaves zeroes behind its last record, which read as REPLAY_END
+typedef enum {
+    REPLAY_END = 0,
+    REPLAY_SLICE,                   // One poll of a partition's future
+    REPLAY_HOST,                    // Results of an external host call, then a payload
+    REPLAY_FUEL                     // Fuel refill by the scheduler, before the slice that follows it
+} wasm_replay_type_t;
+
+typedef struct wasm_replay_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t record_size;
+} wasm_replay_header_t;
+
+// 16 bytes. REPLAY_HOST is followed by value bytes of payload, padded to 8:
+// nresults raw results of 8 bytes, guest address and length of the output
+// buffer as two uint32_t, then the buffer's bytes
+typedef struct wasm_replay_record {
+    uint8_t type;                   // wasm_replay_type_t
+    uint8_t status;                 // SLICE: wasm_api_result_t, HOST: number of results
+    uint16_t reserved;
+    int32_t partition_id;
+    uint64_t value;                 // SLICE: fuel left after it, HOST: payload bytes, FUEL: budget
+} wasm_replay_record_t;
+
+typedef struct wasm_replay_stats {
+    uint64_t slices;                // Recorded or replayed
+    uint64_t host_results;
+    uint64_t refills;
+    uint64_t bytes;                 // Log size
+    uint64_t divergences;           // Replayed slices that did not match, replay stops at the first
+} wasm_replay_stats_t;
+
+
+/****************************************************************************
+ * Globals
+****************************************************************************/
+
+// Only read on the hot path, see wasm_replay_mode()
+extern wasm_replay_mode_t g_replay_mode;
+
+
+/****************************************************************************
+ * Function Prototypes
+****************************************************************************/
+
+/**
+ * @brief REPLAY_OFF unless a log is being recorded or replayed. The only cost
+ *        on the hot path when neither is
+ */
+static inline wasm_replay_mode_t wasm_replay_mode(void) {
+    return (wasm_replay_mode_t) __builtin_expect(g_replay_mode, REPLAY_OFF);
+}
+
+
+/**
+ * @brief Start recording to a new log file, truncated if it exists
+ *
+ * @param log_file Log file
+ * @return 0 when successful, else -1
+ */
+int wasm_replay_record(const char *log_file);
+
+
+/**
+ * @brief Start replaying a recorded log
+ *
+ * @param log_file Log file
+ * @return 0 when successful, else -1
+ */
+int wasm_replay_open(const char *log_file);
+
+
+/**
+ * @brief Record one slice, or check it against the log while replaying.
+ *        YIELDED and BLOCKED compare equal, replayed host calls never block
+ *
+ * @param partition_id Partition identifier
+ * @param status wasm_api_result_t of the slice
+ * @param fuel Fuel left after the slice
+ */
+void wasm_replay_slice(int partition_id, int status, uint64_t fuel);
+
+
+/**
+ * @brief Record the results of an external host call as the guest receives
+ *        them, with the guest memory the call wrote
+ *
+ * @param partition_id Partition identifier
+ * @param results Results handed to the guest
+ * @param nresults Number of results
+ * @param guest_ptr Guest address of the written buffer
+ * @param data Written buffer, NULL when none
+ * @param len Bytes written
+ */
+void wasm_replay_host(int partition_id, const wasmtime_val_t *results, size_t nresults,
+                      uint32_t guest_ptr, const uint8_t *data, uint32_t len);
+
+
+/**
+ * @brief Take the results of an external host call from the log. They are
+ *        due when the next record is a host record of the partition
+ *
+ * @param partition_id Partition identifier
+ * @param results Output, kinds are preset
+ * @param nresults Number of results
+ * @param memory Base of the guest's linear memory, NULL when it has none
+ * @param memory_size Size of the guest's linear memory
+ * @return True when taken, false when the call has not completed yet
+ */
+bool wasm_replay_take_host(int partition_id, wasmtime_val_t *results, size_t nresults,
+                           uint8_t *memory, size_t memory_size);
+
+
+/**
+ * @brief Record a fuel refill. Refills follow the clock, a replay takes
+ *        them from the log with wasm_replay_take_fuel
+ *
+ * @param partition_id Partition identifier
+ * @param fuel Budget the partition was refilled to
+ */
+void wasm_replay_fuel(int partition_id, uint64_t fuel);
+
+
+/**
+ * @brief Take the refill due before the next slice from the log
+ *
+ * @param partition_id Output, partition identifier
+ * @param fuel Output, budget to refill to
+ * @return True when taken, false when the next record is no refill
+ */
+bool wasm_replay_take_fuel(int *partition_id, uint64_t *fuel);
+
+
+/**
+ * @brief Partition whose slice comes next in the log
+ *
+ * @return Partition identifier, -1 at the end of the log or after a divergence
+ */
+int wasm_replay_next(void);
+
+
+/**
+ * @brief Mark the replay diverged at the current record, it stops there
+ */
+void wasm_replay_diverged(int partition_id, const char *what);
+
+
+/**
+ * @brief Recording and replay statistics
+ *
+ * @param stats Output
+ */
+void wasm_replay_stats(wasm_replay_stats_t *stats);
+
+
+/**
+ * @brief Finish the log, a recorded log is truncated to its records
+ */
+void wasm_replay_close(void);
+
+
+#endif // WASM_REPLAY_H
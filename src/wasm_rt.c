@@ -0,0 +1,234 @@
+/*
+ * wasm_rt.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+// Placement of the scheduler thread for steady slice timing: pinned to its
+// own CPUs, optionally under SCHED_FIFO, with compilation and worker threads
+// kept on housekeeping CPUs. Best combined with isolcpus/nohz_full on the
+// scheduler CPUs
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#define _GNU_SOURCE
+#include "wasm_rt.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/****************************************************************************
+ * Placement state
+****************************************************************************/
+static bool g_rt_pin_sched = false;
+static cpu_set_t g_rt_sched_cpus;
+static int g_rt_fifo_priority = 0;
+static bool g_rt_housekeeping = false;
+static pthread_attr_t g_rt_housekeeping_attr;
+
+
+/****************************************************************************
+ * Static Function Prototypes
+****************************************************************************/
+static int rt_parse_cpus(const char *list, cpu_set_t *set);
+
+
+/****************************************************************************
+ * Static Function Implementations
+****************************************************************************/
+
+/**
+ * @brief Parse a CPU list in the kernel's format, "2-3,6"
+ *
+ * @return 0 when successful, -1 on a syntax error or an empty list
+ */
+static int rt_parse_cpus(const char *list, cpu_set_t *set) {
+    const char *it = list;
+
+    CPU_ZERO(set);
+
+    while(*it != '\0') {
+        char *end;
+        unsigned long first = strtoul(it, &end, 10);
+        unsigned long last = first;
+
+        if(end == it) {
+            return -1;
+        }
+        if(*end == '-') {
+            it = end + 1;
+            last = strtoul(it, &end, 10);
+            if(end == it) {
+                return -1;
+            }
+        }
+        if(last < first || last >= CPU_SETSIZE) {
+            return -1;
+        }
+
+        for(unsigned long cpu = first; cpu <= last; cpu++) {
+            CPU_SET(cpu, set);
+        }
+
+        it = end;
+        if(*it == ',') {
+            it++;
+        } else if(*it != '\0') {
+            return -1;
+        }
+    }
+
+    return CPU_COUNT(set) > 0 ? 0 : -1;
+}
+
+
+/****************************************************************************
+ * Function Implementations
+****************************************************************************/
+
+/**
+ * @brief Set up the placement of scheduler and housekeeping threads. The
+ *        calling thread moves to the housekeeping CPUs, so modules compiled
+ *        on it and threads it starts stay off the scheduler's CPUs
+ *
+ * @param sched_cpus CPU list of the scheduler thread, "2-3,6", NULL leaves it unpinned
+ * @param housekeeping_cpus CPU list of everything else, NULL leaves the calling
+ *        thread unpinned and starts threads on the CPUs not in sched_cpus
+ * @param fifo_priority SCHED_FIFO priority of the scheduler thread, 0 for SCHED_OTHER
+ * @return 0 when successful, else -1
+ */
+int wasm_rt_init(const char *sched_cpus, const char *housekeeping_cpus, int fifo_priority) {
+    cpu_set_t housekeeping;
+
+    wasm_rt_destroy();
+
+    if(fifo_priority != 0 && (fifo_priority < sched_get_priority_min(SCHED_FIFO)
+                              || fifo_priority > sched_get_priority_max(SCHED_FIFO))) {
+        printf("SCHED_FIFO priority %d out of range %d-%d\n", fifo_priority,
+               sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO));
+        return -1;
+    }
+    g_rt_fifo_priority = fifo_priority;
+
+    if(sched_cpus != NULL) {
+        if(rt_parse_cpus(sched_cpus, &g_rt_sched_cpus) != 0) {
+            printf("Invalid scheduler CPU list: %s\n", sched_cpus);
+            return -1;
+        }
+        g_rt_pin_sched = true;
+    }
+
+    if(housekeeping_cpus != NULL) {
+        if(rt_parse_cpus(housekeeping_cpus, &housekeeping) != 0) {
+            printf("Invalid housekeeping CPU list: %s\n", housekeeping_cpus);
+            return -1;
+        }
+    } else if(g_rt_pin_sched) {
+        // Without a list, threads go to the allowed CPUs the scheduler leaves
+        if(sched_getaffinity(0, sizeof(housekeeping), &housekeeping) != 0) {
+            CPU_ZERO(&housekeeping);
+        }
+        for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if(CPU_ISSET(cpu, &g_rt_sched_cpus)) {
+                CPU_CLR(cpu, &housekeeping);
+            }
+        }
+    } else {
+        CPU_ZERO(&housekeeping);
+    }
+
+    if(!g_rt_pin_sched && g_rt_fifo_priority == 0 && housekeeping_cpus == NULL) {
+        return 0;
+    }
+
+    // Threads started from the scheduler thread would inherit SCHED_FIFO and
+    // its CPUs, so their policy is always explicit
+    struct sched_param param = { .sched_priority = 0 };
+    pthread_attr_init(&g_rt_housekeeping_attr);
+    pthread_attr_setinheritsched(&g_rt_housekeeping_attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&g_rt_housekeeping_attr, SCHED_OTHER);
+    pthread_attr_setschedparam(&g_rt_housekeeping_attr, &param);
+    if(CPU_COUNT(&housekeeping) > 0) {
+        pthread_attr_setaffinity_np(&g_rt_housekeeping_attr, sizeof(housekeeping), &housekeeping);
+    }
+    g_rt_housekeeping = true;
+
+    if(housekeeping_cpus == NULL) {
+        return 0;
+    }
+
+    // Compilation runs here, and Wasmtime's compile threads inherit the mask
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(housekeeping), &housekeeping);
+    if(err != 0) {
+        printf("Failed to pin to housekeeping CPUs %s: %s\n", housekeeping_cpus, strerror(err));
+        wasm_rt_destroy();
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Pin the calling thread to the scheduler CPUs and switch it to
+ *        SCHED_FIFO, as configured by wasm_rt_init. Call on the scheduler
+ *        thread once partitions are loaded
+ *
+ * @return 0 when successful, else -1
+ */
+int wasm_rt_enter(void) {
+
+    if(g_rt_pin_sched) {
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(g_rt_sched_cpus), &g_rt_sched_cpus);
+        if(err != 0) {
+            printf("Failed to pin the scheduler thread: %s\n", strerror(err));
+            return -1;
+        }
+    }
+
+    if(g_rt_fifo_priority != 0) {
+        struct sched_param param = { .sched_priority = g_rt_fifo_priority };
+        int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if(err != 0) {
+            // EPERM without CAP_SYS_NICE or an RLIMIT_RTPRIO allowance
+            printf("Failed to switch the scheduler thread to SCHED_FIFO %d: %s\n", g_rt_fifo_priority, strerror(err));
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Attributes for threads the library starts, host and map workers.
+ *        They run on the housekeeping CPUs under SCHED_OTHER, also when
+ *        started from the scheduler thread
+ *
+ * @return Attributes for pthread_create, NULL when neither scheduler CPUs,
+ *         SCHED_FIFO nor housekeeping CPUs are configured
+ */
+const pthread_attr_t *wasm_rt_housekeeping_attr(void) {
+    return g_rt_housekeeping ? &g_rt_housekeeping_attr : NULL;
+}
+
+
+/**
+ * @brief Drop the configuration, threads keep their placement
+ */
+void wasm_rt_destroy(void) {
+    if(g_rt_housekeeping) {
+        pthread_attr_destroy(&g_rt_housekeeping_attr);
+    }
+
+    g_rt_pin_sched = false;
+    g_rt_fifo_priority = 0;
+    g_rt_housekeeping = false;
+}
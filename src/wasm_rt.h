@@ -0,0 +1,62 @@
+/*
+ * wasm_rt.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+#ifndef WASM_RT_H
+#define WASM_RT_H
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include <pthread.h>
+
+
+/****************************************************************************
+ * Function Prototypes
+****************************************************************************/
+
+/**
+ * @brief Set up the placement of scheduler and housekeeping threads. The
+ *        calling thread moves to the housekeeping CPUs, so modules compiled
+ *        on it and threads it starts stay off the scheduler's CPUs
+ *
+ * @param sched_cpus CPU list of the scheduler thread, "2-3,6", NULL leaves it unpinned
+ * @param housekeeping_cpus CPU list of everything else, NULL leaves the calling
+ *        thread unpinned and starts threads on the CPUs not in sched_cpus
+ * @param fifo_priority SCHED_FIFO priority of the scheduler thread, 0 for SCHED_OTHER
+ * @return 0 when successful, else -1
+ */
+int wasm_rt_init(const char *sched_cpus, const char *housekeeping_cpus, int fifo_priority);
+
+
+/**
+ * @brief Pin the calling thread to the scheduler CPUs and switch it to
+ *        SCHED_FIFO, as configured by wasm_rt_init. Call on the scheduler
+ *        thread once partitions are loaded
+ *
+ * @return 0 when successful, else -1
+ */
+int wasm_rt_enter(void);
+
+
+/**
+ * @brief Attributes for threads the library starts, host and map workers.
+ *        They run on the housekeeping CPUs under SCHED_OTHER, also when
+ *        started from the scheduler thread
+ *
+ * @return Attributes for pthread_create, NULL when neither scheduler CPUs,
+ *         SCHED_FIFO nor housekeeping CPUs are configured
+ */
+const pthread_attr_t *wasm_rt_housekeeping_attr(void);
+
+
+/**
+ * @brief Drop the configuration, threads keep their placement
+ */
+void wasm_rt_destroy(void);
+
+
+#endif // WASM_RT_H
@@ -0,0 +1,692 @@
+/*
+ * wasm_sched.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+// Scheduler as a readiness source: the eventfd is readable while a step can
+// run a slice. Host completions, io_uring completions and new partitions
+// signal it, wasm_sched_step rearms it when work is left over. Backoff
+// restarts and refills of starved partitions are timers instead, the event
+// loop waits wasm_sched_timeout_ms
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include "wasm_sched.h"
+#include "wasm_host.h"
+#include "wasm_uring.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+// Restart policy of a partition id and its budget in the current window
+typedef struct sched_restart {
+    wasm_sched_restart_t policy;
+    uint64_t window_start_ns;
+    uint32_t window_restarts;
+    uint64_t restart_at_ns;             // Backoff deadline, 0 when not waiting
+    wasm_api_result_t status;           // Status passed to on_exit when the restart fails
+} sched_restart_t;
+
+// Fuel budget of a partition id, see wasm_sched_set_fuel_period
+typedef struct sched_period {
+    uint64_t fuel;
+    uint64_t period_ns;                 // 0 when not refilled
+    uint64_t refill_at_ns;              // Start of the next period
+} sched_period_t;
+
+
+/****************************************************************************
+ * Scheduler state
+****************************************************************************/
+static int g_sched_fd = -1;
+static char *g_sched_funcs[NUM_MAX_PARTITIONS];     // Non-NULL while on the run queue
+static size_t g_sched_active = 0;
+static int g_sched_cursor = 0;                      // Round robin position
+static wasm_sched_exit_t g_sched_on_exit = NULL;
+static void *g_sched_env = NULL;
+static sched_restart_t g_sched_restarts[NUM_MAX_PARTITIONS];
+static size_t g_sched_waiting = 0;                  // Partitions with a backoff deadline
+static sched_period_t g_sched_periods[NUM_MAX_PARTITIONS];
+static size_t g_sched_periodic = 0;                 // Partition ids with a period
+static wasm_sched_stats_t g_sched_stats;
+
+
+/****************************************************************************
+ * Static Function Prototypes
+****************************************************************************/
+static void sched_signal(void *env);
+static void sched_rearm(void);
+static uint64_t sched_now_ns(void);
+static uint64_t sched_fuel(int partition_id);
+static void sched_exit(int partition_id, wasm_api_result_t status);
+static bool sched_runnable(int partition_id);
+static void sched_finish(int partition_id, wasm_api_result_t status, bool wait);
+static void sched_restart(int partition_id, wasm_api_result_t status);
+static void sched_restart_due(void);
+static void sched_refill(int partition_id, uint64_t fuel);
+static void sched_refill_due(void);
+static size_t sched_replay_step(const wasm_sched_budget_t *budget);
+
+
+/****************************************************************************
+ * Static Function Implementations
+****************************************************************************/
+
+/**
+ * @brief Make the eventfd readable, also the host completion callback
+ */
+static void sched_signal(void *env) {
+    uint64_t one = 1;
+    (void) env;
+
+    // EAGAIN means the counter is saturated, the fd is readable anyway
+    if(write(g_sched_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        printf("Failed to signal the scheduler: %s\n", strerror(errno));
+    }
+}
+
+
+/**
+ * @brief Consume readiness, then signal again if a slice can run. Completions
+ *        after the poll signal on their own
+ */
+static void sched_rearm(void) {
+    uint64_t count;
+
+    if(read(g_sched_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        printf("Failed to read the scheduler eventfd: %s\n", strerror(errno));
+    }
+
+    wasm_api_poll_completions();
+
+    for(int id = 0; id < NUM_MAX_PARTITIONS; id++) {
+        if(sched_runnable(id)) {
+            sched_signal(NULL);
+            return;
+        }
+    }
+
+    if(wasm_sched_timeout_ms() == 0) {
+        sched_signal(NULL);
+    }
+}
+
+
+static uint64_t sched_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+
+/**
+ * @brief Fuel left in a partition's store, 0 without fuel metering
+ */
+static uint64_t sched_fuel(int partition_id) {
+    wasm_partition_t *partition = get_wasm_partition(partition_id);
+    uint64_t fuel = 0;
+
+    wasmtime_error_t *error = wasmtime_context_get_fuel(partition->context, &fuel);
+    if(error != NULL) {
+        wasmtime_error_delete(error);
+        return 0;
+    }
+
+    return fuel;
+}
+
+
+static void sched_exit(int partition_id, wasm_api_result_t status) {
+    wasm_sched_remove(partition_id);
+
+    if(g_sched_on_exit != NULL) {
+        g_sched_on_exit(partition_id, status, g_sched_env);
+    }
+}
+
+
+/**
+ * @brief On the run queue, not waiting for a restart and not blocked
+ */
+static bool sched_runnable(int partition_id) {
+    return g_sched_funcs[partition_id] != NULL && g_sched_restarts[partition_id].restart_at_ns == 0
+        && wasm_api_partition_runnable(partition_id);
+}
+
+
+/**
+ * @brief A call of a scheduled partition ended. A trap restarts it as far as
+ *        its policy and budget allow, anything else leaves the run queue
+ *
+ * @param wait False restarts a backoff partition right away, for replays
+ */
+static void sched_finish(int partition_id, wasm_api_result_t status, bool wait) {
+    sched_restart_t *restart = &g_sched_restarts[partition_id];
+    const wasm_sched_restart_t *policy = &restart->policy;
+
+    if(policy->mode == RESTART_NEVER || (status != PARTITION_ERROR && status != PARTITION_LIMIT)) {
+        sched_exit(partition_id, status);
+        return;
+    }
+
+    // The window starts with its first restart
+    uint64_t now = sched_now_ns();
+    uint64_t window = policy->window_ns ? policy->window_ns : SCHED_RESTART_WINDOW_NS;
+    if(restart->window_restarts == 0 || now - restart->window_start_ns >= window) {
+        restart->window_start_ns = now;
+        restart->window_restarts = 0;
+    }
+    if(policy->max_restarts > 0 && restart->window_restarts >= policy->max_restarts) {
+        g_sched_stats.budget_exhausted++;
+        sched_exit(partition_id, status);
+        return;
+    }
+    restart->window_restarts++;
+
+    if(policy->mode == RESTART_BACKOFF && wait) {
+        uint64_t delay = policy->backoff_ns ? policy->backoff_ns : SCHED_BACKOFF_NS;
+        uint64_t max = policy->backoff_max_ns ? policy->backoff_max_ns : SCHED_BACKOFF_MAX_NS;
+        for(uint32_t i = 1; i < restart->window_restarts && delay < max; i++) {
+            delay *= 2;
+        }
+        restart->restart_at_ns = now + (delay < max ? delay : max);
+        restart->status = status;
+        g_sched_waiting++;
+        return;
+    }
+
+    sched_restart(partition_id, status);
+}
+
+
+static void sched_restart(int partition_id, wasm_api_result_t status) {
+    uint64_t start = sched_now_ns();
+
+    if(wasm_api_restart_partition(partition_id) != WASM_API_OK) {
+        g_sched_stats.restart_failures++;
+        sched_exit(partition_id, status);
+        return;
+    }
+
+    uint64_t ns = sched_now_ns() - start;
+    g_sched_stats.restarts++;
+    g_sched_stats.restart_ns += ns;
+    if(ns > g_sched_stats.restart_max_ns) {
+        g_sched_stats.restart_max_ns = ns;
+    }
+}
+
+
+/**
+ * @brief Restart the partitions whose backoff ran out
+ */
+static void sched_restart_due(void) {
+    if(g_sched_waiting == 0) {
+        return;
+    }
+
+    uint64_t now = sched_now_ns();
+    for(int id = 0; id < NUM_MAX_PARTITIONS && g_sched_waiting > 0; id++) {
+        sched_restart_t *restart = &g_sched_restarts[id];
+        if(restart->restart_at_ns != 0 && restart->restart_at_ns <= now) {
+            restart->restart_at_ns = 0;
+            g_sched_waiting--;
+            sched_restart(id, restart->status);
+        }
+    }
+}
+
+
+/**
+ * @brief Refill a partition's fuel, a starved one becomes runnable
+ */
+static void sched_refill(int partition_id, uint64_t fuel) {
+    wasm_partition_t *partition = get_wasm_partition(partition_id);
+
+    if(partition == NULL || wasm_api_inject_fuel(partition_id, fuel, partition->fuel_yield) != WASM_API_OK) {
+        return;
+    }
+
+    wasm_replay_fuel(partition_id, fuel);
+    g_sched_stats.refills++;
+}
+
+
+/**
+ * @brief Refill the scheduled partitions whose period ended, periods missed
+ *        while the scheduler was busy are skipped
+ */
+static void sched_refill_due(void) {
+    if(g_sched_periodic == 0) {
+        return;
+    }
+
+    uint64_t now = sched_now_ns();
+    for(int id = 0; id < NUM_MAX_PARTITIONS; id++) {
+        sched_period_t *period = &g_sched_periods[id];
+        if(period->period_ns == 0 || period->refill_at_ns > now) {
+            continue;
+        }
+
+        if(g_sched_funcs[id] != NULL) {
+            sched_refill(id, period->fuel);
+        }
+        period->refill_at_ns += period->period_ns;
+        if(period->refill_at_ns <= now) {
+            period->refill_at_ns = now + period->period_ns;
+        }
+    }
+}
+
+
+/**
+ * @brief wasm_sched_step while replaying, runs partitions in the order of the
+ *        log. At its end, or once the replay diverged, the remaining
+ *        partitions leave the run queue without on_exit
+ */
+static size_t sched_replay_step(const wasm_sched_budget_t *budget) {
+    bool one_round = budget == NULL || (budget->time_ns == 0 && budget->fuel == 0);
+    size_t round = g_sched_active;
+    uint64_t start = sched_now_ns();
+    uint64_t fuel_used = 0;
+    size_t slices = 0;
+
+    wasm_api_poll_completions();
+
+    while(g_sched_active > 0) {
+
+        // Refills happened on the recording's clock, the log has them in order
+        int refill_id;
+        uint64_t refill_fuel;
+        while(wasm_replay_take_fuel(&refill_id, &refill_fuel)) {
+            sched_refill(refill_id, refill_fuel);
+        }
+
+        int id = wasm_replay_next();
+        if(id < 0 || id >= NUM_MAX_PARTITIONS || g_sched_funcs[id] == NULL) {
+            if(id >= 0) {
+                wasm_replay_diverged(id, "partition is not scheduled");
+            }
+            printf("Replay stopped, %zu partitions left\n", g_sched_active);
+            for(int i = 0; i < NUM_MAX_PARTITIONS; i++) {
+                wasm_sched_remove(i);
+            }
+            break;
+        }
+
+        // Internal host calls complete as they did, the poll only lags behind
+        if(!wasm_api_partition_runnable(id)) {
+            wasm_api_poll_completions();
+        }
+
+        uint64_t fuel_before = budget != NULL && budget->fuel ? sched_fuel(id) : 0;
+        wasm_api_result_t status = wasm_api_run_partition(id, g_sched_funcs[id]);
+        slices++;
+
+        if(budget != NULL && budget->fuel) {
+            uint64_t fuel_after = sched_fuel(id);
+            fuel_used += fuel_before > fuel_after ? fuel_before - fuel_after : 0;
+        }
+
+        // The log decides when the partition runs again, backoffs do not wait
+        if(status != PARTITION_YIELDED && status != PARTITION_BLOCKED && status != PARTITION_STARVED) {
+            sched_finish(id, status, false);
+        }
+
+        if(one_round ? slices >= round
+                     : ((budget->time_ns && sched_now_ns() - start >= budget->time_ns)
+                        || (budget->fuel && fuel_used >= budget->fuel))) {
+            break;
+        }
+    }
+
+    // Blocked partitions do not matter, the log decides what runs next
+    uint64_t count;
+    if(read(g_sched_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        printf("Failed to read the scheduler eventfd: %s\n", strerror(errno));
+    }
+    if(g_sched_active > 0) {
+        sched_signal(NULL);
+    }
+
+    return slices;
+}
+
+
+/****************************************************************************
+ * Function Implementations
+****************************************************************************/
+
+/**
+ * @brief Create the scheduler's eventfd and route host completions to it.
+ *        Call after wasm_api_init
+ *
+ * @param on_exit Called for partitions leaving the run queue, may be NULL
+ * @param env Passed to on_exit
+ * @return 0 when successful, else -1
+ */
+int wasm_sched_init(wasm_sched_exit_t on_exit, void *env) {
+
+    if(g_sched_fd >= 0) {
+        printf("Scheduler already initialized\n");
+        return -1;
+    }
+
+    g_sched_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(g_sched_fd < 0) {
+        printf("Failed to create the scheduler eventfd: %s\n", strerror(errno));
+        return -1;
+    }
+
+    g_sched_on_exit = on_exit;
+    g_sched_env = env;
+    g_sched_cursor = 0;
+    memset(&g_sched_stats, 0, sizeof(g_sched_stats));
+
+    wasm_host_set_notify(sched_signal, NULL);
+    wasm_uring_set_eventfd(g_sched_fd);
+
+    return 0;
+}
+
+
+/**
+ * @brief Readiness source for an event loop. Readable while a step can make
+ *        progress, wasm_sched_step consumes it
+ */
+int wasm_sched_fd(void) {
+    return g_sched_fd;
+}
+
+
+/**
+ * @brief Put a loaded partition on the run queue
+ *
+ * @param partition_id Partition identifier
+ * @param func_name Exported function to run, kept until the partition exits
+ * @return 0 when successful, else -1
+ */
+int wasm_sched_add(int partition_id, const char *func_name) {
+
+    if(g_sched_fd < 0 || get_wasm_partition(partition_id) == NULL) {
+        printf("Cannot schedule partition %d\n", partition_id);
+        return -1;
+    }
+
+    if(g_sched_funcs[partition_id] != NULL) {
+        printf("Partition %d already scheduled\n", partition_id);
+        return -1;
+    }
+
+    g_sched_funcs[partition_id] = strdup(func_name);
+    if(!g_sched_funcs[partition_id]) {
+        printf("Memory allocation failed!\n");
+        return -1;
+    }
+    g_sched_active++;
+    g_sched_restarts[partition_id].window_restarts = 0;
+
+    sched_signal(NULL);
+    return 0;
+}
+
+
+/**
+ * @brief Take a partition off the run queue without calling on_exit
+ */
+void wasm_sched_remove(int partition_id) {
+
+    if(partition_id < 0 || partition_id >= NUM_MAX_PARTITIONS || g_sched_funcs[partition_id] == NULL) {
+        return;
+    }
+
+    free(g_sched_funcs[partition_id]);
+    g_sched_funcs[partition_id] = NULL;
+    g_sched_active--;
+
+    if(g_sched_restarts[partition_id].restart_at_ns != 0) {
+        g_sched_restarts[partition_id].restart_at_ns = 0;
+        g_sched_waiting--;
+    }
+}
+
+
+/**
+ * @brief Set the restart policy of a partition id, kept until it is set
+ *        again. Restarts reuse the partition's compiled code, see
+ *        wasm_api_restart_partition
+ *
+ * @param partition_id Partition identifier
+ * @param policy Restart policy, NULL for RESTART_NEVER
+ * @return 0 when successful, else -1
+ */
+int wasm_sched_set_restart(int partition_id, const wasm_sched_restart_t *policy) {
+
+    if(partition_id < 0 || partition_id >= NUM_MAX_PARTITIONS
+       || (policy != NULL && (unsigned) policy->mode > RESTART_BACKOFF)) {
+        printf("Invalid restart policy for partition %d\n", partition_id);
+        return -1;
+    }
+
+    sched_restart_t *restart = &g_sched_restarts[partition_id];
+    if(policy != NULL) {
+        restart->policy = *policy;
+    } else {
+        memset(&restart->policy, 0, sizeof(restart->policy));
+    }
+    restart->window_restarts = 0;
+
+    return 0;
+}
+
+
+/**
+ * @brief Refill the fuel of a partition id to a budget at the start of every
+ *        period, fuel left over does not carry into the next one. With
+ *        wasm_api_set_fuel_suspend a partition that spent its budget waits
+ *        starved for the next period instead of trapping
+ *
+ * @param partition_id Partition identifier, loaded
+ * @param fuel Budget per period, refilled right away
+ * @param period_ns Period, 0 stops refilling
+ * @return 0 when successful, else -1
+ */
+int wasm_sched_set_fuel_period(int partition_id, uint64_t fuel, uint64_t period_ns) {
+
+    if(partition_id < 0 || partition_id >= NUM_MAX_PARTITIONS || get_wasm_partition(partition_id) == NULL) {
+        printf("Cannot set the fuel period of partition %d\n", partition_id);
+        return -1;
+    }
+
+    sched_period_t *period = &g_sched_periods[partition_id];
+    if(period->period_ns == 0 && period_ns != 0) {
+        g_sched_periodic++;
+    } else if(period->period_ns != 0 && period_ns == 0) {
+        g_sched_periodic--;
+    }
+
+    period->fuel = fuel;
+    period->period_ns = period_ns;
+    if(period_ns == 0) {
+        return 0;
+    }
+
+    period->refill_at_ns = sched_now_ns() + period_ns;
+    sched_refill(partition_id, fuel);
+    return 0;
+}
+
+
+/**
+ * @brief Timeout for the event loop's wait, the next backoff restart or
+ *        refill of a starved partition is due then and wasm_sched_step should
+ *        run even if the fd is not readable
+ *
+ * @return Milliseconds, rounded up, or -1 when nothing is waiting
+ */
+int wasm_sched_timeout_ms(void) {
+    uint64_t next = UINT64_MAX;
+
+    if(g_sched_waiting == 0 && g_sched_periodic == 0) {
+        return -1;
+    }
+
+    for(int id = 0; id < NUM_MAX_PARTITIONS; id++) {
+        uint64_t at = g_sched_restarts[id].restart_at_ns;
+        if(at != 0 && at < next) {
+            next = at;
+        }
+
+        // Other partitions run or block, their refill waits for the next step
+        at = g_sched_periods[id].refill_at_ns;
+        if(g_sched_periods[id].period_ns != 0 && g_sched_funcs[id] != NULL && at < next
+           && wasm_api_partition_starved(id)) {
+            next = at;
+        }
+    }
+
+    if(next == UINT64_MAX) {
+        return -1;
+    }
+
+    uint64_t now = sched_now_ns();
+    if(next <= now) {
+        return 0;
+    }
+
+    uint64_t ms = (next - now + 999999) / 1000000;
+    return ms > INT_MAX ? INT_MAX : (int) ms;
+}
+
+
+/**
+ * @brief Run slices round robin over runnable partitions until the budget is
+ *        used up or every partition is blocked or gone. Never blocks
+ *
+ * @param budget Limits of this step, NULL for one round
+ * @return Slices run
+ */
+size_t wasm_sched_step(const wasm_sched_budget_t *budget) {
+    bool one_round = budget == NULL || (budget->time_ns == 0 && budget->fuel == 0);
+    uint64_t start = sched_now_ns();
+    uint64_t fuel_used = 0;
+    size_t slices = 0;
+    bool exhausted = false;
+
+    if(g_sched_fd < 0) {
+        return 0;
+    }
+
+    if(wasm_replay_mode() == REPLAY_REPLAY) {
+        return sched_replay_step(budget);
+    }
+
+    // Completions and io_uring submissions are batched once per round
+    wasm_api_poll_completions();
+    sched_restart_due();
+    sched_refill_due();
+
+    while(!exhausted) {
+        size_t round_slices = 0;
+
+        for(int i = 0; i < NUM_MAX_PARTITIONS && !exhausted; i++) {
+            int id = (g_sched_cursor + i) % NUM_MAX_PARTITIONS;
+            if(!sched_runnable(id)) {
+                continue;
+            }
+
+            uint64_t fuel_before = budget != NULL && budget->fuel ? sched_fuel(id) : 0;
+            wasm_api_result_t status = wasm_api_run_partition(id, g_sched_funcs[id]);
+            round_slices++;
+
+            if(budget != NULL && budget->fuel) {
+                uint64_t fuel_after = sched_fuel(id);
+                fuel_used += fuel_before > fuel_after ? fuel_before - fuel_after : 0;
+            }
+
+            if(status != PARTITION_YIELDED && status != PARTITION_BLOCKED && status != PARTITION_STARVED) {
+                sched_finish(id, status, true);
+            }
+
+            // Continue behind this partition in the next step
+            if(!one_round && ((budget->time_ns && sched_now_ns() - start >= budget->time_ns)
+                              || (budget->fuel && fuel_used >= budget->fuel))) {
+                g_sched_cursor = (id + 1) % NUM_MAX_PARTITIONS;
+                exhausted = true;
+            }
+        }
+
+        slices += round_slices;
+        if(one_round || round_slices == 0) {
+            break;
+        }
+
+        wasm_api_poll_completions();
+        sched_restart_due();
+        sched_refill_due();
+    }
+
+    sched_rearm();
+    return slices;
+}
+
+
+/**
+ * @brief Number of partitions on the run queue, blocked, starved and ones
+ *        waiting for a restart included
+ */
+size_t wasm_sched_active(void) {
+    return g_sched_active;
+}
+
+
+/**
+ * @brief Restart and refill statistics
+ *
+ * @param stats Output
+ */
+void wasm_sched_stats(wasm_sched_stats_t *stats) {
+    *stats = g_sched_stats;
+    stats->waiting = g_sched_waiting;
+    stats->starved = 0;
+    for(int id = 0; id < NUM_MAX_PARTITIONS; id++) {
+        stats->starved += g_sched_funcs[id] != NULL && wasm_api_partition_starved(id);
+    }
+}
+
+
+/**
+ * @brief Close the eventfd and detach from host completions. Before
+ *        wasm_api_cleanup
+ */
+void wasm_sched_shutdown(void) {
+
+    if(g_sched_fd < 0) {
+        return;
+    }
+
+    wasm_host_set_notify(NULL, NULL);
+    wasm_uring_set_eventfd(-1);
+
+    for(int id = 0; id < NUM_MAX_PARTITIONS; id++) {
+        wasm_sched_remove(id);
+    }
+
+    close(g_sched_fd);
+    g_sched_fd = -1;
+    g_sched_on_exit = NULL;
+    g_sched_env = NULL;
+}
@@ -0,0 +1,183 @@
+/*
+ * wasm_sched.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+#ifndef WASM_SCHED_H
+#define WASM_SCHED_H
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include "wasm_api.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/****************************************************************************
+ * Defines
+****************************************************************************/
+#define SCHED_BACKOFF_NS            (1000 * 1000)           // Default first delay of RESTART_BACKOFF, 1 ms
+#define SCHED_BACKOFF_MAX_NS        (1000 * 1000 * 1000)    // Default cap of the delay, 1 s
+#define SCHED_RESTART_WINDOW_NS     (60ull * 1000 * 1000 * 1000)  // Default window of the restart budget
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+// Limits of one wasm_sched_step, 0 leaves a limit unset. Without any limit
+// a step runs one round over the runnable partitions
+typedef struct wasm_sched_budget {
+    uint64_t time_ns;                   // Wall time, checked between slices
+    uint64_t fuel;                      // Fuel consumed by all partitions together
+} wasm_sched_budget_t;
+
+typedef enum {
+    RESTART_NEVER = 0,                  // Leave the run queue, on_exit is called
+    RESTART_IMMEDIATE,                  // Restart before its next slice
+    RESTART_BACKOFF                     // Restart after a delay that doubles with every restart in the window
+} wasm_sched_restart_mode_t;
+
+// What happens to a partition whose call traps, see wasm_sched_set_restart.
+// PARTITION_ERROR and PARTITION_LIMIT restart, other statuses leave the run
+// queue. Once the budget is spent the partition leaves with its status
+typedef struct wasm_sched_restart {
+    wasm_sched_restart_mode_t mode;
+    uint32_t max_restarts;              // Restarts per window, 0 for no limit
+    uint64_t window_ns;                 // Window of max_restarts, 0 for SCHED_RESTART_WINDOW_NS
+    uint64_t backoff_ns;                // First delay of RESTART_BACKOFF, 0 for SCHED_BACKOFF_NS
+    uint64_t backoff_max_ns;            // Cap of the delay, 0 for SCHED_BACKOFF_MAX_NS
+} wasm_sched_restart_t;
+
+typedef struct wasm_sched_stats {
+    uint64_t restarts;
+    uint64_t restart_failures;          // Restarts whose instantiation failed, the partition left
+    uint64_t budget_exhausted;          // Partitions that left because their restart budget was spent
+    uint64_t restart_ns;                // Time spent in restarts
+    uint64_t restart_max_ns;            // Slowest restart
+    size_t waiting;                     // Partitions waiting out a backoff
+    uint64_t refills;                   // Fuel refills of wasm_sched_set_fuel_period
+    size_t starved;                     // Scheduled partitions waiting for a refill
+} wasm_sched_stats_t;
+
+/**
+ * @brief Called when a scheduled partition finished and left the run queue
+ *
+ * @param partition_id Partition identifier
+ * @param status PARTITION_DONE, PARTITION_ERROR, PARTITION_LIMIT or WASM_API_ERR
+ * @param env User data given to wasm_sched_init
+ */
+typedef void (*wasm_sched_exit_t)(int partition_id, wasm_api_result_t status, void *env);
+
+
+/****************************************************************************
+ * Function Prototypes
+****************************************************************************/
+
+/**
+ * @brief Create the scheduler's eventfd and route host completions to it.
+ *        Call after wasm_api_init
+ *
+ * @param on_exit Called for partitions leaving the run queue, may be NULL
+ * @param env Passed to on_exit
+ * @return 0 when successful, else -1
+ */
+int wasm_sched_init(wasm_sched_exit_t on_exit, void *env);
+
+
+/**
+ * @brief Readiness source for an event loop. Readable while a step can make
+ *        progress, wasm_sched_step consumes it
+ */
+int wasm_sched_fd(void);
+
+
+/**
+ * @brief Put a loaded partition on the run queue
+ *
+ * @param partition_id Partition identifier
+ * @param func_name Exported function to run, kept until the partition exits
+ * @return 0 when successful, else -1
+ */
+int wasm_sched_add(int partition_id, const char *func_name);
+
+
+/**
+ * @brief Take a partition off the run queue without calling on_exit
+ */
+void wasm_sched_remove(int partition_id);
+
+
+/**
+ * @brief Set the restart policy of a partition id, kept until it is set
+ *        again. Restarts reuse the partition's compiled code, see
+ *        wasm_api_restart_partition
+ *
+ * @param partition_id Partition identifier
+ * @param policy Restart policy, NULL for RESTART_NEVER
+ * @return 0 when successful, else -1
+ */
+int wasm_sched_set_restart(int partition_id, const wasm_sched_restart_t *policy);
+
+
+/**
+ * @brief Refill the fuel of a partition id to a budget at the start of every
+ *        period, fuel left over does not carry into the next one. With
+ *        wasm_api_set_fuel_suspend a partition that spent its budget waits
+ *        starved for the next period instead of trapping
+ *
+ * @param partition_id Partition identifier, loaded
+ * @param fuel Budget per period, refilled right away
+ * @param period_ns Period, 0 stops refilling
+ * @return 0 when successful, else -1
+ */
+int wasm_sched_set_fuel_period(int partition_id, uint64_t fuel, uint64_t period_ns);
+
+
+/**
+ * @brief Timeout for the event loop's wait, the next backoff restart or
+ *        refill of a starved partition is due then and wasm_sched_step should
+ *        run even if the fd is not readable
+ *
+ * @return Milliseconds, rounded up, or -1 when nothing is waiting
+ */
+int wasm_sched_timeout_ms(void);
+
+
+/**
+ * @brief Run slices round robin over runnable partitions until the budget is
+ *        used up or every partition is blocked or gone. Never blocks
+ *
+ * @param budget Limits of this step, NULL for one round
+ * @return Slices run
+ */
+size_t wasm_sched_step(const wasm_sched_budget_t *budget);
+
+
+/**
+ * @brief Number of partitions on the run queue, blocked, starved and ones
+ *        waiting for a restart included
+ */
+size_t wasm_sched_active(void);
+
+
+/**
+ * @brief Restart and refill statistics
+ *
+ * @param stats Output
+ */
+void wasm_sched_stats(wasm_sched_stats_t *stats);
+
+
+/**
+ * @brief Close the eventfd and detach from host completions. Before
+ *        wasm_api_cleanup
+ */
+void wasm_sched_shutdown(void);
+
+
+#endif // WASM_SCHED_H
@@ -0,0 +1,389 @@
+/*
+ * wasm_stack_pool.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+// https://docs.wasmtime.dev/api/wasmtime/trait.StackCreator.html
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include "wasm_stack_pool.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+typedef struct wasm_stack_pool wasm_stack_pool_t;
+
+// One slot: [guard | stack], the stack grows down towards the guard
+typedef struct wasm_stack_slot {
+    wasm_stack_pool_t *pool;    // Owner, the finalizer only gets the slot
+    uint8_t *base;              // Lowest usable address, right above the guard
+    size_t size;
+    size_t index;
+    bool zeroed;                // Handed out zeroed, its depth is measured on release
+    size_t dirty;               // Bytes below the top that may be non-zero
+    size_t high_water;          // Deepest use measured so far
+} wasm_stack_slot_t;
+
+struct wasm_stack_pool {
+    uint8_t *mapping;
+    size_t mapping_size;
+    size_t slot_size;           // Guard + stack
+    size_t guard_size;
+    size_t stack_size;
+    size_t count;
+    wasm_stack_slot_t *slots;
+    size_t *free_list;          // Indices of free slots, LIFO keeps warm stacks hot
+    size_t free_count;
+    size_t high_water;
+    uint64_t exhausted;
+    size_t locked;
+    unsigned char *residency;   // mincore scratch, one byte per page
+    pthread_mutex_t lock;
+};
+
+
+/****************************************************************************
+ * Pool state
+****************************************************************************/
+static wasm_stack_pool_t *g_stack_pool = NULL;
+
+
+/****************************************************************************
+ * Static Function Prototypes
+****************************************************************************/
+static wasmtime_error_t *stack_pool_new_stack(void *env, size_t size, bool zeroed, wasmtime_stack_memory_t *stack_ret);
+static uint8_t *stack_pool_get_stack(void *env, size_t *out_len);
+static void stack_pool_release(void *env);
+static size_t stack_pool_depth(wasm_stack_pool_t *pool, const wasm_stack_slot_t *slot);
+static size_t round_up(size_t value, size_t align);
+
+
+/****************************************************************************
+ * Static Function Implementations
+****************************************************************************/
+
+static size_t round_up(size_t value, size_t align) {
+    return (value + align - 1) / align * align;
+}
+
+
+/**
+ * @brief Wasmtime's new_stack callback, hands out a free slot. Must be thread-safe
+ */
+static wasmtime_error_t *stack_pool_new_stack(void *env, size_t size, bool zeroed, wasmtime_stack_memory_t *stack_ret) {
+    wasm_stack_pool_t *pool = env;
+
+    if(size > pool->stack_size) {
+        return wasmtime_error_new("requested async stack larger than the pool's stack size");
+    }
+
+    pthread_mutex_lock(&pool->lock);
+
+    if(pool->free_count == 0) {
+        pool->exhausted++;
+        pthread_mutex_unlock(&pool->lock);
+        return wasmtime_error_new("async stack pool exhausted");
+    }
+
+    wasm_stack_slot_t *slot = &pool->slots[pool->free_list[--pool->free_count]];
+
+    size_t in_use = pool->count - pool->free_count;
+    if(in_use > pool->high_water) {
+        pool->high_water = in_use;
+    }
+
+    // Only the range the previous fiber wrote can be dirty
+    size_t dirty = zeroed ? slot->dirty : 0;
+    slot->zeroed = zeroed;
+
+    pthread_mutex_unlock(&pool->lock);
+
+    if(dirty > 0) {
+        memset(slot->base + slot->size - dirty, 0, dirty);
+        slot->dirty = 0;
+    }
+
+    stack_ret->env = slot;
+    stack_ret->get_stack_memory = stack_pool_get_stack;
+    stack_ret->finalizer = stack_pool_release;
+
+    return NULL;
+}
+
+
+/**
+ * @brief Returns the top of the stack and its usable length, guard excluded
+ */
+static uint8_t *stack_pool_get_stack(void *env, size_t *out_len) {
+    wasm_stack_slot_t *slot = env;
+    *out_len = slot->size;
+    return slot->base + slot->size;
+}
+
+
+/**
+ * @brief Finalizer of a stack, puts the slot back. A stack handed out zeroed
+ *        is measured now, the next zeroed use only clears that range
+ */
+static void stack_pool_release(void *env) {
+    wasm_stack_slot_t *slot = env;
+    wasm_stack_pool_t *pool = slot->pool;
+
+    pthread_mutex_lock(&pool->lock);
+
+    // Without a measurement every byte may be dirty
+    slot->dirty = slot->zeroed ? stack_pool_depth(pool, slot) : slot->size;
+    if(slot->zeroed && slot->dirty > slot->high_water) {
+        slot->high_water = slot->dirty;
+    }
+
+    pool->free_list[pool->free_count++] = slot->index;
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
+
+/**
+ * @brief Depth of the deepest non-zero word of a stack, in bytes from the
+ *        top. Pages that are not resident read as zero and are skipped, the
+ *        rest is scanned, so hugepage-backed stacks are measured exactly too.
+ *        Caller holds the lock, the residency buffer is shared
+ */
+static size_t stack_pool_depth(wasm_stack_pool_t *pool, const wasm_stack_slot_t *slot) {
+    size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+    size_t pages = slot->size / page_size;
+
+    if(mincore(slot->base, slot->size, pool->residency) != 0) {
+        return slot->size;
+    }
+
+    // The stack grows down, the lowest non-zero word is the deepest point
+    for(size_t i = 0; i < pages; i++) {
+        if(!(pool->residency[i] & 1)) {
+            continue;
+        }
+
+        const uint64_t *word = (const uint64_t *) (slot->base + i * page_size);
+        for(size_t w = 0; w < page_size / sizeof(uint64_t); w++) {
+            if(word[w] != 0) {
+                return slot->size - (i * page_size + w * sizeof(uint64_t));
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+/****************************************************************************
+ * Function Implementations
+****************************************************************************/
+
+/**
+ * @brief Preallocate the fiber stack pool and register it as host stack
+ *        creator. Each stack has a PROT_NONE guard page below it, so no mmap
+ *        happens when a call starts
+ *
+ * @param config Config the stack creator is set on
+ * @param count Number of stacks, one per concurrently running future
+ * @param stack_size Usable size per stack, 0 for STACK_POOL_DEFAULT_SIZE
+ * @param hugepages Back stacks with transparent 2 MiB pages
+ * @param lock Prefault and mlock every stack up front
+ * @return 0 when successful, else -1
+ */
+int wasm_stack_pool_init(wasm_config_t *config, size_t count, size_t stack_size, bool hugepages, bool lock) {
+
+    if(g_stack_pool != NULL) {
+        printf("Stack pool already initialised\n");
+        return -1;
+    }
+
+    if(count == 0) {
+        return -1;
+    }
+
+    size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+    size_t align = hugepages ? STACK_POOL_HUGE_PAGE : page_size;
+
+    wasm_stack_pool_t *pool = calloc(1, sizeof(wasm_stack_pool_t));
+    if(!pool) {
+        printf("Memory allocation failed!\n");
+        return -1;
+    }
+
+    // With hugepages the guard takes a whole 2 MiB so stacks stay huge-page aligned,
+    // that only costs address space, guards are never backed
+    pool->stack_size = round_up(stack_size ? stack_size : STACK_POOL_DEFAULT_SIZE, align);
+    pool->guard_size = hugepages ? STACK_POOL_HUGE_PAGE : round_up(STACK_POOL_GUARD_SIZE, page_size);
+    pool->slot_size = pool->guard_size + pool->stack_size;
+    pool->count = count;
+    pool->mapping_size = pool->slot_size * count + (hugepages ? STACK_POOL_HUGE_PAGE : 0);
+
+    pool->slots = calloc(count, sizeof(wasm_stack_slot_t));
+    pool->free_list = calloc(count, sizeof(size_t));
+    pool->residency = calloc(pool->stack_size / page_size, 1);
+    if(!pool->slots || !pool->free_list || !pool->residency) {
+        printf("Memory allocation failed!\n");
+        free(pool->slots);
+        free(pool->free_list);
+        free(pool->residency);
+        free(pool);
+        return -1;
+    }
+
+    pool->mapping = mmap(NULL, pool->mapping_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(pool->mapping == MAP_FAILED) {
+        printf("Failed to reserve %zu bytes for the stack pool\n", pool->mapping_size);
+        free(pool->slots);
+        free(pool->free_list);
+        free(pool->residency);
+        free(pool);
+        return -1;
+    }
+
+    uint8_t *first = (uint8_t *) round_up((size_t) pool->mapping, align);
+
+    for(size_t i = 0; i < count; i++) {
+        wasm_stack_slot_t *slot = &pool->slots[i];
+        slot->pool = pool;
+        slot->base = first + i * pool->slot_size + pool->guard_size;
+        slot->size = pool->stack_size;
+        slot->index = i;
+
+        // Guard stays PROT_NONE, overflowing into it faults instead of corrupting the neighbour
+        if(mprotect(slot->base, slot->size, PROT_READ | PROT_WRITE) != 0) {
+            printf("Failed to map stack %zu of the stack pool\n", i);
+            munmap(pool->mapping, pool->mapping_size);
+            free(pool->slots);
+            free(pool->free_list);
+            free(pool->residency);
+            free(pool);
+            return -1;
+        }
+
+        if(hugepages) {
+            madvise(slot->base, slot->size, MADV_HUGEPAGE);
+        }
+
+        // Faults in the whole stack, fibers never take a page fault
+        if(lock && mlock(slot->base, slot->size) != 0) {
+            printf("Failed to lock stack %zu of the stack pool, check RLIMIT_MEMLOCK\n", i);
+            munmap(pool->mapping, pool->mapping_size);
+            free(pool->slots);
+            free(pool->free_list);
+            free(pool->residency);
+            free(pool);
+            return -1;
+        }
+        pool->locked += lock ? slot->size : 0;
+
+        // Hand out low indices first
+        pool->free_list[count - 1 - i] = i;
+    }
+    pool->free_count = count;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    g_stack_pool = pool;
+
+    return wasm_stack_pool_attach(config);
+}
+
+
+/**
+ * @brief Register the existing pool as host stack creator of another config,
+ *        engines built from both share its stacks
+ *
+ * @param config Config the stack creator is set on
+ * @return 0 when successful, -1 without a pool
+ */
+int wasm_stack_pool_attach(wasm_config_t *config) {
+
+    if(g_stack_pool == NULL) {
+        return -1;
+    }
+
+    wasmtime_stack_creator_t creator = {
+        .env = g_stack_pool,
+        .new_stack = stack_pool_new_stack,
+        .finalizer = NULL
+    };
+    wasmtime_config_host_stack_creator_set(config, &creator);
+    wasmtime_config_async_stack_size_set(config, g_stack_pool->stack_size);
+
+    return 0;
+}
+
+
+/**
+ * @brief Current pool statistics, zeroed when the pool is not in use
+ *
+ * @param stats Output
+ */
+void wasm_stack_pool_stats(wasm_stack_pool_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+
+    wasm_stack_pool_t *pool = g_stack_pool;
+    if(pool == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    stats->stacks_total = pool->count;
+    stats->stacks_in_use = pool->count - pool->free_count;
+    stats->stacks_high_water = pool->high_water;
+
+    // Free stacks keep what their last fiber wrote unless they are zeroed,
+    // stacks in use may run on another thread and only count as measured
+    for(size_t i = 0; i < pool->free_count; i++) {
+        wasm_stack_slot_t *slot = &pool->slots[pool->free_list[i]];
+        size_t depth = stack_pool_depth(pool, slot);
+        if(depth > slot->high_water) {
+            slot->high_water = depth;
+        }
+    }
+    for(size_t i = 0; i < pool->count; i++) {
+        if(pool->slots[i].high_water > stats->stack_bytes_high_water) {
+            stats->stack_bytes_high_water = pool->slots[i].high_water;
+        }
+    }
+
+    stats->stack_exhausted = pool->exhausted;
+    stats->stack_bytes_locked = pool->locked;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+
+/**
+ * @brief Unmap the pool. All stacks must have been returned, i.e. the engine
+ *        and every store using it are deleted
+ */
+void wasm_stack_pool_destroy(void) {
+    wasm_stack_pool_t *pool = g_stack_pool;
+    if(pool == NULL) {
+        return;
+    }
+
+    if(pool->free_count != pool->count) {
+        printf("Stack pool destroyed with %zu stacks in use\n", pool->count - pool->free_count);
+    }
+
+    munmap(pool->mapping, pool->mapping_size);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->slots);
+    free(pool->free_list);
+    free(pool->residency);
+    free(pool);
+    g_stack_pool = NULL;
+}
@@ -0,0 +1,87 @@
+/*
+ * wasm_stack_pool.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+#ifndef WASM_STACK_POOL_H
+#define WASM_STACK_POOL_H
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wasm.h>
+#include <wasmtime.h>
+
+
+/****************************************************************************
+ * Defines
+****************************************************************************/
+#define STACK_POOL_DEFAULT_SIZE     (2u * 1024 * 1024)  // Wasmtime's default async stack size
+#define STACK_POOL_GUARD_SIZE       4096
+#define STACK_POOL_HUGE_PAGE        (2u * 1024 * 1024)
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+typedef struct wasm_stack_pool_stats {
+    size_t stacks_total;
+    size_t stacks_in_use;
+    size_t stacks_high_water;       // Most stacks in use at the same time
+    size_t stack_bytes_high_water;  // Deepest stack usage seen, the deepest non-zero word of a free or released stack
+    uint64_t stack_exhausted;       // Requests failed because the pool was empty
+    size_t stack_bytes_locked;      // mlocked at init
+} wasm_stack_pool_stats_t;
+
+
+/****************************************************************************
+ * Function Prototypes
+****************************************************************************/
+
+/**
+ * @brief Preallocate the fiber stack pool and register it as host stack
+ *        creator. Each stack has a PROT_NONE guard page below it, so no mmap
+ *        happens when a call starts
+ *
+ * @param config Config the stack creator is set on
+ * @param count Number of stacks, one per concurrently running future
+ * @param stack_size Usable size per stack, 0 for STACK_POOL_DEFAULT_SIZE
+ * @param hugepages Back stacks with transparent 2 MiB pages
+ * @param lock Prefault and mlock every stack up front
+ * @return 0 when successful, else -1
+ */
+int wasm_stack_pool_init(wasm_config_t *config, size_t count, size_t stack_size, bool hugepages, bool lock);
+
+
+/**
+ * @brief Register the existing pool as host stack creator of another config,
+ *        engines built from both share its stacks
+ *
+ * @param config Config the stack creator is set on
+ * @return 0 when successful, -1 without a pool
+ */
+int wasm_stack_pool_attach(wasm_config_t *config);
+
+
+/**
+ * @brief Current pool statistics, zeroed when the pool is not in use
+ *
+ * @param stats Output
+ */
+void wasm_stack_pool_stats(wasm_stack_pool_stats_t *stats);
+
+
+/**
+ * @brief Unmap the pool. All stacks must have been returned, i.e. the engine
+ *        and every store using it are deleted
+ */
+void wasm_stack_pool_destroy(void);
+
+
+#endif // WASM_STACK_POOL_H
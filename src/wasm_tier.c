@@ -0,0 +1,296 @@
+/*
+ * wasm_tier.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+// Tier-up of modules. Partitions start on code of the baseline engine, which
+// compiles quickly, and modules that turn out hot are recompiled by the
+// optimizing engine in the background. Code never changes under a running
+// instance: loads after the recompilation get the optimized module
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include "wasm_tier.h"
+#include "wasm_cache.h"
+#include "wasm_rt.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+// Written by its compile thread until done is set
+typedef struct tier_entry {
+    char *wasm_file;
+    dev_t dev;                      // File identity, as for shared modules
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    uint8_t *wasm;                  // Bytes the baseline was compiled from, freed by the compile
+    size_t wasm_size;
+    uint64_t slices;
+    bool started;
+    bool start_failed;              // No compile thread was created, thread is unset
+    pthread_t thread;
+    wasmtime_module_t *module;      // Optimized, NULL when the recompilation failed
+    uint64_t compile_ns;
+    _Atomic bool done;
+} tier_entry_t;
+
+
+/****************************************************************************
+ * Tier state
+****************************************************************************/
+static wasm_engine_t *g_tier_engine = NULL;
+static uint64_t g_tier_threshold = TIER_UP_SLICES;
+static tier_entry_t g_tier_entries[TIER_MAX_MODULES];
+static int g_tier_count = 0;
+static uint64_t g_tier_baseline_loads = 0;
+static uint64_t g_tier_optimized_loads = 0;
+static uint64_t g_tier_start_failures = 0;
+
+
+/****************************************************************************
+ * Static Function Prototypes
+****************************************************************************/
+static void *tier_compile(void *arg);
+static uint64_t tier_now_ns(void);
+
+
+/****************************************************************************
+ * Static Function Implementations
+****************************************************************************/
+
+static uint64_t tier_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+
+/**
+ * @brief Recompile a module with the optimizing engine, on a housekeeping thread
+ */
+static void *tier_compile(void *arg) {
+    tier_entry_t *entry = arg;
+    uint64_t start = tier_now_ns();
+
+    // The file may have changed since, the baseline's bytes are compiled
+    wasmtime_error_t *error = wasmtime_module_new(g_tier_engine, entry->wasm, entry->wasm_size, &entry->module);
+    if(error != NULL) {
+        wasmtime_error_delete(error);
+        entry->module = NULL;
+    } else {
+        wasm_cache_count_compile();
+    }
+    free(entry->wasm);
+    entry->wasm = NULL;
+
+    if(entry->module == NULL) {
+        printf("Tier-up of %s failed, it stays on baseline code\n", entry->wasm_file);
+    }
+
+    entry->compile_ns = tier_now_ns() - start;
+    atomic_store_explicit(&entry->done, true, memory_order_release);
+    return NULL;
+}
+
+
+/****************************************************************************
+ * Function Implementations
+****************************************************************************/
+
+/**
+ * @brief Enable tier-up. Modules whose partitions ran tier_up_slices slices
+ *        are recompiled on a housekeeping thread with the optimizing engine
+ *
+ * @param optimized Engine of the optimized tier
+ * @param tier_up_slices Slices before a module is recompiled, 0 for TIER_UP_SLICES
+ * @return 0 when successful, else -1
+ */
+int wasm_tier_init(wasm_engine_t *optimized, uint64_t tier_up_slices) {
+
+    if(g_tier_engine != NULL || optimized == NULL) {
+        printf("Cannot initialise tiering\n");
+        return -1;
+    }
+
+    g_tier_engine = optimized;
+    g_tier_threshold = tier_up_slices ? tier_up_slices : TIER_UP_SLICES;
+    g_tier_count = 0;
+    g_tier_baseline_loads = 0;
+    g_tier_optimized_loads = 0;
+    g_tier_start_failures = 0;
+
+    return 0;
+}
+
+
+/**
+ * @brief Tier entry of a module file, created on first use. Entries are
+ *        identified like shared modules, a changed file gets an entry of its
+ *        own. Hands out the optimized module once its recompilation has
+ *        finished
+ *
+ * @param wasm_file Module file, for messages
+ * @param st File the bytes were read from
+ * @param wasm Module bytes, a new entry keeps a copy to recompile
+ * @param size Bytes of wasm
+ * @param optimized Output, a new reference to the optimized module, else NULL
+ * @return Entry for wasm_tier_count, -1 when the table is full or tiering is off
+ */
+int wasm_tier_lookup(const char *wasm_file, const struct stat *st, const uint8_t *wasm, size_t size,
+                     wasmtime_module_t **optimized) {
+    int tier;
+
+    *optimized = NULL;
+    if(g_tier_engine == NULL) {
+        return -1;
+    }
+
+    for(tier = 0; tier < g_tier_count; tier++) {
+        tier_entry_t *entry = &g_tier_entries[tier];
+        if(entry->dev == st->st_dev && entry->ino == st->st_ino && entry->size == st->st_size
+           && entry->mtime.tv_sec == st->st_mtim.tv_sec && entry->mtime.tv_nsec == st->st_mtim.tv_nsec) {
+            break;
+        }
+    }
+
+    if(tier == g_tier_count) {
+        if(g_tier_count == TIER_MAX_MODULES) {
+            g_tier_baseline_loads++;
+            return -1;
+        }
+
+        tier_entry_t *entry = &g_tier_entries[tier];
+        memset(entry, 0, sizeof(*entry));
+        entry->wasm_file = strdup(wasm_file);
+        entry->wasm = malloc(size ? size : 1);
+        if(!entry->wasm_file || !entry->wasm) {
+            printf("Memory allocation failed!\n");
+            free(entry->wasm_file);
+            free(entry->wasm);
+            return -1;
+        }
+        memcpy(entry->wasm, wasm, size);
+        entry->wasm_size = size;
+        entry->dev = st->st_dev;
+        entry->ino = st->st_ino;
+        entry->size = st->st_size;
+        entry->mtime = st->st_mtim;
+        atomic_init(&entry->done, false);
+        g_tier_count++;
+    }
+
+    tier_entry_t *entry = &g_tier_entries[tier];
+    if(atomic_load_explicit(&entry->done, memory_order_acquire) && entry->module != NULL) {
+        *optimized = wasmtime_module_clone(entry->module);
+        g_tier_optimized_loads++;
+    } else {
+        g_tier_baseline_loads++;
+    }
+
+    return tier;
+}
+
+
+/**
+ * @brief Optimized module of an entry, for a partition that starts afresh
+ *        after its module tiered up. Not counted as a load
+ *
+ * @param tier Entry from wasm_tier_lookup
+ * @return A new reference to the optimized module, NULL while there is none
+ */
+wasmtime_module_t *wasm_tier_optimized(int tier) {
+    tier_entry_t *entry = &g_tier_entries[tier];
+
+    if(!atomic_load_explicit(&entry->done, memory_order_acquire) || entry->module == NULL) {
+        return NULL;
+    }
+
+    return wasmtime_module_clone(entry->module);
+}
+
+
+/**
+ * @brief Count a slice of a module, starts its recompilation at the threshold.
+ *        Scheduler thread only
+ *
+ * @param tier Entry from wasm_tier_lookup
+ */
+void wasm_tier_count(int tier) {
+    tier_entry_t *entry = &g_tier_entries[tier];
+
+    if(entry->started || ++entry->slices < g_tier_threshold) {
+        return;
+    }
+
+    // Housekeeping CPUs, never the scheduler's
+    entry->started = true;
+    if(pthread_create(&entry->thread, wasm_rt_housekeeping_attr(), tier_compile, entry) != 0) {
+        printf("Failed to start the tier-up of %s\n", entry->wasm_file);
+        entry->start_failed = true;
+        atomic_store_explicit(&entry->done, true, memory_order_release);
+        g_tier_start_failures++;
+    }
+}
+
+
+/**
+ * @brief Tiering statistics
+ *
+ * @param stats Output
+ */
+void wasm_tier_stats(wasm_tier_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+
+    stats->baseline_loads = g_tier_baseline_loads;
+    stats->optimized_loads = g_tier_optimized_loads;
+    stats->tier_up_failures = g_tier_start_failures;
+
+    for(int tier = 0; tier < g_tier_count; tier++) {
+        tier_entry_t *entry = &g_tier_entries[tier];
+        if(!entry->started || !atomic_load_explicit(&entry->done, memory_order_acquire)) {
+            continue;
+        }
+        if(entry->module != NULL) {
+            stats->tier_ups++;
+            stats->tier_up_ns += entry->compile_ns;
+        } else if(!entry->start_failed) {
+            stats->tier_up_failures++;
+        }
+    }
+}
+
+
+/**
+ * @brief Wait for running recompilations and drop all entries. Modules handed
+ *        out stay valid
+ */
+void wasm_tier_destroy(void) {
+
+    for(int tier = 0; tier < g_tier_count; tier++) {
+        tier_entry_t *entry = &g_tier_entries[tier];
+
+        if(entry->started && !entry->start_failed) {
+            pthread_join(entry->thread, NULL);
+        }
+        if(entry->module != NULL) {
+            wasmtime_module_delete(entry->module);
+        }
+        free(entry->wasm);
+        free(entry->wasm_file);
+    }
+
+    g_tier_count = 0;
+    g_tier_engine = NULL;
+}
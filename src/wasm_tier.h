@@ -0,0 +1,108 @@
+/*
+ * wasm_tier.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+#ifndef WASM_TIER_H
+#define WASM_TIER_H
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <wasm.h>
+#include <wasmtime.h>
+
+
+/****************************************************************************
+ * Defines
+****************************************************************************/
+#define TIER_MAX_MODULES    64              // Distinct module files, or versions of one, tracked for tier-up
+#define TIER_UP_SLICES      1000            // Default slices of a module before it is recompiled
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+typedef struct wasm_tier_stats {
+    uint64_t baseline_loads;        // Partitions loaded with baseline code
+    uint64_t optimized_loads;       // Partitions loaded with recompiled code
+    uint64_t tier_ups;              // Modules recompiled optimized
+    uint64_t tier_up_failures;
+    uint64_t tier_up_ns;            // Background compile time of all tier-ups
+} wasm_tier_stats_t;
+
+
+/****************************************************************************
+ * Function Prototypes
+****************************************************************************/
+
+/**
+ * @brief Enable tier-up. Modules whose partitions ran tier_up_slices slices
+ *        are recompiled on a housekeeping thread with the optimizing engine
+ *
+ * @param optimized Engine of the optimized tier
+ * @param tier_up_slices Slices before a module is recompiled, 0 for TIER_UP_SLICES
+ * @return 0 when successful, else -1
+ */
+int wasm_tier_init(wasm_engine_t *optimized, uint64_t tier_up_slices);
+
+
+/**
+ * @brief Tier entry of a module file, created on first use. Entries are
+ *        identified like shared modules, a changed file gets an entry of its
+ *        own. Hands out the optimized module once its recompilation has
+ *        finished
+ *
+ * @param wasm_file Module file, for messages
+ * @param st File the bytes were read from
+ * @param wasm Module bytes, a new entry keeps a copy to recompile
+ * @param size Bytes of wasm
+ * @param optimized Output, a new reference to the optimized module, else NULL
+ * @return Entry for wasm_tier_count, -1 when the table is full or tiering is off
+ */
+int wasm_tier_lookup(const char *wasm_file, const struct stat *st, const uint8_t *wasm, size_t size,
+                     wasmtime_module_t **optimized);
+
+
+/**
+ * @brief Optimized module of an entry, for a partition that starts afresh
+ *        after its module tiered up. Not counted as a load
+ *
+ * @param tier Entry from wasm_tier_lookup
+ * @return A new reference to the optimized module, NULL while there is none
+ */
+wasmtime_module_t *wasm_tier_optimized(int tier);
+
+
+/**
+ * @brief Count a slice of a module, starts its recompilation at the threshold.
+ *        Scheduler thread only
+ *
+ * @param tier Entry from wasm_tier_lookup
+ */
+void wasm_tier_count(int tier);
+
+
+/**
+ * @brief Tiering statistics
+ *
+ * @param stats Output
+ */
+void wasm_tier_stats(wasm_tier_stats_t *stats);
+
+
+/**
+ * @brief Wait for running recompilations and drop all entries. Modules handed
+ *        out stay valid
+ */
+void wasm_tier_destroy(void);
+
+
+#endif // WASM_TIER_H
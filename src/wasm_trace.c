@@ -0,0 +1,341 @@
+/*
+ * wasm_trace.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+// https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include "wasm_trace.h"
+#include "wasm_api.h"
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+// Single producer (the owning thread), consumer is the flush
+typedef struct wasm_trace_buffer {
+    _Atomic uint64_t head;                  // Total events written
+    uint64_t mask;
+    uint32_t thread_id;
+    struct wasm_trace_buffer *next;
+    wasm_trace_event_t events[];
+} wasm_trace_buffer_t;
+
+
+/****************************************************************************
+ * Trace state
+****************************************************************************/
+bool g_trace_enabled = false;
+
+static char *g_trace_file = NULL;
+static size_t g_trace_capacity = TRACE_EVENTS_PER_THREAD;
+static _Atomic(wasm_trace_buffer_t *) g_trace_buffers = NULL;
+static _Atomic uint32_t g_trace_generation = 0;
+static volatile sig_atomic_t g_trace_flush_requested = 0;
+
+static _Thread_local wasm_trace_buffer_t *t_trace_buffer = NULL;
+static _Thread_local uint32_t t_trace_generation = 0;
+
+
+/****************************************************************************
+ * Static Function Prototypes
+****************************************************************************/
+static wasm_trace_buffer_t *trace_thread_buffer(void);
+static void trace_signal_handler(int signum);
+static const char *trace_reason_name(uint16_t reason);
+static void trace_write_event(FILE *file, const wasm_trace_event_t *event, int pid, bool *first);
+
+
+/****************************************************************************
+ * Static Function Implementations
+****************************************************************************/
+
+/**
+ * @brief Returns the ring buffer of the calling thread, allocates and registers
+ *        it on first use
+ *
+ * @return Ring buffer, NULL if allocation failed
+ */
+static wasm_trace_buffer_t *trace_thread_buffer(void) {
+    uint32_t generation = atomic_load_explicit(&g_trace_generation, memory_order_acquire);
+
+    if(t_trace_buffer != NULL && t_trace_generation == generation) {
+        return t_trace_buffer;
+    }
+
+    wasm_trace_buffer_t *buffer = calloc(1, sizeof(wasm_trace_buffer_t) + g_trace_capacity * sizeof(wasm_trace_event_t));
+    if(!buffer) {
+        return NULL;
+    }
+
+    buffer->mask = g_trace_capacity - 1;
+    buffer->thread_id = (uint32_t) syscall(SYS_gettid);
+
+    // Lock-free push onto the global list, buffers are only freed at shutdown
+    wasm_trace_buffer_t *head = atomic_load_explicit(&g_trace_buffers, memory_order_relaxed);
+    do {
+        buffer->next = head;
+    } while(!atomic_compare_exchange_weak_explicit(&g_trace_buffers, &head, buffer, memory_order_release, memory_order_relaxed));
+
+    t_trace_buffer = buffer;
+    t_trace_generation = generation;
+
+    return buffer;
+}
+
+
+/**
+ * @brief Only sets a flag, the flush happens in wasm_trace_poll()
+ */
+static void trace_signal_handler(int signum) {
+    (void) signum;
+    g_trace_flush_requested = 1;
+}
+
+
+/**
+ * @brief Human-readable name of the slice outcome
+ */
+static const char *trace_reason_name(uint16_t reason) {
+    switch(reason) {
+        case PARTITION_DONE:    return "done";
+        case PARTITION_YIELDED: return "yielded";
+        case PARTITION_ERROR:   return "error";
+        case PARTITION_LIMIT:   return "limit";
+        case PARTITION_BLOCKED: return "blocked";
+        case PARTITION_STARVED: return "starved";
+        case WASM_API_NO_FUEL:  return "no_fuel";
+        case WASM_API_OK:       return "ok";
+        default:                return "error";
+    }
+}
+
+
+/**
+ * @brief Writes a single event as Chrome trace-event JSON object
+ */
+static void trace_write_event(FILE *file, const wasm_trace_event_t *event, int pid, bool *first) {
+    double ts_us = (double) event->timestamp_ns / 1000.0;
+    const char *sep = *first ? "" : ",\n";
+    *first = false;
+
+    switch(event->type) {
+        case TRACE_SLICE_BEGIN:
+            fprintf(file, "%s{\"name\":\"partition %d\",\"cat\":\"slice\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u}",
+                    sep, event->partition_id, ts_us, pid, event->thread_id);
+        break;
+
+        case TRACE_SLICE_END:
+            fprintf(file, "%s{\"name\":\"partition %d\",\"cat\":\"slice\",\"ph\":\"E\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u,"
+                          "\"args\":{\"reason\":\"%s\",\"fuel\":%lu}}",
+                    sep, event->partition_id, ts_us, pid, event->thread_id,
+                    trace_reason_name(event->reason), event->fuel);
+        break;
+
+        case TRACE_INSTANTIATE_BEGIN:
+            fprintf(file, "%s{\"name\":\"instantiate %d\",\"cat\":\"instantiate\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u}",
+                    sep, event->partition_id, ts_us, pid, event->thread_id);
+        break;
+
+        case TRACE_INSTANTIATE_END:
+            fprintf(file, "%s{\"name\":\"instantiate %d\",\"cat\":\"instantiate\",\"ph\":\"E\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u,"
+                          "\"args\":{\"reason\":\"%s\"}}",
+                    sep, event->partition_id, ts_us, pid, event->thread_id, trace_reason_name(event->reason));
+        break;
+
+        case TRACE_TRAP:
+            fprintf(file, "%s{\"name\":\"trap %d\",\"cat\":\"trap\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u}",
+                    sep, event->partition_id, ts_us, pid, event->thread_id);
+        break;
+
+        default:
+        break;
+    }
+}
+
+
+/****************************************************************************
+ * Function Implementations
+****************************************************************************/
+
+/**
+ * @brief Enable tracing. Events are written to per-thread ring buffers and
+ *        dumped as Chrome trace-event JSON (readable by Perfetto) on
+ *        wasm_trace_flush(), on TRACE_FLUSH_SIGNAL or at shutdown
+ *
+ * @param out_file JSON file the trace is written to
+ * @param events_per_thread Ring buffer capacity per thread, power of two, 0 for default
+ * @return 0 when successful, else -1
+ */
+int wasm_trace_init(const char *out_file, size_t events_per_thread) {
+
+    if(out_file == NULL) {
+        return -1;
+    }
+
+    if(events_per_thread == 0) {
+        events_per_thread = TRACE_EVENTS_PER_THREAD;
+    }
+
+    if((events_per_thread & (events_per_thread - 1)) != 0) {
+        printf("Trace buffer size %zu is not a power of two\n", events_per_thread);
+        return -1;
+    }
+
+    free(g_trace_file);
+    g_trace_file = strdup(out_file);
+    if(!g_trace_file) {
+        printf("Memory allocation failed!\n");
+        return -1;
+    }
+
+    g_trace_capacity = events_per_thread;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = trace_signal_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(TRACE_FLUSH_SIGNAL, &sa, NULL);
+
+    g_trace_enabled = true;
+
+    return 0;
+}
+
+
+/**
+ * @brief Record an event in the calling thread's ring buffer. Lock-free, the
+ *        oldest events are overwritten when the buffer is full
+ *
+ * @param type Event type
+ * @param partition_id Partition identifier
+ * @param reason Result code of the slice, 0 if not applicable
+ * @param fuel Fuel consumed, 0 if not applicable
+ */
+void wasm_trace_record(wasm_trace_event_type_t type, int partition_id, uint16_t reason, uint64_t fuel) {
+    wasm_trace_buffer_t *buffer = trace_thread_buffer();
+    if(!buffer) {
+        return;
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    uint64_t head = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+    wasm_trace_event_t *event = &buffer->events[head & buffer->mask];
+
+    event->timestamp_ns = (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+    event->fuel = fuel;
+    event->partition_id = partition_id;
+    event->thread_id = buffer->thread_id;
+    event->type = (uint16_t) type;
+    event->reason = reason;
+    event->reserved = 0;
+
+    atomic_store_explicit(&buffer->head, head + 1, memory_order_release);
+}
+
+
+/**
+ * @brief Flush the trace if TRACE_FLUSH_SIGNAL was received since the last call.
+ *        Meant to be called from the scheduler loop, writing JSON is not
+ *        async-signal-safe
+ */
+void wasm_trace_poll(void) {
+    if(g_trace_flush_requested) {
+        g_trace_flush_requested = 0;
+        wasm_trace_flush();
+    }
+}
+
+
+/**
+ * @brief Write all buffered events to the output file
+ *
+ * @return 0 when successful, else -1
+ */
+int wasm_trace_flush(void) {
+
+    if(!g_trace_enabled || g_trace_file == NULL) {
+        return -1;
+    }
+
+    FILE *file = fopen(g_trace_file, "w");
+    if(!file) {
+        printf("> Error opening trace file: %s\n", g_trace_file);
+        return -1;
+    }
+
+    int pid = (int) getpid();
+    bool first = true;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+    wasm_trace_buffer_t *buffer = atomic_load_explicit(&g_trace_buffers, memory_order_acquire);
+    for(; buffer != NULL; buffer = buffer->next) {
+        uint64_t head = atomic_load_explicit(&buffer->head, memory_order_acquire);
+        uint64_t capacity = buffer->mask + 1;
+        uint64_t start = head > capacity ? head - capacity : 0;
+
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"worker %u\"}}",
+                first ? "" : ",\n", pid, buffer->thread_id, buffer->thread_id);
+        first = false;
+
+        // Events still being written by a running thread may be torn at the
+        // wrap-around edge, flushing at shutdown is exact
+        for(uint64_t i = start; i < head; i++) {
+            trace_write_event(file, &buffer->events[i & buffer->mask], pid, &first);
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    printf("> Trace written to %s\n", g_trace_file);
+
+    return 0;
+}
+
+
+/**
+ * @brief Flush and disable tracing, frees all ring buffers
+ */
+void wasm_trace_shutdown(void) {
+
+    if(!g_trace_enabled) {
+        return;
+    }
+
+    wasm_trace_flush();
+
+    g_trace_enabled = false;
+    signal(TRACE_FLUSH_SIGNAL, SIG_DFL);
+
+    // Invalidate thread-local buffer pointers before freeing
+    atomic_fetch_add_explicit(&g_trace_generation, 1, memory_order_release);
+
+    wasm_trace_buffer_t *buffer = atomic_exchange_explicit(&g_trace_buffers, NULL, memory_order_acq_rel);
+    while(buffer != NULL) {
+        wasm_trace_buffer_t *next = buffer->next;
+        free(buffer);
+        buffer = next;
+    }
+
+    free(g_trace_file);
+    g_trace_file = NULL;
+}
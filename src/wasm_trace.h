@@ -0,0 +1,117 @@
+/*
+ * wasm_trace.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+#ifndef WASM_TRACE_H
+#define WASM_TRACE_H
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+
+/****************************************************************************
+ * Defines
+****************************************************************************/
+#define TRACE_EVENTS_PER_THREAD     65536       // Must be a power of two
+#define TRACE_FLUSH_SIGNAL          SIGUSR1
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+typedef enum {
+    TRACE_SLICE_BEGIN,
+    TRACE_SLICE_END,
+    TRACE_INSTANTIATE_BEGIN,
+    TRACE_INSTANTIATE_END,
+    TRACE_TRAP
+} wasm_trace_event_type_t;
+
+// Fixed-size binary event, 32 bytes so two fit in a cache line
+typedef struct wasm_trace_event {
+    uint64_t timestamp_ns;      // CLOCK_MONOTONIC
+    uint64_t fuel;              // Fuel consumed during the slice (SLICE_END)
+    int32_t partition_id;
+    uint32_t thread_id;
+    uint16_t type;              // wasm_trace_event_type_t
+    uint16_t reason;            // wasm_api_result_t of the slice (SLICE_END)
+    uint32_t reserved;
+} wasm_trace_event_t;
+
+
+/****************************************************************************
+ * Globals
+****************************************************************************/
+
+// Only read on the hot path, see wasm_trace_enabled()
+extern bool g_trace_enabled;
+
+
+/****************************************************************************
+ * Function Prototypes
+****************************************************************************/
+
+/**
+ * @brief True when tracing is on. This is the only cost on the hot path when
+ *        tracing is disabled.
+ */
+static inline bool wasm_trace_enabled(void) {
+    return __builtin_expect(g_trace_enabled, 0);
+}
+
+
+/**
+ * @brief Enable tracing. Events are written to per-thread ring buffers and
+ *        dumped as Chrome trace-event JSON (readable by Perfetto) on
+ *        wasm_trace_flush(), on TRACE_FLUSH_SIGNAL or at shutdown
+ *
+ * @param out_file JSON file the trace is written to
+ * @param events_per_thread Ring buffer capacity per thread, power of two, 0 for default
+ * @return 0 when successful, else -1
+ */
+int wasm_trace_init(const char *out_file, size_t events_per_thread);
+
+
+/**
+ * @brief Record an event in the calling thread's ring buffer. Lock-free, the
+ *        oldest events are overwritten when the buffer is full
+ *
+ * @param type Event type
+ * @param partition_id Partition identifier
+ * @param reason Result code of the slice, 0 if not applicable
+ * @param fuel Fuel consumed, 0 if not applicable
+ */
+void wasm_trace_record(wasm_trace_event_type_t type, int partition_id, uint16_t reason, uint64_t fuel);
+
+
+/**
+ * @brief Flush the trace if TRACE_FLUSH_SIGNAL was received since the last call.
+ *        Meant to be called from the scheduler loop, writing JSON is not
+ *        async-signal-safe
+ */
+void wasm_trace_poll(void);
+
+
+/**
+ * @brief Write all buffered events to the output file
+ *
+ * @return 0 when successful, else -1
+ */
+int wasm_trace_flush(void);
+
+
+/**
+ * @brief Flush and disable tracing, frees all ring buffers
+ */
+void wasm_trace_shutdown(void);
+
+
+#endif // WASM_TRACE_H
@@ -0,0 +1,305 @@
+/*
+ * wasm_typed.hh
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+// Typed binding of a partition's export, TypedFunc<int32_t(int32_t)>. The
+// signature is checked once per store against the export with the traits of
+// the vendored wasmtime/func.hh, calls then skip the lookup and the check
+// and pack their values with kinds known at compile time
+
+#ifndef WASM_TYPED_HH
+#define WASM_TYPED_HH
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+extern "C" {
+#include "wasm_api.h"
+}
+// The vendored headers do not build warning free with -Wextra
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#pragma GCC diagnostic ignored "-Wpessimizing-move"
+#include <wasmtime.hh>
+#pragma GCC diagnostic pop
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+
+namespace wasm_typed {
+
+namespace detail {
+
+/****************************************************************************
+ * Native values
+****************************************************************************/
+
+// Raw and wasmtime_val_t forms of the numeric types func.hh knows
+template<typename T> struct Native {
+    static const bool valid = false;
+};
+
+#define TYPED_NATIVE(native, valkind, field)                                    \
+    template<> struct Native<native> {                                          \
+        static const bool valid = true;                                         \
+        static void store(wasmtime_val_raw_t *raw, native value) {             \
+            raw->field = value;                                                 \
+        }                                                                       \
+        static native load(const wasmtime_val_raw_t *raw) {                    \
+            return (native) raw->field;                                         \
+        }                                                                       \
+        static wasmtime_val_t val(native value) {                              \
+            wasmtime_val_t val;                                                 \
+            val.kind = valkind;                                                 \
+            val.of.field = value;                                               \
+            return val;                                                         \
+        }                                                                       \
+        static native from(const wasmtime_val_t *val) {                        \
+            return (native) val->of.field;                                      \
+        }                                                                       \
+    };
+
+TYPED_NATIVE(int32_t, WASMTIME_I32, i32)
+TYPED_NATIVE(uint32_t, WASMTIME_I32, i32)
+TYPED_NATIVE(int64_t, WASMTIME_I64, i64)
+TYPED_NATIVE(uint64_t, WASMTIME_I64, i64)
+TYPED_NATIVE(float, WASMTIME_F32, f32)
+TYPED_NATIVE(double, WASMTIME_F64, f64)
+
+#undef TYPED_NATIVE
+
+
+// Results of a signature: void, one value or a std::tuple
+template<typename R> struct Results {
+    using type = R;
+    static const bool valid = Native<R>::valid;
+
+    static R load(const wasmtime_val_raw_t *raw) {
+        return Native<R>::load(raw);
+    }
+
+    static R from(const wasmtime_val_t *vals) {
+        return Native<R>::from(vals);
+    }
+};
+
+template<> struct Results<void> {
+    using type = std::monostate;
+    static const bool valid = true;
+
+    static std::monostate load(const wasmtime_val_raw_t *) {
+        return {};
+    }
+
+    static std::monostate from(const wasmtime_val_t *) {
+        return {};
+    }
+};
+
+template<typename... T> struct Results<std::tuple<T...>> {
+    using type = std::tuple<T...>;
+    static const bool valid = (Native<T>::valid && ...);
+
+    static type load(const wasmtime_val_raw_t *raw) {
+        return load(raw, std::index_sequence_for<T...>{});
+    }
+
+    static type from(const wasmtime_val_t *vals) {
+        return from(vals, std::index_sequence_for<T...>{});
+    }
+
+private:
+    template<std::size_t... I>
+    static type load(const wasmtime_val_raw_t *raw, std::index_sequence<I...>) {
+        return type{ Native<T>::load(&raw[I])... };
+    }
+
+    template<std::size_t... I>
+    static type from(const wasmtime_val_t *vals, std::index_sequence<I...>) {
+        return type{ Native<T>::from(&vals[I])... };
+    }
+};
+
+} // namespace detail
+
+
+/****************************************************************************
+ * TypedFunc
+****************************************************************************/
+
+template<typename Signature> class TypedFunc;
+
+/**
+ * @brief Export of a loaded partition with the signature R(A...). R is void,
+ *        a numeric type or a std::tuple of them. The function handle belongs
+ *        to the partition's store. After a restart, reload or a new load of
+ *        the id the next call looks the export up again, and fails when the
+ *        new code lacks it or changed its signature
+ */
+template<typename R, typename... A>
+class TypedFunc<R(A...)> {
+public:
+    using Results = typename detail::Results<R>::type;
+
+    static_assert((detail::Native<A>::valid && ...), "Params must be i32, i64, f32 or f64 types");
+    static_assert(detail::Results<R>::valid, "Results must be i32, i64, f32 or f64 types");
+
+    /**
+     * @brief Look up an export and check it against the signature, again
+     *        only when the partition got a new store
+     *
+     * @param partition_id Partition identifier
+     * @param name Exported function
+     * @return The binding, empty when missing or of another type
+     */
+    static std::optional<TypedFunc> bind(int partition_id, const char *name) {
+        TypedFunc func(partition_id, name);
+
+        if(!func.resolve()) {
+            return std::nullopt;
+        }
+
+        return func;
+    }
+
+    /**
+     * @brief Synchronous call through wasmtime_func_call_unchecked. Runs to
+     *        completion without fuel yields and must not reach an async host
+     *        function. Fails while an async call is in flight
+     */
+    wasmtime::TrapResult<Results> call(A... args) const {
+        wasm_partition_t *partition = get_wasm_partition(partition_id_);
+        std::array<wasmtime_val_raw_t, STORAGE> storage;
+        std::size_t n = 0;
+
+        if(partition == nullptr || partition->future != nullptr) {
+            return wasmtime::TrapError(wasmtime::Trap("partition busy or not loaded"));
+        }
+        if(!resolve()) {
+            return wasmtime::TrapError(wasmtime::Trap("export missing or changed in the partition's new code"));
+        }
+
+        (detail::Native<A>::store(&storage[n++], args), ...);
+
+        // A fuel yield needs a future to suspend, none exists on this path
+        wasm_api_pause_fuel_yield(partition_id_, true);
+
+        wasm_trap_t *trap = nullptr;
+        wasmtime_error_t *error = wasmtime_func_call_unchecked(partition->context, &func_, storage.data(),
+                                                               storage.size(), &trap);
+
+        wasm_api_pause_fuel_yield(partition_id_, false);
+
+        if(error != nullptr) {
+            return wasmtime::TrapError(wasmtime::Error(error));
+        }
+        if(trap != nullptr) {
+            // Trap only adopts raw traps inside the vendored headers
+            wasm_message_t message;
+            wasm_trap_message(trap, &message);
+            std::string text(message.data, message.size > 0 ? message.size - 1 : 0);
+            wasm_byte_vec_delete(&message);
+            wasm_trap_delete(trap);
+            return wasmtime::TrapError(wasmtime::Trap(text));
+        }
+
+        return detail::Results<R>::load(storage.data());
+    }
+
+    /**
+     * @brief Start an async call, run it with wasm_api_run_partition or
+     *        co_await a wasm_coro::Executor call of the partition
+     *
+     * @return WASM_API_OK, when successful, else WASM_API_ERR
+     */
+    wasm_api_result_t start(A... args) const {
+        if(!resolve()) {
+            return WASM_API_ERR;
+        }
+
+        const wasmtime_val_t params[std::max<std::size_t>(sizeof...(A), 1)] = { detail::Native<A>::val(args)... };
+        return wasm_api_start_call(partition_id_, &func_, params, sizeof...(A), ResultList::size);
+    }
+
+    /**
+     * @brief Results of the last async call that returned PARTITION_DONE
+     */
+    Results result() const {
+        return detail::Results<R>::from(get_wasm_partition(partition_id_)->results);
+    }
+
+    int partition_id() const noexcept {
+        return partition_id_;
+    }
+
+private:
+    using ParamList = wasmtime::detail::WasmTypeList<std::tuple<A...>>;
+    using ResultList = wasmtime::detail::WasmTypeList<Results>;
+
+    static constexpr std::size_t STORAGE = std::max<std::size_t>({ sizeof...(A), ResultList::size, 1 });
+
+    int partition_id_;
+    std::string name_;
+    mutable wasmtime_func_t func_ = {};
+    mutable uint64_t store_generation_ = 0;     // Store func_ belongs to, 0 before the first lookup
+
+    TypedFunc(int partition_id, const char *name) : partition_id_(partition_id), name_(name) {}
+
+    /**
+     * @brief Look the export up and check it against the signature, unless
+     *        func_ already belongs to the partition's current store
+     *
+     * @return False when not loaded, missing or of another type
+     */
+    bool resolve() const {
+        wasm_partition_t *partition = get_wasm_partition(partition_id_);
+        wasmtime_extern_t ext;
+
+        if(partition == nullptr || !partition->instantiated) {
+            printf("Module not instantiated\n");
+            return false;
+        }
+
+        if(partition->store_generation == store_generation_) {
+            return true;
+        }
+
+        if(!wasmtime_instance_export_get(partition->context, &partition->instance, name_.data(), name_.size(), &ext)
+           || ext.kind != WASMTIME_EXTERN_FUNC) {
+            printf("Function '%s' not found or not a function\n", name_.c_str());
+            return false;
+        }
+
+        wasm_functype_t *functype = wasmtime_func_type(partition->context, &ext.of.func);
+        bool matches = ParamList::matches(wasm_functype_params(functype))
+                       && ResultList::matches(wasm_functype_results(functype));
+        wasm_functype_delete(functype);
+
+        if(!matches) {
+            printf("Function '%s' does not match the bound signature\n", name_.c_str());
+            return false;
+        }
+
+        func_ = ext.of.func;
+        store_generation_ = partition->store_generation;
+        return true;
+    }
+};
+
+} // namespace wasm_typed
+
+
+#endif // WASM_TYPED_HH
@@ -0,0 +1,779 @@
+/*
+ * wasm_uring.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+// https://kernel.dk/io_uring.pdf
+// Raw syscalls, no liburing dependency
+//
+// Guests never see host fds. host.open returns a handle into a table of the
+// partition, and paths resolve beneath the configured root directory
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#define _GNU_SOURCE
+#include "wasm_uring.h"
+#include "wasm_api.h"
+#include "wasm_host.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <linux/openat2.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+
+/****************************************************************************
+ * Defines
+****************************************************************************/
+#define URING_HANDLE_FREE       -1
+#define URING_HANDLE_OPENING    -2      // Reserved until its open completes
+#define URING_OPEN_FLAGS        (O_ACCMODE | O_CREAT | O_EXCL | O_TRUNC | O_APPEND | O_DIRECTORY | O_NOFOLLOW)
+#define URING_OPEN_MODE         0777    // No setuid, setgid or sticky files
+#define URING_CANCEL_DATA       0       // user_data of cancel SQEs, ops are never NULL
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+typedef enum {
+    URING_OPEN,
+    URING_READ,
+    URING_WRITE,
+    URING_CLOSE
+} uring_op_kind_t;
+
+// One submission, user_data of its SQE
+typedef struct uring_op {
+    wasm_host_call_t *call;
+    uring_op_kind_t kind;
+    int partition_id;
+    int handle;                 // Slot reserved by URING_OPEN
+    uint32_t guest_ptr;         // Buffer of URING_READ, recorded for replay
+    struct open_how how;        // Only for URING_OPEN
+    bool cancelled;             // Cancel submitted
+    struct uring_op *prev;      // In flight on the ring
+    struct uring_op *next;
+    char path[];                // Only for URING_OPEN, guest strings are not terminated
+} uring_op_t;
+
+// Host fds of a partition, the guest's handle is the index
+typedef struct uring_handles {
+    int fds[URING_MAX_HANDLES];
+} uring_handles_t;
+
+typedef struct uring {
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned sq_entries;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    unsigned cq_entries;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    unsigned to_submit;         // Prepared since the last io_uring_enter
+    unsigned inflight;          // SQEs without a CQE yet, cancels included
+    uring_op_t *ops;            // Operations in flight
+    struct uring *next;
+} uring_t;
+
+
+/****************************************************************************
+ * Ring state
+****************************************************************************/
+static uring_t *g_uring_rings = NULL;
+static pthread_mutex_t g_uring_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Atomic uint32_t g_uring_generation = 0;
+static _Atomic uint64_t g_uring_enters = 0;
+static _Atomic uint64_t g_uring_ops = 0;
+static int g_uring_eventfd = -1;
+static int g_uring_root = -1;                   // Directory opens resolve beneath, -1 refuses them
+static uring_handles_t *g_uring_handles[NUM_MAX_PARTITIONS];    // Under g_uring_lock
+
+static _Thread_local uring_t *t_uring = NULL;
+static _Thread_local uint32_t t_uring_generation = 0;
+
+
+/****************************************************************************
+ * Static Function Prototypes
+****************************************************************************/
+static uring_t *uring_thread_ring(void);
+static uring_t *uring_setup(unsigned entries);
+static void uring_close(uring_t *ring);
+static int uring_register_eventfd(uring_t *ring, int fd);
+static int uring_enter(uring_t *ring, unsigned min_complete);
+static size_t uring_reap(uring_t *ring);
+static struct io_uring_sqe *uring_get_sqe(uring_t *ring);
+static int uring_handle_reserve(int partition_id);
+static int uring_handle_fd(int partition_id, int handle, bool take);
+static int uring_handle_opened(int partition_id, int handle, int fd);
+static int uring_submit(void *env, wasmtime_caller_t *caller, const wasmtime_val_t *params, size_t nparams,
+                        wasm_host_call_t *call);
+
+
+/****************************************************************************
+ * Static Function Implementations
+****************************************************************************/
+
+/**
+ * @brief Map the rings of a new io_uring instance
+ */
+static uring_t *uring_setup(unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    uring_t *ring = calloc(1, sizeof(uring_t));
+    if(!ring) {
+        return NULL;
+    }
+
+    ring->fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+    if(ring->fd < 0) {
+        printf("io_uring_setup failed: %s\n", strerror(errno));
+        free(ring);
+        return NULL;
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if(params.features & IORING_FEAT_SINGLE_MMAP) {
+        if(ring->cq_ring_size > ring->sq_ring_size) {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_ring = (params.features & IORING_FEAT_SINGLE_MMAP) ? ring->sq_ring
+                  : mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+
+    if(ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        printf("Failed to map io_uring rings\n");
+        uring_close(ring);
+        return NULL;
+    }
+
+    uint8_t *sq = ring->sq_ring;
+    uint8_t *cq = ring->cq_ring;
+    ring->sq_head = (unsigned *) (sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *) (sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *) (sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *) (sq + params.sq_off.array);
+    ring->sq_entries = params.sq_entries;
+    ring->cq_head = (unsigned *) (cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *) (cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *) (cq + params.cq_off.ring_mask);
+    ring->cq_entries = params.cq_entries;
+    ring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+
+    return ring;
+}
+
+
+/**
+ * @brief Unmap and close a ring, in-flight operations must be reaped
+ */
+static void uring_close(uring_t *ring) {
+    if(ring->sqes != NULL && ring->sqes != MAP_FAILED) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if(ring->cq_ring != NULL && ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if(ring->sq_ring != NULL && ring->sq_ring != MAP_FAILED) {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    close(ring->fd);
+    free(ring);
+}
+
+
+/**
+ * @brief Let the kernel signal fd for every CQE of the ring, -1 unregisters
+ *
+ * @return 0 when successful, else -1
+ */
+static int uring_register_eventfd(uring_t *ring, int fd) {
+    int ret;
+
+    if(fd >= 0) {
+        ret = (int) syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_EVENTFD, &fd, 1);
+    } else {
+        ret = (int) syscall(__NR_io_uring_register, ring->fd, IORING_UNREGISTER_EVENTFD, NULL, 0);
+    }
+
+    if(ret < 0) {
+        printf("io_uring eventfd registration failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Ring of the calling scheduler thread, created on first use
+ */
+static uring_t *uring_thread_ring(void) {
+    uint32_t generation = atomic_load_explicit(&g_uring_generation, memory_order_acquire);
+
+    if(t_uring != NULL && t_uring_generation == generation) {
+        return t_uring;
+    }
+
+    uring_t *ring = uring_setup(URING_ENTRIES);
+    if(!ring) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&g_uring_lock);
+    ring->next = g_uring_rings;
+    g_uring_rings = ring;
+    if(g_uring_eventfd >= 0) {
+        uring_register_eventfd(ring, g_uring_eventfd);
+    }
+    pthread_mutex_unlock(&g_uring_lock);
+
+    t_uring = ring;
+    t_uring_generation = generation;
+
+    return ring;
+}
+
+
+/**
+ * @brief Submit all prepared SQEs, optionally waiting for completions
+ *
+ * @return 0 when successful, else -1
+ */
+static int uring_enter(uring_t *ring, unsigned min_complete) {
+    unsigned flags = IORING_ENTER_GETEVENTS;
+
+    for(;;) {
+        int ret = (int) syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, min_complete, flags, NULL, 0);
+        if(ret >= 0) {
+            ring->to_submit -= (unsigned) ret;
+            atomic_fetch_add_explicit(&g_uring_enters, 1, memory_order_relaxed);
+            return 0;
+        }
+        if(errno != EINTR) {
+            return -1;
+        }
+    }
+}
+
+
+/**
+ * @brief Hand completed operations to the host completion queue
+ *
+ * @return Number of completions
+ */
+static size_t uring_reap(uring_t *ring) {
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    size_t reaped = 0;
+
+    for(; head != tail; head++, ring->inflight--) {
+        struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+        if(cqe->user_data == URING_CANCEL_DATA) {
+            continue;
+        }
+
+        uring_op_t *op = (uring_op_t *) (uintptr_t) cqe->user_data;
+        int32_t res = cqe->res;
+
+        if(op->prev != NULL) {
+            op->prev->next = op->next;
+        } else {
+            ring->ops = op->next;
+        }
+        if(op->next != NULL) {
+            op->next->prev = op->prev;
+        }
+
+        if(op->kind == URING_OPEN) {
+            res = uring_handle_opened(op->partition_id, op->handle, res);
+        }
+        wasm_host_call_results(op->call)[0].of.i32 = res;
+        if(op->kind == URING_READ && cqe->res > 0) {
+            wasm_host_call_set_output(op->call, op->guest_ptr, (uint32_t) cqe->res);
+        }
+        wasm_host_complete(op->call);
+        free(op);
+        reaped++;
+    }
+
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+    return reaped;
+}
+
+
+/**
+ * @brief Next free SQE. A full ring is submitted first, more operations in
+ *        flight than the CQ holds wait for completions
+ */
+static struct io_uring_sqe *uring_get_sqe(uring_t *ring) {
+
+    if(ring->inflight >= ring->cq_entries) {
+        if(uring_enter(ring, 1) != 0) {
+            return NULL;
+        }
+        uring_reap(ring);
+    }
+
+    unsigned tail = *ring->sq_tail;
+    if(tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries) {
+        if(uring_enter(ring, 0) != 0) {
+            return NULL;
+        }
+    }
+
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+
+    return sqe;
+}
+
+
+/**
+ * @brief Reserve a handle for an open in flight
+ *
+ * @return Handle, else -errno
+ */
+static int uring_handle_reserve(int partition_id) {
+    int handle = -EMFILE;
+
+    pthread_mutex_lock(&g_uring_lock);
+    uring_handles_t *handles = g_uring_handles[partition_id];
+    if(handles == NULL && (handles = malloc(sizeof(uring_handles_t))) != NULL) {
+        for(int i = 0; i < URING_MAX_HANDLES; i++) {
+            handles->fds[i] = URING_HANDLE_FREE;
+        }
+        g_uring_handles[partition_id] = handles;
+    }
+    for(int i = 0; handles != NULL && i < URING_MAX_HANDLES; i++) {
+        if(handles->fds[i] == URING_HANDLE_FREE) {
+            handles->fds[i] = URING_HANDLE_OPENING;
+            handle = i;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_uring_lock);
+
+    return handle;
+}
+
+
+/**
+ * @brief Host fd of an open handle, take frees the handle
+ *
+ * @return fd, else -EBADF
+ */
+static int uring_handle_fd(int partition_id, int handle, bool take) {
+    int fd = -EBADF;
+
+    pthread_mutex_lock(&g_uring_lock);
+    uring_handles_t *handles = g_uring_handles[partition_id];
+    if(handles != NULL && handle >= 0 && handle < URING_MAX_HANDLES && handles->fds[handle] >= 0) {
+        fd = handles->fds[handle];
+        if(take) {
+            handles->fds[handle] = URING_HANDLE_FREE;
+        }
+    }
+    pthread_mutex_unlock(&g_uring_lock);
+
+    return fd;
+}
+
+
+/**
+ * @brief Complete a reserved handle with the result of its open. An fd whose
+ *        partition was detached meanwhile is closed again
+ *
+ * @return Handle, else -errno
+ */
+static int uring_handle_opened(int partition_id, int handle, int fd) {
+    pthread_mutex_lock(&g_uring_lock);
+    uring_handles_t *handles = g_uring_handles[partition_id];
+    bool reserved = handles != NULL && handles->fds[handle] == URING_HANDLE_OPENING;
+    if(reserved) {
+        handles->fds[handle] = fd >= 0 ? fd : URING_HANDLE_FREE;
+    }
+    pthread_mutex_unlock(&g_uring_lock);
+
+    if(fd < 0) {
+        return fd;
+    }
+    if(!reserved) {
+        close(fd);
+        return -EBADF;
+    }
+    return handle;
+}
+
+
+/**
+ * @brief Submit callback of all host I/O functions, env is the operation.
+ *        Only prepares the SQE, wasm_uring_poll submits the whole batch
+ */
+static int uring_submit(void *env, wasmtime_caller_t *caller, const wasmtime_val_t *params, size_t nparams,
+                        wasm_host_call_t *call) {
+    uring_op_kind_t kind = (uring_op_kind_t) (uintptr_t) env;
+    (void) nparams;
+
+    uring_t *ring = uring_thread_ring();
+    if(!ring) {
+        return -1;
+    }
+
+    uint32_t len = kind == URING_OPEN ? (uint32_t) params[1].of.i32 : kind == URING_CLOSE ? 0 : (uint32_t) params[2].of.i32;
+    if(kind == URING_OPEN && len >= URING_MAX_PATH) {
+        return -1;
+    }
+
+    // Refused calls complete inline with -errno
+    int partition_id = wasm_host_call_partition(call);
+    int32_t *result = &wasm_host_call_results(call)[0].of.i32;
+    int handle = -1;
+    int fd = -1;
+
+    if(kind == URING_OPEN) {
+        uint32_t flags = (uint32_t) params[2].of.i32;
+        if(g_uring_root < 0) {
+            *result = -EACCES;
+            return 1;
+        }
+        if(flags & ~(uint32_t) URING_OPEN_FLAGS) {
+            *result = -EINVAL;
+            return 1;
+        }
+    } else {
+        fd = uring_handle_fd(partition_id, params[0].of.i32, kind == URING_CLOSE);
+        if(fd < 0) {
+            *result = fd;
+            return 1;
+        }
+    }
+
+    uint8_t *buffer = NULL;
+    if(kind == URING_OPEN) {
+        buffer = wasm_host_guest_buffer(caller, (uint32_t) params[0].of.i32, len);
+    } else if(kind != URING_CLOSE) {
+        buffer = wasm_host_guest_buffer(caller, (uint32_t) params[1].of.i32, len);
+    }
+    if(kind != URING_CLOSE && buffer == NULL) {
+        return -1;
+    }
+
+    if(kind == URING_OPEN) {
+        handle = uring_handle_reserve(partition_id);
+        if(handle < 0) {
+            *result = handle;
+            return 1;
+        }
+    }
+
+    uring_op_t *op = malloc(sizeof(uring_op_t) + (kind == URING_OPEN ? len + 1 : 0));
+    if(!op) {
+        if(kind == URING_OPEN) {
+            uring_handle_opened(partition_id, handle, -ENOMEM);
+        }
+        return -1;
+    }
+    op->call = call;
+    op->kind = kind;
+    op->partition_id = partition_id;
+    op->handle = handle;
+    op->guest_ptr = kind == URING_READ ? (uint32_t) params[1].of.i32 : 0;
+    op->cancelled = false;
+
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    if(!sqe) {
+        if(kind == URING_OPEN) {
+            uring_handle_opened(partition_id, handle, -EBUSY);
+        }
+        free(op);
+        return -1;
+    }
+
+    switch(kind) {
+        case URING_OPEN:
+            // Absolute paths, .. above the root and symlinks leaving it fail with EXDEV
+            memcpy(op->path, buffer, len);
+            op->path[len] = '\0';
+            memset(&op->how, 0, sizeof(op->how));
+            op->how.flags = (uint32_t) params[2].of.i32 | O_CLOEXEC;
+            op->how.mode = (op->how.flags & O_CREAT) ? (uint32_t) params[3].of.i32 & URING_OPEN_MODE : 0;
+            op->how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+            sqe->opcode = IORING_OP_OPENAT2;
+            sqe->fd = g_uring_root;
+            sqe->addr = (uint64_t) (uintptr_t) op->path;
+            sqe->len = sizeof(op->how);
+            sqe->addr2 = (uint64_t) (uintptr_t) &op->how;
+        break;
+
+        case URING_READ:
+        case URING_WRITE:
+            // Straight into/out of linear memory, offset -1 uses the file position
+            sqe->opcode = kind == URING_READ ? IORING_OP_READ : IORING_OP_WRITE;
+            sqe->fd = fd;
+            sqe->addr = (uint64_t) (uintptr_t) buffer;
+            sqe->len = len;
+            sqe->off = (uint64_t) -1;
+        break;
+
+        case URING_CLOSE:
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = fd;
+        break;
+    }
+    sqe->user_data = (uint64_t) (uintptr_t) op;
+    op->prev = NULL;
+    op->next = ring->ops;
+    if(ring->ops != NULL) {
+        ring->ops->prev = op;
+    }
+    ring->ops = op;
+
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + 1, __ATOMIC_RELEASE);
+    ring->to_submit++;
+    ring->inflight++;
+    atomic_fetch_add_explicit(&g_uring_ops, 1, memory_order_relaxed);
+
+    return 0;
+}
+
+
+/****************************************************************************
+ * Function Implementations
+****************************************************************************/
+
+/**
+ * @brief Register the file I/O host module, linked into partitions loaded
+ *        afterwards. The guest must export its memory as "memory"
+ *
+ * @param root Directory paths of host.open resolve beneath, NULL refuses
+ *        every open
+ * @return 0 when successful, else -1
+ */
+int wasm_uring_init(const char *root) {
+    const wasm_valkind_t i32x4[] = { WASM_I32, WASM_I32, WASM_I32, WASM_I32 };
+    const wasm_valkind_t result[] = { WASM_I32 };
+
+    if(root != NULL) {
+        g_uring_root = open(root, O_PATH | O_DIRECTORY | O_CLOEXEC);
+        if(g_uring_root < 0) {
+            printf("Failed to open the host I/O root %s: %s\n", root, strerror(errno));
+            return -1;
+        }
+    }
+
+    if(wasm_host_define_submit_external("host", "open", i32x4, 4, result, 1, uring_submit, (void *) (uintptr_t) URING_OPEN) != 0
+       || wasm_host_define_submit_external("host", "read", i32x4, 3, result, 1, uring_submit, (void *) (uintptr_t) URING_READ) != 0
+       || wasm_host_define_submit_external("host", "write", i32x4, 3, result, 1, uring_submit, (void *) (uintptr_t) URING_WRITE) != 0
+       || wasm_host_define_submit_external("host", "close", i32x4, 1, result, 1, uring_submit, (void *) (uintptr_t) URING_CLOSE) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Submit everything queued on the calling thread's ring with a single
+ *        io_uring_enter and post completed operations to the host completion
+ *        queue. Called once per scheduling round
+ *
+ * @return Number of completions reaped
+ */
+size_t wasm_uring_poll(void) {
+    uring_t *ring = t_uring;
+
+    if(ring == NULL || t_uring_generation != atomic_load_explicit(&g_uring_generation, memory_order_acquire)) {
+        return 0;
+    }
+
+    // GETEVENTS also runs pending completion work when there is nothing to submit
+    if(ring->to_submit > 0 || ring->inflight > 0) {
+        uring_enter(ring, 0);
+    }
+
+    return uring_reap(ring);
+}
+
+
+/**
+ * @brief Signal an eventfd whenever a completion is posted to any ring,
+ *        -1 to stop
+ *
+ * @return 0 when successful, else -1
+ */
+int wasm_uring_set_eventfd(int fd) {
+    int rc = 0;
+
+    pthread_mutex_lock(&g_uring_lock);
+    for(uring_t *ring = g_uring_rings; ring != NULL; ring = ring->next) {
+        if(g_uring_eventfd >= 0) {
+            uring_register_eventfd(ring, -1);
+        }
+        if(fd >= 0 && uring_register_eventfd(ring, fd) != 0) {
+            rc = -1;
+        }
+    }
+    g_uring_eventfd = fd;
+    pthread_mutex_unlock(&g_uring_lock);
+
+    return rc;
+}
+
+
+/**
+ * @brief Cancel the partition's operations in flight on the calling thread's
+ *        ring and wait for their completions. Needed before a store whose
+ *        memory they target is deleted
+ */
+void wasm_uring_cancel(int partition_id) {
+    uring_t *ring = t_uring;
+
+    if(ring == NULL || t_uring_generation != atomic_load_explicit(&g_uring_generation, memory_order_acquire)) {
+        return;
+    }
+
+    // A read of a pipe without writer never completes by itself. Ops already
+    // running finish or fail with -ECANCELED, other partitions' keep going
+    bool pending = false;
+    uring_op_t *op = ring->ops;
+    while(op != NULL) {
+        if(op->partition_id != partition_id || op->cancelled) {
+            op = op->next;
+            continue;
+        }
+
+        // Reaping frees ops, the list is scanned again
+        if(ring->inflight >= ring->cq_entries) {
+            if(uring_enter(ring, 1) != 0) {
+                break;
+            }
+            uring_reap(ring);
+            op = ring->ops;
+            continue;
+        }
+
+        struct io_uring_sqe *sqe = uring_get_sqe(ring);
+        if(!sqe) {
+            break;
+        }
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = (uint64_t) (uintptr_t) op;
+        sqe->user_data = URING_CANCEL_DATA;
+        __atomic_store_n(ring->sq_tail, *ring->sq_tail + 1, __ATOMIC_RELEASE);
+        ring->to_submit++;
+        ring->inflight++;
+        op->cancelled = true;
+        op = op->next;
+    }
+
+    for(op = ring->ops; op != NULL && !pending; op = op->next) {
+        pending = op->partition_id == partition_id;
+    }
+
+    // Completions of other partitions are posted as usual
+    while(pending && uring_enter(ring, 1) == 0) {
+        uring_reap(ring);
+        pending = false;
+        for(op = ring->ops; op != NULL && !pending; op = op->next) {
+            pending = op->partition_id == partition_id;
+        }
+    }
+}
+
+
+/**
+ * @brief Close the files a partition opened, its handles become invalid.
+ *        Opens still in flight close their fd when they complete
+ */
+void wasm_uring_detach(int partition_id) {
+    pthread_mutex_lock(&g_uring_lock);
+    uring_handles_t *handles = g_uring_handles[partition_id];
+    g_uring_handles[partition_id] = NULL;
+    pthread_mutex_unlock(&g_uring_lock);
+
+    if(handles == NULL) {
+        return;
+    }
+    for(int i = 0; i < URING_MAX_HANDLES; i++) {
+        if(handles->fds[i] >= 0) {
+            close(handles->fds[i]);
+        }
+    }
+    free(handles);
+}
+
+
+/**
+ * @brief Submission statistics of all rings
+ *
+ * @param stats Output
+ */
+void wasm_uring_stats(wasm_uring_stats_t *stats) {
+    stats->enters = atomic_load_explicit(&g_uring_enters, memory_order_relaxed);
+    stats->ops = atomic_load_explicit(&g_uring_ops, memory_order_relaxed);
+}
+
+
+/**
+ * @brief Wait for in-flight operations and close all rings. Partitions must
+ *        have been unloaded
+ */
+void wasm_uring_shutdown(void) {
+
+    pthread_mutex_lock(&g_uring_lock);
+    uring_t *ring = g_uring_rings;
+    g_uring_rings = NULL;
+    atomic_fetch_add_explicit(&g_uring_generation, 1, memory_order_release);
+    pthread_mutex_unlock(&g_uring_lock);
+
+    while(ring != NULL) {
+        uring_t *next = ring->next;
+
+        // Normally cancelled when their partitions were unloaded
+        while(ring->inflight > 0 && uring_enter(ring, ring->inflight) == 0) {
+            uring_reap(ring);
+        }
+
+        uring_close(ring);
+        ring = next;
+    }
+
+    for(int id = 0; id < NUM_MAX_PARTITIONS; id++) {
+        wasm_uring_detach(id);
+    }
+    if(g_uring_root >= 0) {
+        close(g_uring_root);
+        g_uring_root = -1;
+    }
+}
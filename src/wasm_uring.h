@@ -0,0 +1,111 @@
+/*
+ * wasm_uring.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: tdhoang
+ */
+
+#ifndef WASM_URING_H
+#define WASM_URING_H
+
+/****************************************************************************
+ * Includes
+****************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/****************************************************************************
+ * Defines
+****************************************************************************/
+#define URING_ENTRIES       256         // Submission queue size per scheduler thread
+#define URING_MAX_PATH      4096
+#define URING_MAX_HANDLES   64          // Files a partition has open at a time
+
+
+/****************************************************************************
+ * Structs
+****************************************************************************/
+
+typedef struct wasm_uring_stats {
+    uint64_t enters;                // io_uring_enter calls
+    uint64_t ops;                   // Operations submitted, ops / enters is the batch size
+} wasm_uring_stats_t;
+
+
+/****************************************************************************
+ * Function Prototypes
+****************************************************************************/
+
+/**
+ * @brief Register the file I/O host module, linked into partitions loaded
+ *        afterwards. The guest must export its memory as "memory":
+ *
+ *          host.open(path_ptr: i32, path_len: i32, flags: i32, mode: i32) -> handle or -errno
+ *          host.read(handle: i32, buf_ptr: i32, len: i32) -> bytes or -errno
+ *          host.write(handle: i32, buf_ptr: i32, len: i32) -> bytes or -errno
+ *          host.close(handle: i32) -> 0 or -errno
+ *
+ *        Handles index a table of the partition, a handle it did not open
+ *        fails with -EBADF. Paths resolve beneath root, flags other than
+ *        the access mode, O_CREAT, O_EXCL, O_TRUNC, O_APPEND, O_DIRECTORY
+ *        and O_NOFOLLOW fail with -EINVAL
+ *
+ * @param root Directory paths of host.open resolve beneath, NULL refuses
+ *        every open
+ * @return 0 when successful, else -1
+ */
+int wasm_uring_init(const char *root);
+
+
+/**
+ * @brief Submit everything queued on the calling thread's ring with a single
+ *        io_uring_enter and post completed operations to the host completion
+ *        queue. Called once per scheduling round
+ *
+ * @return Number of completions reaped
+ */
+size_t wasm_uring_poll(void);
+
+
+/**
+ * @brief Signal an eventfd whenever a completion is posted to any ring,
+ *        -1 to stop
+ *
+ * @return 0 when successful, else -1
+ */
+int wasm_uring_set_eventfd(int fd);
+
+
+/**
+ * @brief Cancel the partition's operations in flight on the calling thread's
+ *        ring and wait for their completions. Needed before a store whose
+ *        memory they target is deleted
+ */
+void wasm_uring_cancel(int partition_id);
+
+
+/**
+ * @brief Close the files a partition opened, its handles become invalid.
+ *        Opens still in flight close their fd when they complete
+ */
+void wasm_uring_detach(int partition_id);
+
+
+/**
+ * @brief Submission statistics of all rings
+ *
+ * @param stats Output
+ */
+void wasm_uring_stats(wasm_uring_stats_t *stats);
+
+
+/**
+ * @brief Wait for in-flight operations and close all rings. Partitions must
+ *        have been unloaded
+ */
+void wasm_uring_shutdown(void);
+
+
+#endif // WASM_URING_H
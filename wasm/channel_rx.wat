@@ -0,0 +1,58 @@
+(module
+  ;; Receives n messages from the channel "bulk" and reads every payload byte.
+  ;; Returns the messages received, or -1 - seq for a corrupted message
+  (import "channel" "bulk" (memory $shm 1 65536 shared))
+  (import "channel" "id" (func $id (param i32 i32) (result i32)))
+  (import "channel" "wait" (func $wait (param i32 i32 i32) (result i32)))
+  (import "channel" "notify" (func $notify (param i32) (result i32)))
+  (memory $own (export "memory") 1)
+  (data (memory $own) (i32.const 0) "bulk")
+  (func $main (param $n i32) (result i32)
+    (local $ch i32)
+    (local $slots i32)
+    (local $size i32)
+    (local $head i32)
+    (local $slot i32)
+    (local $p i32)
+    (local $end i32)
+    (local $sum i64)
+    (local.set $ch (call $id (i32.const 0) (i32.const 4)))
+    (if (i32.lt_s (local.get $ch) (i32.const 0)) (then (return (local.get $ch))))
+    (local.set $slots (i32.atomic.load $shm (i32.const 192)))
+    (local.set $size (i32.atomic.load $shm (i32.const 196)))
+    (local.set $head (i32.atomic.load $shm (i32.const 0)))
+    (loop $messages
+      ;; Park while the ring is empty
+      (loop $empty
+        (if (i32.eq (i32.atomic.load $shm (i32.const 64)) (local.get $head))
+          (then
+            (drop (call $wait (local.get $ch) (i32.const 64) (local.get $head)))
+            (br $empty)))
+      )
+      (local.set $slot (i32.add (i32.const 256)
+        (i32.mul (i32.and (local.get $head) (i32.sub (local.get $slots) (i32.const 1))) (local.get $size))))
+      (local.set $p (i32.add (local.get $slot) (i32.const 8)))
+      (local.set $end (i32.add (local.get $p) (i32.load $shm (local.get $slot))))
+      (local.set $sum (i64.const 0))
+      (loop $bytes
+        (local.set $sum (i64.add (local.get $sum) (i64.load $shm (local.get $p))))
+        (local.set $p (i32.add (local.get $p) (i32.const 8)))
+        (br_if $bytes (i32.lt_u (local.get $p) (local.get $end)))
+      )
+      ;; Every byte holds the low byte of the sequence number, so the low byte
+      ;; of the sum is that byte times the number of words
+      (if (i64.ne (i64.and (local.get $sum) (i64.const 0xff))
+                  (i64.and (i64.mul (i64.extend_i32_u (i32.and (local.get $head) (i32.const 0xff)))
+                                    (i64.extend_i32_u (i32.shr_u (i32.sub (local.get $end) (i32.add (local.get $slot) (i32.const 8))) (i32.const 3))))
+                           (i64.const 0xff)))
+        (then (return (i32.sub (i32.const -1) (local.get $head)))))
+      (local.set $head (i32.add (local.get $head) (i32.const 1)))
+      (i32.atomic.store $shm (i32.const 0) (local.get $head))
+      (if (i32.atomic.load $shm (i32.const 128)) (then (drop (call $notify (local.get $ch)))))
+      (local.set $n (i32.sub (local.get $n) (i32.const 1)))
+      (br_if $messages (i32.gt_s (local.get $n) (i32.const 0)))
+    )
+    (local.get $head)
+  )
+  (export "main" (func $main))
+)
@@ -0,0 +1,44 @@
+(module
+  ;; Sends n messages over the channel "bulk", each fills a whole slot with the
+  ;; low byte of its sequence number. Returns the messages sent
+  (import "channel" "bulk" (memory $shm 1 65536 shared))
+  (import "channel" "id" (func $id (param i32 i32) (result i32)))
+  (import "channel" "wait" (func $wait (param i32 i32 i32) (result i32)))
+  (import "channel" "notify" (func $notify (param i32) (result i32)))
+  (memory $own (export "memory") 1)
+  (data (memory $own) (i32.const 0) "bulk")
+  (func $main (param $n i32) (result i32)
+    (local $ch i32)
+    (local $slots i32)
+    (local $size i32)
+    (local $tail i32)
+    (local $head i32)
+    (local $slot i32)
+    (local.set $ch (call $id (i32.const 0) (i32.const 4)))
+    (if (i32.lt_s (local.get $ch) (i32.const 0)) (then (return (local.get $ch))))
+    (local.set $slots (i32.atomic.load $shm (i32.const 192)))
+    (local.set $size (i32.atomic.load $shm (i32.const 196)))
+    (local.set $tail (i32.atomic.load $shm (i32.const 64)))
+    (loop $messages
+      ;; Park while the ring is full
+      (loop $full
+        (local.set $head (i32.atomic.load $shm (i32.const 0)))
+        (if (i32.ge_u (i32.sub (local.get $tail) (local.get $head)) (local.get $slots))
+          (then
+            (drop (call $wait (local.get $ch) (i32.const 0) (local.get $head)))
+            (br $full)))
+      )
+      (local.set $slot (i32.add (i32.const 256)
+        (i32.mul (i32.and (local.get $tail) (i32.sub (local.get $slots) (i32.const 1))) (local.get $size))))
+      (i32.store $shm (local.get $slot) (i32.sub (local.get $size) (i32.const 8)))
+      (memory.fill $shm (i32.add (local.get $slot) (i32.const 8)) (local.get $tail) (i32.sub (local.get $size) (i32.const 8)))
+      (local.set $tail (i32.add (local.get $tail) (i32.const 1)))
+      (i32.atomic.store $shm (i32.const 64) (local.get $tail))
+      (if (i32.atomic.load $shm (i32.const 128)) (then (drop (call $notify (local.get $ch)))))
+      (local.set $n (i32.sub (local.get $n) (i32.const 1)))
+      (br_if $messages (i32.gt_s (local.get $n) (i32.const 0)))
+    )
+    (local.get $tail)
+  )
+  (export "main" (func $main))
+)
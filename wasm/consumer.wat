@@ -0,0 +1,24 @@
+(module
+  ;; Receives n messages from the queuing port "pipe", returns the sum of the numbers
+  (import "port" "id" (func $id (param i32 i32) (result i32)))
+  (import "port" "receive" (func $receive (param i32 i32 i32) (result i32)))
+  (memory (export "memory") 1)
+  (data (i32.const 0) "pipe")
+  (func $main (param $n i32) (result i32)
+    (local $port i32)
+    (local $i i32)
+    (local $sum i32)
+    (local $len i32)
+    (local.set $port (call $id (i32.const 0) (i32.const 4)))
+    (if (i32.lt_s (local.get $port) (i32.const 0)) (then (return (local.get $port))))
+    (loop $messages
+      (local.set $len (call $receive (local.get $port) (i32.const 64) (i32.const 64)))
+      (if (i32.lt_s (local.get $len) (i32.const 0)) (then (return (local.get $len))))
+      (local.set $sum (i32.add (local.get $sum) (i32.load (i32.const 64))))
+      (local.set $i (i32.add (local.get $i) (i32.const 1)))
+      (br_if $messages (i32.lt_s (local.get $i) (local.get $n)))
+    )
+    (local.get $sum)
+  )
+  (export "main" (func $main))
+)
@@ -0,0 +1,12 @@
+(module
+  ;; Counts to $n in its memory, then traps. A restart starts with a zeroed counter
+  (memory (export "memory") 1)
+  (func $main (param $n i32) (result i32)
+    (loop $count
+      (i32.store (i32.const 0) (i32.add (i32.load (i32.const 0)) (i32.const 1)))
+      (br_if $count (i32.lt_s (i32.load (i32.const 0)) (local.get $n)))
+    )
+    unreachable
+  )
+  (export "main" (func $main))
+)
@@ -0,0 +1,14 @@
+(module
+  ;; Grows memory one page at a time, traps when memory.grow fails
+  (memory (export "memory") 1)
+  (func $main (param $pages i32) (result i32)
+    (loop $grow
+      (if (i32.eq (memory.grow (i32.const 1)) (i32.const -1))
+        (then unreachable)
+      )
+      (br_if $grow (i32.lt_u (memory.size) (local.get $pages)))
+    )
+    (memory.size)
+  )
+  (export "main" (func $main))
+)
@@ -0,0 +1,30 @@
+(module
+  ;; Reads README.md n times through the host I/O module, returns the bytes read
+  ;; or the negative errno of the failed call
+  (import "host" "open" (func $open (param i32 i32 i32 i32) (result i32)))
+  (import "host" "read" (func $read (param i32 i32 i32) (result i32)))
+  (import "host" "close" (func $close (param i32) (result i32)))
+  (memory (export "memory") 1)
+  (data (i32.const 0) "README.md")
+  (func $main (param $n i32) (result i32)
+    (local $i i32)
+    (local $fd i32)
+    (local $got i32)
+    (local $total i32)
+    (loop $passes
+      (local.set $fd (call $open (i32.const 0) (i32.const 9) (i32.const 0) (i32.const 0)))
+      (if (i32.lt_s (local.get $fd) (i32.const 0)) (then (return (local.get $fd))))
+      (loop $chunks
+        (local.set $got (call $read (local.get $fd) (i32.const 1024) (i32.const 4096)))
+        (if (i32.lt_s (local.get $got) (i32.const 0)) (then (return (local.get $got))))
+        (local.set $total (i32.add (local.get $total) (local.get $got)))
+        (br_if $chunks (i32.gt_s (local.get $got) (i32.const 0)))
+      )
+      (drop (call $close (local.get $fd)))
+      (local.set $i (i32.add (local.get $i) (i32.const 1)))
+      (br_if $passes (i32.lt_s (local.get $i) (local.get $n)))
+    )
+    (local.get $total)
+  )
+  (export "main" (func $main))
+)
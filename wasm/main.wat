@@ -1,4 +1,5 @@
 (module
+  (memory 1)
   (func (export "main")
     (local $i i32)
     (local.set $i (i32.const 0))
@@ -0,0 +1,30 @@
+(module
+  ;; 16 MiB buffer, larger than typical L2/L3 slices
+  (memory 256)
+  (func $main (param $passes i32) (result i32)
+    (local $pass i32)
+    (local $addr i32)
+    (local $sum i32)
+    (local.set $pass (i32.const 0))
+    (loop $passes_loop
+      ;; Write pass, one store per cache line
+      (local.set $addr (i32.const 0))
+      (loop $write
+        (i32.store (local.get $addr) (i32.add (local.get $addr) (local.get $pass)))
+        (local.set $addr (i32.add (local.get $addr) (i32.const 64)))
+        (br_if $write (i32.lt_u (local.get $addr) (i32.const 16777216)))
+      )
+      ;; Read pass, summing every cache line
+      (local.set $addr (i32.const 0))
+      (loop $read
+        (local.set $sum (i32.add (local.get $sum) (i32.load (local.get $addr))))
+        (local.set $addr (i32.add (local.get $addr) (i32.const 64)))
+        (br_if $read (i32.lt_u (local.get $addr) (i32.const 16777216)))
+      )
+      (local.set $pass (i32.add (local.get $pass) (i32.const 1)))
+      (br_if $passes_loop (i32.lt_s (local.get $pass) (local.get $passes)))
+    )
+    (local.get $sum)
+  )
+  (export "main" (func $main))
+)
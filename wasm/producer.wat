@@ -0,0 +1,21 @@
+(module
+  ;; Sends the numbers 1..n over the queuing port "pipe", returns the messages sent
+  (import "port" "id" (func $id (param i32 i32) (result i32)))
+  (import "port" "send" (func $send (param i32 i32 i32) (result i32)))
+  (memory (export "memory") 1)
+  (data (i32.const 0) "pipe")
+  (func $main (param $n i32) (result i32)
+    (local $port i32)
+    (local $i i32)
+    (local.set $port (call $id (i32.const 0) (i32.const 4)))
+    (if (i32.lt_s (local.get $port) (i32.const 0)) (then (return (local.get $port))))
+    (loop $messages
+      (local.set $i (i32.add (local.get $i) (i32.const 1)))
+      (i32.store (i32.const 64) (local.get $i))
+      (drop (call $send (local.get $port) (i32.const 64) (i32.const 4)))
+      (br_if $messages (i32.lt_s (local.get $i) (local.get $n)))
+    )
+    (local.get $i)
+  )
+  (export "main" (func $main))
+)
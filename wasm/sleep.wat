@@ -0,0 +1,14 @@
+(module
+  ;; Calls the async host function host.sleep_ms n times, returns the calls made
+  (import "host" "sleep_ms" (func $sleep_ms (param i32) (result i32)))
+  (func $main (param $n i32) (result i32)
+    (local $i i32)
+    (loop $calls
+      (drop (call $sleep_ms (i32.const 100)))
+      (local.set $i (i32.add (local.get $i) (i32.const 1)))
+      (br_if $calls (i32.lt_s (local.get $i) (local.get $n)))
+    )
+    (local.get $i)
+  )
+  (export "main" (func $main))
+)